@@ -1,14 +1,15 @@
 #include "AssImpMesh.h"
+#include "TextureState.h"
+#include "TextureCache.h"
+#include "MeshOptimizer.h"
 
 using namespace std;
 
 /*  Functions  */
 // Constructor
-AssImpMesh::AssImpMesh(QOpenGLShaderProgram* shader, QString name, vector<Vertex> vertices, vector<unsigned int> indices, vector<Texture> textures, GLMaterial material) : TriangleMesh(shader, "AssImpMesh")
+AssImpMesh::AssImpMesh(QOpenGLShaderProgram* shader, QString name, MeshGeometry&& geometry, const vector<Texture>& textures, const GLMaterial& material) : TriangleMesh(shader, "AssImpMesh")
 {
 	setAutoIncrName(name);
-	_vertices = vertices;
-	_indices = indices;
 	_textures = textures;
 	/*for (Texture t : _textures)
 	{
@@ -17,24 +18,40 @@ AssImpMesh::AssImpMesh(QOpenGLShaderProgram* shader, QString name, vector<Vertex
 
 	_material = material;
 	// Now that we have all the required data, set the vertex buffers and its attribute pointers.
-	setupMesh();
+	setupMesh(geometry);
+}
+
+AssImpMesh::AssImpMesh(QOpenGLShaderProgram* shader, QString name, const std::shared_ptr<Geometry>& geometry, const vector<Texture>& textures, const GLMaterial& material) : TriangleMesh(shader, "AssImpMesh")
+{
+	setAutoIncrName(name);
+	_textures = textures;
+	_material = material;
+	setupMaps();
+	shareGeometry(geometry);
+	computeBounds();
 }
 
 AssImpMesh::~AssImpMesh()
 {
 	if (_textures.size())
 	{
-		for (const Texture &t : _textures)
+		for (Texture &t : _textures)
 		{
 			//std::cout << "AssImpMesh::~AssImpMesh : texture = " << t.id << std::endl;
-			glDeleteTextures(1, &t.id);
+			TextureCache::instance().release(t.id);
 		}
 	}
 }
 
 TriangleMesh* AssImpMesh::clone()
 {
-	return new AssImpMesh(_prog, _name, _vertices, _indices, _textures, _material);
+	// the clone releases its textures on its own
+	for (const Texture& t : _textures)
+		TextureCache::instance().retain(t.id);
+	// the clone draws from the same buffers
+	AssImpMesh* mesh = new AssImpMesh(_prog, _name, _geometry, _textures, _material);
+	mesh->setBaseTransformation(_baseTransformation);
+	return mesh;
 }
 
 void AssImpMesh::render()
@@ -104,12 +121,11 @@ void AssImpMesh::render()
 
 		if (hasTexture)
 		{
-			glActiveTexture(GL_TEXTURE10 + i); // Active proper texture unit before binding
 			// Now set the sampler to the correct texture unit
 			_prog->bind();
 			_prog->setUniformValue((name + number).c_str(), i);
 			// And finally bind the texture
-			glBindTexture(GL_TEXTURE_2D, _textures[i].id);
+			TextureState::instance().bind(10 + i, _textures[i].id);
 		}
 	}
 	// PBR from ADS
@@ -149,12 +165,11 @@ void AssImpMesh::render()
 		number = ss.str();
 		if (hasTexture)
 		{
-			glActiveTexture(GL_TEXTURE20 + i); // Active proper texture unit before binding
 			// Now set the sampler to the correct texture unit
 			_prog->bind();
 			_prog->setUniformValue((name + number).c_str(), i);
 			// And finally bind the texture
-			glBindTexture(GL_TEXTURE_2D, _textures[i].id);
+			TextureState::instance().bind(20 + i, _textures[i].id);
 		}
 	}
 	// PBR from model
@@ -194,12 +209,11 @@ void AssImpMesh::render()
 		number = ss.str();
 		if (hasTexture)
 		{
-			glActiveTexture(GL_TEXTURE20 + i); // Active proper texture unit before binding
 			// Now set the sampler to the correct texture unit
 			_prog->bind();
 			_prog->setUniformValue((name + number).c_str(), i);
 			// And finally bind the texture
-			glBindTexture(GL_TEXTURE_2D, _textures[i].id);
+			TextureState::instance().bind(20 + i, _textures[i].id);
 		}
 	}
 
@@ -215,11 +229,8 @@ void AssImpMesh::render()
 		glDisable(GL_BLEND);
 	}
 
-	// Handle lighting normal for negative scaling
-	if ((_scaleX < 0 && _scaleY > 0 && _scaleZ > 0) ||
-		(_scaleX > 0 && _scaleY < 0 && _scaleZ > 0) ||
-		(_scaleX > 0 && _scaleY > 0 && _scaleZ < 0) ||
-		(_scaleX < 0 && _scaleY < 0 && _scaleZ < 0))
+	// Handle lighting normal for mirroring transformations
+	if (_transformation.determinant() < 0.0)
 	{
 		glFrontFace(GL_CW);
 	}
@@ -228,50 +239,32 @@ void AssImpMesh::render()
 		glFrontFace(GL_CCW);
 	}
 	_vertexArrayObject.bind();
-	glDrawElements(GL_TRIANGLES, _nVerts, GL_UNSIGNED_INT, 0);
+	glDrawElements(GL_TRIANGLES, getLodIndexCount(_lodLevel), _geometry->indexType, getLodIndexPointer(_lodLevel));
 	_vertexArrayObject.release();
 	_prog->release();
 	glDisable(GL_BLEND);
-
-	// Always good practice to set everything back to defaults once configured.
-	for (unsigned int i = 0; i < _textures.size(); i++)
-	{
-		glActiveTexture(GL_TEXTURE10 + i);
-		glBindTexture(GL_TEXTURE_2D, 0);
-	}
 }
 
 /*  Functions    */
 // Initializes all the buffer objects/arrays
-void AssImpMesh::setupMesh()
+void AssImpMesh::setupMesh(MeshGeometry& geometry)
 {
-	std::vector<float> points;
-	std::vector<float> normals;
-	std::vector<float> texCoords;
-	std::vector<float> tangents;
-	std::vector<float> bitangents;
+	setupMaps();
 
-	for (const Vertex& v : _vertices)
+	if (geometry.optimized)
 	{
-		points.push_back(v.Position.x);
-		points.push_back(v.Position.y);
-		points.push_back(v.Position.z);
-
-		normals.push_back(v.Normal.x);
-		normals.push_back(v.Normal.y);
-		normals.push_back(v.Normal.z);
-
-		texCoords.push_back(v.TexCoords.x);
-		texCoords.push_back(v.TexCoords.y);
-
-		tangents.push_back(v.Tangent.x);
-		tangents.push_back(v.Tangent.y);
-		tangents.push_back(v.Tangent.z);
-		bitangents.push_back(v.Bitangent.x);
-		bitangents.push_back(v.Bitangent.y);
-		bitangents.push_back(v.Bitangent.z);
+		_preparedOptimization = true;
+		_geometry->acmrBefore = geometry.acmrBefore;
+		_geometry->acmrAfter = geometry.acmrAfter;
 	}
+	_preparedVertices = std::move(geometry.compactVertices);
+	initBuffers(std::move(geometry.indices), std::move(geometry.points), std::move(geometry.normals),
+		std::move(geometry.texCoords), std::move(geometry.tangents), std::move(geometry.bitangents));
+	computeBounds();
+}
 
+void AssImpMesh::setupMaps()
+{
 	_hasTexture = false;
 
 	for (unsigned int i = 0; i < _textures.size(); i++)
@@ -330,7 +323,20 @@ void AssImpMesh::setupMesh()
 			_hasAOPBRMap = true;
 		}
 	}
+}
 
-	initBuffers(&_indices, &points, &normals, &texCoords, &tangents, &bitangents);
-	computeBounds();
+void AssImpMesh::prepareGeometry(MeshGeometry& geometry)
+{
+	if (!geometry.optimized)
+	{
+		geometry.acmrBefore = geometry.acmrAfter = MeshOptimizer::computeACMR(geometry.indices, geometry.points.size() / 3);
+		if (meshOptimization())
+		{
+			optimizeGeometry(geometry.indices, geometry.points, geometry.normals, geometry.texCoords, geometry.tangents, geometry.bitangents);
+			geometry.acmrAfter = MeshOptimizer::computeACMR(geometry.indices, geometry.points.size() / 3);
+		}
+		geometry.optimized = true;
+	}
+	if (compactVertexFormat() && geometry.compactVertices.data.empty())
+		geometry.compactVertices = packCompactVertices(geometry.points, geometry.normals, geometry.texCoords, geometry.tangents, geometry.bitangents);
 }
\ No newline at end of file
@@ -11,23 +11,27 @@
 #include <assimp/Importer.hpp>
 #include <assimp/scene.h>
 #include <assimp/postprocess.h>
+#include <QImage>
 #include "TriangleMesh.h"
 #include "GLMaterial.h"
 
 using namespace std;
 
-struct Vertex
+// Vertex attributes in the layout they are uploaded in, one array per attribute
+struct MeshGeometry
 {
-	// Position
-	glm::vec3 Position;
-	// Normal
-	glm::vec3 Normal;
-	// TexCoords
-	glm::vec2 TexCoords;
-	// tangent
-	glm::vec3 Tangent;
-	// bitangent
-	glm::vec3 Bitangent;
+	vector<unsigned int> indices;
+	vector<float> points;
+	vector<float> normals;
+	vector<float> texCoords;
+	vector<float> tangents;
+	vector<float> bitangents;
+
+	// Filled by AssImpMesh::prepareGeometry on the loading thread
+	bool optimized = false;
+	float acmrBefore = 0.0f;
+	float acmrAfter = 0.0f;
+	TriangleMesh::CompactVertices compactVertices;
 };
 
 struct Texture
@@ -35,6 +39,9 @@ struct Texture
 	unsigned int id;
 	string type;
 	aiString path;
+	// images embedded in the model file, decoded in GL format on the loading thread
+	QImage image;
+	QByteArray contentHash;
 };
 
 class AssImpMesh : public TriangleMesh
@@ -42,20 +49,26 @@ class AssImpMesh : public TriangleMesh
 public:
 
 	/*  Functions  */
-	// Constructor
-	AssImpMesh(QOpenGLShaderProgram* shader, QString name, vector<Vertex> vertices, vector<unsigned int> indices, vector<Texture> textures, GLMaterial material);
+	// Constructor, the geometry is moved into the mesh
+	AssImpMesh(QOpenGLShaderProgram* shader, QString name, MeshGeometry&& geometry, const vector<Texture>& textures, const GLMaterial& material);
+	// Constructor for another placement of geometry uploaded by a mesh, its buffers are shared
+	AssImpMesh(QOpenGLShaderProgram* shader, QString name, const std::shared_ptr<Geometry>& geometry, const vector<Texture>& textures, const GLMaterial& material);
 	~AssImpMesh();
+	// Reorder and pack the geometry the way the mesh would on creation, so the GL thread
+	// only uploads it. Geometry prepared before is left as it is. Needs no context, runs
+	// on the loading thread
+	static void prepareGeometry(MeshGeometry& geometry);
 	virtual TriangleMesh* clone();
 	void render();
 
 private:
 	/*  Functions    */
 	// Initializes all the buffer objects/arrays
-	void setupMesh();
+	void setupMesh(MeshGeometry& geometry);
+	// Enable the maps of the textures
+	void setupMaps();
 
 private:
 	/*  Mesh Data  */
-	vector<Vertex> _vertices;
-	vector<unsigned int> _indices;
 	vector<Texture> _textures;
 };
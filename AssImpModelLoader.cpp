@@ -1,7 +1,19 @@
 #include "AssImpModelLoader.h"
+#include "TextureCache.h"
+#include "MemoryUsage.h"
+#include "ModelCache.h"
+#include "MeshFileReader.h"
+#include "GltfReader.h"
+
+#include <QtConcurrent>
+#include <QThread>
+#include <algorithm>
 
 using namespace std;
 
+// Normals are smoothed across edges up to this angle in degrees, by Assimp and the native readers
+constexpr float SMOOTHING_ANGLE = 15.0f;
+
 bool AssImpModelProgressHandler::Update(float percentage)
 {
 	emit fileReadProcessed(percentage);
@@ -14,13 +26,17 @@ AssImpModelLoader::AssImpModelLoader(QOpenGLShaderProgram* prog) : QObject(), _p
 {
 	initializeOpenGLFunctions();
 	_loadingCancelled = false;
+	_sceneResidentBytes = 0;
 	_progHandler = new AssImpModelProgressHandler();
 	_importer.SetProgressHandler(_progHandler);
 	connect(_progHandler, SIGNAL(fileReadProcessed(float)), this, SLOT(processFileReadProgress(float)));
+	connect(&_watcher, SIGNAL(finished()), this, SIGNAL(loadingFinished()));
 }
 
 AssImpModelLoader::~AssImpModelLoader()
 {
+	cancelLoading();
+	waitForFinished();
 	disconnect(_progHandler, SIGNAL(fileReadProcessed(float)), this, SLOT(processFileReadProgress(float)));
 	//delete _progHandler; // causes crash
 	_progHandler = nullptr;
@@ -34,23 +50,175 @@ void AssImpModelLoader::processFileReadProgress(float percentage)
 void AssImpModelLoader::cancelLoading()
 {
 	_loadingCancelled = true;
+	// meshes not uploaded yet are dropped, the ones already displayed are kept
+	QMutexLocker locker(&_meshPacketsMutex);
+	_meshPackets.clear();
+}
+
+void AssImpModelLoader::loadModelAsync(string path)
+{
+	waitForFinished();
+	_loadingCancelled = false;
+	_watcher.setFuture(QtConcurrent::run([this, path]() { loadModel(path); }));
+}
+
+bool AssImpModelLoader::isLoading() const
+{
+	return _watcher.isRunning();
+}
+
+void AssImpModelLoader::waitForFinished()
+{
+	_watcher.waitForFinished();
+}
+
+bool AssImpModelLoader::takeMeshPacket(MeshPacket& packet)
+{
+	QMutexLocker locker(&_meshPacketsMutex);
+	if (_meshPackets.empty())
+		return false;
+	packet = std::move(_meshPackets.front());
+	_meshPackets.pop_front();
+	return true;
 }
 
-vector<AssImpMesh*> AssImpModelLoader::getMeshes() const
+bool AssImpModelLoader::hasMeshPackets() const
 {
-	return _meshes;
+	QMutexLocker locker(&_meshPacketsMutex);
+	return !_meshPackets.empty();
+}
+
+AssImpMesh* AssImpModelLoader::createMesh(MeshPacket& packet)
+{
+	// Every mesh holds its own reference, the texture is deleted with the last mesh using it
+	vector<Texture> textures;
+	for (Texture& texture : packet.textures)
+	{
+		if (!texture.image.isNull())
+			texture.id = TextureCache::instance().acquire(texture.contentHash, texture.image);
+		else
+			texture.id = TextureCache::instance().acquire(QString::fromStdString(this->directory + '/' + texture.path.C_Str()));
+		// the decoded image is not needed once uploaded
+		texture.image = QImage();
+		// a map that failed to load is drawn white, as it was before the cache
+		if (texture.id == 0)
+			texture.id = TextureCache::instance().acquirePlaceholder();
+		if (texture.id != 0)
+			textures.push_back(texture);
+	}
+	AssImpMesh* mesh = nullptr;
+	if (!packet.sharedGeometry)
+		mesh = new AssImpMesh(_prog, packet.name, std::move(packet.geometry), textures, packet.material);
+	else if (std::shared_ptr<TriangleMesh::Geometry> uploaded = packet.sharedGeometry->uploaded.lock())
+		mesh = new AssImpMesh(_prog, packet.name, uploaded, textures, packet.material);
+	else
+	{
+		// the packets still queued keep the geometry, unless this is the last of them
+		MeshGeometry geometry = packet.sharedGeometry.use_count() == 1 ? std::move(packet.sharedGeometry->geometry) : packet.sharedGeometry->geometry;
+		mesh = new AssImpMesh(_prog, packet.name, std::move(geometry), textures, packet.material);
+		packet.sharedGeometry->uploaded = mesh->getGeometry();
+	}
+	packet.sharedGeometry.reset();
+	if (!packet.transformation.isIdentity())
+		mesh->setBaseTransformation(packet.transformation);
+	return mesh;
 }
 
 /*  Functions   */
-// Loads a model with supported ASSIMP extensions from file and stores the resulting meshes in the meshes vector.
+// Loads a model with supported ASSIMP extensions from file and queues the converted meshes.
 void AssImpModelLoader::loadModel(string path)
 {
-	_loadingCancelled = false;
 	_path = std::string(path);
-	_meshes.clear();
-	_loadedTextures.clear();
+	_errorMessage.clear();
+	_sceneResidentBytes = 0;
+	{
+		QMutexLocker locker(&_meshPacketsMutex);
+		_meshPackets.clear();
+	}
+	// Retrieve the directory path of the filepath
+	this->directory = path.substr(0, path.find_last_of('/'));
+
+	const QString sourcePath = QString::fromStdString(path);
+	bool queueStopped = false;
+	auto queueMesh = [this, &queueStopped](MeshPacket&& packet) {
+		if (!packet.sharedGeometry)
+			AssImpMesh::prepareGeometry(packet.geometry);
+		QMutexLocker locker(&_meshPacketsMutex);
+		if (_loadingCancelled)
+		{
+			queueStopped = true;
+			return false;
+		}
+		_meshPackets.push_back(std::move(packet));
+		return true;
+	};
+
+	// glTF buffers are read from the mapped file at disk speed, without ASSIMP or the model cache
+	if (GltfReader::canRead(sourcePath))
+	{
+		// conversion progress in whole percents, the reader stops converting on a cancel
+		auto conversionProgress = [this](int converted, int total) {
+			if (_loadingCancelled)
+				return false;
+			if (converted * 100 / total != (converted - 1) * 100 / total)
+				emit nodeProcessed(converted, total);
+			return true;
+		};
+		QString readerError;
+		if (GltfReader::read(sourcePath, queueMesh, conversionProgress, readerError))
+		{
+			_sceneResidentBytes = MemoryUsage::residentBytes();
+			if (queueStopped || _loadingCancelled)
+				emit loadingCancelled();
+			else
+				emit nodeProcessed(1, 1);
+			return;
+		}
+		cout << "GltfReader : " << readerError.toStdString() << ", importing with ASSIMP" << endl;
+	}
+
+	// An unchanged file imported before is read from the model cache, without ASSIMP
+	if (ModelCache::instance().load(sourcePath, queueMesh))
+	{
+		if (queueStopped)
+			emit loadingCancelled();
+		else
+			emit nodeProcessed(1, 1);
+		return;
+	}
+
+	// STL, OBJ and PLY geometry is read by the native readers, ASSIMP stays the fallback
+	// for the variants they leave out
+	if (MeshFileReader::canRead(sourcePath))
+	{
+		MeshPacket packet;
+		QString readerError;
+		if (MeshFileReader::read(sourcePath, packet.geometry, SMOOTHING_ANGLE, readerError))
+		{
+			_sceneResidentBytes = MemoryUsage::residentBytes();
+			packet.name = QFileInfo(sourcePath).baseName();
+			packet.material = GLMaterial::DEFAULT_MAT();
+			AssImpMesh::prepareGeometry(packet.geometry);
+			ModelCacheWriter cacheWriter(sourcePath);
+			cacheWriter.write(packet);
+			QMutexLocker locker(&_meshPacketsMutex);
+			if (_loadingCancelled)
+			{
+				locker.unlock();
+				emit loadingCancelled();
+				return;
+			}
+			_meshPackets.push_back(std::move(packet));
+			locker.unlock();
+			emit nodeProcessed(1, 1);
+			cacheWriter.commit();
+			return;
+		}
+		cout << "MeshFileReader : " << readerError.toStdString() << ", importing with ASSIMP" << endl;
+	}
+
 	// Read file via ASSIMP
-	_importer.SetPropertyFloat("PP_GSN_MAX_SMOOTHING_ANGLE", 15);
+	_importer.SetPropertyFloat("PP_GSN_MAX_SMOOTHING_ANGLE", SMOOTHING_ANGLE);
 	const aiScene* scene = _importer.ReadFile(path, aiProcess_CalcTangentSpace |
 		aiProcess_GenSmoothNormals |
 		aiProcess_JoinIdenticalVertices |
@@ -65,112 +233,138 @@ void AssImpModelLoader::loadModel(string path)
 		cout << "ERROR::ASSIMP:: " << _importer.GetErrorString() << endl;
 		return;
 	}
-	// Retrieve the directory path of the filepath
-	this->directory = path.substr(0, path.find_last_of('/'));
-
-	// Process ASSIMP's root node recursively
-	this->processNode(0, scene->mRootNode, scene);
+	_sceneResidentBytes = MemoryUsage::residentBytes();
+
+	// Collect the meshes of ASSIMP's node hierarchy, then convert them on the thread pool.
+	// The converted meshes are written to the model cache on the way
+	vector<NodeMesh> nodeMeshes;
+	int nodeCount = 0;
+	this->collectNodeMeshes(scene->mRootNode, scene, nodeCount, nodeMeshes);
+	ModelCacheWriter cacheWriter(sourcePath);
+	this->processMeshes(nodeMeshes, nodeCount, scene, &cacheWriter);
+	_importer.FreeScene();
+	if (!_loadingCancelled)
+		cacheWriter.commit();
 }
 
-// Processes a node in a recursive fashion. Processes each individual mesh located at the node and repeats this process on its children nodes (if any).
-void AssImpModelLoader::processNode(int nodeNum, aiNode* node, const aiScene* scene)
+// Collects the meshes of a node and recursively of its children nodes (if any), in depth first order.
+void AssImpModelLoader::collectNodeMeshes(aiNode* node, const aiScene* scene, int& nodeCount, vector<NodeMesh>& nodeMeshes)
 {
-	if (_loadingCancelled)
-	{
-		emit loadingCancelled();
-		return;
-	}
-	// Process each mesh located at the current node
+	int nodeNum = ++nodeCount;
 	for (unsigned int i = 0; i < node->mNumMeshes; i++)
 	{
 		// The node object only contains indices to index the actual objects in the scene.
 		// The scene contains all the data, node is just to keep stuff organized (like relations between nodes).
-		aiMesh* mesh = scene->mMeshes[node->mMeshes[i]];
-
-		this->_meshes.push_back(this->processMesh(mesh, scene));
+		NodeMesh nodeMesh;
+		nodeMesh.nodeNum = nodeNum;
+		nodeMesh.mesh = scene->mMeshes[node->mMeshes[i]];
+		nodeMeshes.push_back(std::move(nodeMesh));
 	}
 
-	// After we've processed all of the meshes (if any) we then recursively process each of the children nodes
 	for (unsigned int i = 0; i < node->mNumChildren; i++)
+		this->collectNodeMeshes(node->mChildren[i], scene, nodeCount, nodeMeshes);
+}
+
+// The meshes of a scene are independent, each one is converted by its own task. Batches of
+// a few tasks per thread are converted in place and queued in node order, so the GL thread
+// starts uploading before the whole scene is converted.
+void AssImpModelLoader::processMeshes(vector<NodeMesh>& nodeMeshes, int nodeCount, const aiScene* scene, ModelCacheWriter* cacheWriter)
+{
+	// the vertex cache optimization and packing run here too, the GL thread only uploads
+	auto convert = [this, scene](NodeMesh& nodeMesh) {
+		nodeMesh.packet = this->processMesh(nodeMesh.mesh, scene);
+		AssImpMesh::prepareGeometry(nodeMesh.packet.geometry);
+	};
+
+	const size_t batchSize = 4 * static_cast<size_t>(std::max(1, QThread::idealThreadCount()));
+	for (size_t first = 0; first < nodeMeshes.size(); first += batchSize)
 	{
 		if (_loadingCancelled)
 		{
 			emit loadingCancelled();
 			return;
 		}
-		this->processNode(++nodeNum, node->mChildren[i], scene);
-		emit nodeProcessed(nodeNum, node->mNumChildren);
+
+		auto begin = nodeMeshes.begin() + first;
+		auto end = nodeMeshes.begin() + std::min(first + batchSize, nodeMeshes.size());
+		QtConcurrent::blockingMap(begin, end, convert);
+		if (cacheWriter)
+		{
+			for (auto it = begin; it != end; ++it)
+				cacheWriter->write(it->packet);
+		}
+
+		QMutexLocker locker(&_meshPacketsMutex);
+		if (_loadingCancelled)
+			continue;
+		for (auto it = begin; it != end; ++it)
+			_meshPackets.push_back(std::move(it->packet));
+		locker.unlock();
+		emit nodeProcessed((end - 1)->nodeNum, nodeCount);
 	}
 }
 
-AssImpMesh* AssImpModelLoader::processMesh(aiMesh* mesh, const aiScene* scene)
+AssImpModelLoader::MeshPacket AssImpModelLoader::processMesh(aiMesh* mesh, const aiScene* scene)
 {
-	// Data to fill
-	vector<Vertex> vertices;
-	vector<unsigned int> indices;
+	// Data to fill, every attribute array is sized from the aiMesh counts and written
+	// once in the layout it is uploaded in
+	MeshPacket packet;
+	MeshGeometry& geometry = packet.geometry;
 	vector<Texture> textures;
 
-	// Walk through each of the mesh's vertices
-	int step = 0;
-	unsigned int nbVertices = mesh->mNumVertices;
+	const unsigned int nbVertices = mesh->mNumVertices;
+	geometry.points.resize(3 * static_cast<size_t>(nbVertices));
+	geometry.normals.resize(3 * static_cast<size_t>(nbVertices));
+	geometry.texCoords.resize(2 * static_cast<size_t>(nbVertices));
+	geometry.tangents.resize(3 * static_cast<size_t>(nbVertices));
+	geometry.bitangents.resize(3 * static_cast<size_t>(nbVertices));
+	float* points = geometry.points.data();
+	float* normals = geometry.normals.data();
+	float* texCoords = geometry.texCoords.data();
+	float* tangents = geometry.tangents.data();
+	float* bitangents = geometry.bitangents.data();
+
+	// A vertex can contain up to 8 different texture coordinates. We thus make the assumption that we won't
+	// use models where a vertex can have multiple texture coordinates so we always take the first set (0).
+	const aiVector3D* meshTexCoords = mesh->mTextureCoords[0];
 	for (unsigned int i = 0; i < nbVertices; i++)
 	{
-		step++;
-		Vertex vertex;
-		glm::vec3 vector; // We declare a placeholder vector since assimp uses its own vector class that doesn't directly convert to glm's vec3 class so we transfer the data to this placeholder glm::vec3 first.
-
-		// Positions
-		vector.x = mesh->mVertices[i].x;
-		vector.y = mesh->mVertices[i].y;
-		vector.z = mesh->mVertices[i].z;
-		vertex.Position = vector;
-
-		// Normals
-		vector.x = mesh->mNormals[i].x;
-		vector.y = mesh->mNormals[i].y;
-		vector.z = mesh->mNormals[i].z;
-		vertex.Normal = vector;
-
-		// Texture Coordinates
-		if (mesh->mTextureCoords[0]) // Does the mesh contain texture coordinates?
+		points[3 * i + 0] = mesh->mVertices[i].x;
+		points[3 * i + 1] = mesh->mVertices[i].y;
+		points[3 * i + 2] = mesh->mVertices[i].z;
+
+		if (mesh->mNormals)
+		{
+			normals[3 * i + 0] = mesh->mNormals[i].x;
+			normals[3 * i + 1] = mesh->mNormals[i].y;
+			normals[3 * i + 2] = mesh->mNormals[i].z;
+		}
+
+		if (meshTexCoords)
 		{
-			glm::vec2 vec;
-			// A vertex can contain up to 8 different texture coordinates. We thus make the assumption that we won't
-			// use models where a vertex can have multiple texture coordinates so we always take the first set (0).
-			vec.x = mesh->mTextureCoords[0][i].x;
-			vec.y = mesh->mTextureCoords[0][i].y;
-			vertex.TexCoords = vec;
-
-			// tangent
+			texCoords[2 * i + 0] = meshTexCoords[i].x;
+			texCoords[2 * i + 1] = meshTexCoords[i].y;
+
 			if (mesh->mTangents)
 			{
-				vector.x = mesh->mTangents[i].x;
-				vector.y = mesh->mTangents[i].y;
-				vector.z = mesh->mTangents[i].z;
-				vertex.Tangent = vector;
+				tangents[3 * i + 0] = mesh->mTangents[i].x;
+				tangents[3 * i + 1] = mesh->mTangents[i].y;
+				tangents[3 * i + 2] = mesh->mTangents[i].z;
 			}
-			// bitangent
 			if (mesh->mBitangents)
 			{
-				vector.x = mesh->mBitangents[i].x;
-				vector.y = mesh->mBitangents[i].y;
-				vector.z = mesh->mBitangents[i].z;
-				vertex.Bitangent = vector;
+				bitangents[3 * i + 0] = mesh->mBitangents[i].x;
+				bitangents[3 * i + 1] = mesh->mBitangents[i].y;
+				bitangents[3 * i + 2] = mesh->mBitangents[i].z;
 			}
 		}
 		else
 		{
-			if (step == 1)
-				vertex.TexCoords = glm::vec2(0.0f, 0.0f);
-			else if (step == 2)
-				vertex.TexCoords = glm::vec2(1.0f, 0.0f);
-			else
-			{
-				vertex.TexCoords = glm::vec2(0.5f, 1.0f);
-				step = 0;
-			}
+			// repeat the corners of one texture triangle over the vertices
+			static const float cornerTexCoords[3][2] = { { 0.0f, 0.0f }, { 1.0f, 0.0f }, { 0.5f, 1.0f } };
+			texCoords[2 * i + 0] = cornerTexCoords[i % 3][0];
+			texCoords[2 * i + 1] = cornerTexCoords[i % 3][1];
 		}
-		vertices.push_back(vertex);
 
 		if (i % 100000 == 0)
 		{
@@ -178,15 +372,15 @@ AssImpMesh* AssImpModelLoader::processMesh(aiMesh* mesh, const aiScene* scene)
 		}
 	}
 
-	// Now wak through each of the mesh's faces (a face is a mesh its triangle) and retrieve the corresponding vertex indices.
+	// Now walk through each of the mesh's faces (a face is a mesh its triangle) and retrieve the corresponding vertex indices.
+	size_t nbIndices = 0;
+	for (unsigned int i = 0; i < mesh->mNumFaces; i++)
+		nbIndices += mesh->mFaces[i].mNumIndices;
+	geometry.indices.reserve(nbIndices);
 	for (unsigned int i = 0; i < mesh->mNumFaces; i++)
 	{
-		aiFace face = mesh->mFaces[i];
-		// Retrieve all indices of the face and store them in the indices vector
-		for (unsigned int j = 0; j < face.mNumIndices; j++)
-		{
-			indices.push_back(face.mIndices[j]);
-		}
+		const aiFace& face = mesh->mFaces[i];
+		geometry.indices.insert(geometry.indices.end(), face.mIndices, face.mIndices + face.mNumIndices);
 	}
 
 	// Process materials
@@ -275,11 +469,15 @@ AssImpMesh* AssImpModelLoader::processMesh(aiMesh* mesh, const aiScene* scene)
 		}
 	}
 
-	// Return a mesh object created from the extracted mesh data
-	return new AssImpMesh(_prog, QFileInfo(QString(_path.data())).baseName(), vertices, indices, textures, mat);
+	// Return the extracted mesh data, the mesh object is created on the GL thread
+	packet.name = QFileInfo(QString(_path.data())).baseName();
+	packet.textures = std::move(textures);
+	packet.material = mat;
+	return packet;
 }
 
-// Checks all material textures of a given type and loads the textures if they're not loaded yet.
+// Collects the file paths of all material textures of a given type, the textures are
+// acquired from the shared texture cache when the mesh is created.
 // The required info is returned as a Texture struct.
 vector<Texture> AssImpModelLoader::loadMaterialTextures(aiMaterial* mat, aiTextureType type, string typeName)
 {
@@ -290,72 +488,16 @@ vector<Texture> AssImpModelLoader::loadMaterialTextures(aiMaterial* mat, aiTextu
 		aiString str;
 		mat->GetTexture(type, i, &str);
 
-		// Check if texture was loaded before and if so, continue to next iteration: skip loading a new texture
-		GLboolean skip = false;
-
-		for (unsigned int j = 0; j < _loadedTextures.size(); j++)
-		{
-			if (_loadedTextures[j].path == str)
-			{
-				textures.push_back(_loadedTextures[j]);
-				skip = true; // A texture with the same filepath has already been loaded, continue to next one. (optimization)
-				break;
-			}
-		}
-
-		if (!skip)
-		{
-			// If texture hasn't been loaded already, load it
-			Texture texture;
-			texture.id = textureFromFile(str.C_Str(), this->directory);
-			texture.type = typeName;
-			texture.path = str;
-			textures.push_back(texture);
-
-			this->_loadedTextures.push_back(texture);  // Store it as texture loaded for entire model, to ensure we won't unnecesery load duplicate textures.
-		}
+		Texture texture;
+		texture.id = 0;
+		texture.type = typeName;
+		texture.path = str;
+		textures.push_back(texture);
 	}
 
 	return textures;
 }
 
-unsigned int AssImpModelLoader::textureFromFile(const char* path, string directory)
-{
-	//Generate texture ID and load texture data
-	string filename = string(path);
-	filename = directory + '/' + filename;
-	unsigned int textureID;
-	glGenTextures(1, &textureID);
-
-	QImage texImage;
-
-	if (!texImage.load(QString(filename.c_str())))
-	{ // Load first image from file
-		qWarning("Could not read image file, using single-color instead.");
-		QImage dummy(128, 128, static_cast<QImage::Format>(5));
-		dummy.fill(Qt::white);
-		texImage = dummy;
-	}
-	else
-	{
-		texImage = QGLWidget::convertToGLFormat(texImage); // flipped 32bit RGBA
-	}
-
-	// Assign texture to ID
-	glBindTexture(GL_TEXTURE_2D, textureID);
-	glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, texImage.width(), texImage.height(), 0, GL_RGBA, GL_UNSIGNED_BYTE, texImage.bits());
-	glGenerateMipmap(GL_TEXTURE_2D);
-
-	// Parameters
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-	glBindTexture(GL_TEXTURE_2D, 0);
-
-	return textureID;
-}
-
 QString AssImpModelLoader::getErrorMessage() const
 {
 	return _errorMessage;
@@ -6,12 +6,16 @@
 #include <iostream>
 #include <map>
 #include <vector>
+#include <deque>
+#include <atomic>
 
 #include <glm/glm.hpp>
 #include <glm/gtc/matrix_transform.hpp>
 #include <QImage>
 #include <QString>
 #include <QFileInfo>
+#include <QFutureWatcher>
+#include <QMutex>
 #include <assimp/Importer.hpp>
 #include <assimp/scene.h>
 #include <assimp/postprocess.h>
@@ -23,6 +27,8 @@ using namespace Assimp;
 
 using namespace std;
 
+class ModelCacheWriter;
+
 class AssImpModelProgressHandler : public QObject, public ProgressHandler
 {
 	Q_OBJECT
@@ -36,6 +42,28 @@ class AssImpModelLoader : public QObject, public QOpenGLFunctions_4_5_Core
 {
 	Q_OBJECT
 public:
+	// Geometry placed by several meshes, converted once. The first mesh created uploads
+	// it and the others draw from its buffers, only touched on the GL thread once queued
+	struct SharedGeometry
+	{
+		MeshGeometry geometry;
+		std::weak_ptr<TriangleMesh::Geometry> uploaded;
+	};
+
+	// CPU side data of one mesh, converted on the loading thread. Textures only carry
+	// their file path until the mesh is created on the GL thread
+	struct MeshPacket
+	{
+		QString name;
+		MeshGeometry geometry;
+		// used instead of geometry when set
+		std::shared_ptr<SharedGeometry> sharedGeometry;
+		vector<Texture> textures;
+		GLMaterial material;
+		// placement in the scene, the world transform of a glTF node
+		QMatrix4x4 transformation;
+	};
+
 	/*  Functions   */
 	// Constructor, expects a filepath to a 3D model.
 	AssImpModelLoader(QOpenGLShaderProgram* prog);
@@ -43,18 +71,29 @@ public:
 	~AssImpModelLoader();
 
 	/*  Functions   */
-	// Loads a model with supported ASSIMP extensions from file and stores the resulting meshes in the meshes vector.
+	// Loads a model with supported ASSIMP extensions from file and queues the converted meshes.
 	void loadModel(string path);
+	// Same as loadModel on a worker thread, loadingFinished is emitted when it is done
+	void loadModelAsync(string path);
+	bool isLoading() const;
+	void waitForFinished();
 
-	vector<AssImpMesh*> getMeshes() const;
+	// Take the oldest converted mesh from the queue, false when the queue is empty
+	bool takeMeshPacket(MeshPacket& packet);
+	bool hasMeshPackets() const;
+	// Create the mesh of a packet, the GL context must be current
+	AssImpMesh* createMesh(MeshPacket& packet);
 
 	QString getErrorMessage() const;
+	// Resident memory of the process once the scene had been read, the import peaks there
+	unsigned long long sceneResidentBytes() const { return _sceneResidentBytes; }
 
 signals:
 	void fileReadProcessed(float percent);
 	void verticesProcessed(float percent);
 	void nodeProcessed(int nodeNum, int totalNodes);
 	void loadingCancelled();
+	void loadingFinished();
 
 public slots:
 	void processFileReadProgress(float percentage);
@@ -64,23 +103,33 @@ private:
 	QOpenGLShaderProgram* _prog;
 	std::string _path;
 	/*  Model Data  */
-	vector<AssImpMesh*> _meshes;
+	std::deque<MeshPacket> _meshPackets;
+	mutable QMutex _meshPacketsMutex;
 	string directory;
-	vector<Texture> _loadedTextures;	// Stores all the textures loaded so far, optimization to make sure textures aren't loaded more than once.
 
-	// Processes a node in a recursive fashion. Processes each individual mesh located at the node and repeats this process on its children nodes (if any).
-	void processNode(int nodeNum, aiNode* node, const aiScene* scene);
+	// A mesh referenced by a node, converted into its packet on the thread pool
+	struct NodeMesh
+	{
+		int nodeNum = 0;
+		aiMesh* mesh = nullptr;
+		MeshPacket packet;
+	};
 
-	AssImpMesh* processMesh(aiMesh* mesh, const aiScene* scene);
+	// Collects the meshes of a node and of its children nodes (if any) in depth first order.
+	void collectNodeMeshes(aiNode* node, const aiScene* scene, int& nodeCount, vector<NodeMesh>& nodeMeshes);
+	// Converts the collected meshes in parallel and queues them in the same order.
+	void processMeshes(vector<NodeMesh>& nodeMeshes, int nodeCount, const aiScene* scene, ModelCacheWriter* cacheWriter);
 
-	// Checks all material textures of a given type and loads the textures if they're not loaded yet.
+	MeshPacket processMesh(aiMesh* mesh, const aiScene* scene);
+
+	// Collects the file paths of all material textures of a given type.
 	// The required info is returned as a Texture struct.
 	vector<Texture> loadMaterialTextures(aiMaterial* mat, aiTextureType type, string typeName);
 
-	unsigned int textureFromFile(const char* path, string directory);
-
 	Assimp::Importer _importer;
 	AssImpModelProgressHandler* _progHandler;
 	QString _errorMessage;
-	bool _loadingCancelled;
+	std::atomic<bool> _loadingCancelled;
+	std::atomic<unsigned long long> _sceneResidentBytes;
+	QFutureWatcher<void> _watcher;
 };
@@ -169,6 +169,7 @@ TriangleMesh* Cone::clone()
 
 void Cone::computeBounds()
 {
+	updateWorldData();
 	QList<float> xVals, yVals, zVals;
 	for (size_t i = 0; i < _trsfpoints.size(); i += 3)
 	{
@@ -186,4 +187,5 @@ void Cone::computeBounds()
 
 	_boundingSphere.setCenter(cen.getX(), cen.getY(), cen.getZ());
 	_boundingSphere.setRadius(sqrt(_radius * _radius + _height / 2.0f * _height / 2.0f));
+	_boundsDirty = false;
 }
@@ -219,6 +219,7 @@ TriangleMesh* Cylinder::clone()
 
 void Cylinder::computeBounds()
 {
+	updateWorldData();
 	QList<float> xVals, yVals, zVals;
 	for (size_t i = 0; i < _trsfpoints.size(); i += 3)
 	{
@@ -236,4 +237,5 @@ void Cylinder::computeBounds()
 
 	_boundingSphere.setCenter(cen.getX(), cen.getY(), cen.getZ());
 	_boundingSphere.setRadius(sqrt(_radius * _radius + _height / 2.0f * _height / 2.0f));
+	_boundsDirty = false;
 }
@@ -0,0 +1,64 @@
+#include "Frustum.h"
+#include "BoundingSphere.h"
+#include "BoundingBox.h"
+
+Frustum::Frustum()
+{
+	setMatrix(QMatrix4x4());
+}
+
+Frustum::Frustum(const QMatrix4x4& viewProjection)
+{
+	setMatrix(viewProjection);
+}
+
+void Frustum::setMatrix(const QMatrix4x4& viewProjection)
+{
+	// Gribb and Hartmann plane extraction from the rows of the matrix
+	QVector4D r0 = viewProjection.row(0);
+	QVector4D r1 = viewProjection.row(1);
+	QVector4D r2 = viewProjection.row(2);
+	QVector4D r3 = viewProjection.row(3);
+	_planes[0] = r3 + r0;
+	_planes[1] = r3 - r0;
+	_planes[2] = r3 + r1;
+	_planes[3] = r3 - r1;
+	_planes[4] = r3 + r2;
+	_planes[5] = r3 - r2;
+	for (QVector4D& plane : _planes)
+	{
+		float length = plane.toVector3D().length();
+		if (length > 0.0f)
+			plane /= length;
+	}
+}
+
+bool Frustum::intersects(const BoundingSphere& sphere) const
+{
+	const QVector3D center = sphere.getCenter();
+	for (const QVector4D& plane : _planes)
+	{
+		if (QVector3D::dotProduct(plane.toVector3D(), center) + plane.w() < -sphere.getRadius())
+			return false;
+	}
+	return true;
+}
+
+bool Frustum::intersects(const BoundingBox& box) const
+{
+	return intersects(QVector3D(box.xMin(), box.yMin(), box.zMin()), QVector3D(box.xMax(), box.yMax(), box.zMax()));
+}
+
+bool Frustum::intersects(const QVector3D& boundsMin, const QVector3D& boundsMax) const
+{
+	for (const QVector4D& plane : _planes)
+	{
+		// the corner furthest along the plane normal
+		QVector3D corner(plane.x() >= 0.0f ? boundsMax.x() : boundsMin.x(),
+			plane.y() >= 0.0f ? boundsMax.y() : boundsMin.y(),
+			plane.z() >= 0.0f ? boundsMax.z() : boundsMin.z());
+		if (QVector3D::dotProduct(plane.toVector3D(), corner) + plane.w() < 0.0f)
+			return false;
+	}
+	return true;
+}
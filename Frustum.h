@@ -0,0 +1,25 @@
+#pragma once
+
+#include <QMatrix4x4>
+#include <QVector4D>
+
+class BoundingSphere;
+class BoundingBox;
+
+// View volume of a combined view projection matrix as six inward facing planes.
+// The tests are conservative, bounds straddling a plane count as visible
+class Frustum
+{
+public:
+	Frustum();
+	explicit Frustum(const QMatrix4x4& viewProjection);
+
+	void setMatrix(const QMatrix4x4& viewProjection);
+
+	bool intersects(const BoundingSphere& sphere) const;
+	bool intersects(const BoundingBox& box) const;
+	bool intersects(const QVector3D& boundsMin, const QVector3D& boundsMax) const;
+
+private:
+	QVector4D _planes[6]; // left, right, bottom, top, near, far
+};
@@ -1,6 +1,12 @@
 #include "GLWidget.h"
 
 #include "TextRenderer.h"
+#include "TextureState.h"
+#include "TextureCache.h"
+#include "ProgramBinaryCache.h"
+#include "IBLCache.h"
+#include "IrradianceSH.h"
+#include "MemoryUsage.h"
 
 #include "Cylinder.h"
 #include "Cone.h"
@@ -44,11 +50,11 @@
 #include "ClippingPlanesEditor.h"
 
 #include "Plane.h"
+#include "Frustum.h"
 #include "ModelViewer.h"
 #include "MainWindow.h"
 
 #include <glm/gtc/matrix_transform.hpp>
-#include "stb_image.h"
 
 #include "AssImpModelLoader.h"
 
@@ -56,6 +62,14 @@ using glm::mat4;
 using glm::vec3;
 
 constexpr auto TWO_HUNDRED_MB = 209715200; // bytes
+// Allowed LOD error in pixels, the small multi view viewports use coarser levels
+constexpr float LOD_PIXEL_ERROR = 1.0f;
+constexpr float LOD_MULTIVIEW_PIXEL_ERROR = 2.0f;
+// in shadow map texels, a texel already spans several pixels of the view
+constexpr float LOD_SHADOW_PIXEL_ERROR = 1.0f;
+// Loaded meshes are uploaded once per frame interval, for at most half of it
+constexpr int MESH_UPLOAD_INTERVAL_MS = 16;
+constexpr qint64 MESH_UPLOAD_BUDGET_MS = 8;
 
 GLWidget::GLWidget(QWidget* parent, const char* /*name*/) : QOpenGLWidget(parent),
 _textRenderer(nullptr),
@@ -73,7 +87,13 @@ _floorPlane(nullptr),
 _skyBox(nullptr),
 _axisCone(nullptr),
 _lightCube(nullptr),
-_assimpModelLoader(nullptr)
+_assimpModelLoader(nullptr),
+_meshUploadTimer(nullptr),
+_modelLoadingCancelled(false),
+_modelMeshCount(0),
+_modelGeometryBytes(0),
+_modelLoadBaseMemory(0),
+_modelLoadPeakMemory(0)
 {
     setFocusPolicy(Qt::StrongFocus);
 
@@ -122,6 +142,8 @@ _assimpModelLoader(nullptr)
 
 	_multiViewActive = false;
 
+	_lodPixelError = LOD_PIXEL_ERROR;
+
 	_showAxis = true;
 
 	_windowZoomActive = false;
@@ -159,6 +181,7 @@ _assimpModelLoader(nullptr)
 	_skyBoxEnabled = false;
 	_skyBoxFOV = 45.0f;
 	_skyBoxTextureHDRI = false;
+	_shIrradianceEnabled = false;
 	_gammaCorrection = false;
 	_screenGamma = 2.2f;
 	_hdrToneMapping = false;;
@@ -177,9 +200,25 @@ _assimpModelLoader(nullptr)
 	_prefilterMap = 0;
 	_brdfLUTTexture = 0;
 
-	_selectionFBO = 0;
-	_selectionRBO = 0;
-	_selectionDBO = 0;
+	_frameUBO = 0;
+	_lightingUBO = 0;
+	_passUBO = 0;
+	_fgShaderVariants = nullptr;
+
+	_objectIdFBO = 0;
+	_objectIdTexture = 0;
+	_objectIdDepthRBO = 0;
+	_objectIdReadIndex = 0;
+	_objectIdPassRequested = false;
+	_objectIdBufferDirty = true;
+	_objectIdReadPixel = QPoint(-1, -1);
+	_objectIdCollectScheduled = false;
+	_hoverHighlightEnabled = false;
+	_hoveredId = -1;
+	_pickedPixel = QPoint(-1, -1);
+	_pickedId = -1;
+	_pickedTriangle = -1;
+	_pendingSelectionPixel = QPoint(-1, -1);
 
 	_clipXCoeff = 0.0f;
 	_clipYCoeff = 0.0f;
@@ -229,6 +268,14 @@ _assimpModelLoader(nullptr)
 	connect(_animateCenterScreenTimer, SIGNAL(timeout()), this, SLOT(animateCenterScreen()));
 	connect(this, SIGNAL(zoomAndPanSet()), this, SLOT(stopAnimations()));
 
+	_skyBoxLoader = new SkyBoxLoader(this);
+	connect(_skyBoxLoader, SIGNAL(faceLoaded(int,int)), this, SLOT(showSkyBoxLoadingProgress(int,int)));
+	connect(_skyBoxLoader, SIGNAL(loaded(bool)), this, SLOT(skyBoxLoaded(bool)));
+	connect(_skyBoxLoader, SIGNAL(loadingCancelled()), this, SLOT(skyBoxLoadingCancelled()));
+
+	_meshUploadTimer = new QTimer(this);
+	connect(_meshUploadTimer, SIGNAL(timeout()), this, SLOT(uploadAssImpMeshes()));
+
 	_editorLayout = new QVBoxLayout(this);
 	_upperLayout = new QFormLayout();
 	_upperLayout->setFormAlignment(Qt::AlignTop | Qt::AlignLeft);
@@ -254,6 +301,9 @@ _assimpModelLoader(nullptr)
 
 GLWidget::~GLWidget()
 {
+	// meshes, buffers and textures are deleted in the context they were created in
+	makeCurrent();
+
 	if (_textRenderer)
 		delete _textRenderer;
 	if (_axisTextRenderer)
@@ -282,7 +332,21 @@ GLWidget::~GLWidget()
 	//std::cout << "GLWidget::~GLWidget : _brdfLUTTexture = " << _brdfLUTTexture << std::endl;
 	glDeleteTextures(1, &_brdfLUTTexture);
 	//std::cout << "GLWidget::~GLWidget : _cappingTexture = " << _cappingTexture << std::endl;
-	glDeleteTextures(1, &_cappingTexture);
+	TextureCache::instance().release(_cappingTexture);
+
+	glDeleteBuffers(1, &_frameUBO);
+	glDeleteBuffers(1, &_lightingUBO);
+	glDeleteBuffers(1, &_passUBO);
+
+	glDeleteFramebuffers(1, &_objectIdFBO);
+	glDeleteTextures(1, &_objectIdTexture);
+	glDeleteRenderbuffers(1, &_objectIdDepthRBO);
+	for (ObjectIdRead& read : _objectIdReads)
+	{
+		if (read.fence)
+			glDeleteSync(read.fence);
+		glDeleteBuffers(1, &read.pbo);
+	}
 
 	if (_clippingPlaneXY)
 		delete _clippingPlaneXY;
@@ -306,11 +370,14 @@ GLWidget::~GLWidget()
 	_bgSplitVAO.destroy();
 
 	_bgVAO.destroy();
+
+	doneCurrent();
 }
 
 void GLWidget::cleanUpShaders()
 {
 	if (_fgShader)	delete _fgShader;
+	if (_fgShaderVariants) delete _fgShaderVariants;
 	if (_axisShader) delete _axisShader;
 	if (_vertexNormalShader) delete _vertexNormalShader;
 	if (_faceNormalShader) delete _faceNormalShader;
@@ -341,7 +408,7 @@ void GLWidget::setTexture(const std::vector<int>& ids, const QImage& texImage)
 		try
 		{
 			TriangleMesh* mesh = _meshStore[id];
-			mesh->setTexureImage(QGLWidget::convertToGLFormat(texImage));
+			mesh->setTexureImage(TextureState::glFormat(texImage));
 		}
 		catch (const std::exception& ex)
 		{
@@ -352,9 +419,7 @@ void GLWidget::setTexture(const std::vector<int>& ids, const QImage& texImage)
 
 void GLWidget::setSkyBoxTextureFolder(QString folder)
 {
-	QApplication::setOverrideCursor(Qt::WaitCursor);
-
-	_skyBoxFaces =
+	QStringList faces =
 	{
 		QString(folder + "/posx"),
 		QString(folder + "/negx"),
@@ -364,85 +429,127 @@ void GLWidget::setSkyBoxTextureFolder(QString folder)
 		QString(folder + "/negy")
 	};
 	// stb image library supported formats
-	QList<QString> supportedFormats = { "jpeg", "jpg", "png", "bmp", "psd", "tga", "gif", "hdr", "pic", "pnm" };
+	QStringList supportedFormats = { "jpeg", "jpg", "png", "bmp", "psd", "tga", "gif", "hdr", "pic", "pnm" };
 
-	makeCurrent();
+	// the faces are decoded on worker threads, the current skybox stays in use until
+	// the new one and its IBL maps are complete
+	MainWindow::showStatusMessage("Loading skybox: " + folder);
+	MainWindow::showProgressBar();
+	_skyBoxLoader->load(faces, _skyBoxTextureHDRI, _skyBoxTextureHDRI ? QStringList({ "hdr" }) : supportedFormats);
+}
 
-	glBindTexture(GL_TEXTURE_CUBE_MAP, _environmentMap);
+bool GLWidget::isSkyBoxLoading() const
+{
+	return _skyBoxLoader->isLoading();
+}
+
+void GLWidget::cancelSkyBoxLoading()
+{
+	_skyBoxLoader->cancelLoading();
+}
 
-	stbi_set_flip_vertically_on_load(true);
-	bool loaded = false;
-	int width, height, nrComponents;
-	void* data = nullptr;
-	for (unsigned int i = 0; i < _skyBoxFaces.size(); i++)
+void GLWidget::showSkyBoxLoadingProgress(int count, int total)
+{
+	MainWindow::setProgressValue((int)((float)count / (float)total * 100.0f));
+}
+
+void GLWidget::skyBoxLoadingCancelled()
+{
+	MainWindow::setProgressValue(0);
+	MainWindow::hideProgressBar();
+	MainWindow::showStatusMessage("Skybox loading cancelled, continuing with the existing one", 5000);
+}
+
+void GLWidget::skyBoxLoaded(bool success)
+{
+	MainWindow::setProgressValue(0);
+	MainWindow::hideProgressBar();
+	MainWindow::showStatusMessage("");
+	if (!success)
 	{
-		if (!_skyBoxTextureHDRI)
+		if (_skyBoxLoader->isHDR())
 		{
-			for (const QString &extn : supportedFormats)
-			{
-				QString fileName = _skyBoxFaces.at(i) + "." + extn;
-				data = static_cast<unsigned char*>(stbi_load(fileName.toStdString().c_str(), &width, &height, &nrComponents, 0));
-				if (data)
-				{
-					loaded = true;
-					break;
-				}
-			}
+			QMessageBox::critical(this, "Error", "Skybox HDR files are not found in the selected folder\n"
+				"Please make sure that if HRDI option is checked,\n"
+				"six HDRI images with names in the following manner...\n"
+				"posx.hdr, posy.hdr, posz.hdr,\n"
+				"negx.hdr, negy.hdr, negz.hdr\n"
+				"are present in the folder."
+				"\nSkybox has not changed, continuing with the existing one.");
 		}
 		else
 		{
-			QString fileName = _skyBoxFaces.at(i) + ".hdr";
-			data = static_cast<float*>(stbi_loadf(fileName.toStdString().c_str(), &width, &height, &nrComponents, 0));
-			if (data)
-			{
-				loaded = true;
-			}
-		}
-		if (loaded)
-		{
-			if (_skyBoxTextureHDRI)
-				glTexImage2D(GL_TEXTURE_CUBE_MAP_POSITIVE_X + i, 0, GL_RGB16F, width, height, 0, GL_RGB, GL_FLOAT, data);
-			else
-				glTexImage2D(GL_TEXTURE_CUBE_MAP_POSITIVE_X + i, 0, GL_RGB16F, width, height, 0, GL_RGB, GL_UNSIGNED_BYTE, data);
-			glGenerateMipmap(GL_TEXTURE_CUBE_MAP);
-			stbi_image_free(data);
-		}
-		else
-		{
-			if (_skyBoxTextureHDRI)
-			{
-				QMessageBox::critical(this, "Error", "Skybox HDR files are not found in the selected folder\n"
-					"Please make sure that if HRDI option is checked,\n"
-					"six HDRI images with names in the following manner...\n"
-					"posx.hdr, posy.hdr, posz.hdr,\n"
-					"negx.hdr, negy.hdr, negz.hdr\n"
-					"are present in the folder."
-					"\nSkybox has not changed, continuing with the existing one.");
-			}
-			else
-			{
-				QString formats;
-                for (const QString& extn : supportedFormats)
-				{
-					formats += extn + " ";
-				}
-				// Load first image from file
-				QMessageBox::critical(this, "Error", "Skybox compatible files are not found in the selected folder.\n"
-					"Please make sure that there are six images of supported formats "
-					"in the folder with names in the following manner...\n"
-					"posx.jpg, posy.jpg, posz.jpg,\n"
-					"negx.jpg, negy.jpg, negz.jpg\nSupported formats are:\n" + formats +
-					"\nSkybox has not changed, continuing with the existing one.");
-			}
-			QApplication::restoreOverrideCursor();
-			return;
+			QString formats = "jpeg jpg png bmp psd tga gif hdr pic pnm ";
+			// Load first image from file
+			QMessageBox::critical(this, "Error", "Skybox compatible files are not found in the selected folder.\n"
+				"Please make sure that there are six images of supported formats "
+				"in the folder with names in the following manner...\n"
+				"posx.jpg, posy.jpg, posz.jpg,\n"
+				"negx.jpg, negy.jpg, negz.jpg\nSupported formats are:\n" + formats +
+				"\nSkybox has not changed, continuing with the existing one.");
 		}
+		return;
 	}
+
+	QApplication::setOverrideCursor(Qt::WaitCursor);
+	makeCurrent();
+	// swapped in one step, no frame is drawn before the derived IBL maps are rebuilt
+	unsigned int previousMap = _environmentMap;
+	_environmentMap = createEnvironmentMap(_skyBoxLoader->faces(), _skyBoxLoader->isHDR());
+	_environmentMapHash = _skyBoxLoader->contentHash();
+	_skyBoxFaces.assign(_skyBoxLoader->files().begin(), _skyBoxLoader->files().end());
 	loadIrradianceMap();
+	glActiveTexture(GL_TEXTURE1);
+	glBindTexture(GL_TEXTURE_CUBE_MAP, _environmentMap);
+	glDeleteTextures(1, &previousMap);
+	TextureState::instance().invalidate();
 	update();
 	QApplication::restoreOverrideCursor();
 }
 
+unsigned int GLWidget::createEnvironmentMap(const std::vector<SkyBoxLoader::Face>& faces, bool hdr)
+{
+	int size = faces[0].width;
+	int levels = 1 + static_cast<int>(std::floor(std::log2(size)));
+	GLsizeiptr faceBytes = faces[0].pixels.size();
+
+	unsigned int texture = 0;
+	glCreateTextures(GL_TEXTURE_CUBE_MAP, 1, &texture);
+	glTextureStorage2D(texture, levels, GL_RGB16F, size, size);
+
+	// all faces are staged in one pixel buffer and copied from there by the driver
+	unsigned int pixelBuffer = 0;
+	glCreateBuffers(1, &pixelBuffer);
+	glNamedBufferStorage(pixelBuffer, faceBytes * 6, nullptr, GL_MAP_WRITE_BIT);
+	char* staging = static_cast<char*>(glMapNamedBufferRange(pixelBuffer, 0, faceBytes * 6, GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_BUFFER_BIT));
+	if (staging)
+	{
+		for (size_t i = 0; i < faces.size(); i++)
+			memcpy(staging + i * faceBytes, faces[i].pixels.constData(), faceBytes);
+		glUnmapNamedBuffer(pixelBuffer);
+
+		glBindBuffer(GL_PIXEL_UNPACK_BUFFER, pixelBuffer);
+		glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+		for (size_t i = 0; i < faces.size(); i++)
+		{
+			// the faces of a cube map are the layers of a 3D upload
+			glTextureSubImage3D(texture, 0, 0, 0, static_cast<GLint>(i), size, size, 1, GL_RGB, hdr ? GL_FLOAT : GL_UNSIGNED_BYTE,
+				reinterpret_cast<const void*>(i * faceBytes));
+		}
+		glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+		glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+	}
+	glDeleteBuffers(1, &pixelBuffer);
+	glGenerateTextureMipmap(texture);
+
+	glTextureParameteri(texture, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+	glTextureParameteri(texture, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+	glTextureParameteri(texture, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+	glTextureParameteri(texture, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+	glTextureParameteri(texture, GL_TEXTURE_WRAP_R, GL_CLAMP_TO_EDGE);
+	return texture;
+}
+
 QVector3D GLWidget::getLightPosition() const
 {
 	return _lightPosition;
@@ -766,7 +873,7 @@ void GLWidget::showFloor(bool show)
 
 void GLWidget::setFloorTexture(QImage img)
 {
-	_floorTexImage = QGLWidget::convertToGLFormat(img); // flipped 32bit RGBA
+	_floorTexImage = TextureState::glFormat(img);
 	_floorPlane->setTexureImage(_floorTexImage);
 }
 
@@ -780,12 +887,32 @@ void GLWidget::addToDisplay(TriangleMesh* mesh)
 {
 	_meshStore.push_back(mesh);
 	_displayedObjectsIds.push_back(static_cast<int>(_meshStore.size() - 1));
+	// only the new leaf is inserted, walking the whole store per mesh made loading quadratic
+	if (_sceneBoundsVersions.size() + 1 == _meshStore.size())
+	{
+		_sceneBVH.insert(static_cast<int>(_meshStore.size() - 1), mesh->getBoundingBox());
+		_sceneBoundsVersions.push_back(mesh->getBoundsVersion());
+	}
+	else
+	{
+		updateSceneBVH();
+	}
 }
 
 void GLWidget::removeFromDisplay(int index)
 {
+	// ids above the removed mesh shift down, drop the hover state instead of remapping it
+	if (_hoveredId >= 0 && _hoveredId < static_cast<int>(_meshStore.size()))
+		_meshStore[_hoveredId]->setHovered(false);
+	_hoveredId = -1;
+	_pickedId = -1;
 	TriangleMesh* mesh = _meshStore[index];
 	_meshStore.erase(_meshStore.begin() + index);
+	if (index < _sceneBVH.size())
+	{
+		_sceneBVH.remove(index);
+		_sceneBoundsVersions.erase(_sceneBoundsVersions.begin() + index);
+	}
 	delete mesh;
 	if (_meshStore.size() == 0)
 	{
@@ -830,9 +957,25 @@ void GLWidget::deselect(int id)
 
 bool GLWidget::loadAssImpModel(const QString& fileName, QString& error)
 {
-	bool success = false;
+	if (!_assimpModelLoader)
+	{
+		error = "The model loader is not initialized";
+		return false;
+	}
+	if (isAssImpModelLoading())
+		_pendingModelFiles.append(fileName);
+	else
+		startAssImpModelLoading(fileName);
+	return true;
+}
 
-	makeCurrent();
+bool GLWidget::isAssImpModelLoading() const
+{
+	return _meshUploadTimer->isActive();
+}
+
+void GLWidget::startAssImpModelLoading(const QString& fileName)
+{
 	QString displayFileName = fileName;
 	if (fileName.length() > 125)
 	{
@@ -840,41 +983,65 @@ bool GLWidget::loadAssImpModel(const QString& fileName, QString& error)
 	}
 	MainWindow::showStatusMessage("Reading file: " + displayFileName);
 	MainWindow::showProgressBar();
-	if (_assimpModelLoader)
+
+	_modelLoadingFile = fileName;
+	_modelLoadingCancelled = false;
+	_modelMeshCount = 0;
+	_modelGeometryBytes = 0;
+	_modelLoadBaseMemory = _modelLoadPeakMemory = MemoryUsage::residentBytes();
+	_modelLoadTimer.start();
+	// parsing and conversion run on a worker thread, uploadAssImpMeshes creates the meshes
+	_assimpModelLoader->loadModelAsync(fileName.toStdString());
+	_meshUploadTimer->start(MESH_UPLOAD_INTERVAL_MS);
+}
+
+void GLWidget::uploadAssImpMeshes()
+{
+	// checked before draining, meshes queued before the worker finished are always seen
+	bool readFinished = !_assimpModelLoader->isLoading();
+
+	makeCurrent();
+	QElapsedTimer sliceTimer;
+	sliceTimer.start();
+	unsigned int uploaded = 0;
+	AssImpModelLoader::MeshPacket packet;
+	while (sliceTimer.elapsed() < MESH_UPLOAD_BUDGET_MS && _assimpModelLoader->takeMeshPacket(packet))
 	{
-		/*QMessageBox msgBox(this);
-		msgBox.setIcon( QMessageBox::Information);
-		msgBox.setText("Click Abort to stop file loading.");
-		msgBox.setWindowFlag(Qt::FramelessWindowHint,true);
-		msgBox.setModal(false);
-		float ph = geometry().height();
-		float px = geometry().x();
-		float py = geometry().y();
-		float dw = msgBox.width();
-		float dh = msgBox.height();
-		msgBox.setGeometry( px + 20, py+ph-4*dh, dw, dh );
-		QPushButton *abortButton = msgBox.addButton(QMessageBox::Abort);
-		connect(abortButton, SIGNAL(pressed()), this, SLOT(cancelAssImpModelLoading()));
-		msgBox.show();*/
-		_assimpModelLoader->loadModel(const_cast<GLchar*>(fileName.toStdString().c_str()));
-		std::vector<AssImpMesh*> meshes = _assimpModelLoader->getMeshes();
-		if (meshes.size() == 0)
-		{
-			success = false;
-			error = _assimpModelLoader->getErrorMessage();
-		}
-		else
-		{
-			success = true;
-			for (AssImpMesh* mesh : meshes)
-				addToDisplay(mesh);
-		}
+		TriangleMesh* mesh = _assimpModelLoader->createMesh(packet);
+		_modelGeometryBytes += mesh->memorySize();
+		addToDisplay(mesh);
+		uploaded++;
 	}
+	_modelLoadPeakMemory = std::max(_modelLoadPeakMemory, MemoryUsage::residentBytes());
+
+	if (uploaded)
+	{
+		_modelMeshCount += uploaded;
+		update();
+	}
+	if (readFinished && !_assimpModelLoader->hasMeshPackets())
+		finishAssImpModelLoading();
+}
+
+void GLWidget::finishAssImpModelLoading()
+{
+	_meshUploadTimer->stop();
+	std::cout << "GLWidget::loadAssImpModel : " << _modelMeshCount << " meshes loaded in " << _modelLoadTimer.elapsed() << " ms" << std::endl;
+	// the geometry is the size of the uploaded buffers, one copy of it stays in memory for picking
+	_modelLoadPeakMemory = std::max(_modelLoadPeakMemory, _assimpModelLoader->sceneResidentBytes());
+	std::cout << "GLWidget::loadAssImpModel : geometry " << _modelGeometryBytes / (1024 * 1024) << " MB, peak memory "
+		<< (_modelLoadPeakMemory - _modelLoadBaseMemory) / (1024 * 1024) << " MB above the "
+		<< _modelLoadBaseMemory / (1024 * 1024) << " MB in use before loading" << std::endl;
+
+	bool success = _modelMeshCount > 0;
+	QString error = success ? QString() : _assimpModelLoader->getErrorMessage();
 	MainWindow::showStatusMessage("");
 	MainWindow::setProgressValue(0);
 	MainWindow::hideProgressBar();
+	emit assImpModelLoaded(_modelLoadingFile, success, error, _modelLoadingCancelled);
 
-	return success;
+	if (!_pendingModelFiles.isEmpty())
+		startAssImpModelLoading(_pendingModelFiles.takeFirst());
 }
 
 void GLWidget::showFileReadingProgress(float percent)
@@ -906,6 +1073,8 @@ void GLWidget::swapVisible(bool checked)
 
 void GLWidget::cancelAssImpModelLoading()
 {
+	_pendingModelFiles.clear();
+	_modelLoadingCancelled = true;
 	emit loadingAssImpModelCancelled();
 	QMessageBox::critical(this, "Cancelled", "Model loading cancelled!\nModel may be loaded partially");
 }
@@ -928,13 +1097,12 @@ void GLWidget::enableADSDiffuseTexMap(const std::vector<int>& ids, const bool& e
 
 void GLWidget::setADSDiffuseTexMap(const std::vector<int>& ids, const QString& path)
 {
-	unsigned int texId = loadTextureFromFile(path.toStdString().c_str());
 	for (int id : ids)
 	{
 		try
 		{
 			TriangleMesh* mesh = _meshStore[id];
-			mesh->setDiffuseADSMap(texId);
+			mesh->setDiffuseADSMap(TextureCache::instance().acquire(path));
 		}
 		catch (const std::exception& ex)
 		{
@@ -977,13 +1145,12 @@ void GLWidget::enableADSSpecularTexMap(const std::vector<int>& ids, const bool&
 
 void GLWidget::setADSSpecularTexMap(const std::vector<int>& ids, const QString& path)
 {
-	unsigned int texId = loadTextureFromFile(path.toStdString().c_str());
 	for (int id : ids)
 	{
 		try
 		{
 			TriangleMesh* mesh = _meshStore[id];
-			mesh->setSpecularADSMap(texId);
+			mesh->setSpecularADSMap(TextureCache::instance().acquire(path));
 		}
 		catch (const std::exception& ex)
 		{
@@ -1026,13 +1193,12 @@ void GLWidget::enableADSEmissiveTexMap(const std::vector<int>& ids, const bool&
 
 void GLWidget::setADSEmissiveTexMap(const std::vector<int>& ids, const QString& path)
 {
-	unsigned int texId = loadTextureFromFile(path.toStdString().c_str());
 	for (int id : ids)
 	{
 		try
 		{
 			TriangleMesh* mesh = _meshStore[id];
-			mesh->setEmissiveADSMap(texId);
+			mesh->setEmissiveADSMap(TextureCache::instance().acquire(path));
 		}
 		catch (const std::exception& ex)
 		{
@@ -1075,13 +1241,12 @@ void GLWidget::enableADSNormalTexMap(const std::vector<int>& ids, const bool& en
 
 void GLWidget::setADSNormalTexMap(const std::vector<int>& ids, const QString& path)
 {
-	unsigned int texId = loadTextureFromFile(path.toStdString().c_str());
 	for (int id : ids)
 	{
 		try
 		{
 			TriangleMesh* mesh = _meshStore[id];
-			mesh->setNormalADSMap(texId);
+			mesh->setNormalADSMap(TextureCache::instance().acquire(path));
 		}
 		catch (const std::exception& ex)
 		{
@@ -1124,13 +1289,12 @@ void GLWidget::enableADSHeightTexMap(const std::vector<int>& ids, const bool& en
 
 void GLWidget::setADSHeightTexMap(const std::vector<int>& ids, const QString& path)
 {
-	unsigned int texId = loadTextureFromFile(path.toStdString().c_str());
 	for (int id : ids)
 	{
 		try
 		{
 			TriangleMesh* mesh = _meshStore[id];
-			mesh->setHeightADSMap(texId);
+			mesh->setHeightADSMap(TextureCache::instance().acquire(path));
 		}
 		catch (const std::exception& ex)
 		{
@@ -1189,13 +1353,12 @@ void GLWidget::invertADSOpacityTexMap(const std::vector<int>& ids, const bool& i
 
 void GLWidget::setADSOpacityTexMap(const std::vector<int>& ids, const QString& path)
 {
-	unsigned int texId = loadTextureFromFile(path.toStdString().c_str());
 	for (int id : ids)
 	{
 		try
 		{
 			TriangleMesh* mesh = _meshStore[id];
-			mesh->setOpacityADSMap(texId);
+			mesh->setOpacityADSMap(TextureCache::instance().acquire(path));
 		}
 		catch (const std::exception& ex)
 		{
@@ -1334,13 +1497,12 @@ void GLWidget::enablePBRAlbedoTexMap(const std::vector<int>& ids, const bool& en
 
 void GLWidget::setPBRAlbedoTexMap(const std::vector<int>& ids, const QString& path)
 {
-	unsigned int texId = loadTextureFromFile(path.toStdString().c_str());
 	for (int id : ids)
 	{
 		try
 		{
 			TriangleMesh* mesh = _meshStore[id];
-			mesh->setAlbedoPBRMap(texId);
+			mesh->setAlbedoPBRMap(TextureCache::instance().acquire(path));
 		}
 		catch (const std::exception& ex)
 		{
@@ -1383,13 +1545,12 @@ void GLWidget::enablePBRMetallicTexMap(const std::vector<int>& ids, const bool&
 
 void GLWidget::setPBRMetallicTexMap(const std::vector<int>& ids, const QString& path)
 {
-	unsigned int texId = loadTextureFromFile(path.toStdString().c_str());
 	for (int id : ids)
 	{
 		try
 		{
 			TriangleMesh* mesh = _meshStore[id];
-			mesh->setMetallicPBRMap(texId);
+			mesh->setMetallicPBRMap(TextureCache::instance().acquire(path));
 		}
 		catch (const std::exception& ex)
 		{
@@ -1432,13 +1593,12 @@ void GLWidget::enablePBRRoughnessTexMap(const std::vector<int>& ids, const bool&
 
 void GLWidget::setPBRRoughnessTexMap(const std::vector<int>& ids, const QString& path)
 {
-	unsigned int texId = loadTextureFromFile(path.toStdString().c_str());
 	for (int id : ids)
 	{
 		try
 		{
 			TriangleMesh* mesh = _meshStore[id];
-			mesh->setRoughnessPBRMap(texId);
+			mesh->setRoughnessPBRMap(TextureCache::instance().acquire(path));
 		}
 		catch (const std::exception& ex)
 		{
@@ -1481,13 +1641,12 @@ void GLWidget::enablePBRNormalTexMap(const std::vector<int>& ids, const bool& en
 
 void GLWidget::setPBRNormalTexMap(const std::vector<int>& ids, const QString& path)
 {
-	unsigned int texId = loadTextureFromFile(path.toStdString().c_str());
 	for (int id : ids)
 	{
 		try
 		{
 			TriangleMesh* mesh = _meshStore[id];
-			mesh->setNormalPBRMap(texId);
+			mesh->setNormalPBRMap(TextureCache::instance().acquire(path));
 		}
 		catch (const std::exception& ex)
 		{
@@ -1530,13 +1689,12 @@ void GLWidget::enablePBRAOTexMap(const std::vector<int>& ids, const bool& enable
 
 void GLWidget::setPBRAOTexMap(const std::vector<int>& ids, const QString& path)
 {
-	unsigned int texId = loadTextureFromFile(path.toStdString().c_str());
 	for (int id : ids)
 	{
 		try
 		{
 			TriangleMesh* mesh = _meshStore[id];
-			mesh->setAOPBRMap(texId);
+			mesh->setAOPBRMap(TextureCache::instance().acquire(path));
 		}
 		catch (const std::exception& ex)
 		{
@@ -1579,13 +1737,12 @@ void GLWidget::enablePBROpacityTexMap(const std::vector<int>& ids, const bool& e
 
 void GLWidget::setPBROpacityTexMap(const std::vector<int>& ids, const QString& path)
 {
-	unsigned int texId = loadTextureFromFile(path.toStdString().c_str());
 	for (int id : ids)
 	{
 		try
 		{
 			TriangleMesh* mesh = _meshStore[id];
-			mesh->setOpacityPBRMap(texId);
+			mesh->setOpacityPBRMap(TextureCache::instance().acquire(path));
 		}
 		catch (const std::exception& ex)
 		{
@@ -1644,13 +1801,12 @@ void GLWidget::enablePBRHeightTexMap(const std::vector<int>& ids, const bool& en
 
 void GLWidget::setPBRHeightTexMap(const std::vector<int>& ids, const QString& path)
 {
-	unsigned int texId = loadTextureFromFile(path.toStdString().c_str());
 	for (int id : ids)
 	{
 		try
 		{
 			TriangleMesh* mesh = _meshStore[id];
-			mesh->setHeightPBRMap(texId);
+			mesh->setHeightPBRMap(TextureCache::instance().acquire(path));
 		}
 		catch (const std::exception& ex)
 		{
@@ -1708,6 +1864,7 @@ void GLWidget::setTransformation(const std::vector<int>& ids, const QVector3D& t
 		}
 	}
 	updateBoundingSphere();
+	updateSceneBVH();
 }
 
 void GLWidget::resetTransformation(const std::vector<int>& ids)
@@ -1725,6 +1882,37 @@ void GLWidget::resetTransformation(const std::vector<int>& ids)
 		}
 	}
 	updateBoundingSphere();
+	updateSceneBVH();
+}
+
+void GLWidget::updateSceneBVH()
+{
+	// new meshes are inserted, the ones whose bounds changed since are moved
+	for (size_t i = 0; i < _meshStore.size(); i++)
+	{
+		TriangleMesh* mesh = _meshStore[i];
+		if (i >= _sceneBoundsVersions.size())
+		{
+			_sceneBVH.insert(static_cast<int>(i), mesh->getBoundingBox());
+			_sceneBoundsVersions.push_back(mesh->getBoundsVersion());
+		}
+		else if (_sceneBoundsVersions[i] != mesh->getBoundsVersion())
+		{
+			_sceneBVH.update(static_cast<int>(i), mesh->getBoundingBox());
+			_sceneBoundsVersions[i] = mesh->getBoundsVersion();
+		}
+	}
+}
+
+std::vector<bool> GLWidget::pickableMeshes() const
+{
+	std::vector<bool> pickable(_meshStore.size(), false);
+	for (int i : (_visibleSwapped ? _hiddenObjectsIds : _displayedObjectsIds))
+	{
+		if (i >= 0 && i < static_cast<int>(pickable.size()))
+			pickable[i] = true;
+	}
+	return pickable;
 }
 
 void GLWidget::initializeGL()
@@ -1733,7 +1921,12 @@ void GLWidget::initializeGL()
 
 	makeCurrent();
 
+	QElapsedTimer shaderTimer;
+	shaderTimer.start();
+	unsigned int cachedPrograms = ProgramBinaryCache::instance().hitCount();
 	createShaderPrograms();
+	std::cout << "GLWidget::initializeGL : shader programs created in " << shaderTimer.elapsed() << " ms, "
+		<< ProgramBinaryCache::instance().hitCount() - cachedPrograms << " loaded from the binary cache" << std::endl;
 
 	_assimpModelLoader = new AssImpModelLoader(_fgShader);
 	connect(_assimpModelLoader, SIGNAL(fileReadProcessed(float)), this, SLOT(showFileReadingProgress(float)));
@@ -1763,19 +1956,21 @@ void GLWidget::initializeGL()
 
 	createGeometry();
 
-	// Set lighting information
-	_fgShader->bind();
-	_fgShader->setUniformValue("lightSource.ambient", _ambientLight.toVector3D());
-	_fgShader->setUniformValue("lightSource.diffuse", _diffuseLight.toVector3D());
-	_fgShader->setUniformValue("lightSource.specular", _specularLight.toVector3D());
-	_fgShader->setUniformValue("lightSource.position", _lightPosition + QVector3D(_lightOffsetX, _lightOffsetY, _lightOffsetZ));
-	_fgShader->setUniformValue("lightModel.ambient", QVector3D(0.2f, 0.2f, 0.2f));
-	_fgShader->setUniformValue("texUnit", 0);
-	_fgShader->setUniformValue("envMap", 1);
-	_fgShader->setUniformValue("shadowMap", 2);
-	_fgShader->setUniformValue("irradianceMap", 3);
-	_fgShader->setUniformValue("prefilterMap", 4);
-	_fgShader->setUniformValue("brdfLUT", 5);
+	// Lighting and camera go through uniform blocks, updated per view in render()
+	memset(&_frameBlock, 0, sizeof(_frameBlock));
+	memset(&_lightingBlock, 0, sizeof(_lightingBlock));
+	glCreateBuffers(1, &_frameUBO);
+	glNamedBufferData(_frameUBO, sizeof(_frameBlock), &_frameBlock, GL_DYNAMIC_DRAW);
+	glCreateBuffers(1, &_lightingUBO);
+	glNamedBufferData(_lightingUBO, sizeof(_lightingBlock), &_lightingBlock, GL_DYNAMIC_DRAW);
+	memset(&_passBlock, 0, sizeof(_passBlock));
+	_passBlockUploaded = _passBlock;
+	glCreateBuffers(1, &_passUBO);
+	glNamedBufferData(_passUBO, sizeof(_passBlock), &_passBlock, GL_DYNAMIC_DRAW);
+
+	// Texture units are fixed, the samplers are set once, variants set them when they are compiled
+	setupFgShaderSamplers(_fgShader);
+	_fgShaderVariants->setInitializer([this](QOpenGLShaderProgram* prog) { setupFgShaderSamplers(prog); });
 
 	/*std::vector<int> ids;
 	for(size_t i = 0; i < _meshStore.size(); i++)
@@ -1804,6 +1999,14 @@ bool GLWidget::loadCompileAndLinkShaderFromFile(QOpenGLShaderProgram* prog, cons
 	if (prog == nullptr || vertexProg == "" || fragmentProg == "")
 		return false;
 
+	// the stages are hashed in a fixed order, the optional ones only when present
+	QStringList sourceFiles = { vertexProg, tessControlProg, tessEvalProg, geometryProg, fragmentProg };
+	sourceFiles.removeAll("");
+	ProgramBinaryCache& binaryCache = ProgramBinaryCache::instance();
+	QByteArray cacheKey = binaryCache.keyForFiles(sourceFiles);
+	if (binaryCache.load(prog, cacheKey))
+		return true;
+
 	bool success = prog->addShaderFromSourceFile(QOpenGLShader::Vertex, vertexProg);
 	if (!success)
 	{
@@ -1840,11 +2043,16 @@ bool GLWidget::loadCompileAndLinkShaderFromFile(QOpenGLShaderProgram* prog, cons
 	}
 	if (success)
 	{
+		binaryCache.prepare(prog);
 		success = prog->link();
 		if (!success)
 		{
 			qDebug() << "Error linking shader program:" << prog->objectName() << prog->log();
 		}
+		else
+		{
+			binaryCache.save(prog, cacheKey);
+		}
 	}
 
 	return success;
@@ -1858,6 +2066,8 @@ void GLWidget::createShaderPrograms()
 	_fgShader = new QOpenGLShaderProgram(this); _fgShader->setObjectName("_fgShader");
     loadCompileAndLinkShaderFromFile(_fgShader, path + "shaders/twoside_per_fragment.vert",
         path + "shaders/twoside_per_fragment.frag", path + "shaders/twoside_per_fragment.geom");
+	_fgShaderVariants = new ShaderVariants(this, "_fgShader", path + "shaders/twoside_per_fragment.vert",
+		path + "shaders/twoside_per_fragment.frag", path + "shaders/twoside_per_fragment.geom");
 	// Axis
 	_axisShader = new QOpenGLShaderProgram(this); _axisShader->setObjectName("_axisShader");
     loadCompileAndLinkShaderFromFile(_axisShader, path + "shaders/axis.vert", path + "shaders/axis.frag");
@@ -1918,7 +2128,7 @@ void GLWidget::createCappingPlanes()
 	_clippingPlaneXY = new Plane(_clippingPlaneShader, QVector3D(0, 0, 0), 1000, 1000, 1, 1);
 	_clippingPlaneYZ = new Plane(_clippingPlaneShader, QVector3D(0, 0, 0), 1000, 1000, 1, 1);
 	_clippingPlaneZX = new Plane(_clippingPlaneShader, QVector3D(0, 0, 0), 1000, 1000, 1, 1);
-    _cappingTexture = loadTextureFromFile(QString(path + "textures/patterns/hatch_02.png").toStdString().c_str());
+	_cappingTexture = TextureCache::instance().acquire(path + "textures/patterns/hatch_02.png");
 	glActiveTexture(GL_TEXTURE6);
 	glBindTexture(GL_TEXTURE_2D, _cappingTexture);
 }
@@ -2042,7 +2252,7 @@ void GLWidget::loadFloor()
 	}
 	else
 	{
-		_floorTexImage = QGLWidget::convertToGLFormat(_texBuffer); // flipped 32bit RGBA
+		_floorTexImage = TextureState::glFormat(_texBuffer);
 	}
 
 	_floorSize = _boundingSphere.getRadius();
@@ -2073,45 +2283,25 @@ void GLWidget::loadEnvMap()
 	};
 
 	glEnable(GL_TEXTURE_CUBE_MAP_SEAMLESS);
-	glGenTextures(1, &_environmentMap);
-	//std::cout << "GLWidget::loadEnvMap : _environmentMap = " << _environmentMap << std::endl;
-	glActiveTexture(GL_TEXTURE1);
-	glBindTexture(GL_TEXTURE_CUBE_MAP, _environmentMap);
-
-	stbi_set_flip_vertically_on_load(true);
-	int width, height, nrComponents;
-	void* data = nullptr;
-	for (unsigned int i = 0; i < _skyBoxFaces.size(); i++)
+	// the startup skybox is needed right away, only its faces are decoded in parallel
+	QStringList files;
+	for (const QString& face : _skyBoxFaces)
+		files.append(face);
+	if (_skyBoxLoader->loadAndWait(files, _skyBoxTextureHDRI))
 	{
-		if (_skyBoxTextureHDRI)
-			data = static_cast<float*>(stbi_loadf((_skyBoxFaces.at(i)).toStdString().c_str(), &width, &height, &nrComponents, 0));
-		else
-			data = static_cast<unsigned char*>(stbi_load((_skyBoxFaces.at(i)).toStdString().c_str(), &width, &height, &nrComponents, 0));
-
-		if (data)
-		{
-			if (_skyBoxTextureHDRI)
-				glTexImage2D(GL_TEXTURE_CUBE_MAP_POSITIVE_X + i, 0, GL_RGB16F, width, height, 0, GL_RGB, GL_FLOAT, data);
-			else
-				glTexImage2D(GL_TEXTURE_CUBE_MAP_POSITIVE_X + i, 0, GL_RGB16F, width, height, 0, GL_RGB, GL_UNSIGNED_BYTE, data);
-			glGenerateMipmap(GL_TEXTURE_CUBE_MAP);
-			stbi_image_free(data);
-		}
-		else
-		{
-			qWarning("Could not read image file, using single-color instead.");
-			QImage dummy(128, 128, static_cast<QImage::Format>(5));
-			dummy.fill(Qt::white);
-			_texImage = dummy;
-			_texImage = QGLWidget::convertToGLFormat(_texBuffer); // flipped 32bit RGBA
-			glTexImage2D(GL_TEXTURE_CUBE_MAP_POSITIVE_X + i, 0, GL_RGB16F, _texImage.width(), _texImage.height(), 0, GL_RGBA, GL_UNSIGNED_BYTE, _texImage.bits());
-		}
+		_environmentMap = createEnvironmentMap(_skyBoxLoader->faces(), _skyBoxLoader->isHDR());
+		_environmentMapHash = _skyBoxLoader->contentHash();
 	}
-	glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-	glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-	glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
-	glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
-	glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_R, GL_CLAMP_TO_EDGE);
+	else
+	{
+		qWarning("Could not read image file, using single-color instead.");
+		SkyBoxLoader::Face white;
+		white.width = white.height = 128;
+		white.pixels = QByteArray(128 * 128 * 3, static_cast<char>(0xFF));
+		_environmentMap = createEnvironmentMap(std::vector<SkyBoxLoader::Face>(6, white), false);
+		_environmentMapHash = white.pixels;
+	}
+	//std::cout << "GLWidget::loadEnvMap : _environmentMap = " << _environmentMap << std::endl;
 	glActiveTexture(GL_TEXTURE1);
 	glBindTexture(GL_TEXTURE_CUBE_MAP, _environmentMap);
 
@@ -2122,6 +2312,18 @@ void GLWidget::loadEnvMap()
 
 void GLWidget::loadIrradianceMap()
 {
+	QElapsedTimer iblTimer;
+	iblTimer.start();
+	// the convolved maps are cached per environment, the BRDF LUT does not depend on it
+	QString path = QApplication::applicationDirPath() + "/";
+	IBLCache& iblCache = IBLCache::instance();
+	QString environmentKey = QString::fromLatin1(iblCache.key(_environmentMapHash, { path + "shaders/skybox.vert",
+		path + "shaders/irradiance_convolution.frag", path + "shaders/prefilter.frag" }));
+	QString brdfKey = QString::fromLatin1(iblCache.key(QByteArray(), { path + "shaders/brdf.vert", path + "shaders/brdf.frag" }));
+	int computedMaps = 0;
+	if (_shIrradianceEnabled)
+		computeIrradianceSH();
+
 	// PBR: setup framebuffer
 	// ----------------------
 	unsigned int captureFBO;
@@ -2167,30 +2369,36 @@ void GLWidget::loadIrradianceMap()
 	glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
 	glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
 
-	glBindFramebuffer(GL_FRAMEBUFFER, captureFBO);
-	glBindRenderbuffer(GL_RENDERBUFFER, captureRBO);
-	glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH_COMPONENT24, 32, 32);
-
-	// PBR: solve diffuse integral by convolution to create an irradiance (cube)map.
-	// -----------------------------------------------------------------------------
-	_skyBox->setProg(_irradianceShader);
-	_irradianceShader->bind();
-	_irradianceShader->setUniformValue("environmentMap", 1);
-	_irradianceShader->setUniformValue("projectionMatrix", captureProjection);
-	glActiveTexture(GL_TEXTURE1);
-	glBindTexture(GL_TEXTURE_CUBE_MAP, _environmentMap);
-
-	glViewport(0, 0, 32, 32); // don't forget to configure the viewport to the capture dimensions.
-	glBindFramebuffer(GL_FRAMEBUFFER, captureFBO);
-	for (unsigned int i = 0; i < 6; ++i)
+	// not read by the shaders while the spherical harmonics replace it
+	if (!_shIrradianceEnabled && !iblCache.load("irradiance_" + environmentKey, _irradianceMap, GL_TEXTURE_CUBE_MAP, GL_RGB, 1))
 	{
+		glBindFramebuffer(GL_FRAMEBUFFER, captureFBO);
+		glBindRenderbuffer(GL_RENDERBUFFER, captureRBO);
+		glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH_COMPONENT24, 32, 32);
+
+		// PBR: solve diffuse integral by convolution to create an irradiance (cube)map.
+		// -----------------------------------------------------------------------------
+		_skyBox->setProg(_irradianceShader);
 		_irradianceShader->bind();
-		_irradianceShader->setUniformValue("viewMatrix", captureViews[i]);
-		glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_CUBE_MAP_POSITIVE_X + i, _irradianceMap, 0);
-		glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
-		_skyBox->render();
+		_irradianceShader->setUniformValue("environmentMap", 1);
+		_irradianceShader->setUniformValue("projectionMatrix", captureProjection);
+		glActiveTexture(GL_TEXTURE1);
+		glBindTexture(GL_TEXTURE_CUBE_MAP, _environmentMap);
+
+		glViewport(0, 0, 32, 32); // don't forget to configure the viewport to the capture dimensions.
+		glBindFramebuffer(GL_FRAMEBUFFER, captureFBO);
+		for (unsigned int i = 0; i < 6; ++i)
+		{
+			_irradianceShader->bind();
+			_irradianceShader->setUniformValue("viewMatrix", captureViews[i]);
+			glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_CUBE_MAP_POSITIVE_X + i, _irradianceMap, 0);
+			glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+			_skyBox->render();
+		}
+		glBindFramebuffer(GL_FRAMEBUFFER, defaultFramebufferObject());
+		iblCache.save("irradiance_" + environmentKey, _irradianceMap, GL_TEXTURE_CUBE_MAP, GL_RGB, 1);
+		computedMaps++;
 	}
-	glBindFramebuffer(GL_FRAMEBUFFER, defaultFramebufferObject());
 
 	// PBR: create a pre-filter cubemap, and re-scale capture FBO to pre-filter scale.
 	// --------------------------------------------------------------------------------
@@ -2214,69 +2422,84 @@ void GLWidget::loadIrradianceMap()
 	// generate mipmaps for the cubemap so OpenGL automatically allocates the required memory.
 	glGenerateMipmap(GL_TEXTURE_CUBE_MAP);
 
-	// PBR: run a quasi monte-carlo simulation on the environment lighting to create a prefilter (cube)map.
-	// ----------------------------------------------------------------------------------------------------
-	_skyBox->setProg(_prefilterShader);
-	_prefilterShader->bind();
-	_prefilterShader->setUniformValue("environmentMap", 1);
-	_prefilterShader->setUniformValue("projectionMatrix", captureProjection);
-	glActiveTexture(GL_TEXTURE1);
-	glBindTexture(GL_TEXTURE_CUBE_MAP, _environmentMap);
-
-	glBindFramebuffer(GL_FRAMEBUFFER, captureFBO);
 	unsigned int maxMipLevels = 5;
-	for (unsigned int mip = 0; mip < maxMipLevels; ++mip)
+	if (!iblCache.load("prefilter_" + environmentKey, _prefilterMap, GL_TEXTURE_CUBE_MAP, GL_RGB, maxMipLevels))
 	{
-		// reisze framebuffer according to mip-level size.
-		unsigned int mipWidth = 128 * std::pow(0.5, mip);
-		unsigned int mipHeight = 128 * std::pow(0.5, mip);
-		glBindRenderbuffer(GL_RENDERBUFFER, captureRBO);
-		glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH_COMPONENT24, mipWidth, mipHeight);
-		glViewport(0, 0, mipWidth, mipHeight);
-
-		float roughness = (float)mip / (float)(maxMipLevels - 1);
+		// PBR: run a quasi monte-carlo simulation on the environment lighting to create a prefilter (cube)map.
+		// ----------------------------------------------------------------------------------------------------
+		_skyBox->setProg(_prefilterShader);
 		_prefilterShader->bind();
-		_prefilterShader->setUniformValue("roughness", roughness);
-		for (unsigned int i = 0; i < 6; ++i)
-		{
+		_prefilterShader->setUniformValue("environmentMap", 1);
+		_prefilterShader->setUniformValue("projectionMatrix", captureProjection);
+		glActiveTexture(GL_TEXTURE1);
+		glBindTexture(GL_TEXTURE_CUBE_MAP, _environmentMap);
+
+		glBindFramebuffer(GL_FRAMEBUFFER, captureFBO);
+		for (unsigned int mip = 0; mip < maxMipLevels; ++mip)
+		{
+			// reisze framebuffer according to mip-level size.
+			unsigned int mipWidth = 128 * std::pow(0.5, mip);
+			unsigned int mipHeight = 128 * std::pow(0.5, mip);
+			glBindRenderbuffer(GL_RENDERBUFFER, captureRBO);
+			glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH_COMPONENT24, mipWidth, mipHeight);
+			glViewport(0, 0, mipWidth, mipHeight);
+
+			float roughness = (float)mip / (float)(maxMipLevels - 1);
 			_prefilterShader->bind();
-			_prefilterShader->setUniformValue("viewMatrix", captureViews[i]);
-			glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_CUBE_MAP_POSITIVE_X + i, _prefilterMap, mip);
+			_prefilterShader->setUniformValue("roughness", roughness);
+			for (unsigned int i = 0; i < 6; ++i)
+			{
+				_prefilterShader->bind();
+				_prefilterShader->setUniformValue("viewMatrix", captureViews[i]);
+				glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_CUBE_MAP_POSITIVE_X + i, _prefilterMap, mip);
 
-			glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
-			_skyBox->render();
+				glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+				_skyBox->render();
+			}
 		}
+		glBindFramebuffer(GL_FRAMEBUFFER, defaultFramebufferObject());
+		iblCache.save("prefilter_" + environmentKey, _prefilterMap, GL_TEXTURE_CUBE_MAP, GL_RGB, maxMipLevels);
+		computedMaps++;
 	}
-	glBindFramebuffer(GL_FRAMEBUFFER, defaultFramebufferObject());
 
-	// PBR: generate a 2D LUT from the BRDF equations used.
+	// PBR: generate a 2D LUT from the BRDF equations used, once per viewer
+	// and only when it is not cached yet.
 	// ----------------------------------------------------
-	if (_brdfLUTTexture)
-		glDeleteTextures(1, &_brdfLUTTexture);
-	glGenTextures(1, &_brdfLUTTexture);
-	//std::cout << "GLWidget::loadIrradianceMap : _brdfLUTTexture = " << _brdfLUTTexture << std::endl;
+	if (_brdfLUTTexture == 0)
+	{
+		glGenTextures(1, &_brdfLUTTexture);
+		//std::cout << "GLWidget::loadIrradianceMap : _brdfLUTTexture = " << _brdfLUTTexture << std::endl;
+
+		// pre-allocate enough memory for the LUT texture.
+		glBindTexture(GL_TEXTURE_2D, _brdfLUTTexture);
+		glTexImage2D(GL_TEXTURE_2D, 0, GL_RG16F, 512, 512, 0, GL_RG, GL_FLOAT, 0);
+		// be sure to set wrapping mode to GL_CLAMP_TO_EDGE
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
 
-	// pre-allocate enough memory for the LUT texture.
-	glBindTexture(GL_TEXTURE_2D, _brdfLUTTexture);
-	glTexImage2D(GL_TEXTURE_2D, 0, GL_RG16F, 512, 512, 0, GL_RG, GL_FLOAT, 0);
-	// be sure to set wrapping mode to GL_CLAMP_TO_EDGE
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-
-	// then re-configure capture framebuffer object and render screen-space quad with BRDF shader.
-	glBindFramebuffer(GL_FRAMEBUFFER, captureFBO);
-	glBindRenderbuffer(GL_RENDERBUFFER, captureRBO);
-	glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH_COMPONENT24, 512, 512);
-	glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, _brdfLUTTexture, 0);
+		if (!iblCache.load("brdf_" + brdfKey, _brdfLUTTexture, GL_TEXTURE_2D, GL_RG, 1))
+		{
+			// then re-configure capture framebuffer object and render screen-space quad with BRDF shader.
+			glBindFramebuffer(GL_FRAMEBUFFER, captureFBO);
+			glBindRenderbuffer(GL_RENDERBUFFER, captureRBO);
+			glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH_COMPONENT24, 512, 512);
+			glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, _brdfLUTTexture, 0);
 
-	glViewport(0, 0, 512, 512);
-	_brdfShader->bind();
-	glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
-	renderQuad();
+			glViewport(0, 0, 512, 512);
+			_brdfShader->bind();
+			glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+			renderQuad();
 
-	glBindFramebuffer(GL_FRAMEBUFFER, defaultFramebufferObject());
+			glBindFramebuffer(GL_FRAMEBUFFER, defaultFramebufferObject());
+			iblCache.save("brdf_" + brdfKey, _brdfLUTTexture, GL_TEXTURE_2D, GL_RG, 1);
+			computedMaps++;
+		}
+	}
+	glDeleteRenderbuffers(1, &captureRBO);
+	glDeleteFramebuffers(1, &captureFBO);
+	std::cout << "GLWidget::loadIrradianceMap : " << computedMaps << " IBL maps computed, ready in " << iblTimer.elapsed() << " ms" << std::endl;
 
 	// bind pre-computed IBL data
 	glActiveTexture(GL_TEXTURE3);
@@ -2287,6 +2510,29 @@ void GLWidget::loadIrradianceMap()
 	glBindTexture(GL_TEXTURE_2D, _brdfLUTTexture);
 }
 
+void GLWidget::computeIrradianceSH()
+{
+	if (_irradianceSHHash == _environmentMapHash && !_irradianceSH.empty())
+		return;
+
+	QElapsedTimer shTimer;
+	shTimer.start();
+	// irradiance has no high frequencies, a mip level of at most 64 x 64 texels is projected
+	GLint width = 0;
+	glGetTextureLevelParameteriv(_environmentMap, 0, GL_TEXTURE_WIDTH, &width);
+	int level = 0;
+	while ((width >> level) > 64)
+		level++;
+	int size = std::max(1, width >> level);
+	std::vector<float> faces(static_cast<size_t>(size) * size * 3 * 6);
+	glPixelStorei(GL_PACK_ALIGNMENT, 4);
+	glGetTextureImage(_environmentMap, level, GL_RGB, GL_FLOAT, static_cast<GLsizei>(faces.size() * sizeof(float)), faces.data());
+
+	_irradianceSH = IrradianceSH::project(faces, size);
+	_irradianceSHHash = _environmentMapHash;
+	std::cout << "GLWidget::computeIrradianceSH : " << size << " x " << size << " faces projected in " << shTimer.elapsed() << " ms" << std::endl;
+}
+
 void GLWidget::resizeGL(int width, int height)
 {
 	float w = (float)width;
@@ -2334,12 +2580,22 @@ void GLWidget::paintGL()
 		_bgBotColor.alphaF());
 	try
 	{
+		// reads issued since the last frame refer to the previous contents of the id buffer,
+		// a frame changing the hovered mesh keeps the ids current for the next read
+		if (collectObjectIdReads())
+			_objectIdPassRequested = true;
+		if (_objectIdPassRequested)
+			clearObjectIdBuffer();
+		// textures may have been bound or deleted outside of the mesh draws since the last frame
+		TextureState::instance().beginFrame();
+
 		glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT | GL_STENCIL_BUFFER_BIT);
 
 		gradientBackground(topColor.redF(), topColor.greenF(), topColor.blueF(), topColor.alphaF(),
 			botColor.redF(), botColor.greenF(), botColor.blueF(), botColor.alphaF());
 
 		_modelMatrix.setToIdentity();
+		_lodPixelError = _multiViewActive ? LOD_MULTIVIEW_PIXEL_ERROR : LOD_PIXEL_ERROR;
 		if (_multiViewActive)
 		{
             glViewport(0, 0, width(), height());
@@ -2446,6 +2702,24 @@ void GLWidget::paintGL()
 		std::cout << "Exception raised in GLWidget::paintGL\n" << ex.what() << std::endl;
 	}
 
+	// any frame drawn without the ids may show a moved camera or a changed scene
+	if (_objectIdPassRequested)
+	{
+		_objectIdPassRequested = false;
+		_objectIdBufferDirty = false;
+		if (_objectIdReadPixel != QPoint(-1, -1))
+		{
+			readObjectIdBuffer(_objectIdReadPixel);
+			_objectIdReadPixel = QPoint(-1, -1);
+			scheduleObjectIdCollect();
+		}
+	}
+	else
+	{
+		_objectIdBufferDirty = true;
+		_pickedPixel = QPoint(-1, -1);
+	}
+
 	// For testing rendered shadow map
 	/*_debugShader.bind();
 	_debugShader.setUniformValue("near_plane", 1.0f);
@@ -2477,9 +2751,10 @@ void GLWidget::drawFloor()
 
 		// Draw floor
 		_fgShader->bind();
-		_fgShader->setUniformValue("envMapEnabled", false);
-		_fgShader->setUniformValue("floorRendering", true);
-		_fgShader->setUniformValue("renderingMode", static_cast<int>(RenderingMode::ADS_PHONG));
+		_passBlock.envMapEnabled = false;
+		_passBlock.floorRendering = true;
+		_passBlock.renderingMode = static_cast<int>(RenderingMode::ADS_PHONG);
+		updatePassUniforms();
 		_floorPlane->enableTexture(false);
 		_floorPlane->render();
 		glDisable(GL_CULL_FACE);
@@ -2497,11 +2772,12 @@ void GLWidget::drawFloor()
 		model.translate(0.0f, 0.0f, -offset);
 
 		_fgShader->bind();
-		_fgShader->setUniformValue("modelMatrix", model);
+		storeStd140(_passBlock.modelMatrix, model);
+		updatePassUniforms();
 		if (_reflectionsEnabled)
 		{
-			_fgShader->setUniformValue("renderingMode", static_cast<int>(_renderingMode));
-			drawMesh(_fgShader);
+			_passBlock.renderingMode = static_cast<int>(_renderingMode);
+			drawMesh(_fgShader, model);
 		}
 
 		glStencilMask(0x00);
@@ -2514,15 +2790,17 @@ void GLWidget::drawFloor()
 	glEnable(GL_CULL_FACE);
 	glCullFace(GL_FRONT);
 	_fgShader->bind();
-	_fgShader->setUniformValue("envMapEnabled", _envMapEnabled);
-	_fgShader->setUniformValue("renderingMode", static_cast<int>(RenderingMode::ADS_PHONG));
-	_fgShader->setUniformValue("shadowSamples", 18.0f);
+	_passBlock.envMapEnabled = _envMapEnabled;
+	_passBlock.renderingMode = static_cast<int>(RenderingMode::ADS_PHONG);
+	_passBlock.shadowSamples = 18.0f;
+	updatePassUniforms();
 	_floorPlane->enableTexture(_floorTextureDisplayed);
 	_floorPlane->render();
 	glDisable(GL_CULL_FACE);
 	_fgShader->bind();
-	_fgShader->setUniformValue("floorRendering", false);
-	_fgShader->setUniformValue("renderingMode", static_cast<int>(_renderingMode));
+	_passBlock.floorRendering = false;
+	_passBlock.renderingMode = static_cast<int>(_renderingMode);
+	updatePassUniforms();
 }
 
 void GLWidget::drawSkyBox()
@@ -2547,11 +2825,19 @@ void GLWidget::drawSkyBox()
 	glDisable((GL_DEPTH_TEST));
 }
 
-void GLWidget::drawMesh(QOpenGLShaderProgram* prog)
+void GLWidget::drawMesh(QOpenGLShaderProgram* prog, const QMatrix4x4& modelMatrix)
 {
 	QVector3D pos = _primaryCamera->getPosition();
 
 	setupClippingUniforms(prog, pos);
+	if (prog == _fgShader)
+		updatePassUniforms();
+
+	int viewport[4];
+	glGetIntegerv(GL_VIEWPORT, viewport);
+
+	// view volume of the camera being rendered, the model matrix mirrors the floor reflection
+	Frustum frustum(_projectionMatrix * _viewMatrix * modelMatrix);
 
 	// Render
 	if (_meshStore.size() != 0)
@@ -2563,7 +2849,11 @@ void GLWidget::drawMesh(QOpenGLShaderProgram* prog)
 				TriangleMesh* mesh = _meshStore.at(i);
 				if (mesh)
 				{
-					mesh->setProg(prog);
+					if (!frustum.intersects(mesh->getBoundingSphere()) || !frustum.intersects(mesh->getBoundingBox()))
+						continue;
+					mesh->setLodLevel(lodLevelForMesh(mesh, _viewMatrix, _projectionMatrix, viewport[3], _lodPixelError));
+					// the uber shader is replaced by the variant built for this mesh
+					mesh->setProg(prog == _fgShader ? fgShaderVariant(mesh) : prog);
 					mesh->render();
 				}
 			}
@@ -2575,6 +2865,26 @@ void GLWidget::drawMesh(QOpenGLShaderProgram* prog)
 	}
 }
 
+int GLWidget::lodLevelForMesh(TriangleMesh* mesh, const QMatrix4x4& view, const QMatrix4x4& projection, int viewportHeight, float maxPixelError)
+{
+	mesh->updateLodChain();
+	if (mesh->getLodCount() < 2)
+		return 0;
+
+	// projected size of the bounding sphere radius in pixels
+	BoundingSphere sphere = mesh->getBoundingSphere();
+	float radiusPixels = sphere.getRadius() * projection(1, 1) * 0.5f * viewportHeight;
+	if (projection(3, 2) != 0.0f)
+	{
+		// perspective projection, full detail when the camera is inside the sphere
+		float depth = -view.map(sphere.getCenter()).z();
+		if (depth <= sphere.getRadius())
+			return 0;
+		radiusPixels /= depth;
+	}
+	return mesh->selectLodLevel(radiusPixels, maxPixelError);
+}
+
 void GLWidget::drawSectionCapping()
 {
 	// We use a lightweight shader without lighting and stuff for drawing the clipped mesh
@@ -2648,7 +2958,7 @@ void GLWidget::drawSectionCapping()
 			_clippingPlaneShader->setUniformValue("modelMatrix", model);
 			_clippingPlaneShader->setUniformValue("viewMatrix", _viewMatrix);
 			_clippingPlaneShader->setUniformValue("projectionMatrix", _projectionMatrix);
-			glActiveTexture(GL_TEXTURE13);
+			glActiveTexture(GL_TEXTURE6);
 			glBindTexture(GL_TEXTURE_2D, _cappingTexture);
 			_clippingPlaneShader->setUniformValue("hatchMap", 6);
 			float yAng = _clipXFlipped || _clipXCoeff > 0 ? 90.0f : -90.0f;
@@ -2702,6 +3012,7 @@ void GLWidget::drawVertexNormals()
 {
 	QVector3D pos = _primaryCamera->getPosition();
 	setupClippingUniforms(_vertexNormalShader, pos);
+	Frustum frustum(_projectionMatrix * _viewMatrix * _modelMatrix);
 
 	if (_meshStore.size() != 0)
 	{
@@ -2710,9 +3021,12 @@ void GLWidget::drawVertexNormals()
 			if (_showVertexNormals)
 			{
 				TriangleMesh* mesh = _meshStore.at(i);
+				if (!frustum.intersects(mesh->getBoundingSphere()) || !frustum.intersects(mesh->getBoundingBox()))
+					continue;
 				mesh->setProg(_vertexNormalShader);
+				_vertexNormalShader->setUniformValue("meshMatrix", mesh->getTransformation());
 				mesh->getVAO().bind();
-				glDrawElements(GL_TRIANGLES, static_cast<int>(mesh->getPoints().size()), GL_UNSIGNED_INT, 0);
+				glDrawElements(GL_TRIANGLES, static_cast<int>(mesh->getIndexCount()), mesh->getIndexType(), 0);
 				mesh->getVAO().release();
 			}
 		}
@@ -2723,6 +3037,7 @@ void GLWidget::drawFaceNormals()
 {
 	QVector3D pos = _primaryCamera->getPosition();
 	setupClippingUniforms(_faceNormalShader, pos);
+	Frustum frustum(_projectionMatrix * _viewMatrix * _modelMatrix);
 
 	if (_meshStore.size() != 0)
 	{
@@ -2731,9 +3046,12 @@ void GLWidget::drawFaceNormals()
 			if (_showFaceNormals)
 			{
 				TriangleMesh* mesh = _meshStore.at(i);
-				mesh->setProg(_faceNormalShader);				
+				if (!frustum.intersects(mesh->getBoundingSphere()) || !frustum.intersects(mesh->getBoundingBox()))
+					continue;
+				mesh->setProg(_faceNormalShader);
+				_faceNormalShader->setUniformValue("meshMatrix", mesh->getTransformation());
 				mesh->getVAO().bind();
-				glDrawElements(GL_TRIANGLES, static_cast<int>(mesh->getPoints().size()), GL_UNSIGNED_INT, 0);
+				glDrawElements(GL_TRIANGLES, static_cast<int>(mesh->getIndexCount()), mesh->getIndexType(), 0);
 				mesh->getVAO().release();
 			}
 		}
@@ -2827,7 +3145,7 @@ void GLWidget::drawAxis()
 	_axisShader->setUniformValue("coneColor", QVector3D(1.0f, 0.0, 0.0));
 	_axisShader->setUniformValue("modelViewMatrix", _viewMatrix * model);
 	_axisCone->getVAO().bind();
-	glDrawElements(GL_TRIANGLES, static_cast<GLsizei>(_axisCone->getPoints().size()), GL_UNSIGNED_INT, 0);
+	glDrawElements(GL_TRIANGLES, static_cast<GLsizei>(_axisCone->getIndexCount()), _axisCone->getIndexType(), 0);
 	_axisCone->getVAO().release();
 
 	// Y Axis
@@ -2838,7 +3156,7 @@ void GLWidget::drawAxis()
 	_axisShader->setUniformValue("coneColor", QVector3D(0.0, 1.0f, 0.0));
 	_axisShader->setUniformValue("modelViewMatrix", _viewMatrix * model);
 	_axisCone->getVAO().bind();
-	glDrawElements(GL_TRIANGLES, static_cast<GLsizei>(_axisCone->getPoints().size()), GL_UNSIGNED_INT, 0);
+	glDrawElements(GL_TRIANGLES, static_cast<GLsizei>(_axisCone->getIndexCount()), _axisCone->getIndexType(), 0);
 	_axisCone->getVAO().release();
 
 	// Z Axis
@@ -2848,7 +3166,7 @@ void GLWidget::drawAxis()
 	_axisShader->setUniformValue("coneColor", QVector3D(0.0, 0.0, 1.0f));
 	_axisShader->setUniformValue("modelViewMatrix", _viewMatrix * model);
 	_axisCone->getVAO().bind();
-	glDrawElements(GL_TRIANGLES, static_cast<GLsizei>(_axisCone->getPoints().size()), GL_UNSIGNED_INT, 0);
+	glDrawElements(GL_TRIANGLES, static_cast<GLsizei>(_axisCone->getIndexCount()), _axisCone->getIndexType(), 0);
 	_axisCone->getVAO().release();
 
 	_axisVAO.release();
@@ -2947,7 +3265,7 @@ void GLWidget::drawCornerAxis()
 	_axisShader->setUniformValue("coneColor", QVector3D(1.0f, 1.0f, 1.0f));
 	_axisShader->setUniformValue("modelViewMatrix", mat);
 	_axisCone->getVAO().bind();
-	glDrawElements(GL_TRIANGLES, static_cast<GLsizei>(_axisCone->getPoints().size()), GL_UNSIGNED_INT, 0);
+	glDrawElements(GL_TRIANGLES, static_cast<GLsizei>(_axisCone->getIndexCount()), _axisCone->getIndexType(), 0);
 	_axisCone->getVAO().release();
 
 	// Y Axis
@@ -2959,7 +3277,7 @@ void GLWidget::drawCornerAxis()
 	_axisShader->bind();
 	_axisShader->setUniformValue("modelViewMatrix", mat);
 	_axisCone->getVAO().bind();
-	glDrawElements(GL_TRIANGLES, static_cast<GLsizei>(_axisCone->getPoints().size()), GL_UNSIGNED_INT, 0);
+	glDrawElements(GL_TRIANGLES, static_cast<GLsizei>(_axisCone->getIndexCount()), _axisCone->getIndexType(), 0);
 	_axisCone->getVAO().release();
 
 	// Z Axis
@@ -2970,7 +3288,7 @@ void GLWidget::drawCornerAxis()
 	_axisShader->bind();
 	_axisShader->setUniformValue("modelViewMatrix", mat);
 	_axisCone->getVAO().bind();
-	glDrawElements(GL_TRIANGLES, static_cast<GLsizei>(_axisCone->getPoints().size()), GL_UNSIGNED_INT, 0);
+	glDrawElements(GL_TRIANGLES, static_cast<GLsizei>(_axisCone->getIndexCount()), _axisCone->getIndexType(), 0);
 	_axisCone->getVAO().release();
 
 	_axisVAO.release();
@@ -3017,33 +3335,16 @@ void GLWidget::render(GLCamera* camera)
 	bool floorVisible = QVector3D::dotProduct(viewDir, zDir) < 0.0f;
 	bool showShadows = (_shadowsEnabled && floorVisible && !_lowResEnabled && camera == _primaryCamera);
 
+	updateFrameUniforms(showShadows);
+
+	// the floor pass overrides part of this state
 	_fgShader->bind();
-	_fgShader->setUniformValue("lightSource.ambient", _ambientLight.toVector3D());
-	_fgShader->setUniformValue("lightSource.diffuse", _diffuseLight.toVector3D());
-	_fgShader->setUniformValue("lightSource.specular", _specularLight.toVector3D());
-	_fgShader->setUniformValue("lightSource.position", _lightPosition + QVector3D(_lightOffsetX, _lightOffsetY, _lightOffsetZ));
-	_fgShader->setUniformValue("lightModel.ambient", QVector3D(0.2f, 0.2f, 0.2f));
-	_fgShader->setUniformValue("modelViewMatrix", _modelViewMatrix);
-	_fgShader->setUniformValue("normalMatrix", _modelViewMatrix.normalMatrix());
-	_fgShader->setUniformValue("projectionMatrix", _projectionMatrix);
-	_fgShader->setUniformValue("viewportMatrix", _viewportMatrix);
-	_fgShader->setUniformValue("Line.Width", 0.75f);
-	_fgShader->setUniformValue("Line.Color", QVector4D(0.05f, 0.0f, 0.05f, 1.0f));
-	_fgShader->setUniformValue("displayMode", static_cast<int>(_displayMode));
-	_fgShader->setUniformValue("renderingMode", static_cast<int>(_renderingMode));
-	_fgShader->setUniformValue("envMapEnabled", _envMapEnabled);
-	_fgShader->setUniformValue("shadowsEnabled", showShadows);
-	_fgShader->setUniformValue("reflectionMapEnabled", false);
-	_fgShader->setUniformValue("cameraPos", _primaryCamera->getPosition());
-	_fgShader->setUniformValue("lightPos", _lightPosition + QVector3D(_lightOffsetX, _lightOffsetY, _lightOffsetZ));
-	_fgShader->setUniformValue("modelMatrix", _modelMatrix);
-	_fgShader->setUniformValue("viewMatrix", _viewMatrix);
-	_fgShader->setUniformValue("lightSpaceMatrix", _lightSpaceMatrix);
-	_fgShader->setUniformValue("lockLightAndCamera", _lockLightAndCamera);
-	_fgShader->setUniformValue("hdrToneMapping", _hdrToneMapping);
-	_fgShader->setUniformValue("gammaCorrection", _gammaCorrection);
-	_fgShader->setUniformValue("screenGamma", _screenGamma);
-	_fgShader->setUniformValue("shadowSamples", 27.0f);
+	_passBlock.renderingMode = static_cast<int>(_renderingMode);
+	_passBlock.envMapEnabled = _envMapEnabled;
+	_passBlock.floorRendering = false;
+	storeStd140(_passBlock.modelMatrix, _modelMatrix);
+	_passBlock.shadowSamples = 27.0f;
+	updatePassUniforms();
 
 	glPolygonMode(GL_FRONT_AND_BACK, _displayMode == DisplayMode::WIREFRAME ? GL_LINE : GL_FILL);
 	glLineWidth(_displayMode == DisplayMode::WIREFRAME ? 1.25 : 1.0);
@@ -3099,6 +3400,9 @@ void GLWidget::render(GLCamera* camera)
 		drawFaceNormals();
 	}
 
+	if (_objectIdPassRequested)
+		renderToObjectIdBuffer();
+
 	/*
 	if (!(_clipDX == 0 && _clipDY == 0 && _clipDZ == 0))
 	{
@@ -3125,6 +3429,117 @@ void GLWidget::render(GLCamera* camera)
 	_fgShader->release();
 }
 
+void GLWidget::updateFrameUniforms(bool showShadows)
+{
+	QVector3D lightPos = _lightPosition + QVector3D(_lightOffsetX, _lightOffsetY, _lightOffsetZ);
+
+	FrameUniformBlock frame;
+	memset(&frame, 0, sizeof(frame));
+	storeStd140(frame.viewMatrix, _viewMatrix);
+	storeStd140(frame.modelViewMatrix, _modelViewMatrix);
+	storeStd140(frame.projectionMatrix, _projectionMatrix);
+	storeStd140(frame.viewportMatrix, _viewportMatrix);
+	storeStd140(frame.lightSpaceMatrix, _lightSpaceMatrix);
+	storeStd140(frame.normalMatrix, _modelViewMatrix.normalMatrix());
+	storeStd140(frame.cameraPos, _primaryCamera->getPosition());
+	storeStd140(frame.lightPos, lightPos);
+	frame.displayMode = static_cast<int>(_displayMode);
+
+	LightingUniformBlock lighting;
+	memset(&lighting, 0, sizeof(lighting));
+	storeStd140(lighting.lightAmbient, _ambientLight.toVector3D());
+	storeStd140(lighting.lightDiffuse, _diffuseLight.toVector3D());
+	storeStd140(lighting.lightSpecular, _specularLight.toVector3D());
+	storeStd140(lighting.lightPosition, lightPos);
+	storeStd140(lighting.lightModelAmbient, QVector3D(0.2f, 0.2f, 0.2f));
+	lighting.lineWidth = 0.75f;
+	lighting.lineColor[0] = 0.05f;
+	lighting.lineColor[1] = 0.0f;
+	lighting.lineColor[2] = 0.05f;
+	lighting.lineColor[3] = 1.0f;
+	lighting.shadowsEnabled = showShadows;
+	lighting.lockLightAndCamera = _lockLightAndCamera;
+	lighting.hdrToneMapping = _hdrToneMapping;
+	lighting.gammaCorrection = _gammaCorrection;
+	lighting.screenGamma = _screenGamma;
+	lighting.shIrradiance = _shIrradianceEnabled && _irradianceSH.size() == static_cast<size_t>(IrradianceSH::COEFFICIENT_COUNT);
+	if (lighting.shIrradiance)
+	{
+		for (int i = 0; i < IrradianceSH::COEFFICIENT_COUNT; i++)
+			storeStd140(lighting.irradianceSH[i], _irradianceSH[i]);
+	}
+
+	// nothing is uploaded while the view does not change
+	if (memcmp(&frame, &_frameBlock, sizeof(frame)) != 0)
+	{
+		glNamedBufferSubData(_frameUBO, 0, sizeof(frame), &frame);
+		_frameBlock = frame;
+	}
+	if (memcmp(&lighting, &_lightingBlock, sizeof(lighting)) != 0)
+	{
+		glNamedBufferSubData(_lightingUBO, 0, sizeof(lighting), &lighting);
+		_lightingBlock = lighting;
+	}
+	glBindBufferBase(GL_UNIFORM_BUFFER, FrameUniformBlock::BINDING, _frameUBO);
+	glBindBufferBase(GL_UNIFORM_BUFFER, LightingUniformBlock::BINDING, _lightingUBO);
+}
+
+void GLWidget::updatePassUniforms()
+{
+	if (memcmp(&_passBlock, &_passBlockUploaded, sizeof(_passBlock)) != 0)
+	{
+		glNamedBufferSubData(_passUBO, 0, sizeof(_passBlock), &_passBlock);
+		_passBlockUploaded = _passBlock;
+	}
+	glBindBufferBase(GL_UNIFORM_BUFFER, PassUniformBlock::BINDING, _passUBO);
+}
+
+void GLWidget::setupFgShaderSamplers(QOpenGLShaderProgram* prog)
+{
+	prog->bind();
+	prog->setUniformValue("texUnit", 0);
+	prog->setUniformValue("envMap", 1);
+	prog->setUniformValue("shadowMap", 2);
+	prog->setUniformValue("irradianceMap", 3);
+	prog->setUniformValue("prefilterMap", 4);
+	prog->setUniformValue("brdfLUT", 5);
+	prog->setUniformValue("texture_diffuse", 10);
+	prog->setUniformValue("texture_specular", 11);
+	prog->setUniformValue("texture_emissive", 12);
+	prog->setUniformValue("texture_normal", 13);
+	prog->setUniformValue("texture_height", 14);
+	prog->setUniformValue("texture_opacity", 15);
+	prog->setUniformValue("albedoMap", 20);
+	prog->setUniformValue("normalMap", 21);
+	prog->setUniformValue("metallicMap", 22);
+	prog->setUniformValue("roughnessMap", 23);
+	prog->setUniformValue("aoMap", 24);
+	prog->setUniformValue("heightMap", 25);
+	prog->setUniformValue("opacityMap", 26);
+}
+
+QOpenGLShaderProgram* GLWidget::fgShaderVariant(const TriangleMesh* mesh)
+{
+	// display and rendering mode become constants so the compiler drops the branches
+	// of the other modes, meshes without maps also lose all texture fetches
+	int displayMode = static_cast<int>(_displayMode);
+	int renderingMode = _passBlock.renderingMode;
+	bool noTextureMaps = !mesh->hasTextureMaps();
+	unsigned int key = displayMode | (renderingMode << 2) | (noTextureMaps ? 1 << 4 : 0);
+
+	QOpenGLShaderProgram* prog = _fgShaderVariants->find(key);
+	if (!prog)
+	{
+		QByteArray defines;
+		defines += "#define DISPLAY_MODE " + QByteArray::number(displayMode) + "\n";
+		defines += "#define RENDERING_MODE " + QByteArray::number(renderingMode) + "\n";
+		if (noTextureMaps)
+			defines += "#define NO_TEXTURE_MAPS\n";
+		prog = _fgShaderVariants->compile(key, defines);
+	}
+	return prog;
+}
+
 void GLWidget::renderToShadowBuffer()
 {
 	// save current viewport
@@ -3156,6 +3571,8 @@ void GLWidget::renderToShadowBuffer()
 	_shadowMappingShader->bind();
 	_shadowMappingShader->setUniformValue("lightSpaceMatrix", _lightSpaceMatrix);
 	_shadowMappingShader->setUniformValue("model", _modelMatrix);
+	// casters outside the light volume cannot shadow anything inside the shadow map
+	Frustum lightFrustum(_lightSpaceMatrix * _modelMatrix);
 	if (_meshStore.size() != 0)
 	{
 		for (int i : (_visibleSwapped ? _hiddenObjectsIds : _displayedObjectsIds))
@@ -3165,9 +3582,14 @@ void GLWidget::renderToShadowBuffer()
 				TriangleMesh* mesh = _meshStore.at(i);
 				if (mesh)
 				{
+					if (!lightFrustum.intersects(mesh->getBoundingSphere()) || !lightFrustum.intersects(mesh->getBoundingBox()))
+						continue;
 					mesh->setProg(_shadowMappingShader);
+					_shadowMappingShader->setUniformValue("meshMatrix", mesh->getTransformation());
+					// the size the caster takes in the shadow map, not on screen
+					int lod = lodLevelForMesh(mesh, lightView, lightProjection, _shadowHeight, LOD_SHADOW_PIXEL_ERROR);
 					mesh->getVAO().bind();
-					glDrawElements(GL_TRIANGLES, static_cast<int>(mesh->getPoints().size()), GL_UNSIGNED_INT, 0);
+					glDrawElements(GL_TRIANGLES, static_cast<int>(mesh->getLodIndexCount(lod)), mesh->getIndexType(), mesh->getLodIndexPointer(lod));
 					mesh->getVAO().release();
 				}
 			}
@@ -3195,99 +3617,263 @@ int GLWidget::processSelection(const QPoint& pixel)
 		}
 		else
 		{
+			// overlapping candidates are resolved with the object id buffer, normally the
+			// read for the cursor position was already issued while the mouse moved there
 			makeCurrent();
-			if(_selectionFBO == 0)
-				glGenFramebuffers(1, &_selectionFBO);
-			glBindFramebuffer(GL_FRAMEBUFFER, _selectionFBO);
-			glFramebufferParameteri(GL_FRAMEBUFFER, GL_FRAMEBUFFER_DEFAULT_SAMPLES, 0);
-			if(_selectionRBO == 0)
-				glGenRenderbuffers(1, &_selectionRBO);
-			glBindRenderbuffer(GL_RENDERBUFFER, _selectionRBO);
-			glRenderbufferStorage(GL_RENDERBUFFER, GL_RGBA, width(), height());
-			glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_RENDERBUFFER, _selectionRBO);
-			GLenum DrawBuffers[1] = { GL_COLOR_ATTACHMENT0 };
-			glDrawBuffers(1, DrawBuffers);
-			if(_selectionDBO == 0)
-				glGenRenderbuffers(1, &_selectionDBO);
-			glBindRenderbuffer(GL_RENDERBUFFER, (GLuint)_selectionDBO);
-			glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH_COMPONENT, width(), height());	
-			glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_RENDERBUFFER, _selectionDBO);
-			GLenum status = glCheckFramebufferStatus(GL_FRAMEBUFFER);
-			if (status != GL_FRAMEBUFFER_COMPLETE)
-				std::cout << "Failed to create selection framebuffer" << std::endl;
-
-			// save current viewport
-			int viewport[4];
-			glGetIntegerv(GL_VIEWPORT, viewport);
-
-			glClearColor(0.0f, 0.0f, 0.0f, 1.0f);
-			glViewport(0, 0, width(), height());
-			glBindFramebuffer(GL_FRAMEBUFFER, _selectionFBO);
-			glDrawBuffer(GL_COLOR_ATTACHMENT0);
-			glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
-			glEnable(GL_DEPTH_TEST);
-			glDisable(GL_BLEND);			
-			_selectionShader->bind();
-			_selectionShader->setUniformValue("projectionMatrix", _projectionMatrix);
-			_selectionShader->setUniformValue("modelViewMatrix", _modelViewMatrix);
+			if (collectObjectIdReads())
+			{
+				_objectIdPassRequested = true;
+				update();
+			}
+			if (_pickedPixel == pixel)
+			{
+				if (_selectedIDs.contains(_pickedId))
+					id = _pickedId;
+			}
+			else
+			{
+				// resolved in collectObjectIdReads once the gpu has written the ids
+				_pendingSelectionPixel = pixel;
+				_pendingSelectionIDs = _selectedIDs;
+				requestObjectIdRead(pixel);
+			}
+		}
+	}
+
+	return id;
+}
+
+void GLWidget::clearObjectIdBuffer()
+{
+	QSize size(width(), height());
+	if (_objectIdFBO == 0 || _objectIdBufferSize != size)
+	{
+		if (_objectIdFBO == 0)
+		{
+			glGenFramebuffers(1, &_objectIdFBO);
+			glGenTextures(1, &_objectIdTexture);
+			glGenRenderbuffers(1, &_objectIdDepthRBO);
+			for (ObjectIdRead& read : _objectIdReads)
+			{
+				glGenBuffers(1, &read.pbo);
+				glBindBuffer(GL_PIXEL_PACK_BUFFER, read.pbo);
+				glBufferData(GL_PIXEL_PACK_BUFFER, OBJECT_ID_PATCH_SIZE * OBJECT_ID_PATCH_SIZE * 2 * sizeof(GLuint), nullptr, GL_STREAM_READ);
+			}
+			glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+		}
+		// storage is only reallocated when the widget is resized
+		glBindTexture(GL_TEXTURE_2D, _objectIdTexture);
+		glTexImage2D(GL_TEXTURE_2D, 0, GL_RG32UI, size.width(), size.height(), 0, GL_RG_INTEGER, GL_UNSIGNED_INT, nullptr);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+		glBindTexture(GL_TEXTURE_2D, 0);
+		glBindRenderbuffer(GL_RENDERBUFFER, _objectIdDepthRBO);
+		glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH_COMPONENT24, size.width(), size.height());
+		glBindRenderbuffer(GL_RENDERBUFFER, 0);
+		glBindFramebuffer(GL_FRAMEBUFFER, _objectIdFBO);
+		glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, _objectIdTexture, 0);
+		glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_RENDERBUFFER, _objectIdDepthRBO);
+		if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
+			std::cout << "Failed to create object id framebuffer" << std::endl;
+		_objectIdBufferSize = size;
+		// ids read from the old buffer no longer match the screen
+		_pickedPixel = QPoint(-1, -1);
+	}
+	glBindFramebuffer(GL_FRAMEBUFFER, _objectIdFBO);
+	const GLuint noObject[4] = { 0, 0, 0, 0 };
+	const GLfloat farDepth = 1.0f;
+	glDepthMask(GL_TRUE);
+	glClearBufferuiv(GL_COLOR, 0, noObject);
+	glClearBufferfv(GL_DEPTH, 0, &farDepth);
+	glBindFramebuffer(GL_FRAMEBUFFER, defaultFramebufferObject());
+}
+
+void GLWidget::renderToObjectIdBuffer()
+{
+	if (_objectIdFBO == 0 || _meshStore.size() == 0)
+		return;
+
+	// drawn with the viewport of the current view, so the ids line up with the screen pixels
+	glBindFramebuffer(GL_DRAW_FRAMEBUFFER, _objectIdFBO);
+	glEnable(GL_DEPTH_TEST);
+	glDisable(GL_BLEND);
+	_selectionShader->bind();
+	_selectionShader->setUniformValue("projectionMatrix", _projectionMatrix);
+	_selectionShader->setUniformValue("modelViewMatrix", _modelViewMatrix);
+	Frustum viewFrustum(_projectionMatrix * _viewMatrix * _modelMatrix);
+	for (int i : (_visibleSwapped ? _hiddenObjectsIds : _displayedObjectsIds))
+	{
+		try
+		{
+			TriangleMesh* mesh = _meshStore.at(i);
+			if (mesh && viewFrustum.intersects(mesh->getBoundingSphere()) && viewFrustum.intersects(mesh->getBoundingBox()))
+			{
+				// full resolution, the triangle ids must refer to the original index list
+				mesh->setProg(_selectionShader);
+				_selectionShader->setUniformValue("objectId", static_cast<GLuint>(i + 1));
+				_selectionShader->setUniformValue("meshMatrix", mesh->getTransformation());
+				mesh->getVAO().bind();
+				glDrawElements(GL_TRIANGLES, static_cast<int>(mesh->getIndexCount()), mesh->getIndexType(), 0);
+				mesh->getVAO().release();
+			}
+		}
+		catch (const std::exception& ex)
+		{
+			std::cout << "Exception raised in GLWidget::renderToObjectIdBuffer\n" << ex.what() << std::endl;
+		}
+	}
+	_selectionShader->release();
+	glBindFramebuffer(GL_DRAW_FRAMEBUFFER, defaultFramebufferObject());
+	_fgShader->bind();
+}
+
+void GLWidget::readObjectIdBuffer(const QPoint& pixel)
+{
+	if (_objectIdFBO == 0 || _objectIdBufferSize.width() < OBJECT_ID_PATCH_SIZE || _objectIdBufferSize.height() < OBJECT_ID_PATCH_SIZE)
+		return;
+	ObjectIdRead& read = _objectIdReads[_objectIdReadIndex];
+	// all pixel buffers are still in flight, this position is skipped
+	if (read.fence)
+		return;
+
+	int half = OBJECT_ID_PATCH_SIZE / 2;
+	int x = qBound(0, pixel.x() - half, _objectIdBufferSize.width() - OBJECT_ID_PATCH_SIZE);
+	int y = qBound(0, _objectIdBufferSize.height() - pixel.y() - 1 - half, _objectIdBufferSize.height() - OBJECT_ID_PATCH_SIZE);
+	glBindFramebuffer(GL_READ_FRAMEBUFFER, _objectIdFBO);
+	glReadBuffer(GL_COLOR_ATTACHMENT0);
+	glBindBuffer(GL_PIXEL_PACK_BUFFER, read.pbo);
+	// into the bound pixel buffer, returns without waiting for the gpu
+	glReadPixels(x, y, OBJECT_ID_PATCH_SIZE, OBJECT_ID_PATCH_SIZE, GL_RG_INTEGER, GL_UNSIGNED_INT, nullptr);
+	glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+	glBindFramebuffer(GL_READ_FRAMEBUFFER, defaultFramebufferObject());
+	read.fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+	read.pixel = pixel;
+	_objectIdReadIndex = (_objectIdReadIndex + 1) % OBJECT_ID_READ_COUNT;
+}
+
+void GLWidget::requestObjectIdRead(const QPoint& pixel)
+{
+	makeCurrent();
+	if (collectObjectIdReads())
+		_objectIdPassRequested = true;
+	if (_objectIdBufferDirty)
+	{
+		// read after the ids were drawn with the next frame
+		_objectIdPassRequested = true;
+		_objectIdReadPixel = pixel;
+		update();
+		return;
+	}
+	readObjectIdBuffer(pixel);
+	scheduleObjectIdCollect();
+	if (_objectIdPassRequested)
+		update();
+}
+
+void GLWidget::scheduleObjectIdCollect()
+{
+	if (_objectIdCollectScheduled)
+		return;
+	_objectIdCollectScheduled = true;
+	QTimer::singleShot(16, this, [this]() {
+		_objectIdCollectScheduled = false;
+		makeCurrent();
+		if (collectObjectIdReads())
+		{
+			_objectIdPassRequested = true;
+			update();
+		}
+		// reads the gpu has not finished yet are collected on the next tick
+		for (const ObjectIdRead& read : _objectIdReads)
+		{
+			if (read.fence)
+			{
+				scheduleObjectIdCollect();
+				break;
+			}
+		}
+	});
+}
 
-			for (int i : qAsConst(_selectedIDs))
+bool GLWidget::collectObjectIdReads()
+{
+	// the slot at the ring index is the oldest one
+	for (int n = 0; n < OBJECT_ID_READ_COUNT; n++)
+	{
+		ObjectIdRead& read = _objectIdReads[(_objectIdReadIndex + n) % OBJECT_ID_READ_COUNT];
+		if (!read.fence)
+			continue;
+		GLenum status = glClientWaitSync(read.fence, GL_SYNC_FLUSH_COMMANDS_BIT, 0);
+		if (status != GL_ALREADY_SIGNALED && status != GL_CONDITION_SATISFIED)
+			break;
+		glDeleteSync(read.fence);
+		read.fence = nullptr;
+
+		glBindBuffer(GL_PIXEL_PACK_BUFFER, read.pbo);
+		const GLuint* ids = static_cast<const GLuint*>(glMapBufferRange(GL_PIXEL_PACK_BUFFER, 0,
+			OBJECT_ID_PATCH_SIZE * OBJECT_ID_PATCH_SIZE * 2 * sizeof(GLuint), GL_MAP_READ_BIT));
+		if (ids)
+		{
+			// the pixel under the cursor, or the most frequent object around it
+			int center = OBJECT_ID_PATCH_SIZE * OBJECT_ID_PATCH_SIZE / 2;
+			GLuint object = ids[2 * center];
+			GLuint triangle = ids[2 * center + 1];
+			if (object == 0)
 			{
-				try
+				std::map<GLuint, int> voteCount;
+				for (int k = 0; k < OBJECT_ID_PATCH_SIZE * OBJECT_ID_PATCH_SIZE; k++)
 				{
-					TriangleMesh* mesh = _meshStore.at(i);
-					if (mesh)
-					{
-						QColor pickColor = indexToColor(i + 1);
-						qDebug() << "Id " << i << "Pick Color" << pickColor;
-						_selectionShader->bind();
-						qreal r, g, b, a;
-						pickColor.getRgbF(&r, &g, &b, &a);
-						_selectionShader->setUniformValue("pickingColor", QVector4D(r, g, b, a));
-						mesh->setProg(_selectionShader);
-						mesh->getVAO().bind();
-						glDrawElements(GL_TRIANGLES, static_cast<int>(mesh->getPoints().size()), GL_UNSIGNED_INT, 0);
-						mesh->getVAO().release();
-						glFlush();
-						glFinish();
-					}
+					if (ids[2 * k] != 0)
+						voteCount[ids[2 * k]]++;
 				}
-				catch (const std::exception& ex)
+				if (!voteCount.empty())
 				{
-					std::cout << "Exception raised in GLWidget::renderToSelectionBuffer\n" << ex.what() << std::endl;
+					object = std::max_element(voteCount.begin(), voteCount.end(), voteCount.value_comp())->first;
+					triangle = 0;
 				}
-			}			
-			glReadBuffer(GL_COLOR_ATTACHMENT0);
-			glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
-			int pixelWinSize = 6;
-			std::vector<float> res(static_cast<size_t>(pixelWinSize) * pixelWinSize * 4);
-			glReadPixels(pixel.x() - pixelWinSize / 2, viewport[3] - pixel.y() + pixelWinSize / 2, pixelWinSize, pixelWinSize, GL_RGBA, GL_FLOAT, res.data());
-			std::map<int, int> voteCount;
-			for (size_t i = 0; i < res.size(); i += 4)
-			{
-				QColor col = QColor::fromRgbF(res[i + 0], res[i + 1], res[i + 2], res[i + 3]);
-				//qDebug() << "ReadPixel Color" << col;
-				unsigned int colId = colorToIndex(col);
-				if (colId != 0)
-					voteCount[colId - 1]++;
 			}
-			if (!voteCount.empty())
-				id = std::max_element(voteCount.begin(), voteCount.end(), voteCount.value_comp())->first;
-
-			/*size_t NbBytes = static_cast<size_t>(width()) * height() * 4;
-			uchar * pPixelData = new uchar[NbBytes];
-			glReadPixels(0, 0, width(), height(), GL_RGBA, GL_UNSIGNED_BYTE, pPixelData);
-			QImage image(pPixelData, width(), height(), NbBytes / height(), QImage::Format_RGBA8888);
-			image = image.mirrored();
-			image.save("d:/ss.bmp");*/
+			_pickedPixel = read.pixel;
+			_pickedId = static_cast<int>(object) - 1;
+			_pickedTriangle = static_cast<int>(triangle) - 1;
+			glUnmapBuffer(GL_PIXEL_PACK_BUFFER);
+		}
+		glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
 
-			glBindFramebuffer(GL_DRAW_FRAMEBUFFER, defaultFramebufferObject());
-			// restore viewport
-			glViewport(viewport[0], viewport[1], viewport[2], viewport[3]);
+		if (_pendingSelectionPixel != QPoint(-1, -1) && _pendingSelectionPixel == read.pixel)
+		{
+			int colId = _pendingSelectionIDs.contains(_pickedId) ? _pickedId : -1;
+			qDebug() << "Color Id: " << colId;
+			_pendingSelectionPixel = QPoint(-1, -1);
+			_pendingSelectionIDs.clear();
 		}
 	}
 
-	return id;
+	if (_hoverHighlightEnabled && _pickedId != _hoveredId && _pickedId < static_cast<int>(_meshStore.size()))
+	{
+		if (_hoveredId >= 0 && _hoveredId < static_cast<int>(_meshStore.size()))
+			_meshStore[_hoveredId]->setHovered(false);
+		_hoveredId = _pickedId;
+		if (_hoveredId >= 0)
+			_meshStore[_hoveredId]->setHovered(true);
+		emit objectHovered(_hoveredId, _pickedTriangle);
+		return true;
+	}
+	return false;
+}
+
+void GLWidget::setHoverHighlight(bool enable)
+{
+	_hoverHighlightEnabled = enable;
+	// hover highlighting needs move events without a button pressed
+	if (enable)
+		setMouseTracking(true);
+	if (!enable && _hoveredId >= 0 && _hoveredId < static_cast<int>(_meshStore.size()))
+	{
+		_meshStore[_hoveredId]->setHovered(false);
+		_hoveredId = -1;
+		emit objectHovered(-1, -1);
+	}
+	update();
 }
 
 void GLWidget::renderQuad()
@@ -3396,24 +3982,28 @@ void GLWidget::splitScreen()
 void GLWidget::setupClippingUniforms(QOpenGLShaderProgram* prog, QVector3D pos)
 {
 	prog->bind();
-	if (_clipYZEnabled || _clipZXEnabled || _clipXYEnabled || !(_clipDX == 0 && _clipDY == 0 && _clipDZ == 0))
-	{
-		_fgShader->setUniformValue("sectionActive", true);
-	}
-	else
-	{
-		_fgShader->setUniformValue("sectionActive", false);
-	}
+	_passBlock.sectionActive = _clipYZEnabled || _clipZXEnabled || _clipXYEnabled || !(_clipDX == 0 && _clipDY == 0 && _clipDZ == 0);
+	QVector4D clipPlaneX(_modelViewMatrix * (QVector3D(_clipXFlipped ? 1 : -1, 0, 0) + pos),
+		(_clipXFlipped ? 1 : -1) * (pos.x() - _clipXCoeff));
+	QVector4D clipPlaneY(_modelViewMatrix * (QVector3D(0, _clipYFlipped ? 1 : -1, 0) + pos),
+		(_clipYFlipped ? 1 : -1) * (pos.y() - _clipYCoeff));
+	QVector4D clipPlaneZ(_modelViewMatrix * (QVector3D(0, 0, _clipZFlipped ? 1 : -1) + pos),
+		(_clipZFlipped ? 1 : -1) * (pos.z() - _clipZCoeff));
+	QVector4D clipPlane(_modelViewMatrix * (QVector3D(_clipDX, _clipDY, _clipDZ) + pos),
+		pos.x() * _clipDX + pos.y() * _clipDY + pos.z() * _clipDZ);
+	// _fgShader and its variants read the planes from the pass uniform block
+	storeStd140(_passBlock.clipPlaneX, clipPlaneX);
+	storeStd140(_passBlock.clipPlaneY, clipPlaneY);
+	storeStd140(_passBlock.clipPlaneZ, clipPlaneZ);
+	storeStd140(_passBlock.clipPlane, clipPlane);
+	if (prog == _fgShader)
+		return;
 	prog->setUniformValue("modelViewMatrix", _modelViewMatrix);
 	prog->setUniformValue("projectionMatrix", _projectionMatrix);
-	prog->setUniformValue("clipPlaneX", QVector4D(_modelViewMatrix * (QVector3D(_clipXFlipped ? 1 : -1, 0, 0) + pos),
-		(_clipXFlipped ? 1 : -1) * (pos.x() - _clipXCoeff)));
-	prog->setUniformValue("clipPlaneY", QVector4D(_modelViewMatrix * (QVector3D(0, _clipYFlipped ? 1 : -1, 0) + pos),
-		(_clipYFlipped ? 1 : -1) * (pos.y() - _clipYCoeff)));
-	prog->setUniformValue("clipPlaneZ", QVector4D(_modelViewMatrix * (QVector3D(0, 0, _clipZFlipped ? 1 : -1) + pos),
-		(_clipZFlipped ? 1 : -1) * (pos.z() - _clipZCoeff)));
-	prog->setUniformValue("clipPlane", QVector4D(_modelViewMatrix * (QVector3D(_clipDX, _clipDY, _clipDZ) + pos),
-		pos.x() * _clipDX + pos.y() * _clipDY + pos.z() * _clipDZ));
+	prog->setUniformValue("clipPlaneX", clipPlaneX);
+	prog->setUniformValue("clipPlaneY", clipPlaneY);
+	prog->setUniformValue("clipPlaneZ", clipPlaneZ);
+	prog->setUniformValue("clipPlane", clipPlane);
 }
 
 void GLWidget::checkAndStopTimers()
@@ -3555,6 +4145,14 @@ void GLWidget::mouseReleaseEvent(QMouseEvent* e)
 
 void GLWidget::mouseMoveEvent(QMouseEvent* e)
 {
+	if (e->buttons() == Qt::NoButton && _hoverHighlightEnabled)
+	{
+		// hover, only the id under the cursor is read back and the view is not redrawn
+		// unless the hovered object changes or the ids are stale
+		requestObjectIdRead(e->pos());
+		return;
+	}
+
 	QPoint downPoint(e->x(), e->y());
 	if (e->buttons() == Qt::LeftButton && !_viewPanning && !_viewZooming)
 	{
@@ -3957,46 +4555,6 @@ QVector3D GLWidget::get3dTranslationVectorFromMousePoints(const QPoint& start, c
 	return OP;
 }
 
-unsigned int GLWidget::loadTextureFromFile(char const* path)
-{
-	unsigned int textureID;
-	glGenTextures(1, &textureID);
-	//std::cout << "GLWidget::loadTextureFromFile : textureID = " << textureID << std::endl;
-
-	int width, height, nrComponents;
-	unsigned char* data = stbi_load(path, &width, &height, &nrComponents, 0);
-	if (data)
-	{
-		GLenum format = GL_RGBA;
-		if (nrComponents == 1)
-			format = GL_RED;
-		else if (nrComponents == 2)
-			format = GL_RG;
-		else if (nrComponents == 3)
-			format = GL_RGB;
-		else if (nrComponents == 4)
-			format = GL_RGBA;
-
-		glBindTexture(GL_TEXTURE_2D, textureID);
-		glTexImage2D(GL_TEXTURE_2D, 0, format, width, height, 0, format, GL_UNSIGNED_BYTE, data);
-		glGenerateMipmap(GL_TEXTURE_2D);
-
-		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
-		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
-		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
-		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-
-		stbi_image_free(data);
-	}
-	else
-	{
-		std::cout << "Texture failed to load at path: " << path << std::endl;
-		stbi_image_free(data);
-	}
-
-	return textureID;
-}
-
 #include <chrono>
 using namespace std::chrono;
 int GLWidget::clickSelect(const QPoint& pixel)
@@ -4023,7 +4581,6 @@ int GLWidget::clickSelect(const QPoint& pixel)
 	}
 
 	QVector3D rayPos, rayDir;
-	QVector3D intersectionPoint;
 	QRect viewport = getViewportFromPoint(pixel);
 	GLCamera* camera = _primaryCamera;
 	if (_multiViewActive)
@@ -4047,28 +4604,24 @@ int GLWidget::clickSelect(const QPoint& pixel)
     //auto start = high_resolution_clock::now();
 
 	QMap<int, float> selectedIdsDist;
-	for (int i : (_visibleSwapped ? _hiddenObjectsIds : _displayedObjectsIds))
-	{
-		TriangleMesh* mesh = _meshStore.at(i);
-		if (mesh->getBoundingSphere().intersectsWithRay(rayPos, rayDir))
+	updateSceneBVH();
+	std::vector<bool> pickable = pickableMeshes();
+	// meshes are visited nearest first, the ones entered behind the closest hit are skipped
+	_sceneBVH.intersectsWithRay(rayPos, rayDir, [&](int i, float& closest)
 		{
-			bool intersects = mesh->intersectsWithRay(rayPos, rayDir, intersectionPoint);
-			//qDebug() << intPoint;
+			if (!pickable[i])
+				return;
+			TriangleMesh* mesh = _meshStore.at(i);
+			MeshBVH::Hit hit;
+			bool intersects = mesh->intersectsWithRay(rayPos, rayDir, hit);
 			if (intersects)
 			{
-				//id = i;
-				selectedIdsDist[i] = intersectionPoint.distanceToPoint(rayPos);
+				// ray direction is normalized, so the hit parameter is the distance
+				selectedIdsDist[i] = hit.distance;
 				_selectedIDs.push_back(i);
-				//_selectRect->setGeometry(_boundingRect);
-				//_selectRect->setGeometry(mesh->getBoundingBox().project(_modelViewMatrix, _projectionMatrix, viewport, geometry()));
-				//_selectRect->setGeometry(mesh->projectedRect(_modelViewMatrix, _projectionMatrix, viewport, geometry()));
-				//_selectRect->show();
-				//break;
+				closest = std::min(closest, hit.distance);
 			}
-		}
-		//else
-		//_selectRect->hide();
-	}
+		});
 	//qDebug() << selectedIdsDist;
 	if (!selectedIdsDist.isEmpty())
 	{
@@ -4085,9 +4638,10 @@ int GLWidget::clickSelect(const QPoint& pixel)
 	}
 	qDebug() << "Selected Id: " << id;
 
+	// without a completed read for this pixel the color id is reported when it arrives
 	int colId = processSelection(pixel);
-
-	qDebug() << "Color Id: " << colId;	
+	if (colId >= 0 || _pendingSelectionPixel != pixel)
+		qDebug() << "Color Id: " << colId;
 
     //if (colId > 0)
         //id = colId;
@@ -4136,8 +4690,27 @@ QList<int> GLWidget::sweepSelect(const QPoint& pixel)
 
 	QRect viewport = getViewportFromPoint(pixel);
 	QApplication::setOverrideCursor(Qt::WaitCursor);
-	for (int i : (_visibleSwapped ? _hiddenObjectsIds : _displayedObjectsIds))
-	{
+
+	// narrow the view volume to the rubber band, only meshes inside it are projected
+	float x0 = 2.0f * (rubberRect.left() - viewport.x()) / viewport.width() - 1.0f;
+	float x1 = 2.0f * (rubberRect.right() + 1 - viewport.x()) / viewport.width() - 1.0f;
+	float y0 = 2.0f * (height() - rubberRect.bottom() - 1 - viewport.y()) / viewport.height() - 1.0f;
+	float y1 = 2.0f * (height() - rubberRect.top() - viewport.y()) / viewport.height() - 1.0f;
+	QMatrix4x4 rubberBandMatrix(2.0f / (x1 - x0), 0.0f, 0.0f, -(x1 + x0) / (x1 - x0),
+		0.0f, 2.0f / (y1 - y0), 0.0f, -(y1 + y0) / (y1 - y0),
+		0.0f, 0.0f, 1.0f, 0.0f,
+		0.0f, 0.0f, 0.0f, 1.0f);
+	Frustum rubberBandFrustum(rubberBandMatrix * _projectionMatrix * _viewMatrix * _modelMatrix);
+
+	updateSceneBVH();
+	std::vector<bool> pickable = pickableMeshes();
+	std::vector<int> candidates;
+	_sceneBVH.intersectsWithFrustum(rubberBandFrustum, candidates);
+	std::sort(candidates.begin(), candidates.end());
+	for (int i : candidates)
+	{
+		if (!pickable[i])
+			continue;
 		TriangleMesh* mesh = _meshStore.at(i);
 		QRect objRect = mesh->getBoundingBox().project(_viewMatrix * _modelMatrix, _projectionMatrix, viewport, geometry());
 		QRect interRect = rubberRect.intersected(objRect);
@@ -4155,25 +4728,6 @@ QList<int> GLWidget::sweepSelect(const QPoint& pixel)
 	return _selectedIDs;
 }
 
-unsigned int GLWidget::colorToIndex(const QColor& color)
-{
-	int alpha = color.alpha();
-	int red = color.red();
-	int green = color.green();
-	int blue = color.blue();
-	unsigned int index =  ((alpha << 24) | (red << 16) | (green << 8) | (blue));
-	return index;
-}
-
-QColor GLWidget::indexToColor(const unsigned int& index)
-{
-	int red = ((index >> 16) & 0xFF);
-	int green = ((index >> 8) & 0xFF);
-	int blue = (index & 0xFF);
-	int alpha = ((index >> 24) & 0xFF);
-	return QColor(red, green, blue, alpha);
-}
-
 void GLWidget::setView(QVector3D viewPos, QVector3D viewDir, QVector3D upDir, QVector3D rightDir)
 {
 	_primaryCamera->setView(viewPos, viewDir, upDir, rightDir);
@@ -4364,6 +4918,18 @@ void GLWidget::setSkyBoxTextureHDRI(bool hdrSet)
 	update();
 }
 
+void GLWidget::setSphericalHarmonicsIrradiance(bool enable)
+{
+	_shIrradianceEnabled = enable;
+	makeCurrent();
+	// the irradiance cube map is not built while the spherical harmonics are used
+	if (enable)
+		computeIrradianceSH();
+	else
+		loadIrradianceMap();
+	update();
+}
+
 QColor GLWidget::getBgBotColor() const
 {
 	return _bgBotColor;
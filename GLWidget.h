@@ -11,6 +11,10 @@
 #include "GLCamera.h"
 #include "BoundingSphere.h"
 #include "TriangleMesh.h"
+#include "SceneBVH.h"
+#include "UniformBlocks.h"
+#include "ShaderVariants.h"
+#include "SkyBoxLoader.h"
 
 /* Custom OpenGL Viewer Widget */
 
@@ -49,6 +53,8 @@ public:
 	void setProjection(ViewProjection proj);
 
 	void setMultiView(bool active) { _multiViewActive = active; }
+	bool isHoverHighlightEnabled() const { return _hoverHighlightEnabled; }
+	int getHoveredId() const { return _hoveredId; }
 	void setRotationActive(bool active);
 	void setPanningActive(bool active);
 	void setZoomingActive(bool active);
@@ -86,7 +92,11 @@ public:
 	void select(int id);
 	void deselect(int id);
 
+	// Starts reading the model in the background, meshes are added as they are uploaded
+	// and assImpModelLoaded is emitted at the end. Files requested while a model is
+	// loading are queued
 	bool loadAssImpModel(const QString& fileName, QString& error);
+	bool isAssImpModelLoading() const;
 
 	void enableADSDiffuseTexMap(const std::vector<int>& ids, const bool& enable);
 	void setADSDiffuseTexMap(const std::vector<int>& ids, const QString& path);
@@ -150,6 +160,8 @@ public:
 	void resetTransformation(const std::vector<int>& ids);
 	void setTexture(const std::vector<int>& ids, const QImage& texImage);
 	void setSkyBoxTextureFolder(QString folder);
+	bool isSkyBoxLoading() const;
+	void cancelSkyBoxLoading();
 
 public:
 	float getXTran() const;
@@ -230,10 +242,13 @@ signals:
 	void viewSet();
 	void displayListSet();
 	void singleSelectionDone(int);
+	void objectHovered(int id, int triangle);
 	void sweepSelectionDone(QList<int>);
 	void floorShown(bool);
 	void visibleSwapped(bool);
 	void loadingAssImpModelCancelled();
+	// cancelled when the user stopped the load, the meshes uploaded until then are kept
+	void assImpModelLoaded(const QString& fileName, bool success, const QString& error, bool cancelled);
 
 public slots:
 	void animateViewChange();
@@ -247,11 +262,13 @@ public slots:
 	void performKeyboardNav();
 	void disableLowRes();
 	void lockLightAndCamera(bool lock);
+	void setHoverHighlight(bool enable);
 	void setFloorTexRepeatS(double floorTexRepeatS);
 	void setFloorTexRepeatT(double floorTexRepeatT);
 	void setFloorOffsetPercent(double value);
 	void setSkyBoxFOV(double fov);
 	void setSkyBoxTextureHDRI(bool hdrSet);
+	void setSphericalHarmonicsIrradiance(bool enable);
 	void enableHDRToneMapping(bool hdrToneMapping);
 	void enableGammaCorrection(bool gammaCorrection);
 	void setScreenGamma(double screenGamma);
@@ -264,6 +281,10 @@ public slots:
 
 private slots:
 	void showContextMenu(const QPoint& pos);
+	void showSkyBoxLoadingProgress(int count, int total);
+	void skyBoxLoaded(bool success);
+	void skyBoxLoadingCancelled();
+	void uploadAssImpMeshes();
 	void centerDisplayList();
 	void setBackgroundColor();
 
@@ -290,10 +311,13 @@ private:
 	void createGeometry();
 
 	void loadEnvMap();
+	unsigned int createEnvironmentMap(const std::vector<SkyBoxLoader::Face>& faces, bool hdr);
 	void loadIrradianceMap();
+	void computeIrradianceSH();
 	void loadFloor();
 
-	void drawMesh(QOpenGLShaderProgram* prog);
+	void drawMesh(QOpenGLShaderProgram* prog, const QMatrix4x4& modelMatrix = QMatrix4x4());
+	int lodLevelForMesh(TriangleMesh* mesh, const QMatrix4x4& view, const QMatrix4x4& projection, int viewportHeight, float maxPixelError);
 	void drawSectionCapping();
 	void drawFloor();
 	void drawSkyBox();
@@ -305,6 +329,14 @@ private:
 
 	void render(GLCamera* camera);
 	void renderToShadowBuffer();
+	void updateFrameUniforms(bool showShadows);
+	void updatePassUniforms();
+	void renderToObjectIdBuffer();
+	void clearObjectIdBuffer();
+	void readObjectIdBuffer(const QPoint& pixel);
+	void requestObjectIdRead(const QPoint& pixel);
+	bool collectObjectIdReads();
+	void scheduleObjectIdCollect();
 	int processSelection(const QPoint& pixel);
 	void renderQuad();
 
@@ -318,9 +350,9 @@ private:
 
 	void convertClickToRay(const QPoint& pixel, const QRect& viewport, GLCamera* camera, QVector3D& orig, QVector3D& dir);
 	int clickSelect(const QPoint& pixel);
+	void updateSceneBVH();
+	std::vector<bool> pickableMeshes() const;
 	QList<int> sweepSelect(const QPoint& pixel);
-	unsigned int colorToIndex(const QColor& color);
-	QColor indexToColor(const unsigned int& index);
 
 	float highestModelZ();
 	float lowestModelZ();
@@ -328,8 +360,11 @@ private:
 	QRect getViewportFromPoint(const QPoint& pixel);
 	QRect getClientRectFromPoint(const QPoint& pixel);
 	QVector3D get3dTranslationVectorFromMousePoints(const QPoint& start, const QPoint& end);
-	unsigned int loadTextureFromFile(const char* path);
 	void setupClippingUniforms(QOpenGLShaderProgram* prog, QVector3D pos);
+	void setupFgShaderSamplers(QOpenGLShaderProgram* prog);
+	QOpenGLShaderProgram* fgShaderVariant(const TriangleMesh* mesh);
+	void startAssImpModelLoading(const QString& fileName);
+	void finishAssImpModelLoading();
 
 private:
 	QMap<int, bool> _keys;
@@ -373,12 +408,48 @@ private:
 	float _rubberBandRadius;
 	QVector3D _rubberBandCenter;
 	QList<int> _selectedIDs;
-	unsigned int _selectionFBO;
-	unsigned int _selectionRBO;
-	unsigned int _selectionDBO;
+	// hierarchy over the world bounds of all meshes in the store, for selection
+	SceneBVH _sceneBVH;
+	std::vector<unsigned int> _sceneBoundsVersions;
+	// Object id buffer holding mesh index + 1 and triangle index + 1 per pixel. It is
+	// drawn after the main pass of every viewport, only in frames a read waits for, and
+	// read back through a ring of pixel buffers, so results arrive a frame later without
+	// stalling the pipeline
+	static const int OBJECT_ID_READ_COUNT = 3;
+	static const int OBJECT_ID_PATCH_SIZE = 5;
+	struct ObjectIdRead
+	{
+		unsigned int pbo = 0;
+		GLsync fence = nullptr;
+		QPoint pixel;
+	};
+	unsigned int _objectIdFBO;
+	unsigned int _objectIdTexture;
+	unsigned int _objectIdDepthRBO;
+	QSize _objectIdBufferSize;
+	ObjectIdRead _objectIdReads[OBJECT_ID_READ_COUNT];
+	int _objectIdReadIndex;
+	// set for the next frame to draw the ids, the buffer is stale after any frame without them
+	bool _objectIdPassRequested;
+	bool _objectIdBufferDirty;
+	// read issued after the requested pass, (-1, -1) for none
+	QPoint _objectIdReadPixel;
+	bool _objectIdCollectScheduled;
+	bool _hoverHighlightEnabled;
+	int _hoveredId;
+	// latest completed read
+	QPoint _pickedPixel;
+	int _pickedId;
+	int _pickedTriangle;
+	// click over overlapping candidates waiting for its read, (-1, -1) for none
+	QPoint _pendingSelectionPixel;
+	QList<int> _pendingSelectionIDs;
 
 	bool _multiViewActive;
 
+	// screen space error allowed for the LOD level chosen in drawMesh
+	float _lodPixelError;
+
 	bool _showAxis;
 
 	float _clipXCoeff;
@@ -440,7 +511,20 @@ private:
 	QMatrix4x4 _modelViewMatrix;
 	QMatrix4x4 _viewportMatrix;
 
+	// per view uniform blocks of _fgShader and the contents last uploaded to them
+	unsigned int _frameUBO;
+	unsigned int _lightingUBO;
+	FrameUniformBlock _frameBlock;
+	LightingUniformBlock _lightingBlock;
+	// per pass state of _fgShader and its variants, _passBlock is written by the passes
+	// and uploaded by updatePassUniforms when it differs from the buffer contents
+	unsigned int _passUBO;
+	PassUniformBlock _passBlock;
+	PassUniformBlock _passBlockUploaded;
+
 	QOpenGLShaderProgram* _fgShader;
+	// _fgShader specialized per display mode, rendering mode and texture use of the meshes
+	ShaderVariants* _fgShaderVariants;
 	QOpenGLShaderProgram* _axisShader;
 	QOpenGLShaderProgram* _vertexNormalShader;
 	QOpenGLShaderProgram* _faceNormalShader;
@@ -460,6 +544,12 @@ private:
 	unsigned int			 _irradianceMap;
 	unsigned int             _prefilterMap;
 	unsigned int             _brdfLUTTexture;
+	// hash of the skybox face pixels, keys the cached irradiance and prefilter maps
+	QByteArray               _environmentMapHash;
+	// diffuse IBL from spherical harmonics of the environment, computed for _irradianceSHHash
+	bool                     _shIrradianceEnabled;
+	std::vector<QVector3D>   _irradianceSH;
+	QByteArray               _irradianceSHHash;
 	float                    _floorSize;
 	float					 _floorOffsetPercent;
 	QVector3D                _floorCenter;
@@ -515,6 +605,7 @@ private:
 	Plane* _floorPlane;
 	Cube* _skyBox;
 	vector<QString> _skyBoxFaces;
+	SkyBoxLoader* _skyBoxLoader;
 	float _skyBoxFOV;
 	bool  _skyBoxTextureHDRI;
 	bool  _gammaCorrection;
@@ -536,6 +627,15 @@ private:
 	unsigned long long _displayedObjectsMemSize;
 
     AssImpModelLoader* _assimpModelLoader;
+	QTimer* _meshUploadTimer;
+	QElapsedTimer _modelLoadTimer;
+	QString _modelLoadingFile;
+	QStringList _pendingModelFiles;
+	bool _modelLoadingCancelled;
+	unsigned int _modelMeshCount;
+	unsigned long long _modelGeometryBytes;
+	unsigned long long _modelLoadBaseMemory;
+	unsigned long long _modelLoadPeakMemory;
 };
 
 #endif
@@ -0,0 +1,786 @@
+#include "GltfReader.h"
+#include "MeshFileReader.h"
+#include "TextureState.h"
+
+#include <QtConcurrent>
+#include <QCryptographicHash>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QJsonArray>
+#include <QMatrix4x4>
+#include <QQuaternion>
+#include <QFileInfo>
+#include <QThread>
+#include <QtEndian>
+#include <QFile>
+#include <QUrl>
+#include <algorithm>
+#include <atomic>
+#include <cstring>
+#include <deque>
+#include <iostream>
+#include <map>
+#include <memory>
+
+namespace
+{
+	const quint32 GLB_MAGIC = 0x46546C67; // "glTF"
+	const quint32 GLB_CHUNK_JSON = 0x4E4F534A;
+	const quint32 GLB_CHUNK_BIN = 0x004E4942;
+
+	enum ComponentType { BYTE = 5120, UNSIGNED_BYTE = 5121, SHORT = 5122, UNSIGNED_SHORT = 5123, UNSIGNED_INT = 5125, FLOAT = 5126 };
+	enum PrimitiveMode { TRIANGLES = 4, TRIANGLE_STRIP = 5, TRIANGLE_FAN = 6 };
+	// color channels of an image used as a texture, the metallic and roughness maps are
+	// sampled from the red channel but glTF packs them in blue and green
+	enum ImageChannel { ALL_CHANNELS, GREEN_CHANNEL, BLUE_CHANNEL };
+
+	struct Span
+	{
+		const uchar* data = nullptr;
+		qint64 size = 0;
+	};
+
+	// Elements of an accessor in their buffer
+	struct Accessor
+	{
+		const uchar* data = nullptr;
+		qint64 count = 0;
+		int componentType = FLOAT;
+		int components = 1;
+		qint64 stride = 0;
+		bool normalized = false;
+	};
+
+	int componentSize(int componentType)
+	{
+		switch (componentType)
+		{
+		case BYTE:
+		case UNSIGNED_BYTE:
+			return 1;
+		case SHORT:
+		case UNSIGNED_SHORT:
+			return 2;
+		case UNSIGNED_INT:
+		case FLOAT:
+			return 4;
+		default:
+			return 0;
+		}
+	}
+
+	int componentCount(const QString& type)
+	{
+		static const std::map<QString, int> counts = { { "SCALAR", 1 }, { "VEC2", 2 }, { "VEC3", 3 }, { "VEC4", 4 }, { "MAT2", 4 }, { "MAT3", 9 }, { "MAT4", 16 } };
+		auto count = counts.find(type);
+		return count != counts.end() ? count->second : 0;
+	}
+
+	// Component of an element as float, normalized integers map to [0, 1] or [-1, 1]
+	float componentValue(const uchar* p, int componentType, bool normalized)
+	{
+		switch (componentType)
+		{
+		case BYTE:
+			return normalized ? std::max(static_cast<qint8>(*p) / 127.0f, -1.0f) : static_cast<qint8>(*p);
+		case UNSIGNED_BYTE:
+			return normalized ? *p / 255.0f : *p;
+		case SHORT:
+		{
+			qint16 value;
+			memcpy(&value, p, sizeof(value));
+			return normalized ? std::max(value / 32767.0f, -1.0f) : value;
+		}
+		case UNSIGNED_SHORT:
+		{
+			quint16 value;
+			memcpy(&value, p, sizeof(value));
+			return normalized ? value / 65535.0f : value;
+		}
+		case UNSIGNED_INT:
+		{
+			quint32 value;
+			memcpy(&value, p, sizeof(value));
+			return static_cast<float>(value);
+		}
+		default:
+		{
+			float value;
+			memcpy(&value, p, sizeof(value));
+			return value;
+		}
+		}
+	}
+
+	// The mapped file and the buffers, views and accessors of its JSON. Buffers stored
+	// in other files are mapped as well, data URIs are decoded
+	class GltfData
+	{
+	public:
+		bool load(const QString& fileName, QString& error)
+		{
+			_directory = QFileInfo(fileName).absolutePath();
+			_file.setFileName(fileName);
+			const uchar* data = _file.open(QIODevice::ReadOnly) ? _file.map(0, _file.size()) : nullptr;
+			const qint64 size = _file.size();
+			if (!data)
+			{
+				error = "Could not map " + fileName;
+				return false;
+			}
+
+			Span json = { data, size };
+			Span binary;
+			quint32 magic = 0;
+			if (size >= 12)
+				memcpy(&magic, data, sizeof(magic));
+			if (magic == GLB_MAGIC)
+			{
+				// 12 byte header then chunks of length, type and data, JSON first
+				json = Span();
+				for (qint64 offset = 12; offset + 8 <= size;)
+				{
+					quint32 chunk[2];
+					memcpy(chunk, data + offset, sizeof(chunk));
+					if (offset + 8 + chunk[0] > size)
+						break;
+					if (chunk[1] == GLB_CHUNK_JSON && !json.data)
+						json = { data + offset + 8, chunk[0] };
+					else if (chunk[1] == GLB_CHUNK_BIN && !binary.data)
+						binary = { data + offset + 8, chunk[0] };
+					offset += 8 + ((static_cast<qint64>(chunk[0]) + 3) & ~qint64(3));
+				}
+			}
+			if (!json.data)
+			{
+				error = "No JSON chunk in GLB file";
+				return false;
+			}
+
+			QJsonParseError parseError;
+			QJsonDocument document = QJsonDocument::fromJson(QByteArray::fromRawData(reinterpret_cast<const char*>(json.data), static_cast<int>(json.size)), &parseError);
+			if (!document.isObject())
+			{
+				error = "Invalid glTF JSON: " + parseError.errorString();
+				return false;
+			}
+			_json = document.object();
+			if (!_json["asset"].toObject()["version"].toString().startsWith("2"))
+			{
+				error = "Not a glTF 2.0 file";
+				return false;
+			}
+			if (!_json["extensionsRequired"].toArray().isEmpty())
+			{
+				error = "glTF extensions required";
+				return false;
+			}
+
+			// the buffer without URI of a GLB file is its binary chunk
+			for (const QJsonValue& value : _json["buffers"].toArray())
+			{
+				const QJsonObject buffer = value.toObject();
+				Span span;
+				if (!buffer.contains("uri"))
+					span = binary;
+				else
+				{
+					span = mapUri(buffer["uri"].toString());
+					if (!span.data)
+					{
+						error = "Could not read glTF buffer " + buffer["uri"].toString();
+						return false;
+					}
+				}
+				if (span.size < static_cast<qint64>(buffer["byteLength"].toDouble()))
+				{
+					error = "Truncated glTF buffer";
+					return false;
+				}
+				_buffers.push_back(span);
+			}
+			return true;
+		}
+
+		const QJsonObject& json() const
+		{
+			return _json;
+		}
+
+		QJsonObject object(const char* array, int index) const
+		{
+			return _json[array].toArray().at(index).toObject();
+		}
+
+		// Bytes of a buffer view, an empty span for a bad view
+		Span view(int index) const
+		{
+			const QJsonObject view = object("bufferViews", index);
+			const int buffer = view["buffer"].toInt(-1);
+			const qint64 offset = static_cast<qint64>(view["byteOffset"].toDouble());
+			const qint64 length = static_cast<qint64>(view["byteLength"].toDouble());
+			if (buffer < 0 || buffer >= static_cast<int>(_buffers.size()) || offset < 0 || length < 0 || offset + length > _buffers[buffer].size)
+				return Span();
+			return { _buffers[buffer].data + offset, length };
+		}
+
+		bool accessor(int index, Accessor& accessor) const
+		{
+			const QJsonObject object = this->object("accessors", index);
+			if (object.isEmpty() || object.contains("sparse") || !object.contains("bufferView"))
+				return false;
+			const int view = object["bufferView"].toInt();
+			const Span span = this->view(view);
+			if (!span.data)
+				return false;
+			accessor.count = static_cast<qint64>(object["count"].toDouble());
+			accessor.componentType = object["componentType"].toInt();
+			accessor.components = componentCount(object["type"].toString());
+			accessor.normalized = object["normalized"].toBool();
+			const qint64 elementSize = static_cast<qint64>(componentSize(accessor.componentType)) * accessor.components;
+			const qint64 byteStride = static_cast<qint64>(this->object("bufferViews", view)["byteStride"].toDouble());
+			const qint64 offset = static_cast<qint64>(object["byteOffset"].toDouble());
+			accessor.stride = byteStride > 0 ? byteStride : elementSize;
+			accessor.data = span.data + offset;
+			return elementSize > 0 && accessor.count > 0 && offset >= 0 &&
+				offset + accessor.stride * (accessor.count - 1) + elementSize <= span.size;
+		}
+
+		// Float elements of an accessor, tightly packed float data is a single copy
+		bool readFloats(int index, int components, std::vector<float>& values) const
+		{
+			Accessor accessor;
+			if (!this->accessor(index, accessor) || accessor.components < components)
+				return false;
+			values.resize(static_cast<size_t>(accessor.count) * components);
+			if (accessor.componentType == FLOAT && accessor.components == components && accessor.stride == 4 * components)
+			{
+				memcpy(values.data(), accessor.data, values.size() * sizeof(float));
+				return true;
+			}
+			const int size = componentSize(accessor.componentType);
+			for (qint64 i = 0; i < accessor.count; i++)
+			{
+				const uchar* element = accessor.data + i * accessor.stride;
+				for (int k = 0; k < components; k++)
+					values[i * components + k] = componentValue(element + k * size, accessor.componentType, accessor.normalized);
+			}
+			return true;
+		}
+
+		bool readIndices(int index, std::vector<unsigned int>& indices) const
+		{
+			Accessor accessor;
+			if (!this->accessor(index, accessor) || accessor.components != 1 ||
+				(accessor.componentType != UNSIGNED_BYTE && accessor.componentType != UNSIGNED_SHORT && accessor.componentType != UNSIGNED_INT))
+				return false;
+			indices.resize(static_cast<size_t>(accessor.count));
+			if (accessor.componentType == UNSIGNED_INT && accessor.stride == 4)
+			{
+				memcpy(indices.data(), accessor.data, indices.size() * sizeof(unsigned int));
+				return true;
+			}
+			for (qint64 i = 0; i < accessor.count; i++)
+			{
+				const uchar* element = accessor.data + i * accessor.stride;
+				if (accessor.componentType == UNSIGNED_BYTE)
+					indices[i] = *element;
+				else if (accessor.componentType == UNSIGNED_SHORT)
+					indices[i] = qFromLittleEndian<quint16>(element);
+				else
+					indices[i] = qFromLittleEndian<quint32>(element);
+			}
+			return true;
+		}
+
+		// Content of a data URI or of a file next to the glTF file
+		QByteArray readUri(const QString& uri) const
+		{
+			if (uri.startsWith("data:"))
+			{
+				const int comma = uri.indexOf(',');
+				return comma > 0 && uri.left(comma).endsWith(";base64") ? QByteArray::fromBase64(uri.mid(comma + 1).toLatin1()) : QByteArray();
+			}
+			QFile file(_directory + '/' + QUrl::fromPercentEncoding(uri.toUtf8()));
+			return file.open(QIODevice::ReadOnly) ? file.readAll() : QByteArray();
+		}
+
+	private:
+		Span mapUri(const QString& uri)
+		{
+			if (uri.startsWith("data:"))
+			{
+				_decodedBuffers.push_back(readUri(uri));
+				const QByteArray& buffer = _decodedBuffers.back();
+				return { reinterpret_cast<const uchar*>(buffer.constData()), buffer.size() };
+			}
+			std::unique_ptr<QFile> file(new QFile(_directory + '/' + QUrl::fromPercentEncoding(uri.toUtf8())));
+			const uchar* data = file->open(QIODevice::ReadOnly) && file->size() > 0 ? file->map(0, file->size()) : nullptr;
+			if (!data)
+				return Span();
+			const Span span = { data, file->size() };
+			_bufferFiles.push_back(std::move(file));
+			return span;
+		}
+
+	private:
+		QString _directory;
+		QFile _file;
+		QJsonObject _json;
+		std::vector<Span> _buffers;
+		std::vector<std::unique_ptr<QFile>> _bufferFiles;
+		std::deque<QByteArray> _decodedBuffers;
+	};
+
+	// A primitive converted once in its mesh's space, shared by the nodes using the mesh
+	struct Primitive
+	{
+		QJsonObject json;
+		MeshGeometry geometry;
+		bool valid = false;
+		// nodes left to place it, the meshes of several nodes share one upload of the geometry
+		int users = 0;
+		std::shared_ptr<AssImpModelLoader::SharedGeometry> shared;
+	};
+
+	bool convertPrimitive(const GltfData& data, Primitive& primitive)
+	{
+		const QJsonObject attributes = primitive.json["attributes"].toObject();
+		const int mode = primitive.json["mode"].toInt(TRIANGLES);
+		MeshGeometry& geometry = primitive.geometry;
+		if ((mode != TRIANGLES && mode != TRIANGLE_STRIP && mode != TRIANGLE_FAN) ||
+			!data.readFloats(attributes["POSITION"].toInt(-1), 3, geometry.points))
+			return false;
+		const size_t vertexCount = geometry.points.size() / 3;
+
+		std::vector<unsigned int> indices;
+		if (primitive.json.contains("indices"))
+		{
+			if (!data.readIndices(primitive.json["indices"].toInt(), indices))
+				return false;
+		}
+		else
+		{
+			indices.resize(vertexCount);
+			for (size_t i = 0; i < vertexCount; i++)
+				indices[i] = static_cast<unsigned int>(i);
+		}
+		for (unsigned int index : indices)
+		{
+			if (index >= vertexCount)
+				return false;
+		}
+		if (mode == TRIANGLES)
+		{
+			indices.resize(indices.size() - indices.size() % 3);
+			geometry.indices = std::move(indices);
+		}
+		else
+		{
+			for (size_t i = 2; i < indices.size(); i++)
+			{
+				const bool odd = mode == TRIANGLE_STRIP && i % 2 == 1;
+				const unsigned int first = mode == TRIANGLE_FAN ? indices[0] : indices[i - 2];
+				const unsigned int triangle[3] = { odd ? indices[i - 1] : first, odd ? first : indices[i - 1], indices[i] };
+				geometry.indices.insert(geometry.indices.end(), triangle, triangle + 3);
+			}
+		}
+
+		// attributes with another element count than the positions are ignored
+		if (!data.readFloats(attributes["NORMAL"].toInt(-1), 3, geometry.normals) || geometry.normals.size() != 3 * vertexCount)
+		{
+			// area weighted vertex normals
+			geometry.normals.assign(3 * vertexCount, 0.0f);
+			for (size_t f = 0; f < geometry.indices.size(); f += 3)
+			{
+				const unsigned int* v = &geometry.indices[f];
+				const QVector3D p0(geometry.points[3 * v[0]], geometry.points[3 * v[0] + 1], geometry.points[3 * v[0] + 2]);
+				const QVector3D p1(geometry.points[3 * v[1]], geometry.points[3 * v[1] + 1], geometry.points[3 * v[1] + 2]);
+				const QVector3D p2(geometry.points[3 * v[2]], geometry.points[3 * v[2] + 1], geometry.points[3 * v[2] + 2]);
+				const QVector3D n = QVector3D::crossProduct(p1 - p0, p2 - p0);
+				for (int c = 0; c < 3; c++)
+				{
+					geometry.normals[3 * v[c] + 0] += n.x();
+					geometry.normals[3 * v[c] + 1] += n.y();
+					geometry.normals[3 * v[c] + 2] += n.z();
+				}
+			}
+			for (size_t i = 0; i < vertexCount; i++)
+			{
+				QVector3D n = QVector3D(geometry.normals[3 * i], geometry.normals[3 * i + 1], geometry.normals[3 * i + 2]).normalized();
+				geometry.normals[3 * i + 0] = n.x();
+				geometry.normals[3 * i + 1] = n.y();
+				geometry.normals[3 * i + 2] = n.z();
+			}
+		}
+
+		geometry.tangents.assign(3 * vertexCount, 0.0f);
+		geometry.bitangents.assign(3 * vertexCount, 0.0f);
+		if (data.readFloats(attributes["TEXCOORD_0"].toInt(-1), 2, geometry.texCoords) && geometry.texCoords.size() == 2 * vertexCount)
+		{
+			// glTF puts the origin of the texture at the top, the images are uploaded flipped
+			for (size_t i = 0; i < vertexCount; i++)
+				geometry.texCoords[2 * i + 1] = 1.0f - geometry.texCoords[2 * i + 1];
+
+			std::vector<float> tangents;
+			if (data.readFloats(attributes["TANGENT"].toInt(-1), 4, tangents) && tangents.size() == 4 * vertexCount)
+			{
+				// the bitangent follows from the normal and the handedness in w
+				for (size_t i = 0; i < vertexCount; i++)
+				{
+					const QVector3D n(geometry.normals[3 * i], geometry.normals[3 * i + 1], geometry.normals[3 * i + 2]);
+					const QVector3D t(tangents[4 * i], tangents[4 * i + 1], tangents[4 * i + 2]);
+					const QVector3D b = QVector3D::crossProduct(n, t) * tangents[4 * i + 3];
+					memcpy(&geometry.tangents[3 * i], &tangents[4 * i], 3 * sizeof(float));
+					geometry.bitangents[3 * i + 0] = b.x();
+					geometry.bitangents[3 * i + 1] = b.y();
+					geometry.bitangents[3 * i + 2] = b.z();
+				}
+			}
+			else
+				MeshFileReader::computeTangents(geometry);
+		}
+		else
+		{
+			// repeat the corners of one texture triangle over the vertices, like the Assimp import
+			static const float cornerTexCoords[3][2] = { { 0.0f, 0.0f }, { 1.0f, 0.0f }, { 0.5f, 1.0f } };
+			geometry.texCoords.resize(2 * vertexCount);
+			for (size_t i = 0; i < vertexCount; i++)
+			{
+				geometry.texCoords[2 * i + 0] = cornerTexCoords[i % 3][0];
+				geometry.texCoords[2 * i + 1] = cornerTexCoords[i % 3][1];
+			}
+		}
+		return true;
+	}
+
+	QMatrix4x4 localTransform(const QJsonObject& node)
+	{
+		const QJsonArray matrix = node["matrix"].toArray();
+		if (matrix.size() == 16)
+		{
+			// glTF matrices are column major, QMatrix4x4 takes rows
+			float values[16];
+			for (int i = 0; i < 16; i++)
+				values[i] = static_cast<float>(matrix[i].toDouble());
+			return QMatrix4x4(values).transposed();
+		}
+		QMatrix4x4 transform;
+		const QJsonArray translation = node["translation"].toArray();
+		const QJsonArray rotation = node["rotation"].toArray();
+		const QJsonArray scale = node["scale"].toArray();
+		if (translation.size() == 3)
+			transform.translate(translation[0].toDouble(), translation[1].toDouble(), translation[2].toDouble());
+		if (rotation.size() == 4)
+			transform.rotate(QQuaternion(rotation[3].toDouble(), rotation[0].toDouble(), rotation[1].toDouble(), rotation[2].toDouble()));
+		if (scale.size() == 3)
+			transform.scale(scale[0].toDouble(), scale[1].toDouble(), scale[2].toDouble());
+		return transform;
+	}
+
+	// A mesh placed by a node
+	struct Instance
+	{
+		int mesh;
+		QMatrix4x4 transform;
+		QString name;
+	};
+
+	void collectInstances(const GltfData& data, int node, const QMatrix4x4& parentTransform, int depth, std::vector<Instance>& instances)
+	{
+		// nodes form a tree, the depth limit only guards against broken files
+		const QJsonObject object = data.object("nodes", node);
+		if (object.isEmpty() || depth > 256)
+			return;
+		const QMatrix4x4 transform = parentTransform * localTransform(object);
+		if (object.contains("mesh"))
+		{
+			// named after the node, or after its mesh
+			const int mesh = object["mesh"].toInt();
+			QString name = object["name"].toString();
+			if (name.isEmpty())
+				name = data.object("meshes", mesh)["name"].toString();
+			instances.push_back({ mesh, transform, name });
+		}
+		for (const QJsonValue& child : object["children"].toArray())
+			collectInstances(data, child.toInt(), transform, depth + 1, instances);
+	}
+
+	// An image channel used by the materials, decoded on the thread pool
+	struct ImageJob
+	{
+		int image;
+		ImageChannel channel;
+		QImage glImage;
+		QByteArray contentHash;
+		// reported once by read, the materials are left without the map
+		bool failed;
+	};
+
+	void decodeImage(const GltfData& data, ImageJob& job)
+	{
+		const QJsonObject image = data.object("images", job.image);
+		QByteArray content;
+		if (image.contains("bufferView"))
+		{
+			const Span view = data.view(image["bufferView"].toInt());
+			content = QByteArray(reinterpret_cast<const char*>(view.data), static_cast<int>(view.size));
+		}
+		else
+			content = data.readUri(image["uri"].toString());
+
+		QImage decoded;
+		if (content.isEmpty() || !decoded.loadFromData(content))
+		{
+			job.failed = true;
+			return;
+		}
+		// the hash of the whole image matches the texture cache key of the same file
+		job.contentHash = QCryptographicHash::hash(content, QCryptographicHash::Sha1);
+		if (job.channel != ALL_CHANNELS)
+		{
+			job.contentHash.append(static_cast<char>(job.channel));
+			decoded = decoded.convertToFormat(QImage::Format_RGB32);
+			for (int y = 0; y < decoded.height(); y++)
+			{
+				QRgb* line = reinterpret_cast<QRgb*>(decoded.scanLine(y));
+				for (int x = 0; x < decoded.width(); x++)
+				{
+					const int value = job.channel == GREEN_CHANNEL ? qGreen(line[x]) : qBlue(line[x]);
+					line[x] = qRgb(value, value, value);
+				}
+			}
+		}
+		job.glImage = TextureState::glFormat(decoded);
+	}
+
+	// The material factors and texture maps of a primitive, the maps are set in both the
+	// ADS and the PBR slots the Assimp import fills
+	struct MaterialTexture
+	{
+		const char* key;
+		ImageChannel channel;
+		std::vector<const char*> types;
+	};
+
+	const std::vector<MaterialTexture>& materialTextures()
+	{
+		static const std::vector<MaterialTexture> textures = {
+			{ "baseColorTexture", ALL_CHANNELS, { "texture_diffuse", "albedoMap" } },
+			{ "metallicRoughnessTexture", BLUE_CHANNEL, { "metallicMap" } },
+			{ "metallicRoughnessTexture", GREEN_CHANNEL, { "roughnessMap" } },
+			{ "normalTexture", ALL_CHANNELS, { "normalMap" } },
+			{ "occlusionTexture", ALL_CHANNELS, { "aoMap" } },
+			{ "emissiveTexture", ALL_CHANNELS, { "texture_emissive" } }
+		};
+		return textures;
+	}
+
+	// Texture info of a material, the PBR ones are in pbrMetallicRoughness
+	QJsonObject textureInfo(const QJsonObject& material, const char* key)
+	{
+		if (material.contains(key))
+			return material[key].toObject();
+		return material["pbrMetallicRoughness"].toObject()[key].toObject();
+	}
+
+	int textureImage(const GltfData& data, const QJsonObject& info)
+	{
+		return info.contains("index") ? data.object("textures", info["index"].toInt())["source"].toInt(-1) : -1;
+	}
+
+	GLMaterial convertMaterial(const QJsonObject& material)
+	{
+		GLMaterial mat = GLMaterial::DEFAULT_MAT();
+		if (material.isEmpty())
+			return mat;
+		const QJsonObject pbr = material["pbrMetallicRoughness"].toObject();
+		const QJsonArray baseColor = pbr["baseColorFactor"].toArray();
+		if (baseColor.size() == 4)
+		{
+			const QVector3D color(baseColor[0].toDouble(), baseColor[1].toDouble(), baseColor[2].toDouble());
+			mat.setDiffuse(color);
+			mat.setAlbedoColor(color);
+			// alpha is only blended in BLEND mode, MASK is drawn opaque
+			if (material["alphaMode"].toString() == "BLEND")
+				mat.setOpacity(baseColor[3].toDouble());
+		}
+		mat.setMetalness(pbr["metallicFactor"].toDouble(1.0));
+		mat.setRoughness(pbr["roughnessFactor"].toDouble(1.0));
+		const QJsonArray emissive = material["emissiveFactor"].toArray();
+		if (emissive.size() == 3)
+			mat.setEmissive(QVector3D(emissive[0].toDouble(), emissive[1].toDouble(), emissive[2].toDouble()));
+		return mat;
+	}
+}
+
+bool GltfReader::canRead(const QString& fileName)
+{
+	const QString suffix = QFileInfo(fileName).suffix().toLower();
+	return suffix == "glb" || suffix == "gltf";
+}
+
+bool GltfReader::read(const QString& fileName, const std::function<bool(AssImpModelLoader::MeshPacket&&)>& addMesh,
+	const std::function<bool(int converted, int total)>& progress, QString& error)
+{
+	GltfData data;
+	if (!data.load(fileName, error))
+		return false;
+
+	// meshes placed by the nodes of the default scene, or of the first one
+	const QJsonObject& json = data.json();
+	std::vector<Instance> instances;
+	const QJsonObject scene = data.object("scenes", json["scene"].toInt(0));
+	for (const QJsonValue& node : scene["nodes"].toArray())
+		collectInstances(data, node.toInt(), QMatrix4x4(), 0, instances);
+
+	// the primitives of every used mesh, converted once
+	std::map<int, std::pair<size_t, size_t>> meshPrimitives;
+	std::vector<Primitive> primitives;
+	for (const Instance& instance : instances)
+	{
+		auto mesh = meshPrimitives.find(instance.mesh);
+		if (mesh == meshPrimitives.end())
+		{
+			const size_t first = primitives.size();
+			for (const QJsonValue& value : data.object("meshes", instance.mesh)["primitives"].toArray())
+			{
+				Primitive primitive;
+				primitive.json = value.toObject();
+				primitives.push_back(primitive);
+			}
+			mesh = meshPrimitives.insert({ instance.mesh, { first, primitives.size() } }).first;
+		}
+		for (size_t i = mesh->second.first; i < mesh->second.second; i++)
+			primitives[i].users++;
+	}
+	if (primitives.empty())
+	{
+		error = "No meshes in glTF scene";
+		return false;
+	}
+
+	// the images of the materials are decoded while the primitives are converted
+	std::vector<ImageJob> imageJobs;
+	std::map<std::pair<int, int>, size_t> imageJobIndices;
+	for (const Primitive& primitive : primitives)
+	{
+		const QJsonObject material = data.object("materials", primitive.json["material"].toInt(-1));
+		for (const MaterialTexture& texture : materialTextures())
+		{
+			const int image = textureImage(data, textureInfo(material, texture.key));
+			if (image >= 0 && imageJobIndices.insert({ { image, texture.channel }, imageJobs.size() }).second)
+				imageJobs.push_back({ image, texture.channel, QImage(), QByteArray(), false });
+		}
+	}
+	std::atomic<bool> stopped(false);
+	std::atomic<int> converted(0);
+	const int total = static_cast<int>(primitives.size());
+	QFuture<void> images = QtConcurrent::map(imageJobs, [&data, &stopped](ImageJob& job) {
+		if (!stopped)
+			decodeImage(data, job);
+	});
+	QtConcurrent::blockingMap(primitives, [&](Primitive& primitive) {
+		if (stopped)
+			return;
+		primitive.valid = convertPrimitive(data, primitive);
+		if (primitive.valid)
+		{
+			AssImpMesh::prepareGeometry(primitive.geometry);
+			if (primitive.users > 1)
+			{
+				primitive.shared = std::make_shared<AssImpModelLoader::SharedGeometry>();
+				primitive.shared->geometry = std::move(primitive.geometry);
+			}
+		}
+		if (!progress(++converted, total))
+			stopped = true;
+	});
+	if (stopped)
+		images.cancel();
+	images.waitForFinished();
+	// stopped by progress, no mesh is passed and Assimp is not tried either
+	if (stopped)
+		return true;
+	const auto failedImages = std::count_if(imageJobs.begin(), imageJobs.end(), [](const ImageJob& job) { return job.failed; });
+	if (failedImages)
+		std::cout << "GltfReader : " << failedImages << " of " << imageJobs.size() << " images failed to load" << std::endl;
+	if (std::none_of(primitives.begin(), primitives.end(), [](const Primitive& primitive) { return primitive.valid; }))
+	{
+		error = "No triangle primitives in glTF scene";
+		return false;
+	}
+
+	// one mesh per primitive and node, placed by its model matrix in batches of a few per thread
+	struct Placement
+	{
+		Primitive* primitive;
+		const Instance* instance;
+		AssImpModelLoader::MeshPacket packet;
+	};
+	std::vector<Placement> placements;
+	for (const Instance& instance : instances)
+	{
+		const std::pair<size_t, size_t>& range = meshPrimitives[instance.mesh];
+		for (size_t i = range.first; i < range.second; i++)
+		{
+			if (primitives[i].valid)
+				placements.push_back({ &primitives[i], &instance, AssImpModelLoader::MeshPacket() });
+		}
+	}
+
+	const QString baseName = QFileInfo(fileName).baseName();
+	auto place = [&](Placement& placement) {
+		Primitive& primitive = *placement.primitive;
+		AssImpModelLoader::MeshPacket& packet = placement.packet;
+		packet.name = placement.instance->name.isEmpty() ? baseName : placement.instance->name;
+		packet.transformation = placement.instance->transform;
+		const QJsonObject material = data.object("materials", primitive.json["material"].toInt(-1));
+		packet.material = convertMaterial(material);
+		for (const MaterialTexture& texture : materialTextures())
+		{
+			const int image = textureImage(data, textureInfo(material, texture.key));
+			const ImageJob* job = image >= 0 ? &imageJobs[imageJobIndices.at({ image, texture.channel })] : nullptr;
+			if (!job || job->glImage.isNull())
+				continue;
+			for (const char* type : texture.types)
+			{
+				Texture packetTexture;
+				packetTexture.id = 0;
+				packetTexture.type = type;
+				packetTexture.image = job->glImage;
+				packetTexture.contentHash = job->contentHash;
+				packet.textures.push_back(packetTexture);
+			}
+		}
+	};
+
+	const size_t batchSize = 4 * static_cast<size_t>(std::max(1, QThread::idealThreadCount()));
+	for (size_t first = 0; first < placements.size(); first += batchSize)
+	{
+		auto begin = placements.begin() + first;
+		auto end = placements.begin() + std::min(first + batchSize, placements.size());
+		// a primitive used once moves its geometry into the packet, the others are shared
+		for (auto it = begin; it != end; ++it)
+		{
+			Primitive& primitive = *it->primitive;
+			--primitive.users;
+			if (!primitive.shared)
+				it->packet.geometry = std::move(primitive.geometry);
+			else
+			{
+				it->packet.sharedGeometry = primitive.shared;
+				// the queued packets keep it from now on
+				if (primitive.users == 0)
+					primitive.shared.reset();
+			}
+		}
+		QtConcurrent::blockingMap(begin, end, place);
+		for (auto it = begin; it != end; ++it)
+		{
+			if (!addMesh(std::move(it->packet)))
+				return true;
+		}
+	}
+	return true;
+}
@@ -0,0 +1,27 @@
+#pragma once
+
+#include <QString>
+#include <functional>
+
+#include "AssImpModelLoader.h"
+
+// Native reader for glTF 2.0 scenes, binary .glb files and .gltf files with their
+// buffers. The file is memory mapped and accessors are copied from the mapping straight
+// into the upload layout. Every primitive is converted and optimized once, the meshes
+// of the nodes using it share one set of GL buffers and are placed by their model matrix,
+// named after the node or the mesh. Images are decoded on the thread pool, the packed
+// metallic and roughness channels split into the maps the shaders sample
+class GltfReader
+{
+public:
+	// True for the extensions read natively
+	static bool canRead(const QString& fileName);
+
+	// Pass one mesh per primitive and node to addMesh in node order, with the node's world
+	// transform in the packet's transformation. progress is called from the thread pool
+	// after each converted primitive, addMesh and progress return false to stop. False with
+	// the reason in error, before any mesh is passed, when the file should go through
+	// Assimp instead
+	static bool read(const QString& fileName, const std::function<bool(AssImpModelLoader::MeshPacket&&)>& addMesh,
+		const std::function<bool(int converted, int total)>& progress, QString& error);
+};
@@ -0,0 +1,191 @@
+#include "IBLCache.h"
+
+#include <QCryptographicHash>
+#include <QOpenGLContext>
+#include <QStandardPaths>
+#include <QSaveFile>
+#include <QFile>
+#include <QDir>
+#include <QDebug>
+#include <algorithm>
+#include <cstring>
+#include <vector>
+
+namespace
+{
+	const unsigned char KTX_IDENTIFIER[12] = { 0xAB, 'K', 'T', 'X', ' ', '1', '1', 0xBB, '\r', '\n', 0x1A, '\n' };
+	const quint32 KTX_ENDIANNESS = 0x04030201;
+
+	// KTX 1.1 header following the identifier
+	struct KtxHeader
+	{
+		quint32 endianness;
+		quint32 glType;
+		quint32 glTypeSize;
+		quint32 glFormat;
+		quint32 glInternalFormat;
+		quint32 glBaseInternalFormat;
+		quint32 pixelWidth;
+		quint32 pixelHeight;
+		quint32 pixelDepth;
+		quint32 numberOfArrayElements;
+		quint32 numberOfFaces;
+		quint32 numberOfMipmapLevels;
+		quint32 bytesOfKeyValueData;
+	};
+
+	unsigned int internalFormatOf(unsigned int format)
+	{
+		return format == GL_RG ? GL_RG16F : GL_RGB16F;
+	}
+
+	int componentsOf(unsigned int format)
+	{
+		return format == GL_RG ? 2 : 3;
+	}
+}
+
+IBLCache& IBLCache::instance()
+{
+	static IBLCache cache;
+	return cache;
+}
+
+IBLCache::IBLCache() :
+	_initialized(false)
+{
+}
+
+QOpenGLFunctions_4_5_Core* IBLCache::functions()
+{
+	// owned by the context, resolved again for each one so no pointer outlives its window
+	QOpenGLFunctions_4_5_Core* gl = QOpenGLContext::currentContext()->versionFunctions<QOpenGLFunctions_4_5_Core>();
+	gl->initializeOpenGLFunctions();
+	return gl;
+}
+
+void IBLCache::initialize()
+{
+	if (_initialized)
+		return;
+	_initialized = true;
+	_directory = QStandardPaths::writableLocation(QStandardPaths::CacheLocation) + "/ibl";
+	QDir().mkpath(_directory);
+}
+
+QByteArray IBLCache::key(const QByteArray& content, const QStringList& shaderFiles) const
+{
+	QCryptographicHash hash(QCryptographicHash::Sha1);
+	hash.addData(content);
+	for (const QString& shaderFile : shaderFiles)
+	{
+		QFile file(shaderFile);
+		if (file.open(QIODevice::ReadOnly))
+			hash.addData(file.readAll());
+	}
+	return hash.result().toHex();
+}
+
+bool IBLCache::load(const QString& name, unsigned int texture, unsigned int target, unsigned int format, int levelCount)
+{
+	initialize();
+	QOpenGLFunctions_4_5_Core* gl = functions();
+	QFile file(fileName(name));
+	if (!file.open(QIODevice::ReadOnly))
+		return false;
+	QByteArray data = file.readAll();
+
+	KtxHeader header;
+	if (data.size() < static_cast<int>(sizeof(KTX_IDENTIFIER) + sizeof(header)) ||
+		memcmp(data.constData(), KTX_IDENTIFIER, sizeof(KTX_IDENTIFIER)) != 0)
+		return false;
+	memcpy(&header, data.constData() + sizeof(KTX_IDENTIFIER), sizeof(header));
+
+	GLint width = 0, height = 0;
+	gl->glGetTextureLevelParameteriv(texture, 0, GL_TEXTURE_WIDTH, &width);
+	gl->glGetTextureLevelParameteriv(texture, 0, GL_TEXTURE_HEIGHT, &height);
+	unsigned int faces = target == GL_TEXTURE_CUBE_MAP ? 6 : 1;
+	if (header.endianness != KTX_ENDIANNESS || header.glType != GL_HALF_FLOAT || header.glFormat != format ||
+		header.pixelWidth != static_cast<quint32>(width) || header.pixelHeight != static_cast<quint32>(height) ||
+		header.numberOfFaces != faces || header.numberOfMipmapLevels < static_cast<quint32>(levelCount))
+		return false;
+
+	// check the sizes of all levels before anything is uploaded
+	qint64 offset = sizeof(KTX_IDENTIFIER) + sizeof(header) + header.bytesOfKeyValueData;
+	std::vector<const char*> levels;
+	for (int level = 0; level < levelCount; level++)
+	{
+		int levelWidth = std::max(1, width >> level);
+		int levelHeight = std::max(1, height >> level);
+		quint32 faceSize = levelWidth * levelHeight * componentsOf(format) * 2;
+		quint32 imageSize = 0;
+		if (offset + static_cast<qint64>(sizeof(imageSize)) > data.size())
+			return false;
+		memcpy(&imageSize, data.constData() + offset, sizeof(imageSize));
+		offset += sizeof(imageSize);
+		if (imageSize != faceSize || offset + faceSize * faces > data.size())
+			return false;
+		levels.push_back(data.constData() + offset);
+		offset += faceSize * faces;
+	}
+
+	for (int level = 0; level < levelCount; level++)
+	{
+		int levelWidth = std::max(1, width >> level);
+		int levelHeight = std::max(1, height >> level);
+		// the faces of a cube map are the layers of a 3D upload
+		if (target == GL_TEXTURE_CUBE_MAP)
+			gl->glTextureSubImage3D(texture, level, 0, 0, 0, levelWidth, levelHeight, 6, format, GL_HALF_FLOAT, levels[level]);
+		else
+			gl->glTextureSubImage2D(texture, level, 0, 0, levelWidth, levelHeight, format, GL_HALF_FLOAT, levels[level]);
+	}
+	return true;
+}
+
+void IBLCache::save(const QString& name, unsigned int texture, unsigned int target, unsigned int format, int levelCount)
+{
+	initialize();
+	QOpenGLFunctions_4_5_Core* gl = functions();
+	GLint width = 0, height = 0;
+	gl->glGetTextureLevelParameteriv(texture, 0, GL_TEXTURE_WIDTH, &width);
+	gl->glGetTextureLevelParameteriv(texture, 0, GL_TEXTURE_HEIGHT, &height);
+	unsigned int faces = target == GL_TEXTURE_CUBE_MAP ? 6 : 1;
+
+	KtxHeader header;
+	header.endianness = KTX_ENDIANNESS;
+	header.glType = GL_HALF_FLOAT;
+	header.glTypeSize = 2;
+	header.glFormat = format;
+	header.glInternalFormat = internalFormatOf(format);
+	header.glBaseInternalFormat = format;
+	header.pixelWidth = width;
+	header.pixelHeight = height;
+	header.pixelDepth = 0;
+	header.numberOfArrayElements = 0;
+	header.numberOfFaces = faces;
+	header.numberOfMipmapLevels = levelCount;
+	header.bytesOfKeyValueData = 0;
+
+	QByteArray data(reinterpret_cast<const char*>(KTX_IDENTIFIER), sizeof(KTX_IDENTIFIER));
+	data.append(reinterpret_cast<const char*>(&header), sizeof(header));
+	gl->glPixelStorei(GL_PACK_ALIGNMENT, 4);
+	for (int level = 0; level < levelCount; level++)
+	{
+		// rows of the float16 maps are always a multiple of 4 bytes, no padding is needed
+		quint32 faceSize = std::max(1, width >> level) * std::max(1, height >> level) * componentsOf(format) * 2;
+		data.append(reinterpret_cast<const char*>(&faceSize), sizeof(faceSize));
+		int offset = data.size();
+		data.resize(offset + faceSize * faces);
+		// a cube map level is read back with all six faces
+		gl->glGetTextureImage(texture, level, format, GL_HALF_FLOAT, faceSize * faces, data.data() + offset);
+	}
+
+	QSaveFile file(fileName(name));
+	if (!file.open(QIODevice::WriteOnly) || file.write(data) != data.size() || !file.commit())
+		qDebug() << "IBLCache : could not store" << name;
+}
+
+QString IBLCache::fileName(const QString& name) const
+{
+	return _directory + "/" + name + ".ktx";
+}
@@ -0,0 +1,35 @@
+#pragma once
+
+#include <QOpenGLFunctions_4_5_Core>
+#include <QByteArray>
+#include <QString>
+#include <QStringList>
+
+// Precomputed image based lighting maps stored as float16 KTX files in the user cache
+// directory. The irradiance and prefilter cube maps are keyed by the environment and
+// the shaders that convolve it, the BRDF LUT only by its shader. The caller allocates
+// the texture, load fills its levels from the file and save reads them back after
+// the maps were rendered. GL calls go to the current context
+class IBLCache
+{
+public:
+	static IBLCache& instance();
+
+	// Hex key from the environment content (empty for the BRDF LUT) and the shader sources
+	QByteArray key(const QByteArray& content, const QStringList& shaderFiles) const;
+
+	// Fill levels 0 to levelCount - 1 of a GL_TEXTURE_2D or GL_TEXTURE_CUBE_MAP texture,
+	// false when the file is missing or does not match the texture
+	bool load(const QString& name, unsigned int texture, unsigned int target, unsigned int format, int levelCount);
+	void save(const QString& name, unsigned int texture, unsigned int target, unsigned int format, int levelCount);
+
+private:
+	IBLCache();
+	void initialize();
+	static QOpenGLFunctions_4_5_Core* functions();
+	QString fileName(const QString& name) const;
+
+private:
+	bool _initialized;
+	QString _directory;
+};
@@ -0,0 +1,113 @@
+#include "IrradianceSH.h"
+
+#include <QtConcurrent>
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <functional>
+
+namespace
+{
+	// rows of a face summed by one task
+	const int ROWS_PER_TASK = 16;
+
+	typedef std::array<float, IrradianceSH::COEFFICIENT_COUNT * 3> Sums;
+
+	struct Task
+	{
+		int face;
+		int firstRow;
+		int lastRow;
+	};
+
+	// direction of a cube map texel, s and t in [-1, 1] as in the OpenGL face selection table
+	QVector3D texelDirection(int face, float s, float t)
+	{
+		switch (face)
+		{
+		case 0: return QVector3D(1.0f, -t, -s);
+		case 1: return QVector3D(-1.0f, -t, s);
+		case 2: return QVector3D(s, 1.0f, t);
+		case 3: return QVector3D(s, -1.0f, -t);
+		case 4: return QVector3D(s, -t, 1.0f);
+		default: return QVector3D(-s, -t, -1.0f);
+		}
+	}
+
+	void evaluateBasis(const QVector3D& n, float basis[IrradianceSH::COEFFICIENT_COUNT])
+	{
+		basis[0] = 0.282095f;
+		basis[1] = 0.488603f * n.y();
+		basis[2] = 0.488603f * n.z();
+		basis[3] = 0.488603f * n.x();
+		basis[4] = 1.092548f * n.x() * n.y();
+		basis[5] = 1.092548f * n.y() * n.z();
+		basis[6] = 0.315392f * (3.0f * n.z() * n.z() - 1.0f);
+		basis[7] = 1.092548f * n.x() * n.z();
+		basis[8] = 0.546274f * (n.x() * n.x() - n.y() * n.y());
+	}
+}
+
+std::vector<QVector3D> IrradianceSH::project(const std::vector<float>& faces, int size)
+{
+	std::vector<QVector3D> coefficients(COEFFICIENT_COUNT);
+	if (size <= 0 || faces.size() < static_cast<size_t>(6 * size * size * 3))
+		return coefficients;
+
+	std::vector<Task> tasks;
+	for (int face = 0; face < 6; face++)
+		for (int row = 0; row < size; row += ROWS_PER_TASK)
+			tasks.push_back({ face, row, std::min(row + ROWS_PER_TASK, size) });
+
+	// each task returns radiance times solid angle per coefficient and its total solid angle
+	std::function<std::pair<Sums, float>(const Task&)> projectRows = [&faces, size](const Task& task)
+	{
+		Sums sums;
+		sums.fill(0.0f);
+		float totalWeight = 0.0f;
+		float basis[COEFFICIENT_COUNT];
+		const float* texels = faces.data() + static_cast<size_t>(task.face) * size * size * 3;
+		for (int row = task.firstRow; row < task.lastRow; row++)
+		{
+			float t = 2.0f * (row + 0.5f) / size - 1.0f;
+			for (int col = 0; col < size; col++)
+			{
+				float s = 2.0f * (col + 0.5f) / size - 1.0f;
+				// solid angle of the texel relative to its area on the unit cube
+				float weight = 1.0f / std::pow(1.0f + s * s + t * t, 1.5f);
+				evaluateBasis(texelDirection(task.face, s, t).normalized(), basis);
+				const float* texel = texels + (static_cast<size_t>(row) * size + col) * 3;
+				for (int i = 0; i < COEFFICIENT_COUNT; i++)
+				{
+					sums[i * 3 + 0] += texel[0] * basis[i] * weight;
+					sums[i * 3 + 1] += texel[1] * basis[i] * weight;
+					sums[i * 3 + 2] += texel[2] * basis[i] * weight;
+				}
+				totalWeight += weight;
+			}
+		}
+		return std::make_pair(sums, totalWeight);
+	};
+	QList<std::pair<Sums, float>> partials = QtConcurrent::blockingMapped<QList<std::pair<Sums, float>>>(tasks, projectRows);
+
+	Sums sums;
+	sums.fill(0.0f);
+	float totalWeight = 0.0f;
+	for (const auto& partial : partials)
+	{
+		for (size_t i = 0; i < sums.size(); i++)
+			sums[i] += partial.first[i];
+		totalWeight += partial.second;
+	}
+	if (totalWeight <= 0.0f)
+		return coefficients;
+
+	// normalize the texel weights to the full sphere, then convolve with the clamped cosine
+	// lobe (pi, 2pi/3, pi/4 per band) and divide by pi as the convolution shader does
+	const float PI = 3.14159265359f;
+	const float band[COEFFICIENT_COUNT] = { 1.0f, 2.0f / 3.0f, 2.0f / 3.0f, 2.0f / 3.0f, 0.25f, 0.25f, 0.25f, 0.25f, 0.25f };
+	float scale = 4.0f * PI / totalWeight;
+	for (int i = 0; i < COEFFICIENT_COUNT; i++)
+		coefficients[i] = QVector3D(sums[i * 3 + 0], sums[i * 3 + 1], sums[i * 3 + 2]) * scale * band[i];
+	return coefficients;
+}
@@ -0,0 +1,19 @@
+#pragma once
+
+#include <QVector3D>
+#include <vector>
+
+// Diffuse image based lighting from nine L2 spherical harmonic coefficients
+// (Ramamoorthi and Hanrahan 2001) instead of a convolved irradiance cube map
+class IrradianceSH
+{
+public:
+	static const int COEFFICIENT_COUNT = 9;
+
+	// Project a cube map into irradiance coefficients. faces holds the six faces in
+	// OpenGL order, each size x size RGB texels with rows in increasing t. The result is
+	// scaled like the irradiance cube map (irradiance / pi), the coefficients only have
+	// to be multiplied by the basis functions of the normal. Faces and rows are
+	// projected in parallel
+	static std::vector<QVector3D> project(const std::vector<float>& faces, int size);
+};
@@ -7,6 +7,7 @@
 #include <QPushButton>
 #include <QMdiSubWindow>
 #include <assimp/version.h>
+#include <memory>
 
 #ifdef _WIN32
 #include <QWinTaskbarProgress>
@@ -356,7 +357,9 @@ void MainWindow::cancelFileLoading()
 	if (activeMdiChild())
 	{
 		GLWidget* view = activeMdiChild()->getGLView();
-		if (view)
+		if (view && view->isSkyBoxLoading())
+			view->cancelSkyBoxLoading();
+		else if (view)
 			view->cancelAssImpModelLoading();
 	}
 }
@@ -394,14 +397,21 @@ bool MainWindow::loadFile(const QString& fileName)
 {
 	ModelViewer* child = createMdiChild();
 	child->show();
+	// the model is read in the background, the document is kept once it has loaded
+	auto connection = std::make_shared<QMetaObject::Connection>();
+	*connection = connect(child, &ModelViewer::fileLoaded, this, [this, child, connection](const QString& loadedFile, bool success) {
+		disconnect(*connection);
+		if (!success)
+			child->parentWidget()->close();
+		else
+		{
+			child->setWindowTitle(QFileInfo(loadedFile).fileName());
+			prependToRecentFiles(loadedFile);
+		}
+		});
 	const bool succeeded = child->loadFile(fileName);
 	if (!succeeded)
 		child->parentWidget()->close();
-	else
-	{
-		child->setWindowTitle(QFileInfo(fileName).fileName());
-		MainWindow::prependToRecentFiles(fileName);
-	}
 	return succeeded;
 }
 
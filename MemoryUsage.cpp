@@ -0,0 +1,41 @@
+#include "MemoryUsage.h"
+
+#include <QtGlobal>
+
+#if defined(Q_OS_WIN)
+#include <windows.h>
+#include <psapi.h>
+#elif defined(Q_OS_MACOS)
+#include <mach/mach.h>
+#elif defined(Q_OS_LINUX)
+#include <cstdio>
+#include <unistd.h>
+#endif
+
+unsigned long long MemoryUsage::residentBytes()
+{
+#if defined(Q_OS_WIN)
+	PROCESS_MEMORY_COUNTERS counters;
+	if (GetProcessMemoryInfo(GetCurrentProcess(), &counters, sizeof(counters)))
+		return counters.WorkingSetSize;
+	return 0;
+#elif defined(Q_OS_MACOS)
+	mach_task_basic_info info;
+	mach_msg_type_number_t count = MACH_TASK_BASIC_INFO_COUNT;
+	if (task_info(mach_task_self(), MACH_TASK_BASIC_INFO, reinterpret_cast<task_info_t>(&info), &count) == KERN_SUCCESS)
+		return info.resident_size;
+	return 0;
+#elif defined(Q_OS_LINUX)
+	// the second field of statm is the resident set in pages
+	unsigned long long pages = 0;
+	FILE* file = std::fopen("/proc/self/statm", "r");
+	if (!file)
+		return 0;
+	if (std::fscanf(file, "%*s %llu", &pages) != 1)
+		pages = 0;
+	std::fclose(file);
+	return pages * static_cast<unsigned long long>(sysconf(_SC_PAGESIZE));
+#else
+	return 0;
+#endif
+}
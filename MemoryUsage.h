@@ -0,0 +1,9 @@
+#pragma once
+
+// Physical memory used by the process, sampled to report the memory cost of imports
+class MemoryUsage
+{
+public:
+	// Bytes currently resident, zero when the platform does not report it
+	static unsigned long long residentBytes();
+};
@@ -0,0 +1,416 @@
+#include "MeshBVH.h"
+
+#include <algorithm>
+#include <numeric>
+#include <limits>
+#include <cmath>
+
+namespace
+{
+	const unsigned int BIN_COUNT = 12;     // SAH bins per axis
+	const unsigned int MIN_LEAF_SIZE = 2;  // never split below this
+	const unsigned int MAX_LEAF_SIZE = 8;  // always split above this if possible
+
+	struct Bounds
+	{
+		float mn[3];
+		float mx[3];
+
+		Bounds()
+		{
+			reset();
+		}
+
+		void reset()
+		{
+			mn[0] = mn[1] = mn[2] = std::numeric_limits<float>::max();
+			mx[0] = mx[1] = mx[2] = -std::numeric_limits<float>::max();
+		}
+
+		void grow(const float* p)
+		{
+			for (int a = 0; a < 3; a++)
+			{
+				mn[a] = std::min(mn[a], p[a]);
+				mx[a] = std::max(mx[a], p[a]);
+			}
+		}
+
+		void grow(const Bounds& b)
+		{
+			for (int a = 0; a < 3; a++)
+			{
+				mn[a] = std::min(mn[a], b.mn[a]);
+				mx[a] = std::max(mx[a], b.mx[a]);
+			}
+		}
+
+		float area() const
+		{
+			float dx = mx[0] - mn[0];
+			float dy = mx[1] - mn[1];
+			float dz = mx[2] - mn[2];
+			if (dx < 0.0f || dy < 0.0f || dz < 0.0f)
+				return 0.0f;
+			return 2.0f * (dx * dy + dy * dz + dz * dx);
+		}
+	};
+
+	// Slab test, returns the entry distance of the ray into the node box
+	inline bool intersectsBox(const MeshBVH::Node& node, const float* org, const float* invDir, float maxDist, float& tNear)
+	{
+		float tmin = 0.0f;
+		float tmax = maxDist;
+		for (int a = 0; a < 3; a++)
+		{
+			float t1 = (node.boundsMin[a] - org[a]) * invDir[a];
+			float t2 = (node.boundsMax[a] - org[a]) * invDir[a];
+			tmin = std::max(tmin, std::min(t1, t2));
+			tmax = std::min(tmax, std::max(t1, t2));
+		}
+		tNear = tmin;
+		return tmin <= tmax;
+	}
+}
+
+void MeshBVH::TriangleTable::resize(size_t count)
+{
+	for (std::vector<float>* column : { &v0x, &v0y, &v0z, &e1x, &e1y, &e1z, &e2x, &e2y, &e2z })
+	{
+		column->resize(count);
+		column->shrink_to_fit();
+	}
+}
+
+unsigned long long MeshBVH::TriangleTable::memorySize() const
+{
+	return 9 * v0x.capacity() * sizeof(float);
+}
+
+MeshBVH::MeshBVH()
+{
+}
+
+void MeshBVH::clear()
+{
+	_nodes.clear();
+	_nodes.shrink_to_fit();
+	_triIndices.clear();
+	_triIndices.shrink_to_fit();
+	_table.resize(0);
+}
+
+unsigned long long MeshBVH::memorySize() const
+{
+	return _nodes.capacity() * sizeof(Node) + _triIndices.capacity() * sizeof(unsigned int) + _table.memorySize();
+}
+
+void MeshBVH::storeTriangle(size_t slot, const std::vector<float>& points, const std::vector<unsigned int>& indices)
+{
+	size_t tri = _triIndices[slot];
+	const float* p0 = &points[3 * size_t(indices[3 * tri + 0])];
+	const float* p1 = &points[3 * size_t(indices[3 * tri + 1])];
+	const float* p2 = &points[3 * size_t(indices[3 * tri + 2])];
+	_table.v0x[slot] = p0[0];
+	_table.v0y[slot] = p0[1];
+	_table.v0z[slot] = p0[2];
+	_table.e1x[slot] = p1[0] - p0[0];
+	_table.e1y[slot] = p1[1] - p0[1];
+	_table.e1z[slot] = p1[2] - p0[2];
+	_table.e2x[slot] = p2[0] - p0[0];
+	_table.e2y[slot] = p2[1] - p0[1];
+	_table.e2z[slot] = p2[2] - p0[2];
+}
+
+void MeshBVH::build(const std::vector<float>& points, const std::vector<unsigned int>& indices)
+{
+	clear();
+
+	const unsigned int triCount = static_cast<unsigned int>(indices.size() / 3);
+	if (triCount == 0)
+		return;
+
+	// per triangle bounds and centroids
+	std::vector<Bounds> triBounds(triCount);
+	std::vector<float> centroids(3 * size_t(triCount));
+	for (unsigned int t = 0; t < triCount; t++)
+	{
+		Bounds& b = triBounds[t];
+		b.grow(&points[3 * size_t(indices[3 * size_t(t) + 0])]);
+		b.grow(&points[3 * size_t(indices[3 * size_t(t) + 1])]);
+		b.grow(&points[3 * size_t(indices[3 * size_t(t) + 2])]);
+		for (int a = 0; a < 3; a++)
+			centroids[3 * size_t(t) + a] = (b.mn[a] + b.mx[a]) * 0.5f;
+	}
+
+	_triIndices.resize(triCount);
+	std::iota(_triIndices.begin(), _triIndices.end(), 0);
+
+	_nodes.reserve(2 * size_t(triCount) - 1);
+	Node root;
+	root.leftFirst = 0;
+	root.triCount = triCount;
+	_nodes.push_back(root);
+
+	std::vector<unsigned int> stack;
+	stack.push_back(0);
+	while (!stack.empty())
+	{
+		unsigned int nodeIdx = stack.back();
+		stack.pop_back();
+
+		const unsigned int first = _nodes[nodeIdx].leftFirst;
+		const unsigned int count = _nodes[nodeIdx].triCount;
+
+		Bounds nodeBounds, centroidBounds;
+		for (unsigned int i = first; i < first + count; i++)
+		{
+			unsigned int tri = _triIndices[i];
+			nodeBounds.grow(triBounds[tri]);
+			centroidBounds.grow(&centroids[3 * size_t(tri)]);
+		}
+		for (int a = 0; a < 3; a++)
+		{
+			_nodes[nodeIdx].boundsMin[a] = nodeBounds.mn[a];
+			_nodes[nodeIdx].boundsMax[a] = nodeBounds.mx[a];
+		}
+
+		if (count <= MIN_LEAF_SIZE)
+			continue;
+
+		// find the cheapest split plane over the centroid bins of all three axes
+		float bestCost = std::numeric_limits<float>::max();
+		int bestAxis = -1;
+		unsigned int bestSplit = 0;
+		for (int axis = 0; axis < 3; axis++)
+		{
+			float extent = centroidBounds.mx[axis] - centroidBounds.mn[axis];
+			if (extent <= 0.0f)
+				continue;
+
+			Bounds bins[BIN_COUNT];
+			unsigned int binCounts[BIN_COUNT] = {};
+			float scale = BIN_COUNT / extent;
+			for (unsigned int i = first; i < first + count; i++)
+			{
+				unsigned int tri = _triIndices[i];
+				unsigned int bin = std::min(BIN_COUNT - 1,
+					static_cast<unsigned int>((centroids[3 * size_t(tri) + axis] - centroidBounds.mn[axis]) * scale));
+				binCounts[bin]++;
+				bins[bin].grow(triBounds[tri]);
+			}
+
+			float leftArea[BIN_COUNT - 1], rightArea[BIN_COUNT - 1];
+			unsigned int leftCount[BIN_COUNT - 1], rightCount[BIN_COUNT - 1];
+			Bounds leftBox, rightBox;
+			unsigned int leftSum = 0, rightSum = 0;
+			for (unsigned int i = 0; i < BIN_COUNT - 1; i++)
+			{
+				leftSum += binCounts[i];
+				leftBox.grow(bins[i]);
+				leftCount[i] = leftSum;
+				leftArea[i] = leftBox.area();
+
+				rightSum += binCounts[BIN_COUNT - 1 - i];
+				rightBox.grow(bins[BIN_COUNT - 1 - i]);
+				rightCount[BIN_COUNT - 2 - i] = rightSum;
+				rightArea[BIN_COUNT - 2 - i] = rightBox.area();
+			}
+
+			for (unsigned int i = 0; i < BIN_COUNT - 1; i++)
+			{
+				float cost = leftCount[i] * leftArea[i] + rightCount[i] * rightArea[i];
+				if (cost < bestCost)
+				{
+					bestCost = cost;
+					bestAxis = axis;
+					bestSplit = i;
+				}
+			}
+		}
+
+		if (bestAxis < 0)
+			continue; // all centroids coincide
+
+		// traversal cost of 1 against an intersection cost of 1, both scaled by the node area
+		float nodeArea = nodeBounds.area();
+		if (nodeArea + bestCost >= count * nodeArea && count <= MAX_LEAF_SIZE)
+			continue;
+
+		const float splitMin = centroidBounds.mn[bestAxis];
+		const float splitScale = BIN_COUNT / (centroidBounds.mx[bestAxis] - splitMin);
+		auto middle = std::partition(_triIndices.begin() + first, _triIndices.begin() + first + count,
+			[&](unsigned int tri)
+			{
+				unsigned int bin = std::min(BIN_COUNT - 1,
+					static_cast<unsigned int>((centroids[3 * size_t(tri) + bestAxis] - splitMin) * splitScale));
+				return bin <= bestSplit;
+			});
+		unsigned int leftTris = static_cast<unsigned int>(middle - (_triIndices.begin() + first));
+		if (leftTris == 0 || leftTris == count)
+			continue;
+
+		unsigned int leftIdx = static_cast<unsigned int>(_nodes.size());
+		Node left, right;
+		left.leftFirst = first;
+		left.triCount = leftTris;
+		right.leftFirst = first + leftTris;
+		right.triCount = count - leftTris;
+		_nodes.push_back(left);
+		_nodes.push_back(right);
+
+		_nodes[nodeIdx].leftFirst = leftIdx;
+		_nodes[nodeIdx].triCount = 0;
+
+		stack.push_back(leftIdx + 1);
+		stack.push_back(leftIdx);
+	}
+	_nodes.shrink_to_fit();
+
+	_table.resize(triCount);
+	for (size_t slot = 0; slot < triCount; slot++)
+		storeTriangle(slot, points, indices);
+}
+
+void MeshBVH::computeLeafBounds(Node& node)
+{
+	Bounds b;
+	for (unsigned int i = node.leftFirst; i < node.leftFirst + node.triCount; i++)
+	{
+		const float v0[3] = { _table.v0x[i], _table.v0y[i], _table.v0z[i] };
+		const float v1[3] = { v0[0] + _table.e1x[i], v0[1] + _table.e1y[i], v0[2] + _table.e1z[i] };
+		const float v2[3] = { v0[0] + _table.e2x[i], v0[1] + _table.e2y[i], v0[2] + _table.e2z[i] };
+		b.grow(v0);
+		b.grow(v1);
+		b.grow(v2);
+	}
+	for (int a = 0; a < 3; a++)
+	{
+		node.boundsMin[a] = b.mn[a];
+		node.boundsMax[a] = b.mx[a];
+	}
+}
+
+void MeshBVH::refit(const std::vector<float>& points, const std::vector<unsigned int>& indices)
+{
+	for (size_t slot = 0; slot < _triIndices.size(); slot++)
+		storeTriangle(slot, points, indices);
+
+	// children are always stored after their parent, so a reverse sweep is bottom up
+	for (size_t i = _nodes.size(); i-- > 0;)
+	{
+		Node& node = _nodes[i];
+		if (node.isLeaf())
+		{
+			computeLeafBounds(node);
+		}
+		else
+		{
+			const Node& left = _nodes[node.leftFirst];
+			const Node& right = _nodes[node.leftFirst + 1];
+			for (int a = 0; a < 3; a++)
+			{
+				node.boundsMin[a] = std::min(left.boundsMin[a], right.boundsMin[a]);
+				node.boundsMax[a] = std::max(left.boundsMax[a], right.boundsMax[a]);
+			}
+		}
+	}
+}
+
+bool MeshBVH::intersectsWithRay(const QVector3D& rayPos, const QVector3D& rayDir, Hit& outHit) const
+{
+	if (_nodes.empty())
+		return false;
+
+	const float org[3] = { rayPos.x(), rayPos.y(), rayPos.z() };
+	float invDir[3];
+	for (int a = 0; a < 3; a++)
+	{
+		float d = rayDir[a];
+		invDir[a] = std::fabs(d) > 1e-20f ? 1.0f / d : std::copysign(1e20f, d);
+	}
+
+	// Möller–Trumbore intersection algorithm
+	const float EPSILON = 0.0000001f;
+	float closest = std::numeric_limits<float>::max();
+	bool found = false;
+
+	std::vector<unsigned int> stack;
+	stack.reserve(64);
+	float tNear;
+	if (!intersectsBox(_nodes[0], org, invDir, closest, tNear))
+		return false;
+	stack.push_back(0);
+
+	while (!stack.empty())
+	{
+		const Node& node = _nodes[stack.back()];
+		stack.pop_back();
+
+		if (node.isLeaf())
+		{
+			for (unsigned int i = node.leftFirst; i < node.leftFirst + node.triCount; i++)
+			{
+				QVector3D v0(_table.v0x[i], _table.v0y[i], _table.v0z[i]);
+				QVector3D edge1(_table.e1x[i], _table.e1y[i], _table.e1z[i]);
+				QVector3D edge2(_table.e2x[i], _table.e2y[i], _table.e2z[i]);
+				QVector3D h = QVector3D::crossProduct(rayDir, edge2);
+				float a = QVector3D::dotProduct(edge1, h);
+				if (a > -EPSILON && a < EPSILON)
+					continue; // parallel
+				float f = 1.0f / a;
+				QVector3D s = rayPos - v0;
+				float u = f * QVector3D::dotProduct(s, h);
+				if (u < 0.0f || u > 1.0f)
+					continue;
+				QVector3D q = QVector3D::crossProduct(s, edge1);
+				float v = f * QVector3D::dotProduct(rayDir, q);
+				if (v < 0.0f || u + v > 1.0f)
+					continue;
+				float t = f * QVector3D::dotProduct(edge2, q);
+				if (t > EPSILON && t < closest)
+				{
+					closest = t;
+					found = true;
+					outHit.distance = t;
+					outHit.triangle = _triIndices[i];
+					outHit.u = u;
+					outHit.v = v;
+				}
+			}
+			continue;
+		}
+
+		// visit the nearer child first, skip children beyond the closest hit so far
+		unsigned int leftIdx = node.leftFirst;
+		unsigned int rightIdx = node.leftFirst + 1;
+		float leftNear, rightNear;
+		bool hitLeft = intersectsBox(_nodes[leftIdx], org, invDir, closest, leftNear);
+		bool hitRight = intersectsBox(_nodes[rightIdx], org, invDir, closest, rightNear);
+		if (hitLeft && hitRight)
+		{
+			if (leftNear <= rightNear)
+			{
+				stack.push_back(rightIdx);
+				stack.push_back(leftIdx);
+			}
+			else
+			{
+				stack.push_back(leftIdx);
+				stack.push_back(rightIdx);
+			}
+		}
+		else if (hitLeft)
+		{
+			stack.push_back(leftIdx);
+		}
+		else if (hitRight)
+		{
+			stack.push_back(rightIdx);
+		}
+	}
+
+	if (found)
+		outHit.point = rayPos + rayDir * outHit.distance;
+	return found;
+}
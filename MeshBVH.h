@@ -0,0 +1,66 @@
+#pragma once
+
+#include <vector>
+#include <QVector3D>
+
+// Bounding volume hierarchy over the triangles of a mesh.
+// Built with the binned surface area heuristic and stored as a flat node array,
+// the two children of an interior node are always adjacent in the array
+class MeshBVH
+{
+public:
+	struct Node
+	{
+		float boundsMin[3];
+		float boundsMax[3];
+		unsigned int leftFirst; // index of left child for interior nodes, first triangle for leaves
+		unsigned int triCount;  // number of triangles, 0 for interior nodes
+
+		bool isLeaf() const { return triCount > 0; }
+	};
+
+	// Closest ray hit
+	struct Hit
+	{
+		float distance = 0.0f;      // ray parameter t
+		unsigned int triangle = 0;  // index of the triangle (i.e. first index / 3)
+		float u = 0.0f;             // barycentric weight of the second vertex
+		float v = 0.0f;             // barycentric weight of the third vertex
+		QVector3D point;
+	};
+
+public:
+	MeshBVH();
+
+	void build(const std::vector<float>& points, const std::vector<unsigned int>& indices);
+	// Recompute node bounds bottom up after the vertices moved, the tree topology is kept
+	void refit(const std::vector<float>& points, const std::vector<unsigned int>& indices);
+	void clear();
+
+	bool isBuilt() const { return !_nodes.empty(); }
+	size_t nodeCount() const { return _nodes.size(); }
+	unsigned long long memorySize() const;
+
+	bool intersectsWithRay(const QVector3D& rayPos, const QVector3D& rayDir, Hit& outHit) const;
+
+private:
+	void storeTriangle(size_t slot, const std::vector<float>& points, const std::vector<unsigned int>& indices);
+	void computeLeafBounds(Node& node);
+
+private:
+	// Structure of arrays triangle table in leaf order: first vertex and
+	// the two edges from it, precomputed for Möller–Trumbore
+	struct TriangleTable
+	{
+		std::vector<float> v0x, v0y, v0z;
+		std::vector<float> e1x, e1y, e1z;
+		std::vector<float> e2x, e2y, e2z;
+
+		void resize(size_t count);
+		unsigned long long memorySize() const;
+	};
+
+	std::vector<Node> _nodes;
+	std::vector<unsigned int> _triIndices; // leaf order slot -> mesh triangle index
+	TriangleTable _table;
+};
@@ -0,0 +1,1345 @@
+#include "MeshFileReader.h"
+
+#include <QtConcurrent>
+#include <QFileInfo>
+#include <QFile>
+#include <QThread>
+#include <QtEndian>
+#include <QtMath>
+#include <algorithm>
+#include <atomic>
+#include <cctype>
+#include <cfloat>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <functional>
+#include <limits>
+
+namespace
+{
+	// Triangles as read from a file. Normals and texture coordinates have their own
+	// corner indices (OBJ) or, when the index array is empty, follow the positions
+	struct IndexedMesh
+	{
+		std::vector<float> positions;
+		std::vector<float> normals;
+		std::vector<float> texCoords;
+		std::vector<unsigned int> positionIndices;
+		std::vector<unsigned int> normalIndices;
+		std::vector<unsigned int> texCoordIndices;
+	};
+
+	// A slice of items, or of bytes for text, processed by one task
+	struct Range
+	{
+		size_t index;
+		size_t begin;
+		size_t end;
+	};
+
+	size_t taskCount(size_t count, size_t minSize)
+	{
+		const size_t tasks = 4 * static_cast<size_t>(std::max(1, QThread::idealThreadCount()));
+		return std::max<size_t>(1, std::min(tasks, count / minSize));
+	}
+
+	std::vector<Range> splitRange(size_t count, size_t minSize = 65536)
+	{
+		std::vector<Range> ranges;
+		const size_t tasks = taskCount(count, minSize);
+		for (size_t i = 0; i < tasks; i++)
+			ranges.push_back({ i, count * i / tasks, count * (i + 1) / tasks });
+		return ranges;
+	}
+
+	// Byte ranges of a text ending on line boundaries
+	std::vector<Range> splitLines(const char* text, size_t size)
+	{
+		std::vector<Range> ranges;
+		const size_t tasks = taskCount(size, 4 << 20);
+		size_t begin = 0;
+		for (size_t i = 1; i <= tasks && begin < size; i++)
+		{
+			size_t end = std::max(begin, size * i / tasks);
+			const void* newLine = end < size ? memchr(text + end, '\n', size - end) : nullptr;
+			end = newLine ? static_cast<const char*>(newLine) - text + 1 : size;
+			ranges.push_back({ ranges.size(), begin, end });
+			begin = end;
+		}
+		return ranges;
+	}
+
+	void parallelFor(std::vector<Range>& ranges, const std::function<void(const Range&)>& body)
+	{
+		QtConcurrent::blockingMap(ranges, [&body](Range& range) { body(range); });
+	}
+
+	// Text scanning on the mapped file, lines end with '\n' and '\r' counts as a blank
+
+	inline const char* skipBlanks(const char* p, const char* end)
+	{
+		while (p < end && (*p == ' ' || *p == '\t' || *p == '\r'))
+			p++;
+		return p;
+	}
+
+	inline const char* nextLine(const char* p, const char* end)
+	{
+		const void* newLine = memchr(p, '\n', end - p);
+		return newLine ? static_cast<const char*>(newLine) + 1 : end;
+	}
+
+	// Compare the keyword at p, it has to be followed by a blank or the end of the line
+	inline bool startsWith(const char* p, const char* end, const char* keyword, size_t length)
+	{
+		if (end - p < static_cast<ptrdiff_t>(length) || memcmp(p, keyword, length) != 0)
+			return false;
+		return p + length == end || p[length] == ' ' || p[length] == '\t' || p[length] == '\r' || p[length] == '\n';
+	}
+
+	inline bool isDigit(char c)
+	{
+		return static_cast<unsigned char>(c - '0') < 10;
+	}
+
+	double powerOfTen(int exponent)
+	{
+		static const double powers[] = { 1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+			1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22 };
+		return exponent <= 22 ? powers[exponent] : std::pow(10.0, exponent);
+	}
+
+	// Decimal number without locale or allocation, the mantissa keeps 19 digits which
+	// is more than float data needs
+	bool parseFloat(const char*& p, const char* end, float& value)
+	{
+		const char* s = skipBlanks(p, end);
+		bool negative = false;
+		if (s < end && (*s == '-' || *s == '+'))
+			negative = *s++ == '-';
+
+		uint64_t mantissa = 0;
+		int digits = 0;
+		int exponent = 0;
+		bool valid = false;
+		for (; s < end && isDigit(*s); s++, valid = true)
+		{
+			if (digits < 19)
+			{
+				mantissa = mantissa * 10 + (*s - '0');
+				digits += mantissa != 0;
+			}
+			else
+				exponent++;
+		}
+		if (s < end && *s == '.')
+		{
+			for (s++; s < end && isDigit(*s); s++, valid = true)
+			{
+				if (digits < 19)
+				{
+					mantissa = mantissa * 10 + (*s - '0');
+					digits += mantissa != 0;
+					exponent--;
+				}
+			}
+		}
+		if (!valid)
+			return false;
+
+		if (s < end && (*s == 'e' || *s == 'E'))
+		{
+			const char* e = s + 1;
+			bool negativeExponent = false;
+			if (e < end && (*e == '-' || *e == '+'))
+				negativeExponent = *e++ == '-';
+			if (e < end && isDigit(*e))
+			{
+				int power = 0;
+				for (; e < end && isDigit(*e); e++)
+					power = std::min(power * 10 + (*e - '0'), 9999);
+				exponent += negativeExponent ? -power : power;
+				s = e;
+			}
+		}
+
+		double result = static_cast<double>(mantissa);
+		if (exponent > 0)
+			result *= powerOfTen(exponent);
+		else if (exponent < 0)
+			result /= powerOfTen(-exponent);
+		value = static_cast<float>(negative ? -result : result);
+		p = s;
+		return true;
+	}
+
+	bool parseInt(const char*& p, const char* end, long long& value)
+	{
+		const char* s = skipBlanks(p, end);
+		bool negative = false;
+		if (s < end && (*s == '-' || *s == '+'))
+			negative = *s++ == '-';
+		if (s == end || !isDigit(*s))
+			return false;
+		// nothing larger fits an index, stopping there keeps the sum from overflowing
+		const long long limit = std::numeric_limits<unsigned int>::max();
+		long long result = 0;
+		for (; s < end && isDigit(*s); s++)
+		{
+			result = result * 10 + (*s - '0');
+			if (result > limit)
+				return false;
+		}
+		value = negative ? -result : result;
+		p = s;
+		return true;
+	}
+
+	// Unindexed triangle corners are welded on a spatial hash. Positions snap to a grid
+	// of a millionth of the bounding box diagonal and the corners falling in the same
+	// cell share the vertex of the first one
+	template <typename CornerPosition>
+	void weldCorners(size_t cornerCount, CornerPosition cornerPosition, IndexedMesh& mesh)
+	{
+		std::vector<Range> ranges = splitRange(cornerCount);
+		std::vector<float> rangeBounds(6 * ranges.size());
+		parallelFor(ranges, [&](const Range& range) {
+			float* bounds = &rangeBounds[6 * range.index];
+			std::fill(bounds, bounds + 3, FLT_MAX);
+			std::fill(bounds + 3, bounds + 6, -FLT_MAX);
+			for (size_t i = range.begin; i < range.end; i++)
+			{
+				float p[3];
+				cornerPosition(i, p);
+				for (int k = 0; k < 3; k++)
+				{
+					bounds[k] = std::min(bounds[k], p[k]);
+					bounds[k + 3] = std::max(bounds[k + 3], p[k]);
+				}
+			}
+		});
+		float lower[3] = { FLT_MAX, FLT_MAX, FLT_MAX };
+		float upper[3] = { -FLT_MAX, -FLT_MAX, -FLT_MAX };
+		for (size_t r = 0; r < ranges.size(); r++)
+		{
+			for (int k = 0; k < 3; k++)
+			{
+				lower[k] = std::min(lower[k], rangeBounds[6 * r + k]);
+				upper[k] = std::max(upper[k], rangeBounds[6 * r + k + 3]);
+			}
+		}
+		double diagonal = 0.0;
+		for (int k = 0; k < 3; k++)
+			diagonal += upper[k] > lower[k] ? double(upper[k] - lower[k]) * (upper[k] - lower[k]) : 0.0;
+		const double cellSize = diagonal > 0.0 ? std::sqrt(diagonal) * 1e-6 : 1.0;
+
+		// open addressing on the 21 bit cell coordinates, closed meshes have about a sixth
+		// as many vertices as corners. The key and its vertex share a slot so that a probe
+		// touches a single cache line
+		struct Cell
+		{
+			uint64_t key;
+			unsigned int vertex;
+		};
+		const uint64_t emptyKey = ~uint64_t(0);
+		size_t capacity = 1024;
+		while (capacity < cornerCount / 4)
+			capacity *= 2;
+		std::vector<Cell> cells(capacity, Cell{ emptyKey, 0 });
+		size_t vertexCount = 0;
+		auto slot = [](uint64_t key, size_t mask) {
+			return static_cast<size_t>((key * 0x9E3779B97F4A7C15ull) >> 32) & mask;
+		};
+
+		mesh.positions.clear();
+		mesh.positions.reserve(cornerCount / 2);
+		mesh.positionIndices.resize(cornerCount);
+		for (size_t i = 0; i < cornerCount; i++)
+		{
+			float p[3];
+			cornerPosition(i, p);
+			uint64_t key = 0;
+			for (int k = 0; k < 3; k++)
+			{
+				const double cell = (p[k] - lower[k]) / cellSize;
+				key = (key << 21) | (cell > 0.0 ? static_cast<uint64_t>(std::min(cell, 2097151.0)) : 0);
+			}
+
+			size_t s = slot(key, capacity - 1);
+			while (cells[s].key != emptyKey && cells[s].key != key)
+				s = (s + 1) & (capacity - 1);
+			if (cells[s].key == emptyKey)
+			{
+				cells[s] = Cell{ key, static_cast<unsigned int>(vertexCount++) };
+				mesh.positions.insert(mesh.positions.end(), p, p + 3);
+			}
+			mesh.positionIndices[i] = cells[s].vertex;
+
+			if (4 * vertexCount > 3 * capacity)
+			{
+				std::vector<Cell> grownCells(2 * capacity, Cell{ emptyKey, 0 });
+				for (const Cell& cell : cells)
+				{
+					if (cell.key == emptyKey)
+						continue;
+					size_t t = slot(cell.key, 2 * capacity - 1);
+					while (grownCells[t].key != emptyKey)
+						t = (t + 1) & (2 * capacity - 1);
+					grownCells[t] = cell;
+				}
+				cells.swap(grownCells);
+				capacity *= 2;
+			}
+		}
+		mesh.positions.shrink_to_fit();
+	}
+
+	inline void cross(const float* a, const float* b, const float* c, float* n)
+	{
+		const float u[3] = { b[0] - a[0], b[1] - a[1], b[2] - a[2] };
+		const float v[3] = { c[0] - a[0], c[1] - a[1], c[2] - a[2] };
+		n[0] = u[1] * v[2] - u[2] * v[1];
+		n[1] = u[2] * v[0] - u[0] * v[2];
+		n[2] = u[0] * v[1] - u[1] * v[0];
+	}
+
+	inline void normalize(float* v)
+	{
+		const float length = std::sqrt(v[0] * v[0] + v[1] * v[1] + v[2] * v[2]);
+		if (length > 0.0f)
+		{
+			v[0] /= length;
+			v[1] /= length;
+			v[2] /= length;
+		}
+	}
+
+	// Turn the file's triangles into one mesh in the upload layout. Every corner becomes
+	// the vertex of its position with its normal and texture coordinate, corners of a
+	// position sharing both share the vertex. Generated normals average the area weighted
+	// normals of the triangles around the position within the smoothing angle
+	void buildGeometry(IndexedMesh& mesh, float smoothingAngle, MeshGeometry& geometry)
+	{
+		const size_t positionCount = mesh.positions.size() / 3;
+		const size_t cornerCount = mesh.positionIndices.size();
+		const bool generateNormals = mesh.normals.empty();
+		const bool hasTexCoords = !mesh.texCoords.empty();
+
+		// repeat the corners of one texture triangle over the vertices, like the Assimp import
+		static const float cornerTexCoords[3][2] = { { 0.0f, 0.0f }, { 1.0f, 0.0f }, { 0.5f, 1.0f } };
+
+		// attributes given per position, nothing to split
+		if (!generateNormals && mesh.normalIndices.empty() && mesh.texCoordIndices.empty())
+		{
+			geometry.points = std::move(mesh.positions);
+			geometry.normals = std::move(mesh.normals);
+			geometry.indices = std::move(mesh.positionIndices);
+			geometry.tangents.resize(3 * positionCount);
+			geometry.bitangents.resize(3 * positionCount);
+			if (hasTexCoords)
+			{
+				geometry.texCoords = std::move(mesh.texCoords);
+				MeshFileReader::computeTangents(geometry);
+			}
+			else
+			{
+				geometry.texCoords.resize(2 * positionCount);
+				for (size_t i = 0; i < positionCount; i++)
+				{
+					geometry.texCoords[2 * i + 0] = cornerTexCoords[i % 3][0];
+					geometry.texCoords[2 * i + 1] = cornerTexCoords[i % 3][1];
+				}
+			}
+			return;
+		}
+
+		// area weighted normals of the triangles with their length
+		std::vector<float> faceNormals;
+		std::vector<float> faceAreas;
+		if (generateNormals)
+		{
+			faceNormals.resize(cornerCount);
+			faceAreas.resize(cornerCount / 3);
+			std::vector<Range> ranges = splitRange(cornerCount / 3);
+			parallelFor(ranges, [&](const Range& range) {
+				for (size_t f = range.begin; f < range.end; f++)
+				{
+					const unsigned int* v = &mesh.positionIndices[3 * f];
+					float* n = &faceNormals[3 * f];
+					cross(&mesh.positions[3 * v[0]], &mesh.positions[3 * v[1]], &mesh.positions[3 * v[2]], n);
+					faceAreas[f] = std::sqrt(n[0] * n[0] + n[1] * n[1] + n[2] * n[2]);
+				}
+			});
+		}
+
+		// corners around each position
+		std::vector<unsigned int> firstCorner(positionCount + 1, 0);
+		for (unsigned int position : mesh.positionIndices)
+			firstCorner[position + 1]++;
+		for (size_t i = 0; i < positionCount; i++)
+			firstCorner[i + 1] += firstCorner[i];
+		std::vector<unsigned int> positionCorners(cornerCount);
+		{
+			std::vector<unsigned int> next(firstCorner.begin(), firstCorner.end() - 1);
+			for (size_t c = 0; c < cornerCount; c++)
+				positionCorners[next[mesh.positionIndices[c]]++] = static_cast<unsigned int>(c);
+		}
+
+		// vertices are numbered per range of positions first, then offset by the ranges before
+		struct RangeVertices
+		{
+			std::vector<unsigned int> positions;
+			std::vector<unsigned int> texCoords;
+			std::vector<float> normals;
+		};
+		const float cosAngle = std::cos(qDegreesToRadians(smoothingAngle));
+		std::vector<unsigned int> cornerVertices(cornerCount);
+		std::vector<Range> ranges = splitRange(positionCount, 16384);
+		std::vector<RangeVertices> rangeVertices(ranges.size());
+		parallelFor(ranges, [&](const Range& range) {
+			RangeVertices& out = rangeVertices[range.index];
+			std::vector<unsigned int> normalKeys;
+			for (size_t p = range.begin; p < range.end; p++)
+			{
+				const size_t firstVertex = out.positions.size();
+				for (unsigned int i = firstCorner[p]; i < firstCorner[p + 1]; i++)
+				{
+					const unsigned int c = positionCorners[i];
+					const unsigned int texCoord = mesh.texCoordIndices.empty() ? static_cast<unsigned int>(p) : mesh.texCoordIndices[c];
+					const unsigned int normalKey = mesh.normalIndices.empty() ? static_cast<unsigned int>(p) : mesh.normalIndices[c];
+					float normal[3] = { 0.0f, 0.0f, 0.0f };
+					if (generateNormals)
+					{
+						const float* n = &faceNormals[3 * (c / 3)];
+						const float area = faceAreas[c / 3];
+						for (unsigned int j = firstCorner[p]; j < firstCorner[p + 1]; j++)
+						{
+							const unsigned int face = positionCorners[j] / 3;
+							const float* m = &faceNormals[3 * face];
+							const float d = n[0] * m[0] + n[1] * m[1] + n[2] * m[2];
+							if (positionCorners[j] == c || d >= cosAngle * area * faceAreas[face])
+							{
+								normal[0] += m[0];
+								normal[1] += m[1];
+								normal[2] += m[2];
+							}
+						}
+						normalize(normal);
+					}
+
+					size_t v = firstVertex;
+					for (; v < out.positions.size(); v++)
+					{
+						if (out.texCoords[v] != texCoord)
+							continue;
+						if (generateNormals)
+						{
+							const float* m = &out.normals[3 * v];
+							if (std::fabs(m[0] - normal[0]) < 1e-4f && std::fabs(m[1] - normal[1]) < 1e-4f && std::fabs(m[2] - normal[2]) < 1e-4f)
+								break;
+						}
+						else if (normalKeys[v] == normalKey)
+							break;
+					}
+					if (v == out.positions.size())
+					{
+						out.positions.push_back(static_cast<unsigned int>(p));
+						out.texCoords.push_back(texCoord);
+						if (generateNormals)
+							out.normals.insert(out.normals.end(), normal, normal + 3);
+						else
+						{
+							normalKeys.push_back(normalKey);
+							const float* n = &mesh.normals[3 * static_cast<size_t>(normalKey)];
+							out.normals.insert(out.normals.end(), n, n + 3);
+						}
+					}
+					cornerVertices[c] = static_cast<unsigned int>(v);
+				}
+			}
+		});
+
+		std::vector<size_t> firstVertices(ranges.size() + 1, 0);
+		for (size_t r = 0; r < ranges.size(); r++)
+			firstVertices[r + 1] = firstVertices[r] + rangeVertices[r].positions.size();
+		const size_t vertexCount = firstVertices.back();
+		geometry.points.resize(3 * vertexCount);
+		geometry.normals.resize(3 * vertexCount);
+		geometry.texCoords.resize(2 * vertexCount);
+		geometry.tangents.resize(3 * vertexCount);
+		geometry.bitangents.resize(3 * vertexCount);
+		geometry.indices.resize(cornerCount);
+		parallelFor(ranges, [&](const Range& range) {
+			const RangeVertices& out = rangeVertices[range.index];
+			const size_t first = firstVertices[range.index];
+			for (size_t v = 0; v < out.positions.size(); v++)
+			{
+				const size_t i = first + v;
+				memcpy(&geometry.points[3 * i], &mesh.positions[3 * static_cast<size_t>(out.positions[v])], 3 * sizeof(float));
+				memcpy(&geometry.normals[3 * i], &out.normals[3 * v], 3 * sizeof(float));
+				if (hasTexCoords)
+					memcpy(&geometry.texCoords[2 * i], &mesh.texCoords[2 * static_cast<size_t>(out.texCoords[v])], 2 * sizeof(float));
+				else
+				{
+					geometry.texCoords[2 * i + 0] = cornerTexCoords[i % 3][0];
+					geometry.texCoords[2 * i + 1] = cornerTexCoords[i % 3][1];
+				}
+			}
+			for (size_t p = range.begin; p < range.end; p++)
+			{
+				for (unsigned int i = firstCorner[p]; i < firstCorner[p + 1]; i++)
+					geometry.indices[positionCorners[i]] = static_cast<unsigned int>(first + cornerVertices[positionCorners[i]]);
+			}
+		});
+		if (hasTexCoords)
+			MeshFileReader::computeTangents(geometry);
+	}
+
+	/* STL */
+
+	bool readStl(const uchar* data, qint64 size, IndexedMesh& mesh, QString& error)
+	{
+		// binary files are recognized by their size, some of them start with "solid" too
+		if (size >= 84)
+		{
+			const quint32 triangleCount = qFromLittleEndian<quint32>(data + 80);
+			if (84 + 50 * static_cast<qint64>(triangleCount) == size)
+			{
+				// facets are 50 bytes, the normal, the three corners and an attribute word
+				weldCorners(3 * static_cast<size_t>(triangleCount), [data](size_t i, float* p) {
+					const uchar* corner = data + 84 + 50 * (i / 3) + 12 + 12 * (i % 3);
+					for (int k = 0; k < 3; k++)
+					{
+						const quint32 bits = qFromLittleEndian<quint32>(corner + 4 * k);
+						memcpy(&p[k], &bits, sizeof(float));
+					}
+				}, mesh);
+				return true;
+			}
+		}
+
+		const char* text = reinterpret_cast<const char*>(data);
+		const char* start = text;
+		while (start < text + size && isspace(static_cast<unsigned char>(*start)))
+			start++;
+		if (!startsWith(start, text + size, "solid", 5))
+		{
+			error = "Not a binary or ASCII STL file";
+			return false;
+		}
+
+		// count the corners of every chunk, then parse them in place
+		std::vector<Range> chunks = splitLines(text, static_cast<size_t>(size));
+		std::vector<size_t> firstCorners(chunks.size() + 1, 0);
+		parallelFor(chunks, [&](const Range& chunk) {
+			size_t count = 0;
+			const char* end = text + chunk.end;
+			for (const char* line = text + chunk.begin; line < end; line = nextLine(line, end))
+				count += startsWith(skipBlanks(line, end), end, "vertex", 6);
+			firstCorners[chunk.index + 1] = count;
+		});
+		for (size_t i = 0; i < chunks.size(); i++)
+			firstCorners[i + 1] += firstCorners[i];
+		const size_t cornerCount = firstCorners.back();
+		if (cornerCount == 0 || cornerCount % 3 != 0)
+		{
+			error = "Incomplete facets in ASCII STL file";
+			return false;
+		}
+
+		std::vector<float> corners(3 * cornerCount);
+		std::atomic<bool> failed(false);
+		parallelFor(chunks, [&](const Range& chunk) {
+			float* corner = &corners[3 * firstCorners[chunk.index]];
+			const char* end = text + chunk.end;
+			for (const char* line = text + chunk.begin; line < end; line = nextLine(line, end))
+			{
+				const char* p = skipBlanks(line, end);
+				if (!startsWith(p, end, "vertex", 6))
+					continue;
+				p += 6;
+				if (!parseFloat(p, end, corner[0]) || !parseFloat(p, end, corner[1]) || !parseFloat(p, end, corner[2]))
+					failed = true;
+				corner += 3;
+			}
+		});
+		if (failed)
+		{
+			error = "Invalid vertex in ASCII STL file";
+			return false;
+		}
+
+		weldCorners(cornerCount, [&corners](size_t i, float* p) {
+			memcpy(p, &corners[3 * i], 3 * sizeof(float));
+		}, mesh);
+		return true;
+	}
+
+	/* OBJ */
+
+	struct ObjCounts
+	{
+		size_t positions = 0;
+		size_t texCoords = 0;
+		size_t normals = 0;
+		size_t triangles = 0;
+		bool materials = false;
+		// "o" and "g" statements before, between and after the faces of the chunk
+		bool faces = false;
+		bool groupBeforeFaces = false;
+		bool groupBetweenFaces = false;
+		bool groupAfterFaces = false;
+	};
+
+	// Parse "v", "v/t", "v//n" or "v/t/n" of a face, absolute indices start at one and
+	// negative ones count back from the elements read so far. Missing parts are -1
+	bool parseObjCorner(const char*& p, const char* end, const size_t* counts, long long* corner)
+	{
+		for (int k = 0; k < 3; k++)
+		{
+			corner[k] = -1;
+			if (k > 0)
+			{
+				if (p == end || *p != '/')
+					continue;
+				p++;
+				if (p < end && *p == '/')
+					continue;
+			}
+			long long index;
+			if (!parseInt(p, end, index) || index == 0)
+			{
+				// a missing texture or normal index leaves it out, a number out of range does not
+				if (k == 0 || (p < end && (isDigit(*p) || *p == '-' || *p == '+')))
+					return false;
+				continue;
+			}
+			corner[k] = index > 0 ? index - 1 : static_cast<long long>(counts[k]) + index;
+			if (corner[k] < 0)
+				return false;
+		}
+		return true;
+	}
+
+	bool readObj(const uchar* data, qint64 size, IndexedMesh& mesh, QString& error)
+	{
+		const char* text = reinterpret_cast<const char*>(data);
+		std::vector<Range> chunks = splitLines(text, static_cast<size_t>(size));
+
+		// first pass sizes the arrays and places every chunk in them
+		std::vector<ObjCounts> chunkCounts(chunks.size() + 1);
+		parallelFor(chunks, [&](const Range& chunk) {
+			ObjCounts& counts = chunkCounts[chunk.index + 1];
+			const char* end = text + chunk.end;
+			for (const char* line = text + chunk.begin; line < end; line = nextLine(line, end))
+			{
+				const char* p = skipBlanks(line, end);
+				if (startsWith(p, end, "v", 1))
+					counts.positions++;
+				else if (startsWith(p, end, "vt", 2))
+					counts.texCoords++;
+				else if (startsWith(p, end, "vn", 2))
+					counts.normals++;
+				else if (startsWith(p, end, "f", 1))
+				{
+					size_t cornerCount = 0;
+					const char* lineEnd = nextLine(p, end);
+					for (p = skipBlanks(p + 1, lineEnd); p < lineEnd && *p != '\n' && *p != '#'; p = skipBlanks(p, lineEnd))
+					{
+						cornerCount++;
+						while (p < lineEnd && !isspace(static_cast<unsigned char>(*p)))
+							p++;
+					}
+					counts.triangles += cornerCount > 2 ? cornerCount - 2 : 0;
+					counts.groupBetweenFaces = counts.groupBetweenFaces || counts.groupAfterFaces;
+					counts.groupAfterFaces = false;
+					counts.faces = true;
+				}
+				else if (startsWith(p, end, "mtllib", 6))
+					counts.materials = true;
+				else if (startsWith(p, end, "o", 1) || startsWith(p, end, "g", 1))
+				{
+					if (counts.faces)
+						counts.groupAfterFaces = true;
+					else
+						counts.groupBeforeFaces = true;
+				}
+			}
+		});
+		// faces split by a group statement belong to separate meshes
+		bool groups = false;
+		bool facesBefore = false;
+		bool groupPending = false;
+		for (size_t i = 0; i < chunks.size(); i++)
+		{
+			const ObjCounts& counts = chunkCounts[i + 1];
+			if (counts.faces)
+			{
+				groups = groups || counts.groupBetweenFaces || (facesBefore && (groupPending || counts.groupBeforeFaces));
+				facesBefore = true;
+				groupPending = counts.groupAfterFaces;
+			}
+			else
+			{
+				groupPending = groupPending || counts.groupBeforeFaces;
+			}
+		}
+		for (size_t i = 0; i < chunks.size(); i++)
+		{
+			ObjCounts& next = chunkCounts[i + 1];
+			const ObjCounts& previous = chunkCounts[i];
+			next.positions += previous.positions;
+			next.texCoords += previous.texCoords;
+			next.normals += previous.normals;
+			next.triangles += previous.triangles;
+			next.materials = next.materials || previous.materials;
+		}
+		const ObjCounts& total = chunkCounts.back();
+		if (total.materials)
+		{
+			error = "OBJ file with materials";
+			return false;
+		}
+		if (groups)
+		{
+			error = "OBJ file with several groups";
+			return false;
+		}
+		if (total.triangles == 0)
+		{
+			error = "No faces in OBJ file";
+			return false;
+		}
+
+		mesh.positions.resize(3 * total.positions);
+		mesh.texCoords.resize(2 * total.texCoords);
+		mesh.normals.resize(3 * total.normals);
+		mesh.positionIndices.resize(3 * total.triangles);
+		mesh.texCoordIndices.resize(3 * total.triangles);
+		mesh.normalIndices.resize(3 * total.triangles);
+		// corners with a texture coordinate and with a normal, per chunk
+		std::vector<size_t> attributeCorners(2 * chunks.size(), 0);
+		std::atomic<bool> failed(false);
+		parallelFor(chunks, [&](const Range& chunk) {
+			ObjCounts counts = chunkCounts[chunk.index];
+			size_t texCoordCorners = 0;
+			size_t normalCorners = 0;
+			const char* end = text + chunk.end;
+			for (const char* line = text + chunk.begin; line < end && !failed; line = nextLine(line, end))
+			{
+				const char* p = skipBlanks(line, end);
+				bool valid = true;
+				if (startsWith(p, end, "v", 1))
+				{
+					float* position = &mesh.positions[3 * counts.positions++];
+					p += 1;
+					valid = parseFloat(p, end, position[0]) && parseFloat(p, end, position[1]) && parseFloat(p, end, position[2]);
+				}
+				else if (startsWith(p, end, "vt", 2))
+				{
+					float* texCoord = &mesh.texCoords[2 * counts.texCoords++];
+					p += 2;
+					valid = parseFloat(p, end, texCoord[0]);
+					if (!parseFloat(p, end, texCoord[1]))
+						texCoord[1] = 0.0f;
+				}
+				else if (startsWith(p, end, "vn", 2))
+				{
+					float* normal = &mesh.normals[3 * counts.normals++];
+					p += 2;
+					valid = parseFloat(p, end, normal[0]) && parseFloat(p, end, normal[1]) && parseFloat(p, end, normal[2]);
+				}
+				else if (startsWith(p, end, "f", 1))
+				{
+					// polygons are split in a fan around their first corner
+					const size_t elementCounts[3] = { counts.positions, counts.texCoords, counts.normals };
+					const size_t totals[3] = { total.positions, total.texCoords, total.normals };
+					long long corners[3][3];
+					int cornerCount = 0;
+					const char* lineEnd = nextLine(p, end);
+					for (p = skipBlanks(p + 1, lineEnd); valid && p < lineEnd && *p != '\n' && *p != '#'; p = skipBlanks(p, lineEnd))
+					{
+						long long* corner = corners[std::min(cornerCount, 2)];
+						valid = parseObjCorner(p, lineEnd, elementCounts, corner);
+						for (int k = 0; valid && k < 3; k++)
+							valid = corner[k] < static_cast<long long>(totals[k]);
+						if (!valid)
+							break;
+						if (++cornerCount < 3)
+							continue;
+						const size_t triangle = 3 * counts.triangles++;
+						for (int c = 0; c < 3; c++)
+						{
+							mesh.positionIndices[triangle + c] = static_cast<unsigned int>(corners[c][0]);
+							mesh.texCoordIndices[triangle + c] = static_cast<unsigned int>(std::max(corners[c][1], 0LL));
+							mesh.normalIndices[triangle + c] = static_cast<unsigned int>(std::max(corners[c][2], 0LL));
+							texCoordCorners += corners[c][1] >= 0;
+							normalCorners += corners[c][2] >= 0;
+						}
+						memcpy(corners[1], corners[2], sizeof(corners[2]));
+					}
+				}
+				if (!valid)
+					failed = true;
+			}
+			attributeCorners[2 * chunk.index] = texCoordCorners;
+			attributeCorners[2 * chunk.index + 1] = normalCorners;
+		});
+		if (failed)
+		{
+			error = "Invalid element in OBJ file";
+			return false;
+		}
+
+		// attributes only some faces refer to are dropped, normals are then generated
+		size_t texCoordCorners = 0;
+		size_t normalCorners = 0;
+		for (size_t i = 0; i < chunks.size(); i++)
+		{
+			texCoordCorners += attributeCorners[2 * i];
+			normalCorners += attributeCorners[2 * i + 1];
+		}
+		if (texCoordCorners != mesh.positionIndices.size())
+		{
+			std::vector<float>().swap(mesh.texCoords);
+			std::vector<unsigned int>().swap(mesh.texCoordIndices);
+		}
+		if (normalCorners != mesh.positionIndices.size())
+		{
+			std::vector<float>().swap(mesh.normals);
+			std::vector<unsigned int>().swap(mesh.normalIndices);
+		}
+		return true;
+	}
+
+	/* PLY */
+
+	enum class PlyType { Int8, UInt8, Int16, UInt16, Int32, UInt32, Float32, Float64, Invalid };
+
+	struct PlyProperty
+	{
+		QByteArray name;
+		PlyType type = PlyType::Invalid;
+		// lists start with their item count
+		PlyType countType = PlyType::Invalid;
+	};
+
+	struct PlyElement
+	{
+		QByteArray name;
+		qint64 count = 0;
+		std::vector<PlyProperty> properties;
+	};
+
+	PlyType plyType(const QByteArray& name)
+	{
+		if (name == "char" || name == "int8")
+			return PlyType::Int8;
+		if (name == "uchar" || name == "uint8")
+			return PlyType::UInt8;
+		if (name == "short" || name == "int16")
+			return PlyType::Int16;
+		if (name == "ushort" || name == "uint16")
+			return PlyType::UInt16;
+		if (name == "int" || name == "int32")
+			return PlyType::Int32;
+		if (name == "uint" || name == "uint32")
+			return PlyType::UInt32;
+		if (name == "float" || name == "float32")
+			return PlyType::Float32;
+		if (name == "double" || name == "float64")
+			return PlyType::Float64;
+		return PlyType::Invalid;
+	}
+
+	int plyTypeSize(PlyType type)
+	{
+		static const int sizes[] = { 1, 1, 2, 2, 4, 4, 4, 8, 0 };
+		return sizes[static_cast<int>(type)];
+	}
+
+	template <typename T>
+	T plyRead(const uchar* p, bool bigEndian)
+	{
+		return bigEndian ? qFromBigEndian<T>(p) : qFromLittleEndian<T>(p);
+	}
+
+	double plyValue(const uchar* p, PlyType type, bool bigEndian)
+	{
+		switch (type)
+		{
+		case PlyType::Int8:
+			return static_cast<qint8>(*p);
+		case PlyType::UInt8:
+			return *p;
+		case PlyType::Int16:
+			return plyRead<qint16>(p, bigEndian);
+		case PlyType::UInt16:
+			return plyRead<quint16>(p, bigEndian);
+		case PlyType::Int32:
+			return plyRead<qint32>(p, bigEndian);
+		case PlyType::UInt32:
+			return plyRead<quint32>(p, bigEndian);
+		case PlyType::Float32:
+		{
+			const quint32 bits = plyRead<quint32>(p, bigEndian);
+			float value;
+			memcpy(&value, &bits, sizeof(value));
+			return value;
+		}
+		case PlyType::Float64:
+		{
+			const quint64 bits = plyRead<quint64>(p, bigEndian);
+			double value;
+			memcpy(&value, &bits, sizeof(value));
+			return value;
+		}
+		default:
+			return 0.0;
+		}
+	}
+
+	int plyPropertyIndex(const PlyElement& element, std::initializer_list<const char*> names)
+	{
+		for (const char* name : names)
+		{
+			for (size_t i = 0; i < element.properties.size(); i++)
+			{
+				if (element.properties[i].name == name && element.properties[i].countType == PlyType::Invalid)
+					return static_cast<int>(i);
+			}
+		}
+		return -1;
+	}
+
+	bool readPly(const uchar* data, qint64 size, IndexedMesh& mesh, QString& error)
+	{
+		// the header is short, it is read line by line
+		enum class Format { Ascii, BinaryLittleEndian, BinaryBigEndian } format = Format::Ascii;
+		std::vector<PlyElement> elements;
+		const char* text = reinterpret_cast<const char*>(data);
+		const char* end = text + size;
+		const char* line = text;
+		bool header = false;
+		for (int lineNumber = 0; line < end && !header; lineNumber++)
+		{
+			const char* lineEnd = nextLine(line, end);
+			QList<QByteArray> tokens = QByteArray(line, static_cast<int>(lineEnd - line)).simplified().split(' ');
+			line = lineEnd;
+			const QByteArray& keyword = tokens[0];
+			if (lineNumber == 0 && keyword != "ply")
+				break;
+			if (keyword == "format" && tokens.size() >= 2)
+			{
+				if (tokens[1] == "binary_little_endian")
+					format = Format::BinaryLittleEndian;
+				else if (tokens[1] == "binary_big_endian")
+					format = Format::BinaryBigEndian;
+			}
+			else if (keyword == "element" && tokens.size() >= 3)
+			{
+				PlyElement element;
+				element.name = tokens[1];
+				bool ok = false;
+				element.count = tokens[2].toLongLong(&ok);
+				if (!ok || element.count < 0)
+				{
+					error = "Invalid element count in PLY file";
+					return false;
+				}
+				elements.push_back(element);
+			}
+			else if (keyword == "property" && !elements.empty() && tokens.size() >= 3)
+			{
+				PlyProperty property;
+				if (tokens[1] == "list" && tokens.size() >= 5)
+				{
+					property.countType = plyType(tokens[2]);
+					property.type = plyType(tokens[3]);
+					property.name = tokens[4];
+					if (property.countType == PlyType::Invalid)
+						property.type = PlyType::Invalid;
+				}
+				else
+				{
+					property.type = plyType(tokens[1]);
+					property.name = tokens[2];
+				}
+				if (property.type == PlyType::Invalid)
+				{
+					error = "Unknown property type in PLY file";
+					return false;
+				}
+				elements.back().properties.push_back(property);
+			}
+			else if (keyword == "end_header")
+				header = true;
+		}
+		if (!header)
+		{
+			error = "Not a PLY file";
+			return false;
+		}
+
+		const PlyElement* vertexElement = nullptr;
+		const PlyElement* faceElement = nullptr;
+		for (const PlyElement& element : elements)
+		{
+			if (element.name == "vertex")
+				vertexElement = &element;
+			else if (element.name == "face")
+				faceElement = &element;
+		}
+		int faceList = -1;
+		if (faceElement)
+		{
+			for (size_t i = 0; i < faceElement->properties.size(); i++)
+			{
+				const PlyProperty& property = faceElement->properties[i];
+				if ((property.name == "vertex_indices" || property.name == "vertex_index") && property.countType != PlyType::Invalid)
+					faceList = static_cast<int>(i);
+			}
+		}
+		if (!vertexElement || !faceElement || faceElement->count == 0 || faceList < 0)
+		{
+			error = "No faces in PLY file";
+			return false;
+		}
+
+		// x, y, z, nx, ny, nz, u, v
+		int attributes[8] = {
+			plyPropertyIndex(*vertexElement, { "x" }), plyPropertyIndex(*vertexElement, { "y" }), plyPropertyIndex(*vertexElement, { "z" }),
+			plyPropertyIndex(*vertexElement, { "nx" }), plyPropertyIndex(*vertexElement, { "ny" }), plyPropertyIndex(*vertexElement, { "nz" }),
+			plyPropertyIndex(*vertexElement, { "u", "s", "texture_u", "texture_s" }),
+			plyPropertyIndex(*vertexElement, { "v", "t", "texture_v", "texture_t" })
+		};
+		if (attributes[0] < 0 || attributes[1] < 0 || attributes[2] < 0)
+		{
+			error = "No vertex positions in PLY file";
+			return false;
+		}
+
+		// the counts of the header are checked against the data before anything is sized by them
+		std::vector<Range> chunks;
+		std::vector<size_t> firstLines;
+		if (format == Format::Ascii)
+		{
+			// every element item is one line, the line number tells what it is
+			chunks = splitLines(line, static_cast<size_t>(end - line));
+			firstLines.assign(chunks.size() + 1, 0);
+			parallelFor(chunks, [&](const Range& chunk) {
+				firstLines[chunk.index + 1] = std::count(line + chunk.begin, line + chunk.end, '\n');
+			});
+			for (size_t i = 0; i < chunks.size(); i++)
+				firstLines[i + 1] += firstLines[i];
+			// the last line may end without a line break
+			qint64 remainingLines = static_cast<qint64>(firstLines.back()) + 1;
+			for (const PlyElement& element : elements)
+			{
+				if (element.count > remainingLines)
+				{
+					error = "Truncated PLY file";
+					return false;
+				}
+				remainingLines -= element.count;
+			}
+		}
+		else
+		{
+			// every item takes at least its fixed size properties and list counts
+			qint64 remainingBytes = end - line;
+			for (const PlyElement& element : elements)
+			{
+				qint64 itemSize = 0;
+				for (const PlyProperty& property : element.properties)
+					itemSize += plyTypeSize(property.countType != PlyType::Invalid ? property.countType : property.type);
+				if (element.count > 0 && (itemSize == 0 || element.count > remainingBytes / itemSize))
+				{
+					error = "Truncated PLY file";
+					return false;
+				}
+				remainingBytes -= element.count * itemSize;
+			}
+		}
+
+		const bool hasNormals = attributes[3] >= 0 && attributes[4] >= 0 && attributes[5] >= 0;
+		const bool hasTexCoords = attributes[6] >= 0 && attributes[7] >= 0;
+		const size_t vertexCount = static_cast<size_t>(vertexElement->count);
+		mesh.positions.resize(3 * vertexCount);
+		mesh.normals.resize(hasNormals ? 3 * vertexCount : 0);
+		mesh.texCoords.resize(hasTexCoords ? 2 * vertexCount : 0);
+		auto storeVertex = [&](size_t vertex, const float* values) {
+			for (int k = 0; k < 3; k++)
+				mesh.positions[3 * vertex + k] = values[attributes[k]];
+			for (int k = 0; hasNormals && k < 3; k++)
+				mesh.normals[3 * vertex + k] = values[attributes[3 + k]];
+			for (int k = 0; hasTexCoords && k < 2; k++)
+				mesh.texCoords[2 * vertex + k] = values[attributes[6 + k]];
+		};
+		auto addPolygon = [vertexCount](const long long* indices, size_t count, std::vector<unsigned int>& triangles) {
+			for (size_t i = 0; i < count; i++)
+			{
+				if (indices[i] < 0 || indices[i] >= static_cast<long long>(vertexCount))
+					return false;
+			}
+			for (size_t i = 2; i < count; i++)
+			{
+				triangles.push_back(static_cast<unsigned int>(indices[0]));
+				triangles.push_back(static_cast<unsigned int>(indices[i - 1]));
+				triangles.push_back(static_cast<unsigned int>(indices[i]));
+			}
+			return true;
+		};
+
+		if (format == Format::Ascii)
+		{
+			std::vector<std::vector<unsigned int>> chunkTriangles(chunks.size());
+			std::atomic<bool> failed(false);
+			parallelFor(chunks, [&](const Range& chunk) {
+				std::vector<float> values(vertexElement->properties.size());
+				std::vector<long long> indices;
+				size_t lineNumber = firstLines[chunk.index];
+				const char* chunkEnd = line + chunk.end;
+				for (const char* p = line + chunk.begin; p < chunkEnd && !failed; p = nextLine(p, chunkEnd), lineNumber++)
+				{
+					// find the element of the line
+					size_t item = lineNumber;
+					const PlyElement* element = nullptr;
+					for (const PlyElement& e : elements)
+					{
+						if (item < static_cast<size_t>(e.count))
+						{
+							element = &e;
+							break;
+						}
+						item -= static_cast<size_t>(e.count);
+					}
+					if (element == vertexElement)
+					{
+						for (float& value : values)
+						{
+							if (!parseFloat(p, chunkEnd, value))
+								failed = true;
+						}
+						storeVertex(item, values.data());
+					}
+					else if (element == faceElement)
+					{
+						for (int i = 0; i < static_cast<int>(element->properties.size()) && !failed; i++)
+						{
+							const PlyProperty& property = element->properties[i];
+							long long count = 1;
+							if (property.countType != PlyType::Invalid && !parseInt(p, chunkEnd, count))
+								failed = true;
+							// every item takes at least one character of the line
+							if (count < 0 || count > chunkEnd - p)
+							{
+								failed = true;
+								break;
+							}
+							indices.resize(static_cast<size_t>(count));
+							for (long long& index : indices)
+							{
+								float value;
+								if (i == faceList ? !parseInt(p, chunkEnd, index) : !parseFloat(p, chunkEnd, value))
+									failed = true;
+							}
+							if (i == faceList && !addPolygon(indices.data(), indices.size(), chunkTriangles[chunk.index]))
+								failed = true;
+						}
+					}
+				}
+			});
+			if (failed)
+			{
+				error = "Invalid element in ASCII PLY file";
+				return false;
+			}
+			size_t cornerCount = 0;
+			for (const std::vector<unsigned int>& triangles : chunkTriangles)
+				cornerCount += triangles.size();
+			mesh.positionIndices.reserve(cornerCount);
+			for (std::vector<unsigned int>& triangles : chunkTriangles)
+			{
+				mesh.positionIndices.insert(mesh.positionIndices.end(), triangles.begin(), triangles.end());
+				std::vector<unsigned int>().swap(triangles);
+			}
+			return !mesh.positionIndices.empty();
+		}
+
+		const bool bigEndian = format == Format::BinaryBigEndian;
+		const uchar* p = reinterpret_cast<const uchar*>(line);
+		const uchar* dataEnd = data + size;
+		for (const PlyElement& element : elements)
+		{
+			if (&element == vertexElement)
+			{
+				// vertices have a fixed size and are read in parallel
+				std::vector<int> offsets;
+				int stride = 0;
+				for (const PlyProperty& property : element.properties)
+				{
+					if (property.countType != PlyType::Invalid)
+					{
+						error = "List property in PLY vertices";
+						return false;
+					}
+					offsets.push_back(stride);
+					stride += plyTypeSize(property.type);
+				}
+				if (static_cast<qint64>(vertexCount) * stride > dataEnd - p)
+				{
+					error = "Truncated PLY file";
+					return false;
+				}
+				std::vector<Range> ranges = splitRange(vertexCount);
+				parallelFor(ranges, [&](const Range& range) {
+					std::vector<float> values(element.properties.size());
+					for (size_t v = range.begin; v < range.end; v++)
+					{
+						const uchar* vertex = p + v * stride;
+						for (size_t i = 0; i < values.size(); i++)
+							values[i] = static_cast<float>(plyValue(vertex + offsets[i], element.properties[i].type, bigEndian));
+						storeVertex(v, values.data());
+					}
+				});
+				p += vertexCount * stride;
+				continue;
+			}
+
+			// other elements are walked, only the face indices are kept
+			const bool faces = &element == faceElement;
+			if (faces)
+				mesh.positionIndices.reserve(3 * static_cast<size_t>(element.count));
+			std::vector<long long> indices;
+			for (qint64 item = 0; item < element.count; item++)
+			{
+				for (int i = 0; i < static_cast<int>(element.properties.size()); i++)
+				{
+					const PlyProperty& property = element.properties[i];
+					qint64 count = 1;
+					if (property.countType != PlyType::Invalid)
+					{
+						if (plyTypeSize(property.countType) > dataEnd - p)
+						{
+							error = "Truncated PLY file";
+							return false;
+						}
+						count = static_cast<qint64>(plyValue(p, property.countType, bigEndian));
+						p += plyTypeSize(property.countType);
+					}
+					const int typeSize = plyTypeSize(property.type);
+					if (count < 0 || count * typeSize > dataEnd - p)
+					{
+						error = "Truncated PLY file";
+						return false;
+					}
+					if (faces && i == faceList)
+					{
+						indices.resize(static_cast<size_t>(count));
+						for (qint64 k = 0; k < count; k++)
+							indices[k] = static_cast<long long>(plyValue(p + k * typeSize, property.type, bigEndian));
+						if (!addPolygon(indices.data(), indices.size(), mesh.positionIndices))
+						{
+							error = "Invalid vertex index in PLY file";
+							return false;
+						}
+					}
+					p += count * typeSize;
+				}
+			}
+		}
+		return !mesh.positionIndices.empty();
+	}
+}
+
+bool MeshFileReader::canRead(const QString& fileName)
+{
+	const QString suffix = QFileInfo(fileName).suffix().toLower();
+	return suffix == "stl" || suffix == "obj" || suffix == "ply";
+}
+
+bool MeshFileReader::read(const QString& fileName, MeshGeometry& geometry, float smoothingAngle, QString& error)
+{
+	QFile file(fileName);
+	if (!file.open(QIODevice::ReadOnly))
+	{
+		error = file.errorString();
+		return false;
+	}
+	const qint64 size = file.size();
+	const uchar* data = size > 0 ? file.map(0, size) : nullptr;
+	if (!data)
+	{
+		error = "Could not map " + fileName;
+		return false;
+	}
+
+	IndexedMesh mesh;
+	const QString suffix = QFileInfo(fileName).suffix().toLower();
+	bool success = false;
+	if (suffix == "stl")
+		success = readStl(data, size, mesh, error);
+	else if (suffix == "obj")
+		success = readObj(data, size, mesh, error);
+	else if (suffix == "ply")
+		success = readPly(data, size, mesh, error);
+	file.unmap(const_cast<uchar*>(data));
+	if (!success)
+		return false;
+	if (mesh.positions.size() / 3 >= std::numeric_limits<unsigned int>::max())
+	{
+		error = "Too many vertices in " + fileName;
+		return false;
+	}
+
+	buildGeometry(mesh, smoothingAngle, geometry);
+	return true;
+}
+
+void MeshFileReader::computeTangents(MeshGeometry& geometry)
+{
+	const size_t vertexCount = geometry.points.size() / 3;
+	std::fill(geometry.tangents.begin(), geometry.tangents.end(), 0.0f);
+	std::fill(geometry.bitangents.begin(), geometry.bitangents.end(), 0.0f);
+	const float* points = geometry.points.data();
+	const float* texCoords = geometry.texCoords.data();
+	for (size_t f = 0; f + 2 < geometry.indices.size(); f += 3)
+	{
+		const unsigned int* v = &geometry.indices[f];
+		const float* p0 = points + 3 * v[0];
+		const float* p1 = points + 3 * v[1];
+		const float* p2 = points + 3 * v[2];
+		const float du1 = texCoords[2 * v[1]] - texCoords[2 * v[0]];
+		const float dv1 = texCoords[2 * v[1] + 1] - texCoords[2 * v[0] + 1];
+		const float du2 = texCoords[2 * v[2]] - texCoords[2 * v[0]];
+		const float dv2 = texCoords[2 * v[2] + 1] - texCoords[2 * v[0] + 1];
+		const float det = du1 * dv2 - du2 * dv1;
+		if (std::fabs(det) < 1e-12f)
+			continue;
+		const float r = 1.0f / det;
+		for (int k = 0; k < 3; k++)
+		{
+			const float e1 = p1[k] - p0[k];
+			const float e2 = p2[k] - p0[k];
+			const float t = (e1 * dv2 - e2 * dv1) * r;
+			const float b = (e2 * du1 - e1 * du2) * r;
+			for (int c = 0; c < 3; c++)
+			{
+				geometry.tangents[3 * v[c] + k] += t;
+				geometry.bitangents[3 * v[c] + k] += b;
+			}
+		}
+	}
+	for (size_t i = 0; i < vertexCount; i++)
+	{
+		const float* n = &geometry.normals[3 * i];
+		float* t = &geometry.tangents[3 * i];
+		const float d = n[0] * t[0] + n[1] * t[1] + n[2] * t[2];
+		for (int k = 0; k < 3; k++)
+			t[k] -= n[k] * d;
+		normalize(t);
+		normalize(&geometry.bitangents[3 * i]);
+	}
+}
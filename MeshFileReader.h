@@ -0,0 +1,26 @@
+#pragma once
+
+#include <QString>
+
+#include "AssImpMesh.h"
+
+// Native readers for the plain triangle formats of scans and CAD exports: binary and
+// ASCII STL, OBJ and PLY. Files are memory mapped, text is parsed in parallel chunks
+// and unindexed triangles are welded with a spatial hash. Missing normals are smoothed
+// up to the given angle like Assimp's GenSmoothNormals. Variants carrying more than
+// one mesh of geometry, such as OBJ files with materials or several groups, are left
+// to Assimp
+class MeshFileReader
+{
+public:
+	// True for the extensions read natively
+	static bool canRead(const QString& fileName);
+
+	// Read the file into a single mesh, false with the reason in error when the file
+	// should go through Assimp instead
+	static bool read(const QString& fileName, MeshGeometry& geometry, float smoothingAngle, QString& error);
+
+	// Tangents and bitangents from the texture coordinates of the triangles, accumulated
+	// per vertex and made orthogonal to the normal
+	static void computeTangents(MeshGeometry& geometry);
+};
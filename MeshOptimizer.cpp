@@ -0,0 +1,529 @@
+#include "MeshOptimizer.h"
+
+#include <algorithm>
+#include <numeric>
+#include <cmath>
+#include <cstring>
+#include <unordered_map>
+#include <QVector3D>
+
+namespace
+{
+	// Sum of squared distances to a set of planes, weighted by triangle area
+	struct Quadric
+	{
+		double a00 = 0.0, a11 = 0.0, a22 = 0.0;
+		double a01 = 0.0, a02 = 0.0, a12 = 0.0;
+		double b0 = 0.0, b1 = 0.0, b2 = 0.0;
+		double c = 0.0;
+		double weight = 0.0;
+
+		void addPlane(const QVector3D& n, double d, double w)
+		{
+			a00 += w * n.x() * n.x();
+			a11 += w * n.y() * n.y();
+			a22 += w * n.z() * n.z();
+			a01 += w * n.x() * n.y();
+			a02 += w * n.x() * n.z();
+			a12 += w * n.y() * n.z();
+			b0 += w * n.x() * d;
+			b1 += w * n.y() * d;
+			b2 += w * n.z() * d;
+			c += w * d * d;
+			weight += w;
+		}
+
+		void add(const Quadric& q)
+		{
+			a00 += q.a00; a11 += q.a11; a22 += q.a22;
+			a01 += q.a01; a02 += q.a02; a12 += q.a12;
+			b0 += q.b0; b1 += q.b1; b2 += q.b2;
+			c += q.c;
+			weight += q.weight;
+		}
+
+		// weighted mean of the squared plane distances
+		double error(const float* p) const
+		{
+			if (weight <= 0.0)
+				return 0.0;
+			double x = p[0], y = p[1], z = p[2];
+			double e = a00 * x * x + a11 * y * y + a22 * z * z
+				+ 2.0 * (a01 * x * y + a02 * x * z + a12 * y * z)
+				+ 2.0 * (b0 * x + b1 * y + b2 * z) + c;
+			return std::max(e, 0.0) / weight;
+		}
+	};
+
+	// Half edge collapse moving vertex 'from' onto its neighbour 'to'
+	struct Collapse
+	{
+		unsigned int from;
+		unsigned int to;
+		double error;
+	};
+
+	struct PositionKey
+	{
+		unsigned int bits[3];
+
+		bool operator==(const PositionKey& other) const
+		{
+			return bits[0] == other.bits[0] && bits[1] == other.bits[1] && bits[2] == other.bits[2];
+		}
+	};
+
+	struct PositionHash
+	{
+		size_t operator()(const PositionKey& key) const
+		{
+			return (key.bits[0] * 73856093u) ^ (key.bits[1] * 19349663u) ^ (key.bits[2] * 83492791u);
+		}
+	};
+}
+
+float MeshOptimizer::computeACMR(const std::vector<unsigned int>& indices, size_t vertexCount, unsigned int cacheSize)
+{
+	if (indices.size() < 3)
+		return 0.0f;
+
+	// a vertex is in the FIFO cache while less than cacheSize misses happened since it was loaded
+	std::vector<unsigned int> timestamps(vertexCount, 0);
+	unsigned int time = cacheSize + 1;
+	size_t misses = 0;
+	for (unsigned int v : indices)
+	{
+		if (time - timestamps[v] > cacheSize)
+		{
+			timestamps[v] = time++;
+			misses++;
+		}
+	}
+	return static_cast<float>(misses) / static_cast<float>(indices.size() / 3);
+}
+
+void MeshOptimizer::optimizeVertexCache(std::vector<unsigned int>& indices, size_t vertexCount, unsigned int cacheSize)
+{
+	const size_t triCount = indices.size() / 3;
+	if (triCount == 0 || vertexCount == 0)
+		return;
+
+	// vertex to triangle adjacency in compressed rows
+	std::vector<unsigned int> liveTriangles(vertexCount, 0);
+	for (unsigned int v : indices)
+		liveTriangles[v]++;
+	std::vector<size_t> adjacencyOffsets(vertexCount + 1, 0);
+	for (size_t v = 0; v < vertexCount; v++)
+		adjacencyOffsets[v + 1] = adjacencyOffsets[v] + liveTriangles[v];
+	std::vector<unsigned int> adjacency(adjacencyOffsets[vertexCount]);
+	std::vector<size_t> fill(adjacencyOffsets.begin(), adjacencyOffsets.end() - 1);
+	for (size_t t = 0; t < triCount; t++)
+	{
+		for (int k = 0; k < 3; k++)
+			adjacency[fill[indices[3 * t + k]]++] = static_cast<unsigned int>(t);
+	}
+
+	std::vector<unsigned int> cacheTime(vertexCount, 0);
+	std::vector<bool> emitted(triCount, false);
+	std::vector<unsigned int> deadEnd;
+	std::vector<unsigned int> candidates;
+	std::vector<unsigned int> output;
+	output.reserve(indices.size());
+
+	unsigned int time = cacheSize + 1;
+	size_t cursor = 0;
+	long long fanning = 0;
+	while (fanning >= 0)
+	{
+		candidates.clear();
+		const size_t f = static_cast<size_t>(fanning);
+		for (size_t a = adjacencyOffsets[f]; a < adjacencyOffsets[f + 1]; a++)
+		{
+			unsigned int t = adjacency[a];
+			if (emitted[t])
+				continue;
+			for (int k = 0; k < 3; k++)
+			{
+				unsigned int v = indices[3 * t + k];
+				output.push_back(v);
+				deadEnd.push_back(v);
+				candidates.push_back(v);
+				liveTriangles[v]--;
+				if (time - cacheTime[v] > cacheSize)
+					cacheTime[v] = time++;
+			}
+			emitted[t] = true;
+		}
+
+		// prefer the candidate that will still be in the cache when its remaining triangles are emitted
+		long long next = -1;
+		long long bestPriority = -1;
+		for (unsigned int v : candidates)
+		{
+			if (liveTriangles[v] == 0)
+				continue;
+			long long priority = 0;
+			if (time - cacheTime[v] + 2 * liveTriangles[v] <= cacheSize)
+				priority = time - cacheTime[v];
+			if (priority > bestPriority)
+			{
+				bestPriority = priority;
+				next = v;
+			}
+		}
+
+		// dead end, fall back to recently used vertices and then to input order
+		while (next < 0 && !deadEnd.empty())
+		{
+			unsigned int v = deadEnd.back();
+			deadEnd.pop_back();
+			if (liveTriangles[v] > 0)
+				next = v;
+		}
+		while (next < 0 && cursor < vertexCount)
+		{
+			if (liveTriangles[cursor] > 0)
+				next = static_cast<long long>(cursor);
+			cursor++;
+		}
+		fanning = next;
+	}
+
+	indices.swap(output);
+}
+
+void MeshOptimizer::optimizeOverdraw(std::vector<unsigned int>& indices, const std::vector<float>& points, size_t vertexCount, unsigned int cacheSize)
+{
+	const size_t triCount = indices.size() / 3;
+	if (triCount < 2 || points.size() < 3 * vertexCount)
+		return;
+
+	// clusters start where the cache was completely flushed, reordering whole
+	// clusters keeps the vertex cache efficiency of the input order
+	std::vector<size_t> clusters;
+	std::vector<unsigned int> timestamps(vertexCount, 0);
+	unsigned int time = cacheSize + 1;
+	for (size_t t = 0; t < triCount; t++)
+	{
+		int misses = 0;
+		for (int k = 0; k < 3; k++)
+		{
+			unsigned int v = indices[3 * t + k];
+			if (time - timestamps[v] > cacheSize)
+			{
+				timestamps[v] = time++;
+				misses++;
+			}
+		}
+		if (t == 0 || misses == 3)
+			clusters.push_back(t);
+	}
+	if (clusters.size() < 2)
+		return;
+	clusters.push_back(triCount);
+
+	auto point = [&](unsigned int v)
+	{
+		return QVector3D(points[3 * size_t(v)], points[3 * size_t(v) + 1], points[3 * size_t(v) + 2]);
+	};
+
+	// area weighted mesh centroid
+	QVector3D meshCentroid;
+	float meshArea = 0.0f;
+	std::vector<QVector3D> clusterCentroids(clusters.size() - 1);
+	std::vector<QVector3D> clusterNormals(clusters.size() - 1);
+	for (size_t c = 0; c + 1 < clusters.size(); c++)
+	{
+		QVector3D centroid, normal;
+		float area = 0.0f;
+		for (size_t t = clusters[c]; t < clusters[c + 1]; t++)
+		{
+			QVector3D p0 = point(indices[3 * t]);
+			QVector3D p1 = point(indices[3 * t + 1]);
+			QVector3D p2 = point(indices[3 * t + 2]);
+			QVector3D n = QVector3D::crossProduct(p1 - p0, p2 - p0);
+			float a = n.length();
+			centroid += (p0 + p1 + p2) * (a / 3.0f);
+			normal += n;
+			area += a;
+		}
+		meshCentroid += centroid;
+		meshArea += area;
+		clusterCentroids[c] = area > 0.0f ? centroid / area : point(indices[3 * clusters[c]]);
+		clusterNormals[c] = normal.normalized();
+	}
+	if (meshArea > 0.0f)
+		meshCentroid /= meshArea;
+
+	// clusters facing away from the mesh centre are likely occluders, draw them first
+	std::vector<float> sortKeys(clusters.size() - 1);
+	for (size_t c = 0; c < sortKeys.size(); c++)
+		sortKeys[c] = QVector3D::dotProduct(clusterCentroids[c] - meshCentroid, clusterNormals[c]);
+	std::vector<size_t> order(sortKeys.size());
+	std::iota(order.begin(), order.end(), 0);
+	std::stable_sort(order.begin(), order.end(), [&](size_t a, size_t b) { return sortKeys[a] > sortKeys[b]; });
+
+	std::vector<unsigned int> output;
+	output.reserve(indices.size());
+	for (size_t c : order)
+		output.insert(output.end(), indices.begin() + 3 * clusters[c], indices.begin() + 3 * clusters[c + 1]);
+	indices.swap(output);
+}
+
+std::vector<unsigned int> MeshOptimizer::optimizeVertexFetch(std::vector<unsigned int>& indices, size_t vertexCount)
+{
+	const unsigned int unused = ~0u;
+	std::vector<unsigned int> remap(vertexCount, unused);
+	unsigned int next = 0;
+	for (unsigned int& v : indices)
+	{
+		if (remap[v] == unused)
+			remap[v] = next++;
+		v = remap[v];
+	}
+	// vertices not referenced by any triangle are kept at the end
+	for (unsigned int& r : remap)
+	{
+		if (r == unused)
+			r = next++;
+	}
+	return remap;
+}
+
+void MeshOptimizer::remapVertexAttribute(std::vector<float>& data, const std::vector<unsigned int>& remap, size_t components)
+{
+	if (data.empty())
+		return;
+	// an array not matching the vertex count is padded with zeros or cut, so every
+	// vertex keeps its own attribute after the remap
+	data.resize(remap.size() * components, 0.0f);
+	std::vector<float> remapped(data.size());
+	for (size_t v = 0; v < remap.size(); v++)
+	{
+		for (size_t c = 0; c < components; c++)
+			remapped[remap[v] * components + c] = data[v * components + c];
+	}
+	data.swap(remapped);
+}
+
+std::vector<unsigned int> MeshOptimizer::simplify(const std::vector<unsigned int>& indices, const std::vector<float>& points,
+	size_t vertexCount, size_t targetIndexCount, float targetError, float* resultError)
+{
+	std::vector<unsigned int> result(indices);
+	if (resultError)
+		*resultError = 0.0f;
+	if (result.size() <= targetIndexCount || vertexCount == 0 || points.size() < 3 * vertexCount)
+		return result;
+
+	// the errors are measured relative to the mesh size
+	float boundsMin[3] = { points[0], points[1], points[2] };
+	float boundsMax[3] = { points[0], points[1], points[2] };
+	for (size_t v = 1; v < vertexCount; v++)
+	{
+		for (int a = 0; a < 3; a++)
+		{
+			boundsMin[a] = std::min(boundsMin[a], points[3 * v + a]);
+			boundsMax[a] = std::max(boundsMax[a], points[3 * v + a]);
+		}
+	}
+	const double scale = 0.5 * QVector3D(boundsMax[0] - boundsMin[0], boundsMax[1] - boundsMin[1], boundsMax[2] - boundsMin[2]).length();
+	if (scale <= 0.0)
+		return result;
+	const double maxError = targetError * scale * targetError * scale;
+
+	// vertices sharing a position are welded, the first one represents the group
+	std::vector<unsigned int> welded(vertexCount);
+	std::vector<unsigned int> wedgeCount(vertexCount, 0);
+	{
+		std::unordered_map<PositionKey, unsigned int, PositionHash> positions;
+		positions.reserve(vertexCount);
+		for (size_t v = 0; v < vertexCount; v++)
+		{
+			PositionKey key;
+			memcpy(key.bits, &points[3 * v], sizeof(key.bits));
+			unsigned int first = positions.emplace(key, static_cast<unsigned int>(v)).first->second;
+			welded[v] = first;
+			wedgeCount[first]++;
+		}
+	}
+
+	auto position = [&](unsigned int v)
+	{
+		return QVector3D(points[3 * size_t(v)], points[3 * size_t(v) + 1], points[3 * size_t(v) + 2]);
+	};
+
+	// attribute seams, open borders and non manifold edges keep their vertices
+	std::vector<bool> locked(vertexCount, false);
+	std::unordered_map<unsigned long long, unsigned int> edgeUse;
+	edgeUse.reserve(result.size());
+	for (size_t i = 0; i < result.size(); i += 3)
+	{
+		for (int k = 0; k < 3; k++)
+		{
+			unsigned long long a = welded[result[i + k]];
+			unsigned long long b = welded[result[i + (k + 1) % 3]];
+			edgeUse[std::min(a, b) << 32 | std::max(a, b)]++;
+		}
+	}
+	for (const auto& edge : edgeUse)
+	{
+		if (edge.second != 2)
+		{
+			locked[edge.first >> 32] = true;
+			locked[edge.first & 0xffffffffull] = true;
+		}
+	}
+	for (size_t v = 0; v < vertexCount; v++)
+	{
+		if (wedgeCount[v] > 1)
+			locked[v] = true;
+	}
+
+	std::vector<Quadric> quadrics(vertexCount);
+	for (size_t i = 0; i < result.size(); i += 3)
+	{
+		unsigned int a = welded[result[i]], b = welded[result[i + 1]], c = welded[result[i + 2]];
+		QVector3D p0 = position(a);
+		QVector3D n = QVector3D::crossProduct(position(b) - p0, position(c) - p0);
+		float area = n.length();
+		if (area <= 0.0f)
+			continue;
+		n /= area;
+		double d = -QVector3D::dotProduct(n, p0);
+		quadrics[a].addPlane(n, d, 0.5 * area);
+		quadrics[b].addPlane(n, d, 0.5 * area);
+		quadrics[c].addPlane(n, d, 0.5 * area);
+	}
+
+	// collapses are done in passes, each pass takes the cheapest independent collapses
+	double reachedError = 0.0;
+	std::vector<size_t> adjacencyOffsets(vertexCount + 1);
+	std::vector<unsigned int> adjacency;
+	std::vector<Collapse> collapses;
+	std::vector<unsigned int> replacement(vertexCount);
+	std::vector<bool> touched(vertexCount);
+	while (result.size() > targetIndexCount)
+	{
+		const size_t triCount = result.size() / 3;
+		std::fill(adjacencyOffsets.begin(), adjacencyOffsets.end(), 0);
+		for (unsigned int v : result)
+			adjacencyOffsets[welded[v] + 1]++;
+		for (size_t v = 0; v < vertexCount; v++)
+			adjacencyOffsets[v + 1] += adjacencyOffsets[v];
+		adjacency.resize(result.size());
+		std::vector<size_t> fill(adjacencyOffsets.begin(), adjacencyOffsets.end() - 1);
+		for (size_t t = 0; t < triCount; t++)
+		{
+			for (int k = 0; k < 3; k++)
+				adjacency[fill[welded[result[3 * t + k]]]++] = static_cast<unsigned int>(t);
+		}
+
+		collapses.clear();
+		for (size_t t = 0; t < triCount; t++)
+		{
+			for (int k = 0; k < 3; k++)
+			{
+				unsigned int a = welded[result[3 * t + k]];
+				unsigned int b = welded[result[3 * t + (k + 1) % 3]];
+				for (int dir = 0; dir < 2; dir++)
+				{
+					unsigned int from = dir ? b : a;
+					unsigned int to = dir ? a : b;
+					if (locked[from])
+						continue;
+					Quadric q = quadrics[from];
+					q.add(quadrics[to]);
+					collapses.push_back({ from, to, q.error(&points[3 * size_t(to)]) });
+				}
+			}
+		}
+		if (collapses.empty())
+			break;
+		std::sort(collapses.begin(), collapses.end(), [](const Collapse& x, const Collapse& y) { return x.error < y.error; });
+
+		std::iota(replacement.begin(), replacement.end(), 0);
+		std::fill(touched.begin(), touched.end(), false);
+		const size_t trianglesToRemove = (result.size() - targetIndexCount + 2) / 3;
+		size_t removed = 0;
+		for (const Collapse& collapse : collapses)
+		{
+			if (collapse.error > maxError || removed >= trianglesToRemove)
+				break;
+			if (touched[collapse.from] || touched[collapse.to])
+				continue;
+
+			// the triangles on the collapsed edge give the vertex of 'to' that keeps the
+			// attributes continuous, the others must not flip or degenerate
+			const unsigned int noWedge = ~0u;
+			unsigned int toWedge = noWedge;
+			size_t edgeTriangles = 0;
+			bool valid = true;
+			const QVector3D target = position(collapse.to);
+			for (size_t a = adjacencyOffsets[collapse.from]; a < adjacencyOffsets[collapse.from + 1] && valid; a++)
+			{
+				const unsigned int* tri = &result[3 * size_t(adjacency[a])];
+				bool onEdge = false;
+				for (int k = 0; k < 3; k++)
+				{
+					if (welded[tri[k]] == collapse.to)
+					{
+						if (toWedge != noWedge && toWedge != tri[k])
+							valid = false;
+						toWedge = tri[k];
+						onEdge = true;
+					}
+				}
+				if (onEdge)
+				{
+					edgeTriangles++;
+					continue;
+				}
+				QVector3D p[3], q[3];
+				for (int k = 0; k < 3; k++)
+				{
+					p[k] = position(tri[k]);
+					q[k] = welded[tri[k]] == collapse.from ? target : p[k];
+				}
+				QVector3D n0 = QVector3D::crossProduct(p[1] - p[0], p[2] - p[0]);
+				QVector3D n1 = QVector3D::crossProduct(q[1] - q[0], q[2] - q[0]);
+				if (QVector3D::dotProduct(n0, n1) <= 0.25f * n0.length() * n1.length())
+					valid = false;
+			}
+			if (!valid || toWedge == noWedge)
+				continue;
+
+			replacement[collapse.from] = toWedge;
+			quadrics[collapse.to].add(quadrics[collapse.from]);
+			reachedError = std::max(reachedError, collapse.error);
+			removed += edgeTriangles;
+
+			// the neighbourhood changes, keep it out of the rest of this pass
+			for (size_t a = adjacencyOffsets[collapse.from]; a < adjacencyOffsets[collapse.from + 1]; a++)
+			{
+				for (int k = 0; k < 3; k++)
+					touched[welded[result[3 * size_t(adjacency[a]) + k]]] = true;
+			}
+		}
+		if (removed == 0)
+			break;
+
+		// rewrite the triangles and drop the ones that collapsed
+		size_t write = 0;
+		for (size_t t = 0; t < triCount; t++)
+		{
+			unsigned int a = replacement[result[3 * t]];
+			unsigned int b = replacement[result[3 * t + 1]];
+			unsigned int c = replacement[result[3 * t + 2]];
+			if (welded[a] == welded[b] || welded[b] == welded[c] || welded[a] == welded[c])
+				continue;
+			result[write++] = a;
+			result[write++] = b;
+			result[write++] = c;
+		}
+		result.resize(write);
+	}
+
+	if (resultError)
+		*resultError = static_cast<float>(std::sqrt(reachedError) / scale);
+	return result;
+}
@@ -0,0 +1,37 @@
+#pragma once
+
+#include <cstddef>
+#include <vector>
+
+// Index and vertex reordering for faster rendering of static triangle meshes.
+// Vertex cache optimization follows Tipsify (Sander, Nehab and Barczak 2007),
+// the overdraw pass sorts the cache clusters so that outward facing
+// clusters are drawn first.
+class MeshOptimizer
+{
+public:
+	// Average cache miss ratio (vertex shader invocations per triangle) for a FIFO cache
+	static float computeACMR(const std::vector<unsigned int>& indices, size_t vertexCount, unsigned int cacheSize = 16);
+
+	// Reorder triangles for the post-transform vertex cache
+	static void optimizeVertexCache(std::vector<unsigned int>& indices, size_t vertexCount, unsigned int cacheSize = 16);
+
+	// Reorder the cache clusters of an already cache optimized index list to reduce overdraw
+	static void optimizeOverdraw(std::vector<unsigned int>& indices, const std::vector<float>& points, size_t vertexCount, unsigned int cacheSize = 16);
+
+	// Renumber vertices in order of first use, the indices are rewritten and the returned
+	// table maps each old vertex to its new position for remapping the attributes
+	static std::vector<unsigned int> optimizeVertexFetch(std::vector<unsigned int>& indices, size_t vertexCount);
+
+	// Apply a table from optimizeVertexFetch to a per-vertex attribute array, an empty
+	// array is left alone and any other is sized to the vertex count first
+	static void remapVertexAttribute(std::vector<float>& data, const std::vector<unsigned int>& remap, size_t components);
+
+	// Quadric error edge collapse towards targetIndexCount indices, the vertex data is left
+	// untouched and the result only references existing vertices. Vertices on open borders
+	// and attribute seams are never moved. Stops early once the error, relative to half of
+	// the bounding box diagonal, would exceed targetError. The reached error is returned
+	// in resultError
+	static std::vector<unsigned int> simplify(const std::vector<unsigned int>& indices, const std::vector<float>& points,
+		size_t vertexCount, size_t targetIndexCount, float targetError, float* resultError = nullptr);
+};
@@ -4,7 +4,6 @@
 
 MeshProperties::MeshProperties(TriangleMesh* mesh, QObject* parent) : QObject(parent), _mesh(mesh), _density(1000.0f)
 {
-	_meshPoints = _mesh->getTrsfPoints();
 	calculateSurfaceAreaAndVolume();
 }
 
@@ -16,14 +15,12 @@ TriangleMesh* MeshProperties::mesh() const
 void MeshProperties::setMesh(TriangleMesh* mesh)
 {
 	_mesh = mesh;
-	_meshPoints.clear();
-	_meshPoints = _mesh->getTrsfPoints();
 	calculateSurfaceAreaAndVolume();
 }
 
-std::vector<float> MeshProperties::meshPoints() const
+const std::vector<float>& MeshProperties::meshPoints() const
 {
-	return _meshPoints;
+	return _mesh->getTrsfPoints();
 }
 
 float MeshProperties::surfaceArea() const
@@ -67,26 +64,27 @@ void MeshProperties::calculateSurfaceAreaAndVolume()
 	_volume = 0;
 	float currentVolume = 0, xCen = 0, yCen = 0, zCen = 0;
 	try {
-		std::vector<unsigned int> indices = _mesh->getIndices();
+		const std::vector<float>& points = _mesh->getTrsfPoints();
+		const std::vector<unsigned int>& indices = _mesh->getIndices();
 		size_t offset = 3; // each index points to 3 floats
 		for (size_t i = 0; i < indices.size();)
 		{
 			// Vertex 1
-			QVector3D p1(_meshPoints.at(offset * indices.at(i) + 0), // x coordinate
-				_meshPoints.at(offset * indices.at(i) + 1),          // y coordinate
-				_meshPoints.at(offset * indices.at(i) + 2));         // z coordinate
+			QVector3D p1(points.at(offset * indices.at(i) + 0), // x coordinate
+				points.at(offset * indices.at(i) + 1),          // y coordinate
+				points.at(offset * indices.at(i) + 2));         // z coordinate
 			i++;
 
 			// Vertex 2
-			QVector3D p2(_meshPoints.at(offset * indices.at(i) + 0), // x coordinate
-				_meshPoints.at(offset * indices.at(i) + 1),          // y coordinate
-				_meshPoints.at(offset * indices.at(i) + 2));         // z coordinate
+			QVector3D p2(points.at(offset * indices.at(i) + 0), // x coordinate
+				points.at(offset * indices.at(i) + 1),          // y coordinate
+				points.at(offset * indices.at(i) + 2));         // z coordinate
 			i++;
 
 			// Vertex 3
-			QVector3D p3(_meshPoints.at(offset * indices.at(i) + 0), // x coordinate
-				_meshPoints.at(offset * indices.at(i) + 1),          // y coordinate
-				_meshPoints.at(offset * indices.at(i) + 2));         // z coordinate
+			QVector3D p3(points.at(offset * indices.at(i) + 0), // x coordinate
+				points.at(offset * indices.at(i) + 1),          // y coordinate
+				points.at(offset * indices.at(i) + 2));         // z coordinate
 			i++;
 
 			_volume += currentVolume = QVector3D::dotProduct(p1, (QVector3D::crossProduct(p2, p3))) / 6.0f;
@@ -14,7 +14,7 @@ public:
 	TriangleMesh* mesh() const;
 	void setMesh(TriangleMesh* mesh);
 
-	std::vector<float> meshPoints() const;
+	const std::vector<float>& meshPoints() const;
 
 	float surfaceArea() const;
 
@@ -36,7 +36,6 @@ private:
 
 private:
 	TriangleMesh* _mesh;
-	std::vector<float> _meshPoints;
 	float _surfaceArea;
 	float _volume;
 	float _weight;
@@ -0,0 +1,370 @@
+#include "ModelCache.h"
+
+#include <QCryptographicHash>
+#include <QStandardPaths>
+#include <QFileInfo>
+#include <QDateTime>
+#include <QFile>
+#include <QDir>
+#include <QDebug>
+#include <cstring>
+
+namespace
+{
+	const char MODEL_CACHE_MAGIC[4] = { 'M', 'V', 'M', 'C' };
+	// bumped whenever the conversion or the layout changes, older files are ignored
+	const quint32 MODEL_CACHE_VERSION = 3;
+
+	// MeshHeader flags
+	const quint32 MESH_REORDERED = 1;
+
+	struct CacheHeader
+	{
+		char magic[4];
+		quint32 version;
+		qint64 sourceSize;
+		qint64 sourceModified;
+		char sourceHash[20];
+		quint32 meshCount;
+	};
+
+	// Followed by the name, the texture records, the arrays and the packed vertices.
+	// Strings are padded to 4 bytes so the float and index arrays stay aligned in the mapping
+	struct MeshHeader
+	{
+		quint32 nameSize;
+		quint32 textureCount;
+		quint32 vertexCount;
+		quint32 indexCount;
+		// ambient, diffuse, specular, emissive, albedo, shininess, metalness, roughness, opacity, metallic
+		float material[20];
+		// the arrays are stored as prepareGeometry left them
+		quint32 flags;
+		float acmrBefore;
+		float acmrAfter;
+		// layout of the packed vertices, no packed vertices when the size is 0
+		quint32 compactSize;
+		qint32 compactStride;
+		qint32 compactNormalOffset;
+		qint32 compactTangentOffset;
+		qint32 compactTexCoordOffset;
+		quint32 compactTexCoordType;
+	};
+
+	struct TextureHeader
+	{
+		quint32 typeSize;
+		quint32 pathSize;
+	};
+
+	static_assert(sizeof(CacheHeader) == 48 && sizeof(MeshHeader) == 132, "ModelCache layout");
+
+	qint64 padded(qint64 size)
+	{
+		return (size + 3) & ~qint64(3);
+	}
+
+	QByteArray sourceHash(const QString& sourcePath)
+	{
+		QFile file(sourcePath);
+		QCryptographicHash hash(QCryptographicHash::Sha1);
+		if (!file.open(QIODevice::ReadOnly) || !hash.addData(&file))
+			return QByteArray();
+		return hash.result();
+	}
+
+	void storeVector(float* dst, const QVector3D& v)
+	{
+		dst[0] = v.x();
+		dst[1] = v.y();
+		dst[2] = v.z();
+	}
+
+	// Bounds checked walk over the mapped file
+	class MappedReader
+	{
+	public:
+		MappedReader(const uchar* data, qint64 size) : _pos(data), _end(data + size) {}
+
+		const uchar* take(qint64 size)
+		{
+			if (size < 0 || size > _end - _pos)
+				return nullptr;
+			const uchar* data = _pos;
+			_pos += size;
+			return data;
+		}
+
+		template <typename T>
+		bool read(T& value)
+		{
+			const uchar* data = take(sizeof(T));
+			if (data)
+				memcpy(&value, data, sizeof(T));
+			return data != nullptr;
+		}
+
+	private:
+		const uchar* _pos;
+		const uchar* _end;
+	};
+
+	template <typename T>
+	void assignArray(std::vector<T>& dst, const uchar* src, size_t count)
+	{
+		dst.resize(count);
+		if (count)
+			memcpy(dst.data(), src, count * sizeof(T));
+	}
+
+	// Walk one mesh record. Without a packet the record is only validated
+	bool readMesh(MappedReader& reader, AssImpModelLoader::MeshPacket* packet)
+	{
+		MeshHeader header;
+		if (!reader.read(header))
+			return false;
+		const uchar* name = reader.take(padded(header.nameSize));
+		if (!name)
+			return false;
+		if (packet)
+		{
+			packet->name = QString::fromUtf8(reinterpret_cast<const char*>(name), header.nameSize);
+			GLMaterial& material = packet->material;
+			const float* m = header.material;
+			material.setAmbient(QVector3D(m[0], m[1], m[2]));
+			material.setDiffuse(QVector3D(m[3], m[4], m[5]));
+			material.setSpecular(QVector3D(m[6], m[7], m[8]));
+			material.setEmissive(QVector3D(m[9], m[10], m[11]));
+			material.setAlbedoColor(QVector3D(m[12], m[13], m[14]));
+			material.setShininess(m[15]);
+			material.setMetalness(m[16]);
+			material.setRoughness(m[17]);
+			material.setOpacity(m[18]);
+			material.setMetallic(m[19] != 0.0f);
+		}
+
+		for (quint32 i = 0; i < header.textureCount; i++)
+		{
+			TextureHeader textureHeader;
+			if (!reader.read(textureHeader))
+				return false;
+			const uchar* type = reader.take(padded(textureHeader.typeSize));
+			const uchar* path = type ? reader.take(padded(textureHeader.pathSize)) : nullptr;
+			if (!path)
+				return false;
+			if (packet)
+			{
+				Texture texture;
+				texture.id = 0;
+				texture.type = std::string(reinterpret_cast<const char*>(type), textureHeader.typeSize);
+				texture.path = aiString(std::string(reinterpret_cast<const char*>(path), textureHeader.pathSize));
+				packet->textures.push_back(texture);
+			}
+		}
+
+		const qint64 vertexCount = header.vertexCount;
+		const uchar* points = reader.take(vertexCount * 3 * sizeof(float));
+		const uchar* normals = reader.take(vertexCount * 3 * sizeof(float));
+		const uchar* texCoords = reader.take(vertexCount * 2 * sizeof(float));
+		const uchar* tangents = reader.take(vertexCount * 3 * sizeof(float));
+		const uchar* bitangents = reader.take(vertexCount * 3 * sizeof(float));
+		const uchar* indices = reader.take(static_cast<qint64>(header.indexCount) * sizeof(unsigned int));
+		const uchar* compact = reader.take(padded(header.compactSize));
+		if (!points || !normals || !texCoords || !tangents || !bitangents || !indices || !compact)
+			return false;
+		if (header.compactSize && (header.compactStride <= 0 || header.compactSize != vertexCount * header.compactStride))
+			return false;
+		if (packet)
+		{
+			MeshGeometry& geometry = packet->geometry;
+			assignArray(geometry.points, points, vertexCount * 3);
+			assignArray(geometry.normals, normals, vertexCount * 3);
+			assignArray(geometry.texCoords, texCoords, vertexCount * 2);
+			assignArray(geometry.tangents, tangents, vertexCount * 3);
+			assignArray(geometry.bitangents, bitangents, vertexCount * 3);
+			assignArray(geometry.indices, indices, header.indexCount);
+			// reordered meshes, or all of them while the optimization is off, skip prepareGeometry
+			geometry.optimized = (header.flags & MESH_REORDERED) || !TriangleMesh::meshOptimization();
+			geometry.acmrBefore = header.acmrBefore;
+			geometry.acmrAfter = header.acmrAfter;
+			if (geometry.optimized && header.compactSize)
+			{
+				TriangleMesh::CompactVertices& vertices = geometry.compactVertices;
+				assignArray(vertices.data, compact, header.compactSize);
+				vertices.stride = header.compactStride;
+				vertices.normalOffset = header.compactNormalOffset;
+				vertices.tangentOffset = header.compactTangentOffset;
+				vertices.texCoordOffset = header.compactTexCoordOffset;
+				vertices.texCoordType = header.compactTexCoordType;
+			}
+		}
+		return true;
+	}
+}
+
+ModelCache& ModelCache::instance()
+{
+	static ModelCache cache;
+	return cache;
+}
+
+ModelCache::ModelCache()
+{
+	_directory = QStandardPaths::writableLocation(QStandardPaths::CacheLocation) + "/models";
+	QDir().mkpath(_directory);
+}
+
+QString ModelCache::fileName(const QString& sourcePath) const
+{
+	QString canonicalPath = QFileInfo(sourcePath).canonicalFilePath();
+	return _directory + "/" + QCryptographicHash::hash(canonicalPath.toUtf8(), QCryptographicHash::Sha1).toHex() + ".mvc";
+}
+
+bool ModelCache::load(const QString& sourcePath, const std::function<bool(AssImpModelLoader::MeshPacket&&)>& addMesh)
+{
+	QFileInfo source(sourcePath);
+	QFile file(fileName(sourcePath));
+	if (!source.exists() || !file.open(QIODevice::ReadOnly))
+		return false;
+	const qint64 size = file.size();
+	const uchar* data = size >= static_cast<qint64>(sizeof(CacheHeader)) ? file.map(0, size) : nullptr;
+	if (!data)
+		return false;
+
+	MappedReader reader(data, size);
+	CacheHeader header;
+	reader.read(header);
+	if (memcmp(header.magic, MODEL_CACHE_MAGIC, sizeof(MODEL_CACHE_MAGIC)) != 0 || header.version != MODEL_CACHE_VERSION ||
+		header.sourceSize != source.size() || header.meshCount == 0)
+		return false;
+	// a new time stamp alone, e.g. after a copy, keeps the cache when the content is the same
+	if (header.sourceModified != source.lastModified().toMSecsSinceEpoch() &&
+		sourceHash(sourcePath) != QByteArray(header.sourceHash, sizeof(header.sourceHash)))
+		return false;
+
+	// validate every record before the first mesh is handed out
+	MappedReader validator = reader;
+	for (quint32 i = 0; i < header.meshCount; i++)
+	{
+		if (!readMesh(validator, nullptr))
+		{
+			qDebug() << "ModelCache : ignoring damaged cache file" << file.fileName();
+			return false;
+		}
+	}
+
+	for (quint32 i = 0; i < header.meshCount; i++)
+	{
+		AssImpModelLoader::MeshPacket packet;
+		readMesh(reader, &packet);
+		if (!addMesh(std::move(packet)))
+			break;
+	}
+	return true;
+}
+
+ModelCacheWriter::ModelCacheWriter(const QString& sourcePath) :
+	_sourcePath(sourcePath),
+	_sourceSize(QFileInfo(sourcePath).size()),
+	_sourceModified(QFileInfo(sourcePath).lastModified().toMSecsSinceEpoch()),
+	_file(ModelCache::instance().fileName(sourcePath)),
+	_meshCount(0),
+	_failed(false)
+{
+	// the header is completed on commit
+	CacheHeader header;
+	memset(&header, 0, sizeof(header));
+	_failed = !_file.open(QIODevice::WriteOnly);
+	write(&header, sizeof(header));
+}
+
+void ModelCacheWriter::write(const void* data, qint64 size)
+{
+	static const char padding[4] = { 0, 0, 0, 0 };
+	if (_failed)
+		return;
+	_failed = _file.write(static_cast<const char*>(data), size) != size ||
+		_file.write(padding, padded(size) - size) != padded(size) - size;
+}
+
+void ModelCacheWriter::write(const AssImpModelLoader::MeshPacket& packet)
+{
+	const MeshGeometry& geometry = packet.geometry;
+	const GLMaterial& material = packet.material;
+	QByteArray name = packet.name.toUtf8();
+
+	MeshHeader header;
+	memset(&header, 0, sizeof(header));
+	header.nameSize = static_cast<quint32>(name.size());
+	header.textureCount = static_cast<quint32>(packet.textures.size());
+	header.vertexCount = static_cast<quint32>(geometry.points.size() / 3);
+	header.indexCount = static_cast<quint32>(geometry.indices.size());
+	storeVector(header.material + 0, material.ambient());
+	storeVector(header.material + 3, material.diffuse());
+	storeVector(header.material + 6, material.specular());
+	storeVector(header.material + 9, material.emissive());
+	storeVector(header.material + 12, material.albedoColor());
+	header.material[15] = material.shininess();
+	header.material[16] = material.metalness();
+	header.material[17] = material.roughness();
+	header.material[18] = material.opacity();
+	header.material[19] = material.metallic() ? 1.0f : 0.0f;
+	if (geometry.optimized)
+	{
+		header.flags = TriangleMesh::meshOptimization() ? MESH_REORDERED : 0;
+		header.acmrBefore = geometry.acmrBefore;
+		header.acmrAfter = geometry.acmrAfter;
+		const TriangleMesh::CompactVertices& vertices = geometry.compactVertices;
+		header.compactSize = static_cast<quint32>(vertices.data.size());
+		header.compactStride = vertices.stride;
+		header.compactNormalOffset = vertices.normalOffset;
+		header.compactTangentOffset = vertices.tangentOffset;
+		header.compactTexCoordOffset = vertices.texCoordOffset;
+		header.compactTexCoordType = vertices.texCoordType;
+	}
+
+	write(&header, sizeof(header));
+	write(name.constData(), name.size());
+	for (const Texture& texture : packet.textures)
+	{
+		TextureHeader textureHeader;
+		textureHeader.typeSize = static_cast<quint32>(texture.type.size());
+		textureHeader.pathSize = texture.path.length;
+		write(&textureHeader, sizeof(textureHeader));
+		write(texture.type.data(), texture.type.size());
+		write(texture.path.C_Str(), texture.path.length);
+	}
+
+	write(geometry.points.data(), geometry.points.size() * sizeof(float));
+	write(geometry.normals.data(), geometry.normals.size() * sizeof(float));
+	write(geometry.texCoords.data(), geometry.texCoords.size() * sizeof(float));
+	write(geometry.tangents.data(), geometry.tangents.size() * sizeof(float));
+	write(geometry.bitangents.data(), geometry.bitangents.size() * sizeof(float));
+	write(geometry.indices.data(), geometry.indices.size() * sizeof(unsigned int));
+	write(geometry.compactVertices.data.data(), header.compactSize);
+	_meshCount++;
+}
+
+bool ModelCacheWriter::commit()
+{
+	// a source changed during the import no longer matches the meshes that were written
+	QFileInfo source(_sourcePath);
+	QByteArray hash = sourceHash(_sourcePath);
+	if (_failed || _meshCount == 0 || source.size() != _sourceSize || source.lastModified().toMSecsSinceEpoch() != _sourceModified ||
+		hash.size() != sizeof(CacheHeader::sourceHash) || !_file.seek(0))
+	{
+		_file.cancelWriting();
+		return false;
+	}
+
+	CacheHeader header;
+	memset(&header, 0, sizeof(header));
+	memcpy(header.magic, MODEL_CACHE_MAGIC, sizeof(MODEL_CACHE_MAGIC));
+	header.version = MODEL_CACHE_VERSION;
+	header.sourceSize = _sourceSize;
+	header.sourceModified = _sourceModified;
+	memcpy(header.sourceHash, hash.constData(), sizeof(header.sourceHash));
+	header.meshCount = _meshCount;
+	write(&header, sizeof(header));
+	return !_failed && _file.commit();
+}
@@ -0,0 +1,54 @@
+#pragma once
+
+#include <QSaveFile>
+#include <QString>
+#include <functional>
+
+#include "AssImpModelLoader.h"
+
+// Imported models stored in the user cache directory in the layout their meshes are
+// uploaded in, so reopening an unchanged file skips Assimp and the conversion. A cache
+// file starts with the size, time stamp and SHA-1 of the source, followed per mesh by
+// its name, material, texture references, the attribute and index arrays as reordered by
+// the mesh optimization and the packed vertices. Reading maps the file and copies the
+// arrays from the mapping straight into the mesh packets
+class ModelCache
+{
+public:
+	static ModelCache& instance();
+
+	// Pass the meshes cached for the source file to addMesh in their original order,
+	// addMesh returns false to stop. False when nothing is cached for the current
+	// content of the source
+	bool load(const QString& sourcePath, const std::function<bool(AssImpModelLoader::MeshPacket&&)>& addMesh);
+
+private:
+	ModelCache();
+	QString fileName(const QString& sourcePath) const;
+	friend class ModelCacheWriter;
+
+private:
+	QString _directory;
+};
+
+// Writes the meshes of one import, the file replaces the previous cache only on commit
+class ModelCacheWriter
+{
+public:
+	explicit ModelCacheWriter(const QString& sourcePath);
+
+	void write(const AssImpModelLoader::MeshPacket& packet);
+	// Complete the header with the mesh count and the source hash
+	bool commit();
+
+private:
+	void write(const void* data, qint64 size);
+
+private:
+	QString _sourcePath;
+	qint64 _sourceSize;
+	qint64 _sourceModified;
+	QSaveFile _file;
+	quint32 _meshCount;
+	bool _failed;
+};
@@ -11,12 +11,12 @@ QString ModelViewer::_lastSelectedFilter = "All Models(*.dae *.xml *.blend *.bvh
 "*.nff *.smd *.vta *.mdl *.md2 *.md3 *.pk3 *.mdc *.md5mesh *.md5anim "
 "*.md5camera *.x *.q3o *.q3s *.raw *.ac *.stl *.fbx *.irrmesh *.xml "
 "*.irr *.off. *.ter *.mdl *.hmp *.mesh.xml *.skeleton.xml *.material "
-"*.ms3d *.lwo *.lws *.lxo *.csm *.ply *.cob *.scn *.xgl *.zgl)";
+"*.ms3d *.lwo *.lws *.lxo *.csm *.ply *.cob *.scn *.xgl *.zgl *.gltf *.glb)";
 QString ModelViewer::_supportedExtensions = "All Files (*.*);;""All Models(*.dae *.xml *.blend *.bvh *.3ds *.ase *.obj *.ply *.dxf *.ifc "
 "*.nff *.smd *.vta *.mdl *.md2 *.md3 *.pk3 *.mdc *.md5mesh *.md5anim "
 "*.md5camera *.x *.q3o *.q3s *.raw *.ac *.stl *.fbx *.irrmesh *.xml "
 "*.irr *.off. *.ter *.mdl *.hmp *.mesh.xml *.skeleton.xml *.material "
-"*.ms3d *.lwo *.lws *.lxo *.csm *.ply *.cob *.scn *.xgl *.zgl);;"
+"*.ms3d *.lwo *.lws *.lxo *.csm *.ply *.cob *.scn *.xgl *.zgl *.gltf *.glb);;"
 "Collada ( *.dae;*.xml );;" "Blender ( *.blend );;" "Biovision BVH ( *.bvh );;"
 "3D Studio Max 3DS ( *.3ds );;" "3D Studio Max ASE ( *.ase );;" "Wavefront Object ( *.obj );;"
 "Stanford Polygon Library ( *.ply );;" "AutoCAD DXF ( *.dxf );;"
@@ -30,7 +30,8 @@ QString ModelViewer::_supportedExtensions = "All Files (*.*);;""All Models(*.dae
 "Terragen Terrain ( *.ter );;" "3D GameStudio Model ( *.mdl );;" "3D GameStudio Terrain ( *.hmp );;"
 "Ogre (*.mesh.xml, *.skeleton.xml, *.material);;" "Milkshape 3D ( *.ms3d );;" "LightWave Model ( *.lwo );;"
 "LightWave Scene ( *.lws );;" "Modo Model ( *.lxo );;" "CharacterStudio Motion ( *.csm );;"
-"Stanford Ply ( *.ply );;" "TrueSpace ( *.cob, *.scn );;" "XGL ( *.xgl, *.zgl );;";
+"Stanford Ply ( *.ply );;" "TrueSpace ( *.cob, *.scn );;" "XGL ( *.xgl, *.zgl );;"
+"glTF 2.0 ( *.gltf;*.glb );;";
 
 ModelViewer::ModelViewer(QWidget* parent) : QWidget(parent)
 {
@@ -125,6 +126,12 @@ ModelViewer::ModelViewer(QWidget* parent) : QWidget(parent)
 	tabWidget->setAutoHide(true);
 
 	connect(checkBoxAutoFitView, SIGNAL(toggled(bool)), _glWidget, SLOT(setAutoFitViewOnUpdate(bool)));
+	connect(checkBoxHoverHighlight, SIGNAL(toggled(bool)), _glWidget, SLOT(setHoverHighlight(bool)));
+	connect(_glWidget, &GLWidget::objectHovered, this, [this](int id, int) {
+		// the name of the highlighted object shows as the viewport tool tip
+		std::vector<TriangleMesh*> meshes = _glWidget->getMeshStore();
+		_glWidget->setToolTip(id >= 0 && id < static_cast<int>(meshes.size()) ? meshes[id]->getName() : QString());
+		});
 
 	connect(_glWidget, &GLWidget::windowZoomEnded, this, [this]() {
 		if (toolButtonWindowZoom->isChecked())
@@ -134,6 +141,7 @@ ModelViewer::ModelViewer(QWidget* parent) : QWidget(parent)
 	connect(_glWidget, SIGNAL(sweepSelectionDone(QList<int>)), this, SLOT(setListRows(QList<int>)));
 	connect(_glWidget, SIGNAL(floorShown(bool)), checkBoxFloor, SLOT(setChecked(bool)));
 	connect(_glWidget, SIGNAL(visibleSwapped(bool)), toolButtonSwapVisible, SLOT(setChecked(bool)));
+	connect(_glWidget, SIGNAL(assImpModelLoaded(QString,bool,QString,bool)), this, SLOT(assImpModelLoaded(QString,bool,QString,bool)));
 
 	listWidgetModel->setContextMenuPolicy(Qt::CustomContextMenu);
 	connect(listWidgetModel, SIGNAL(customContextMenuRequested(QPoint)), this, SLOT(showContextMenu(QPoint)));
@@ -154,6 +162,7 @@ ModelViewer::ModelViewer(QWidget* parent) : QWidget(parent)
 	connect(doubleSpinBoxSkyBoxFOV, SIGNAL(valueChanged(double)), _glWidget, SLOT(setSkyBoxFOV(double)));
 	connect(doubleSpinBoxFloorOffset, SIGNAL(valueChanged(double)), _glWidget, SLOT(setFloorOffsetPercent(double)));
 	connect(checkBoxSkyBoxHDRI, SIGNAL(toggled(bool)), _glWidget, SLOT(setSkyBoxTextureHDRI(bool)));
+	connect(checkBoxSHIrradiance, SIGNAL(toggled(bool)), _glWidget, SLOT(setSphericalHarmonicsIrradiance(bool)));
 	connect(checkBoxShowLights, SIGNAL(toggled(bool)), _glWidget, SLOT(showLights(bool)));
 
 	connect(checkBoxHDRToneMapping, SIGNAL(toggled(bool)), _glWidget, SLOT(enableHDRToneMapping(bool)));
@@ -570,13 +579,6 @@ void ModelViewer::dropEvent(QDropEvent* event)
 		{
 			QString errMsg;
 			_glWidget->loadAssImpModel(fileName, errMsg);
-
-			updateDisplayList();
-
-			listWidgetModel->setCurrentRow(listWidgetModel->count() - 1);
-			listWidgetModel->currentItem()->setCheckState(Qt::Checked);
-
-			updateDisplayList();
 		}
 	}
 	QApplication::restoreOverrideCursor();
@@ -850,6 +852,9 @@ void ModelViewer::displaySelectedMeshInfo()
 		QString name;
 		size_t points = 0, triangles = 0;
 		unsigned long long rawmem = 0;
+		// misses summed over the triangles, so several meshes give the ratio of the selection
+		double acmrBeforeMisses = 0, acmrAfterMisses = 0;
+		size_t acmrTriangles = 0;
 		float surfArea = 0, volume = 0;
 		QVector3D centerOfMass;
 		float weight = 0, density = 0;
@@ -867,6 +872,13 @@ void ModelViewer::displaySelectedMeshInfo()
 			points += mesh->getPoints().size() / 3;
 			triangles += mesh->getIndices().size() / 3;
 			rawmem += mesh->memorySize();
+			if (mesh->getACMRBefore() > 0.0f)
+			{
+				size_t meshTriangles = mesh->getIndices().size() / 3;
+				acmrBeforeMisses += mesh->getACMRBefore() * meshTriangles;
+				acmrAfterMisses += mesh->getACMRAfter() * meshTriangles;
+				acmrTriangles += meshTriangles;
+			}
 			try
 			{
 				MeshProperties props(mesh);
@@ -890,6 +902,9 @@ void ModelViewer::displaySelectedMeshInfo()
 
 		QString strpoints = QString("Points: %1\n").arg(points);
 		QString strtriangles = QString("Triangles: %1\n").arg(triangles);
+		if (acmrTriangles)
+			strtriangles += QString("Vertex Cache ACMR: %1 (before optimization %2)\n")
+				.arg(acmrAfterMisses / acmrTriangles, 0, 'f', 3).arg(acmrBeforeMisses / acmrTriangles, 0, 'f', 3);
 		unsigned long long mem = 0;
 		QString units;
 		if (rawmem < 1024)
@@ -1742,6 +1757,18 @@ bool ModelViewer::loadFile(const QString& fileName)
 	QString errMsg;
 	bool success = _glWidget->loadAssImpModel(fileName, errMsg);
 
+	if (!success)
+	{
+		QApplication::restoreOverrideCursor();
+		QMessageBox::critical(this, "Error", QString("Failed to load model %1").arg(fileName) + "\n" + errMsg);
+		QApplication::setOverrideCursor(Qt::WaitCursor);
+	}
+
+	return success;
+}
+
+void ModelViewer::assImpModelLoaded(const QString& fileName, bool success, const QString& error, bool cancelled)
+{
 	if (success)
 	{
 		updateDisplayList();
@@ -1749,18 +1776,17 @@ bool ModelViewer::loadFile(const QString& fileName)
 		listWidgetModel->setCurrentRow(listWidgetModel->count() - 1);
 		listWidgetModel->currentItem()->setCheckState(Qt::Checked);
 
-		updateDisplayList();		
+		updateDisplayList();
 
 		MainWindow::showStatusMessage(tr("File loaded"), 2000);
 	}
-	else
+	// a cancel was already confirmed by its own message
+	else if (!cancelled)
 	{
-		QApplication::restoreOverrideCursor();
-		QMessageBox::critical(this, "Error", QString("Failed to load model %1").arg(fileName) + "\n" + errMsg);
-		QApplication::setOverrideCursor(Qt::WaitCursor);
+		QMessageBox::critical(this, "Error", QString("Failed to load model %1").arg(fileName) + "\n" + error);
 	}
 
-	return success;
+	emit fileLoaded(fileName, success);
 }
 
 void ModelViewer::setMaterialToSelectedItems(const GLMaterial& mat)
@@ -50,6 +50,10 @@ public:
 	void selectAll();
 	void deselectAll();    
 
+signals:
+	// A file passed to loadFile has been read, the meshes are loaded in the background
+	void fileLoaded(const QString& fileName, bool success);
+
 public slots:
     void updateDisplayList();
     void updateSelectionStatusMessage();
@@ -68,6 +72,7 @@ public slots:
 	void clickMultiViewButton();
 
 private slots:
+	void assImpModelLoaded(const QString& fileName, bool success, const QString& error, bool cancelled);
 	void setListRow(int index);
 	void setListRows(QList<int> indices);
 	void showContextMenu(const QPoint& pos);
@@ -6,8 +6,9 @@ TEMPLATE = app
 TARGET = ModelViewer
 INCLUDEPATH += .
 
-QT += core gui widgets opengl
+QT += core gui widgets opengl concurrent
 win32:QT += winextras
+win32:LIBS += -lpsapi
 
 unix {
     INCLUDEPATH += /usr/include/freetype2/
@@ -74,26 +75,39 @@ HEADERS += AABB.h \
     Drawable.h \
     Figure8KleinBottle.h \
     Folium.h \
+    Frustum.h \
     GLCamera.h \
     GLMaterial.h \
     GLWidget.h \
+    GltfReader.h \
     GraysKlein.h \
     GridMesh.h \
     Horn.h \
+    IBLCache.h \
     IDrawable.h \
     IParametricSurface.h \
+    IrradianceSH.h \
     KleinBottle.h \
     LimpetTorus.h \
     MainWindow.h \
+    MemoryUsage.h \
+    MeshBVH.h \
+    MeshFileReader.h \
+    MeshOptimizer.h \
     MeshProperties.h \
+    ModelCache.h \
     ModelObjectList.h \
     ModelViewer.h \
     ParametricSurface.h \
     Periwinkle.h \
     Plane.h \
+    ProgramBinaryCache.h \
     Point.h \
     Resource.h \
     SaddleTorus.h \
+    SceneBVH.h \
+    ShaderVariants.h \
+    SkyBoxLoader.h \
     Sphere.h \
     SphericalHarmonic.h \
     SpindleShell.h \
@@ -104,6 +118,8 @@ HEADERS += AABB.h \
     Teapot.h \
     TeapotData.h \
     TextRenderer.h \
+    TextureCache.h \
+    TextureState.h \
     ToolPanel.h \
     TopShell.h \
     Torus.h \
@@ -116,6 +132,7 @@ HEADERS += AABB.h \
     TwistedPseudoSphere.h \
     TwistedTriaxial.h \
     TurretShell.h \
+    UniformBlocks.h \
     VerrillMinimal.h \
     WrinkledPeriwinkle.h \
     ParametricSurface.h \
@@ -156,15 +173,24 @@ SOURCES += AppleSurface.cpp \
     Drawable.cpp \
     Figure8KleinBottle.cpp \
     Folium.cpp \
+    Frustum.cpp \
     GLCamera.cpp \
     GLMaterial.cpp \
     GLWidget.cpp \
+    GltfReader.cpp \
     GraysKlein.cpp \
     GridMesh.cpp \
     Horn.cpp \
+    IBLCache.cpp \
+    IrradianceSH.cpp \
     KleinBottle.cpp \
     LimpetTorus.cpp \
+    MemoryUsage.cpp \
+    MeshBVH.cpp \
+    MeshFileReader.cpp \
+    MeshOptimizer.cpp \
     MeshProperties.cpp \
+    ModelCache.cpp \
     ModelObjectList.cpp \
     ModelViewer.cpp \
     ToolPanel.cpp \
@@ -176,8 +202,12 @@ SOURCES += AppleSurface.cpp \
     ParametricSurface.cpp \
     Periwinkle.cpp \
     Plane.cpp \
+    ProgramBinaryCache.cpp \
     Point.cpp \
     SaddleTorus.cpp \
+    SceneBVH.cpp \
+    ShaderVariants.cpp \
+    SkyBoxLoader.cpp \
     Sphere.cpp \
     SphericalHarmonic.cpp \
     SpindleShell.cpp \
@@ -187,6 +217,8 @@ SOURCES += AppleSurface.cpp \
     Spring.cpp \
     Teapot.cpp \
     TextRenderer.cpp \
+    TextureCache.cpp \
+    TextureState.cpp \
     TopShell.cpp \
     Torus.cpp \
     TriangleMesh.cpp \
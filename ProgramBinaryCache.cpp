@@ -0,0 +1,154 @@
+#include "ProgramBinaryCache.h"
+
+#include <QCryptographicHash>
+#include <QOpenGLContext>
+#include <QStandardPaths>
+#include <QSaveFile>
+#include <QFile>
+#include <QDir>
+#include <QDebug>
+#include <cstring>
+
+ProgramBinaryCache& ProgramBinaryCache::instance()
+{
+	static ProgramBinaryCache cache;
+	return cache;
+}
+
+ProgramBinaryCache::ProgramBinaryCache() :
+	_initialized(false),
+	_enabled(false),
+	_hitCount(0),
+	_missCount(0)
+{
+}
+
+QOpenGLFunctions_4_5_Core* ProgramBinaryCache::functions()
+{
+	// owned by the context, resolved again for each one so no pointer outlives its window
+	QOpenGLFunctions_4_5_Core* gl = QOpenGLContext::currentContext()->versionFunctions<QOpenGLFunctions_4_5_Core>();
+	gl->initializeOpenGLFunctions();
+	return gl;
+}
+
+void ProgramBinaryCache::initialize()
+{
+	if (_initialized)
+		return;
+	_initialized = true;
+
+	QOpenGLFunctions_4_5_Core* gl = functions();
+	GLint formats = 0;
+	gl->glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS, &formats);
+	_directory = QStandardPaths::writableLocation(QStandardPaths::CacheLocation) + "/shaders";
+	_enabled = formats > 0 && QDir().mkpath(_directory);
+	if (!_enabled)
+	{
+		qDebug() << "ProgramBinaryCache : program binaries are not cached";
+		return;
+	}
+
+	_driver = QByteArray(reinterpret_cast<const char*>(gl->glGetString(GL_VENDOR))) + '\n' +
+		QByteArray(reinterpret_cast<const char*>(gl->glGetString(GL_RENDERER))) + '\n' +
+		QByteArray(reinterpret_cast<const char*>(gl->glGetString(GL_VERSION)));
+}
+
+QByteArray ProgramBinaryCache::key(const QList<QByteArray>& sources)
+{
+	initialize();
+	if (!_enabled)
+		return QByteArray();
+
+	QCryptographicHash hash(QCryptographicHash::Sha1);
+	hash.addData(_driver);
+	for (const QByteArray& source : sources)
+	{
+		// the length separates the sources, so moving text between stages changes the key
+		hash.addData(QByteArray::number(source.size()));
+		hash.addData(source);
+	}
+	return hash.result().toHex();
+}
+
+QByteArray ProgramBinaryCache::keyForFiles(const QStringList& sourceFiles)
+{
+	QList<QByteArray> sources;
+	for (const QString& sourceFile : sourceFiles)
+	{
+		QFile file(sourceFile);
+		if (!file.open(QIODevice::ReadOnly))
+			return QByteArray();
+		sources.append(file.readAll());
+	}
+	return key(sources);
+}
+
+bool ProgramBinaryCache::load(QOpenGLShaderProgram* prog, const QByteArray& key)
+{
+	if (key.isEmpty())
+		return false;
+
+	QFile file(fileName(key));
+	if (!file.open(QIODevice::ReadOnly))
+	{
+		_missCount++;
+		return false;
+	}
+	QByteArray data = file.readAll();
+	file.close();
+
+	GLint linked = 0;
+	if (data.size() > static_cast<int>(sizeof(GLenum)))
+	{
+		QOpenGLFunctions_4_5_Core* gl = functions();
+		GLenum format = 0;
+		memcpy(&format, data.constData(), sizeof(format));
+		gl->glProgramBinary(prog->programId(), format, data.constData() + sizeof(format), data.size() - static_cast<int>(sizeof(format)));
+		gl->glGetProgramiv(prog->programId(), GL_LINK_STATUS, &linked);
+	}
+	// without attached shaders link() only picks up the link status of the binary
+	if (!linked || !prog->link())
+	{
+		// stale after a driver update or truncated, the program is compiled and stored again
+		qDebug() << "ProgramBinaryCache : binary rejected for" << prog->objectName();
+		QFile::remove(fileName(key));
+		_missCount++;
+		return false;
+	}
+	_hitCount++;
+	return true;
+}
+
+void ProgramBinaryCache::prepare(QOpenGLShaderProgram* prog)
+{
+	initialize();
+	if (_enabled)
+		functions()->glProgramParameteri(prog->programId(), GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
+}
+
+void ProgramBinaryCache::save(QOpenGLShaderProgram* prog, const QByteArray& key)
+{
+	if (key.isEmpty() || !prog->isLinked())
+		return;
+
+	QOpenGLFunctions_4_5_Core* gl = functions();
+	GLint length = 0;
+	gl->glGetProgramiv(prog->programId(), GL_PROGRAM_BINARY_LENGTH, &length);
+	if (length <= 0)
+		return;
+
+	QByteArray data(static_cast<int>(sizeof(GLenum)) + length, 0);
+	GLenum format = 0;
+	gl->glGetProgramBinary(prog->programId(), length, nullptr, &format, data.data() + sizeof(format));
+	memcpy(data.data(), &format, sizeof(format));
+
+	// written to a temporary file first, another window may be reading the same entry
+	QSaveFile file(fileName(key));
+	if (!file.open(QIODevice::WriteOnly) || file.write(data) != data.size() || !file.commit())
+		qDebug() << "ProgramBinaryCache : could not store the binary of" << prog->objectName();
+}
+
+QString ProgramBinaryCache::fileName(const QByteArray& key) const
+{
+	return _directory + "/" + QString::fromLatin1(key) + ".bin";
+}
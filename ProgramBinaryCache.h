@@ -0,0 +1,49 @@
+#pragma once
+
+#include <QOpenGLFunctions_4_5_Core>
+#include <QOpenGLShaderProgram>
+#include <QByteArray>
+#include <QList>
+#include <QString>
+#include <QStringList>
+
+// Linked program binaries stored in the user cache directory, so programs are only
+// compiled from source the first time they are built on a driver. Entries are keyed
+// by a hash of the shader sources and the driver vendor, renderer and version strings,
+// a binary the driver rejects is removed and the program is compiled again. GL calls
+// go to the current context
+class ProgramBinaryCache
+{
+public:
+	static ProgramBinaryCache& instance();
+
+	// Key of a program built from the given sources on the current driver, empty when
+	// the driver offers no binary formats and nothing can be cached
+	QByteArray key(const QList<QByteArray>& sources);
+	QByteArray keyForFiles(const QStringList& sourceFiles);
+
+	// Link the program from the cached binary, false when there is none or it was rejected
+	bool load(QOpenGLShaderProgram* prog, const QByteArray& key);
+	// Keep the binary retrievable, must be called before the program is linked
+	void prepare(QOpenGLShaderProgram* prog);
+	// Store the binary of a program linked after prepare
+	void save(QOpenGLShaderProgram* prog, const QByteArray& key);
+
+	unsigned int hitCount() const { return _hitCount; }
+	unsigned int missCount() const { return _missCount; }
+
+private:
+	ProgramBinaryCache();
+	void initialize();
+	static QOpenGLFunctions_4_5_Core* functions();
+	QString fileName(const QByteArray& key) const;
+
+private:
+	bool _initialized;
+	bool _enabled;
+	QByteArray _driver;
+	QString _directory;
+
+	unsigned int _hitCount;
+	unsigned int _missCount;
+};
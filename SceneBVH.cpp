@@ -0,0 +1,283 @@
+#include "SceneBVH.h"
+#include "BoundingBox.h"
+#include "Frustum.h"
+
+#include <algorithm>
+#include <queue>
+#include <limits>
+
+namespace
+{
+	float surfaceArea(const QVector3D& mn, const QVector3D& mx)
+	{
+		QVector3D d = mx - mn;
+		return 2.0f * (d.x() * d.y() + d.y() * d.z() + d.z() * d.x());
+	}
+
+	float unionArea(const QVector3D& mn1, const QVector3D& mx1, const QVector3D& mn2, const QVector3D& mx2)
+	{
+		QVector3D mn(std::min(mn1.x(), mn2.x()), std::min(mn1.y(), mn2.y()), std::min(mn1.z(), mn2.z()));
+		QVector3D mx(std::max(mx1.x(), mx2.x()), std::max(mx1.y(), mx2.y()), std::max(mx1.z(), mx2.z()));
+		return surfaceArea(mn, mx);
+	}
+
+	// Slab test, returns the entry distance or a negative value on a miss
+	float rayEntry(const QVector3D& rayPos, const QVector3D& invDir, const QVector3D& mn, const QVector3D& mx)
+	{
+		float tmin = 0.0f;
+		float tmax = std::numeric_limits<float>::max();
+		for (int a = 0; a < 3; a++)
+		{
+			float t1 = (mn[a] - rayPos[a]) * invDir[a];
+			float t2 = (mx[a] - rayPos[a]) * invDir[a];
+			tmin = std::max(tmin, std::min(t1, t2));
+			tmax = std::min(tmax, std::max(t1, t2));
+		}
+		return tmin <= tmax ? tmin : -1.0f;
+	}
+}
+
+SceneBVH::SceneBVH() : _root(-1)
+{
+}
+
+void SceneBVH::insert(int id, const BoundingBox& box)
+{
+	int leaf = allocateNode();
+	Node& node = _nodes[leaf];
+	node.boundsMin = QVector3D(box.xMin(), box.yMin(), box.zMin());
+	node.boundsMax = QVector3D(box.xMax(), box.yMax(), box.zMax());
+	node.id = id;
+	if (id >= static_cast<int>(_leaves.size()))
+		_leaves.resize(static_cast<size_t>(id) + 1, -1);
+	_leaves[id] = leaf;
+	insertLeaf(leaf);
+}
+
+void SceneBVH::remove(int id)
+{
+	if (id < 0 || id >= static_cast<int>(_leaves.size()))
+		return;
+	int leaf = _leaves[id];
+	if (leaf >= 0)
+	{
+		removeLeaf(leaf);
+		freeNode(leaf);
+	}
+	_leaves.erase(_leaves.begin() + id);
+	for (int l : _leaves)
+	{
+		if (l >= 0 && _nodes[l].id > id)
+			_nodes[l].id--;
+	}
+}
+
+void SceneBVH::update(int id, const BoundingBox& box)
+{
+	if (id < 0 || id >= static_cast<int>(_leaves.size()) || _leaves[id] < 0)
+	{
+		insert(id, box);
+		return;
+	}
+	int leaf = _leaves[id];
+	removeLeaf(leaf);
+	_nodes[leaf].boundsMin = QVector3D(box.xMin(), box.yMin(), box.zMin());
+	_nodes[leaf].boundsMax = QVector3D(box.xMax(), box.yMax(), box.zMax());
+	insertLeaf(leaf);
+}
+
+void SceneBVH::clear()
+{
+	_nodes.clear();
+	_freeNodes.clear();
+	_leaves.clear();
+	_root = -1;
+}
+
+void SceneBVH::intersectsWithRay(const QVector3D& rayPos, const QVector3D& rayDir,
+	const std::function<void(int id, float& closest)>& visitor) const
+{
+	if (_root < 0)
+		return;
+
+	QVector3D invDir;
+	for (int a = 0; a < 3; a++)
+		invDir[a] = rayDir[a] != 0.0f ? 1.0f / rayDir[a] : std::numeric_limits<float>::max();
+
+	typedef std::pair<float, int> Entry;
+	std::priority_queue<Entry, std::vector<Entry>, std::greater<Entry>> queue;
+	float entry = rayEntry(rayPos, invDir, _nodes[_root].boundsMin, _nodes[_root].boundsMax);
+	if (entry >= 0.0f)
+		queue.push(Entry(entry, _root));
+
+	float closest = std::numeric_limits<float>::max();
+	while (!queue.empty())
+	{
+		Entry top = queue.top();
+		queue.pop();
+		// everything left in the queue starts behind the closest hit
+		if (top.first > closest)
+			break;
+
+		const Node& node = _nodes[top.second];
+		if (node.isLeaf())
+		{
+			visitor(node.id, closest);
+			continue;
+		}
+		for (int child : { node.left, node.right })
+		{
+			float t = rayEntry(rayPos, invDir, _nodes[child].boundsMin, _nodes[child].boundsMax);
+			if (t >= 0.0f && t <= closest)
+				queue.push(Entry(t, child));
+		}
+	}
+}
+
+void SceneBVH::intersectsWithFrustum(const Frustum& frustum, std::vector<int>& ids) const
+{
+	if (_root < 0)
+		return;
+
+	std::vector<int> stack;
+	stack.push_back(_root);
+	while (!stack.empty())
+	{
+		const Node& node = _nodes[stack.back()];
+		stack.pop_back();
+		if (!frustum.intersects(node.boundsMin, node.boundsMax))
+			continue;
+		if (node.isLeaf())
+		{
+			ids.push_back(node.id);
+		}
+		else
+		{
+			stack.push_back(node.left);
+			stack.push_back(node.right);
+		}
+	}
+}
+
+int SceneBVH::allocateNode()
+{
+	int index;
+	if (!_freeNodes.empty())
+	{
+		index = _freeNodes.back();
+		_freeNodes.pop_back();
+	}
+	else
+	{
+		index = static_cast<int>(_nodes.size());
+		_nodes.push_back(Node());
+	}
+	Node& node = _nodes[index];
+	node.parent = node.left = node.right = -1;
+	node.id = -1;
+	return index;
+}
+
+void SceneBVH::freeNode(int node)
+{
+	_freeNodes.push_back(node);
+}
+
+void SceneBVH::insertLeaf(int leaf)
+{
+	if (_root < 0)
+	{
+		_root = leaf;
+		_nodes[leaf].parent = -1;
+		return;
+	}
+
+	// walk down towards the sibling with the lowest surface area cost
+	const QVector3D leafMin = _nodes[leaf].boundsMin;
+	const QVector3D leafMax = _nodes[leaf].boundsMax;
+	int index = _root;
+	while (!_nodes[index].isLeaf())
+	{
+		const Node& node = _nodes[index];
+		float area = surfaceArea(node.boundsMin, node.boundsMax);
+		float combinedArea = unionArea(node.boundsMin, node.boundsMax, leafMin, leafMax);
+		// cost of a new parent here, and of pushing the leaf further down
+		float cost = 2.0f * combinedArea;
+		float inheritance = 2.0f * (combinedArea - area);
+		float childCost[2];
+		int children[2] = { node.left, node.right };
+		for (int c = 0; c < 2; c++)
+		{
+			const Node& child = _nodes[children[c]];
+			float grown = unionArea(child.boundsMin, child.boundsMax, leafMin, leafMax);
+			childCost[c] = (child.isLeaf() ? grown : grown - surfaceArea(child.boundsMin, child.boundsMax)) + inheritance;
+		}
+		if (cost < childCost[0] && cost < childCost[1])
+			break;
+		index = childCost[0] < childCost[1] ? children[0] : children[1];
+	}
+
+	int sibling = index;
+	int oldParent = _nodes[sibling].parent;
+	int newParent = allocateNode();
+	_nodes[newParent].parent = oldParent;
+	_nodes[newParent].left = sibling;
+	_nodes[newParent].right = leaf;
+	_nodes[sibling].parent = newParent;
+	_nodes[leaf].parent = newParent;
+	if (oldParent < 0)
+	{
+		_root = newParent;
+	}
+	else if (_nodes[oldParent].left == sibling)
+	{
+		_nodes[oldParent].left = newParent;
+	}
+	else
+	{
+		_nodes[oldParent].right = newParent;
+	}
+	refitFrom(newParent);
+}
+
+void SceneBVH::removeLeaf(int leaf)
+{
+	if (leaf == _root)
+	{
+		_root = -1;
+		return;
+	}
+
+	int parent = _nodes[leaf].parent;
+	int grandParent = _nodes[parent].parent;
+	int sibling = _nodes[parent].left == leaf ? _nodes[parent].right : _nodes[parent].left;
+	if (grandParent < 0)
+	{
+		_root = sibling;
+		_nodes[sibling].parent = -1;
+	}
+	else
+	{
+		if (_nodes[grandParent].left == parent)
+			_nodes[grandParent].left = sibling;
+		else
+			_nodes[grandParent].right = sibling;
+		_nodes[sibling].parent = grandParent;
+		refitFrom(grandParent);
+	}
+	freeNode(parent);
+	_nodes[leaf].parent = -1;
+}
+
+void SceneBVH::refitFrom(int node)
+{
+	while (node >= 0)
+	{
+		Node& n = _nodes[node];
+		const Node& l = _nodes[n.left];
+		const Node& r = _nodes[n.right];
+		n.boundsMin = QVector3D(std::min(l.boundsMin.x(), r.boundsMin.x()), std::min(l.boundsMin.y(), r.boundsMin.y()), std::min(l.boundsMin.z(), r.boundsMin.z()));
+		n.boundsMax = QVector3D(std::max(l.boundsMax.x(), r.boundsMax.x()), std::max(l.boundsMax.y(), r.boundsMax.y()), std::max(l.boundsMax.z(), r.boundsMax.z()));
+		node = n.parent;
+	}
+}
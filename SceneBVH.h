@@ -0,0 +1,60 @@
+#pragma once
+
+#include <vector>
+#include <functional>
+#include <QVector3D>
+
+class BoundingBox;
+class Frustum;
+
+// Dynamic bounding volume hierarchy over the world bounds of the meshes in the
+// scene. Leaves are inserted next to the sibling that grows the least in surface
+// area, so meshes can be added, removed and moved without rebuilding the tree.
+// Leaves are identified by the index of the mesh in the mesh store
+class SceneBVH
+{
+public:
+	SceneBVH();
+
+	// id must be the next index, i.e. the number of meshes inserted so far
+	void insert(int id, const BoundingBox& box);
+	// ids above the removed one shift down by one, like the mesh store does
+	void remove(int id);
+	void update(int id, const BoundingBox& box);
+	void clear();
+
+	int size() const { return static_cast<int>(_leaves.size()); }
+
+	// Visits the leaves whose bounds are hit by the ray in order of entry distance.
+	// The visitor may lower the closest distance, leaves entered beyond it are skipped
+	void intersectsWithRay(const QVector3D& rayPos, const QVector3D& rayDir,
+		const std::function<void(int id, float& closest)>& visitor) const;
+
+	// Ids of the leaves whose bounds intersect the frustum
+	void intersectsWithFrustum(const Frustum& frustum, std::vector<int>& ids) const;
+
+private:
+	struct Node
+	{
+		QVector3D boundsMin;
+		QVector3D boundsMax;
+		int parent;
+		int left;
+		int right;
+		int id; // mesh index for leaves, -1 for interior nodes
+
+		bool isLeaf() const { return left < 0; }
+	};
+
+	int allocateNode();
+	void freeNode(int node);
+	void insertLeaf(int leaf);
+	void removeLeaf(int leaf);
+	void refitFrom(int node);
+
+private:
+	std::vector<Node> _nodes;
+	std::vector<int> _freeNodes;
+	std::vector<int> _leaves; // mesh index -> leaf node
+	int _root;
+};
@@ -0,0 +1,82 @@
+#include "ShaderVariants.h"
+#include "ProgramBinaryCache.h"
+
+#include <QFile>
+#include <QDebug>
+
+ShaderVariants::ShaderVariants(QObject* parent, const QString& name, const QString& vertexProg,
+	const QString& fragmentProg, const QString& geometryProg) :
+	_parent(parent),
+	_name(name),
+	_vertexSource(readSource(vertexProg)),
+	_fragmentSource(readSource(fragmentProg)),
+	_geometrySource(geometryProg != "" ? readSource(geometryProg) : QByteArray())
+{
+}
+
+ShaderVariants::~ShaderVariants()
+{
+	for (auto& variant : _programs)
+		delete variant.second;
+}
+
+QOpenGLShaderProgram* ShaderVariants::find(unsigned int key) const
+{
+	auto it = _programs.find(key);
+	return it != _programs.end() ? it->second : nullptr;
+}
+
+QOpenGLShaderProgram* ShaderVariants::compile(unsigned int key, const QByteArray& defines)
+{
+	QOpenGLShaderProgram* prog = find(key);
+	if (prog)
+		return prog;
+
+	prog = new QOpenGLShaderProgram(_parent);
+	prog->setObjectName(QString("%1_%2").arg(_name).arg(key));
+	QByteArray vertexSource = insertDefines(_vertexSource, defines);
+	QByteArray geometrySource = _geometrySource.isEmpty() ? QByteArray() : insertDefines(_geometrySource, defines);
+	QByteArray fragmentSource = insertDefines(_fragmentSource, defines);
+
+	ProgramBinaryCache& binaryCache = ProgramBinaryCache::instance();
+	QByteArray cacheKey = binaryCache.key({ vertexSource, geometrySource, fragmentSource });
+	if (!binaryCache.load(prog, cacheKey))
+	{
+		if (!prog->addShaderFromSourceCode(QOpenGLShader::Vertex, vertexSource))
+			qDebug() << "Error in vertex shader:" << prog->objectName() << prog->log();
+		if (!geometrySource.isEmpty() && !prog->addShaderFromSourceCode(QOpenGLShader::Geometry, geometrySource))
+			qDebug() << "Error in geometry shader:" << prog->objectName() << prog->log();
+		if (!prog->addShaderFromSourceCode(QOpenGLShader::Fragment, fragmentSource))
+			qDebug() << "Error in fragment shader:" << prog->objectName() << prog->log();
+		binaryCache.prepare(prog);
+		if (prog->link())
+			binaryCache.save(prog, cacheKey);
+		else
+			qDebug() << "Error linking shader program:" << prog->objectName() << prog->log();
+	}
+
+	if (_initializer)
+		_initializer(prog);
+	_programs[key] = prog;
+	return prog;
+}
+
+QByteArray ShaderVariants::readSource(const QString& fileName)
+{
+	QFile file(fileName);
+	if (!file.open(QIODevice::ReadOnly))
+	{
+		qDebug() << "Could not read shader file:" << fileName;
+		return QByteArray();
+	}
+	return file.readAll();
+}
+
+QByteArray ShaderVariants::insertDefines(const QByteArray& source, const QByteArray& defines)
+{
+	// #version has to stay the first statement
+	int lineEnd = source.startsWith("#version") ? source.indexOf('\n') + 1 : 0;
+	QByteArray result = source;
+	result.insert(lineEnd, defines);
+	return result;
+}
@@ -0,0 +1,41 @@
+#pragma once
+
+#include <QOpenGLShaderProgram>
+#include <QByteArray>
+#include <functional>
+#include <map>
+
+// Specialized builds of one shader program. Every variant is compiled from the same
+// sources with preprocessor defines inserted after the #version line, on the first
+// request for its key, and kept for the lifetime of the set. Linked variants go
+// through the ProgramBinaryCache
+class ShaderVariants
+{
+public:
+	ShaderVariants(QObject* parent, const QString& name, const QString& vertexProg,
+		const QString& fragmentProg, const QString& geometryProg = "");
+	~ShaderVariants();
+
+	// Called on each newly linked variant, e.g. to assign sampler units
+	void setInitializer(const std::function<void(QOpenGLShaderProgram*)>& initializer) { _initializer = initializer; }
+
+	// Cached variant for the key, nullptr if it was not compiled yet
+	QOpenGLShaderProgram* find(unsigned int key) const;
+	// Compile and link the variant for the key, the defines are only read on a cache miss
+	QOpenGLShaderProgram* compile(unsigned int key, const QByteArray& defines);
+
+	size_t count() const { return _programs.size(); }
+
+private:
+	static QByteArray readSource(const QString& fileName);
+	static QByteArray insertDefines(const QByteArray& source, const QByteArray& defines);
+
+private:
+	QObject* _parent;
+	QString _name;
+	QByteArray _vertexSource;
+	QByteArray _fragmentSource;
+	QByteArray _geometrySource;
+	std::function<void(QOpenGLShaderProgram*)> _initializer;
+	std::map<unsigned int, QOpenGLShaderProgram*> _programs;
+};
@@ -0,0 +1,120 @@
+#include "SkyBoxLoader.h"
+
+#include <QtConcurrent>
+#include <QCryptographicHash>
+#include <functional>
+
+#include "stb_image.h"
+
+namespace
+{
+	SkyBoxLoader::Face decodeFace(const QString& file, bool hdr, const QStringList& extensions)
+	{
+		QStringList candidates;
+		if (extensions.isEmpty())
+			candidates.append(file);
+		for (const QString& extn : extensions)
+			candidates.append(file + "." + extn);
+
+		SkyBoxLoader::Face face;
+		for (const QString& candidate : candidates)
+		{
+			int nrComponents = 0;
+			// always three channels, the cube map is uploaded as RGB
+			void* data = hdr ?
+				static_cast<void*>(stbi_loadf(candidate.toStdString().c_str(), &face.width, &face.height, &nrComponents, 3)) :
+				static_cast<void*>(stbi_load(candidate.toStdString().c_str(), &face.width, &face.height, &nrComponents, 3));
+			if (data)
+			{
+				face.pixels = QByteArray(static_cast<const char*>(data), face.width * face.height * 3 * static_cast<int>(hdr ? sizeof(float) : 1));
+				stbi_image_free(data);
+				break;
+			}
+		}
+		return face;
+	}
+}
+
+SkyBoxLoader::SkyBoxLoader(QObject* parent) :
+	QObject(parent),
+	_hdr(false)
+{
+	connect(&_watcher, &QFutureWatcher<Face>::progressValueChanged, this, [this](int count) { emit faceLoaded(count, 6); });
+	connect(&_watcher, SIGNAL(finished()), this, SLOT(collectFaces()));
+}
+
+SkyBoxLoader::~SkyBoxLoader()
+{
+	_watcher.cancel();
+	_watcher.waitForFinished();
+}
+
+void SkyBoxLoader::load(const QStringList& files, bool hdr, const QStringList& extensions)
+{
+	if (isLoading())
+	{
+		// only the latest request is kept, setFuture drops the pending signals of this one
+		_watcher.cancel();
+		_watcher.waitForFinished();
+	}
+	_watcher.setFuture(start(files, hdr, extensions));
+}
+
+bool SkyBoxLoader::loadAndWait(const QStringList& files, bool hdr, const QStringList& extensions)
+{
+	QFuture<Face> future = start(files, hdr, extensions);
+	future.waitForFinished();
+	QList<Face> results = future.results();
+	_faces.assign(results.begin(), results.end());
+	return complete();
+}
+
+QFuture<SkyBoxLoader::Face> SkyBoxLoader::start(const QStringList& files, bool hdr, const QStringList& extensions)
+{
+	_files = files;
+	_hdr = hdr;
+	_faces.clear();
+	// the flag is global in stb_image, it is set before any worker starts
+	stbi_set_flip_vertically_on_load(true);
+	std::function<Face(const QString&)> decode = [hdr, extensions](const QString& file) { return decodeFace(file, hdr, extensions); };
+	return QtConcurrent::mapped(_files, decode);
+}
+
+void SkyBoxLoader::cancelLoading()
+{
+	if (isLoading())
+		_watcher.cancel();
+}
+
+void SkyBoxLoader::collectFaces()
+{
+	if (_watcher.isCanceled())
+	{
+		emit loadingCancelled();
+		return;
+	}
+	QList<Face> results = _watcher.future().results();
+	_faces.assign(results.begin(), results.end());
+	emit loaded(complete());
+}
+
+bool SkyBoxLoader::complete()
+{
+	// a cube map needs six square faces of one size
+	if (_faces.size() != 6)
+		return false;
+	for (const Face& face : _faces)
+	{
+		if (face.pixels.isEmpty() || face.width != face.height || face.width != _faces[0].width)
+			return false;
+	}
+	return true;
+}
+
+QByteArray SkyBoxLoader::contentHash() const
+{
+	QCryptographicHash hash(QCryptographicHash::Sha1);
+	for (const Face& face : _faces)
+		hash.addData(face.pixels);
+	return hash.result();
+}
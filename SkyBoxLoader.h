@@ -0,0 +1,62 @@
+#pragma once
+
+#include <QObject>
+#include <QFutureWatcher>
+#include <QByteArray>
+#include <QStringList>
+#include <vector>
+
+// Decodes the six faces of a skybox in parallel on worker threads. The faces are
+// converted to tightly packed RGB, 8 bit or float for HDR images, so they can be
+// uploaded as they are. Progress is reported per decoded face
+class SkyBoxLoader : public QObject
+{
+	Q_OBJECT
+public:
+	struct Face
+	{
+		QByteArray pixels;
+		int width = 0;
+		int height = 0;
+	};
+
+	explicit SkyBoxLoader(QObject* parent = nullptr);
+	~SkyBoxLoader();
+
+	// Start decoding files in cube map face order. Each file is tried with every
+	// extension in turn, or used as it is when no extensions are given
+	void load(const QStringList& files, bool hdr, const QStringList& extensions = QStringList());
+	// Decode on the worker threads and wait, for the skybox needed at startup
+	bool loadAndWait(const QStringList& files, bool hdr, const QStringList& extensions = QStringList());
+
+	bool isLoading() const { return _watcher.isRunning(); }
+	bool isHDR() const { return _hdr; }
+	const QStringList& files() const { return _files; }
+
+	// Decoded faces and a hash of their pixels, valid once loaded(true) was emitted.
+	// Faces that could not be read are empty
+	const std::vector<Face>& faces() const { return _faces; }
+	QByteArray contentHash() const;
+
+public slots:
+	void cancelLoading();
+
+signals:
+	void faceLoaded(int count, int total);
+	// not emitted after cancelLoading
+	void loaded(bool success);
+	void loadingCancelled();
+
+private slots:
+	void collectFaces();
+
+private:
+	QFuture<Face> start(const QStringList& files, bool hdr, const QStringList& extensions);
+	bool complete();
+
+private:
+	QFutureWatcher<Face> _watcher;
+	QStringList _files;
+	bool _hdr;
+	std::vector<Face> _faces;
+};
@@ -0,0 +1,145 @@
+#include "TextureCache.h"
+#include "TextureState.h"
+
+#include <QCryptographicHash>
+#include <QFileInfo>
+#include <QFile>
+#include <QImage>
+#include <iostream>
+
+TextureCache& TextureCache::instance()
+{
+	static TextureCache cache;
+	return cache;
+}
+
+TextureCache::TextureCache() :
+	_hitCount(0),
+	_missCount(0)
+{
+}
+
+unsigned int TextureCache::acquire(const QString& path)
+{
+	QFileInfo info(path);
+	QString canonicalPath = info.canonicalFilePath();
+	if (canonicalPath.isEmpty())
+	{
+		std::cout << "Texture failed to load at path: " << path.toStdString() << std::endl;
+		return 0;
+	}
+
+	auto stamp = _files.find(canonicalPath);
+	if (stamp != _files.end() && stamp->size == info.size() && stamp->modified == info.lastModified())
+	{
+		auto entry = _entries.find(stamp->contentHash);
+		if (entry != _entries.end())
+		{
+			entry->users++;
+			_hitCount++;
+			return entry->texture;
+		}
+	}
+
+	QFile file(canonicalPath);
+	if (!file.open(QIODevice::ReadOnly))
+	{
+		std::cout << "Texture failed to load at path: " << path.toStdString() << std::endl;
+		return 0;
+	}
+	QByteArray content = file.readAll();
+	QByteArray contentHash = QCryptographicHash::hash(content, QCryptographicHash::Sha1);
+
+	FileStamp& fileStamp = _files[canonicalPath];
+	fileStamp.size = info.size();
+	fileStamp.modified = info.lastModified();
+	fileStamp.contentHash = contentHash;
+
+	// the same image under another path or name is shared as well
+	auto entry = _entries.find(contentHash);
+	if (entry != _entries.end())
+	{
+		entry->users++;
+		_hitCount++;
+		return entry->texture;
+	}
+
+	QImage image;
+	if (!image.loadFromData(content))
+	{
+		std::cout << "Texture failed to load at path: " << path.toStdString() << std::endl;
+		return 0;
+	}
+	return acquire(contentHash, TextureState::glFormat(image));
+}
+
+unsigned int TextureCache::acquire(const QByteArray& contentHash, const QImage& glImage)
+{
+	auto entry = _entries.find(contentHash);
+	if (entry != _entries.end())
+	{
+		entry->users++;
+		_hitCount++;
+		return entry->texture;
+	}
+	if (glImage.isNull())
+		return 0;
+	_missCount++;
+
+	Entry newEntry;
+	TextureState::instance().upload(newEntry.texture, glImage);
+	if (newEntry.texture == 0)
+		return 0;
+	newEntry.users = 1;
+	_entries.insert(contentHash, newEntry);
+	_textureHashes.insert(newEntry.texture, contentHash);
+	return newEntry.texture;
+}
+
+unsigned int TextureCache::acquirePlaceholder()
+{
+	// not a SHA-1, so no image content can share the key
+	static const QByteArray placeholderKey("placeholder");
+	if (_entries.contains(placeholderKey))
+		return acquire(placeholderKey, QImage());
+	QImage image(128, 128, QImage::Format_RGBA8888);
+	image.fill(Qt::white);
+	return acquire(placeholderKey, image);
+}
+
+void TextureCache::retain(unsigned int texture)
+{
+	auto hash = _textureHashes.find(texture);
+	if (hash != _textureHashes.end())
+		_entries[*hash].users++;
+}
+
+void TextureCache::release(unsigned int& texture)
+{
+	if (texture == 0)
+		return;
+
+	auto hash = _textureHashes.find(texture);
+	if (hash == _textureHashes.end())
+	{
+		TextureState::instance().release(texture);
+		return;
+	}
+
+	auto entry = _entries.find(*hash);
+	if (--entry->users == 0)
+	{
+		// the stamps of the files with this content go with it
+		for (auto file = _files.begin(); file != _files.end();)
+		{
+			if (file->contentHash == *hash)
+				file = _files.erase(file);
+			else
+				++file;
+		}
+		_entries.erase(entry);
+		_textureHashes.erase(hash);
+		TextureState::instance().release(texture);
+	}
+	texture = 0;
+}
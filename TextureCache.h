@@ -0,0 +1,60 @@
+#pragma once
+
+#include <QByteArray>
+#include <QDateTime>
+#include <QHash>
+#include <QImage>
+#include <QString>
+
+// Image textures shared by every mesh and viewer. Files are keyed by their canonical
+// path and a hash of their content, so a map applied to many meshes, or a file used
+// by several models, is decoded and uploaded once. Textures are reference counted
+// and deleted when the last user releases them. Viewers share their GL contexts, the
+// names returned are valid in all of them
+class TextureCache
+{
+public:
+	static TextureCache& instance();
+
+	// Texture of the image file with one reference taken for the caller, zero when
+	// the file cannot be read
+	unsigned int acquire(const QString& path);
+	// Same for an image decoded by the caller, already in GL format, keyed by the hash
+	// of its encoded content so that it is shared with the same image read from a file
+	unsigned int acquire(const QByteArray& contentHash, const QImage& glImage);
+	// White texture standing in for an image that failed to load, released like the others
+	unsigned int acquirePlaceholder();
+	// Take another reference on a texture returned by acquire
+	void retain(unsigned int texture);
+	// Drop a reference and reset the name. Textures not created by the cache are deleted
+	void release(unsigned int& texture);
+
+	unsigned int textureCount() const { return _entries.size(); }
+	unsigned int hitCount() const { return _hitCount; }
+	unsigned int missCount() const { return _missCount; }
+
+private:
+	TextureCache();
+
+private:
+	struct Entry
+	{
+		unsigned int texture = 0;
+		unsigned int users = 0;
+	};
+
+	// last seen state of a file, so an unchanged file is not read again to be hashed
+	struct FileStamp
+	{
+		qint64 size = 0;
+		QDateTime modified;
+		QByteArray contentHash;
+	};
+
+	QHash<QByteArray, Entry> _entries;
+	QHash<unsigned int, QByteArray> _textureHashes;
+	QHash<QString, FileStamp> _files;
+
+	unsigned int _hitCount;
+	unsigned int _missCount;
+};
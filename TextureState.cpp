@@ -0,0 +1,200 @@
+#include "TextureState.h"
+
+#include <QApplication>
+#include <algorithm>
+#include <cmath>
+#include <iterator>
+
+namespace
+{
+	// no texture name is ever zero-initialized to this, a unit holding it is always rebound
+	const unsigned int UNKNOWN_BINDING = 0xFFFFFFFF;
+}
+
+TextureState& TextureState::instance()
+{
+	static TextureState state;
+	return state;
+}
+
+TextureState::TextureState() :
+	_lastContext(nullptr),
+	_lastContextState(nullptr),
+	_frameUploadBytes(0),
+	_frameBindCount(0),
+	_frameSkippedBindCount(0)
+{
+}
+
+TextureState::ContextState* TextureState::current()
+{
+	QOpenGLContext* context = QOpenGLContext::currentContext();
+	if (!context)
+		return nullptr;
+	if (context == _lastContext && _lastContextState)
+		return _lastContextState;
+
+	auto it = _contexts.find(context);
+	if (it == _contexts.end())
+	{
+		it = _contexts.emplace(context, ContextState()).first;
+		it->second.gl = context->versionFunctions<QOpenGLFunctions_4_5_Core>();
+		it->second.gl->initializeOpenGLFunctions();
+		std::fill(std::begin(it->second.boundTextures), std::end(it->second.boundTextures), UNKNOWN_BINDING);
+		// function pointers and bindings die with the context, a new one at the same address starts over
+		QObject::connect(context, &QOpenGLContext::aboutToBeDestroyed, [this, context]() {
+			_contexts.erase(context);
+			if (_lastContext == context)
+			{
+				_lastContext = nullptr;
+				_lastContextState = nullptr;
+			}
+		});
+
+		// texture names live as long as the share group
+		QOpenGLContextGroup* group = context->shareGroup();
+		if (_shareGroups.find(group) == _shareGroups.end())
+		{
+			_shareGroups.emplace(group, ShareGroupState());
+			QObject::connect(group, &QObject::destroyed, [this, group]() { _shareGroups.erase(group); });
+		}
+	}
+	_lastContext = context;
+	_lastContextState = &it->second;
+	return &it->second;
+}
+
+TextureState::ShareGroupState* TextureState::currentShareGroup()
+{
+	if (!current())
+		return nullptr;
+	return &_shareGroups[QOpenGLContext::currentContext()->shareGroup()];
+}
+
+void TextureState::beginFrame()
+{
+	invalidate();
+	_frameUploadBytes = 0;
+	_frameBindCount = 0;
+	_frameSkippedBindCount = 0;
+}
+
+void TextureState::invalidate()
+{
+	for (auto& context : _contexts)
+		std::fill(std::begin(context.second.boundTextures), std::end(context.second.boundTextures), UNKNOWN_BINDING);
+}
+
+void TextureState::bind(unsigned int unit, unsigned int texture)
+{
+	ContextState* context = current();
+	if (!context)
+		return;
+	if (unit < MAX_TRACKED_UNITS)
+	{
+		if (context->boundTextures[unit] == texture)
+		{
+			_frameSkippedBindCount++;
+			return;
+		}
+		context->boundTextures[unit] = texture;
+	}
+	// leaves the active texture unit alone, code binding through glActiveTexture is not disturbed
+	context->gl->glBindTextureUnit(unit, texture);
+	_frameBindCount++;
+}
+
+void TextureState::upload(unsigned int& texture, const QImage& image)
+{
+	ContextState* context = current();
+	if (image.isNull() || !context)
+		return;
+	QOpenGLFunctions_4_5_Core* gl = context->gl;
+	std::map<unsigned int, Storage>& storage = currentShareGroup()->storage;
+
+	// mesh images are normally converted with glFormat already
+	QImage rgba = image.format() == QImage::Format_RGBA8888 ? image : glFormat(image);
+	auto it = texture ? storage.find(texture) : storage.end();
+	if (it != storage.end() && it->second.imageKey == image.cacheKey())
+		return;
+
+	if (it == storage.end() || it->second.width != rgba.width() || it->second.height != rgba.height())
+	{
+		// immutable storage cannot be resized, a new texture name takes the place of the old one
+		release(texture);
+		gl->glCreateTextures(GL_TEXTURE_2D, 1, &texture);
+		int levels = static_cast<int>(std::floor(std::log2(std::max(rgba.width(), rgba.height())))) + 1;
+		gl->glTextureStorage2D(texture, levels, GL_RGBA8, rgba.width(), rgba.height());
+		gl->glTextureParameteri(texture, GL_TEXTURE_WRAP_S, GL_REPEAT);
+		gl->glTextureParameteri(texture, GL_TEXTURE_WRAP_T, GL_REPEAT);
+		gl->glTextureParameteri(texture, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+		gl->glTextureParameteri(texture, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+		it = storage.emplace(texture, Storage()).first;
+		it->second.width = rgba.width();
+		it->second.height = rgba.height();
+	}
+
+	gl->glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+	gl->glTextureSubImage2D(texture, 0, 0, 0, rgba.width(), rgba.height(), GL_RGBA, GL_UNSIGNED_BYTE, rgba.constBits());
+	gl->glGenerateTextureMipmap(texture);
+	it->second.imageKey = image.cacheKey();
+	_frameUploadBytes += static_cast<unsigned long long>(rgba.sizeInBytes());
+}
+
+QImage TextureState::glFormat(const QImage& image)
+{
+	return image.convertToFormat(QImage::Format_RGBA8888).mirrored();
+}
+
+void TextureState::release(unsigned int& texture)
+{
+	if (texture == 0)
+		return;
+	ContextState* context = current();
+	if (!context)
+	{
+		// the name went with its share group
+		texture = 0;
+		return;
+	}
+	context->gl->glDeleteTextures(1, &texture);
+	currentShareGroup()->storage.erase(texture);
+	// a deleted texture is unbound from every unit of the contexts sharing it, the name may be handed out again
+	for (auto& context : _contexts)
+	{
+		for (unsigned int& bound : context.second.boundTextures)
+		{
+			if (bound == texture)
+				bound = UNKNOWN_BINDING;
+		}
+	}
+	texture = 0;
+}
+
+unsigned int TextureState::acquireDefaultTexture()
+{
+	// without shared contexts every window needs a texture of its own
+	ShareGroupState* group = currentShareGroup();
+	if (!group)
+		return 0;
+	if (group->defaultTextureUsers++ == 0)
+	{
+		QImage image;
+		QString path = QApplication::applicationDirPath() + "/";
+		if (!image.load(path + "textures/opengllogo.png"))
+		{
+			qWarning("Could not read image file, using single-color instead.");
+			image = QImage(128, 128, QImage::Format_RGB32);
+			image.fill(Qt::white);
+		}
+		upload(group->defaultTexture, glFormat(image));
+	}
+	return group->defaultTexture;
+}
+
+void TextureState::releaseDefaultTexture()
+{
+	ShareGroupState* group = currentShareGroup();
+	if (group && group->defaultTextureUsers > 0 && --group->defaultTextureUsers == 0)
+		release(group->defaultTexture);
+}
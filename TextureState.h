@@ -0,0 +1,83 @@
+#pragma once
+
+#include <QOpenGLFunctions_4_5_Core>
+#include <QOpenGLContext>
+#include <QImage>
+#include <map>
+
+// Shared record of the 2D textures bound to each texture unit, so meshes drawn one
+// after another only rebind the units that hold a different texture. Mesh images
+// are uploaded once into immutable storage and again only when the image changes.
+// Binds and uploaded bytes are counted per frame. Every call works on the current
+// context: bindings are kept per context and storage per share group, both dropped
+// when the context or group is destroyed
+class TextureState
+{
+public:
+	static TextureState& instance();
+
+	// Forget the cached bindings and reset the frame counters. Other code binds
+	// textures directly, so this is called at the start of every frame
+	void beginFrame();
+	void invalidate();
+
+	void bind(unsigned int unit, unsigned int texture);
+
+	// Upload the image with a full mip chain. Storage is reallocated (and the texture
+	// name replaced) only when the size changes, nothing is uploaded when the image
+	// is the one already in the texture. Images not in the glFormat layout are converted
+	void upload(unsigned int& texture, const QImage& image);
+	// Flipped RGBA8888, the layout upload takes without a conversion. Needs no context,
+	// so loaders convert on their own thread
+	static QImage glFormat(const QImage& image);
+	// Delete a texture created by upload
+	void release(unsigned int& texture);
+
+	// Texture for meshes without an image of their own, one per share group. It is
+	// loaded on the first acquire and deleted when the last user releases it
+	unsigned int acquireDefaultTexture();
+	void releaseDefaultTexture();
+
+	unsigned long long frameUploadBytes() const { return _frameUploadBytes; }
+	unsigned int frameBindCount() const { return _frameBindCount; }
+	unsigned int frameSkippedBindCount() const { return _frameSkippedBindCount; }
+
+private:
+	static const unsigned int MAX_TRACKED_UNITS = 80;
+
+	struct Storage
+	{
+		int width = 0;
+		int height = 0;
+		qint64 imageKey = 0;
+	};
+
+	struct ContextState
+	{
+		QOpenGLFunctions_4_5_Core* gl = nullptr;
+		unsigned int boundTextures[MAX_TRACKED_UNITS];
+	};
+
+	struct ShareGroupState
+	{
+		std::map<unsigned int, Storage> storage;
+		unsigned int defaultTexture = 0;
+		unsigned int defaultTextureUsers = 0;
+	};
+
+	TextureState();
+	// null without a current context, the calls then do nothing
+	ContextState* current();
+	ShareGroupState* currentShareGroup();
+
+private:
+	std::map<QOpenGLContext*, ContextState> _contexts;
+	std::map<QOpenGLContextGroup*, ShareGroupState> _shareGroups;
+	// the last looked up context, binds are made for every mesh
+	QOpenGLContext* _lastContext;
+	ContextState* _lastContextState;
+
+	unsigned long long _frameUploadBytes;
+	unsigned int _frameBindCount;
+	unsigned int _frameSkippedBindCount;
+};
@@ -1,13 +1,31 @@
 #include "TriangleMesh.h"
-#include "TriangleMollerTrumbore.h"
-#include "TriangleBaldwinWeber.h"
 #include "Point.h"
+#include "MeshOptimizer.h"
+#include "TextureState.h"
+#include "TextureCache.h"
 
 #include <algorithm>
 #include <iostream>
+#include <cstring>
+#include <cmath>
+#include <qfloat16.h>
+#include <QtConcurrent>
+
+bool TriangleMesh::_compactVertexFormat = true;
+bool TriangleMesh::_meshOptimization = true;
+bool TriangleMesh::_lodGeneration = true;
+
+// Smaller meshes are always drawn at full resolution
+const size_t LOD_MIN_TRIANGLES = 4096;
+const size_t LOD_MAX_LEVELS = 6;
+// Simplification stops beyond this error relative to the mesh size
+const float LOD_MAX_ERROR = 0.05f;
 
 TriangleMesh::TriangleMesh(QOpenGLShaderProgram* prog, const QString name) : Drawable(prog),
+_geometry(std::make_shared<Geometry>()),
+_ownsGeometry(true),
 _texture(0),
+_usesDefaultTexture(false),
 _diffuseADSMap(0),
 _specularADSMap(0),
 _emissiveADSMap(0),
@@ -38,51 +56,30 @@ _hasAOPBRMap(false),
 _hasHeightPBRMap(false),
 _heightPBRMapScale(0.05f),
 _hasOpacityPBRMap(false),
-_opacityPBRMapInverted(false)
+_opacityPBRMapInverted(false),
+_worldDataDirty(true),
+_boundsDirty(true),
+_boundsVersion(0),
+_hovered(false),
+_preparedOptimization(false),
+_lodLevel(0),
+_uniformBuffer(0),
+_meshBlockProgramId(0),
+_hasMeshBlock(false)
 {
 	setAutoIncrName(name);
-	_memorySize = 0;
 	_transX = _transY = _transZ = 0.0f;
 	_rotateX = _rotateY = _rotateZ = 0.0f;
 	_scaleX = _scaleY = _scaleZ = 1.0f;
 	_transformation.setToIdentity();
+}
 
-	_indexBuffer = QOpenGLBuffer(QOpenGLBuffer::IndexBuffer);
-	_positionBuffer = QOpenGLBuffer(QOpenGLBuffer::VertexBuffer);
-	_normalBuffer = QOpenGLBuffer(QOpenGLBuffer::VertexBuffer);
-	_texCoordBuffer = QOpenGLBuffer(QOpenGLBuffer::VertexBuffer);
-	_tangentBuf = QOpenGLBuffer(QOpenGLBuffer::VertexBuffer);
-	_bitangentBuf = QOpenGLBuffer(QOpenGLBuffer::VertexBuffer);
-
-	_indexBuffer.create();
-	_positionBuffer.create();
-	_normalBuffer.create();
-	_texCoordBuffer.create();
-	_tangentBuf.create();
-	_bitangentBuf.create();
-
-	_vertexArrayObject.create();
-
-    QString path = QApplication::applicationDirPath() + "/";
-    if (!_texBuffer.load(path + "textures/opengllogo.png"))
-	{ // Load first image from file
-		qWarning("Could not read image file, using single-color instead.");
-		QImage dummy(128, 128, static_cast<QImage::Format>(5));
-		dummy.fill(Qt::white);
-		_texBuffer = dummy;
+TriangleMesh::Geometry::~Geometry()
+{
+	for (QOpenGLBuffer& buff : buffers)
+	{
+		buff.destroy();
 	}
-	_texImage = QGLWidget::convertToGLFormat(_texBuffer); // flipped 32bit RGBA
-
-	glGenTextures(1, &_texture);
-	//std::cout << "TriangleMesh::TriangleMesh : _texture = " << _texture << std::endl;
-	glActiveTexture(GL_TEXTURE0);
-	glBindTexture(GL_TEXTURE_2D, _texture);
-
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
-	glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
 }
 
 void TriangleMesh::initBuffers(
@@ -97,292 +94,606 @@ void TriangleMesh::initBuffers(
 	if (indices == nullptr || points == nullptr || normals == nullptr)
 		return;
 
-	_indices = *indices;
-	_points = *points;
-	_trsfpoints = _points;
-	_normals = *normals;
-
-	// build the triangles for selection
-	buildTriangles();
+	detachGeometry();
+	_geometry->indices = *indices;
+	_geometry->points = *points;
+	_geometry->normals = *normals;
 
 	if (texCoords)
-		_texCoords = *texCoords;
+		_geometry->texCoords = *texCoords;
 	if (tangents)
-		_tangents = *tangents;
+		_geometry->tangents = *tangents;
 	if (bitangents)
-		_bitangents = *bitangents;
+		_geometry->bitangents = *bitangents;
 
-	_memorySize = 0;
-	_memorySize = (_points.size() + _normals.size() + _indices.size()) * sizeof(float);
+	uploadBuffers();
+}
 
-	_nVerts = (unsigned int)indices->size();
+void TriangleMesh::initBuffers(
+	std::vector<unsigned int>&& indices,
+	std::vector<float>&& points,
+	std::vector<float>&& normals,
+	std::vector<float>&& texCoords,
+	std::vector<float>&& tangents,
+	std::vector<float>&& bitangents)
+{
+	// the vectors become the members without a copy
+	detachGeometry();
+	_geometry->indices = std::move(indices);
+	_geometry->points = std::move(points);
+	_geometry->normals = std::move(normals);
+	_geometry->texCoords = std::move(texCoords);
+	_geometry->tangents = std::move(tangents);
+	_geometry->bitangents = std::move(bitangents);
 
-	_buffers.push_back(_indexBuffer);
-	_indexBuffer.bind();
-	_indexBuffer.setUsagePattern(QOpenGLBuffer::StaticDraw);
-	_indexBuffer.allocate(indices->data(), static_cast<int>(indices->size() * sizeof(unsigned int)));
+	uploadBuffers();
+}
 
-	_buffers.push_back(_positionBuffer);
-	_positionBuffer.bind();
-	_positionBuffer.setUsagePattern(QOpenGLBuffer::StaticDraw);
-	_positionBuffer.allocate(points->data(), static_cast<int>(points->size() * sizeof(float)));
+void TriangleMesh::uploadBuffers()
+{
+	_trsfpoints.clear();
+	_worldDataDirty = true;
+	_boundsDirty = true;
+	_boundsVersion++;
 
-	_buffers.push_back(_normalBuffer);
-	_normalBuffer.bind();
-	_normalBuffer.setUsagePattern(QOpenGLBuffer::StaticDraw);
-	_normalBuffer.allocate(normals->data(), static_cast<int>(normals->size() * sizeof(float)));
+	// the hierarchy is built on the first ray query
+	_geometry->bvh.clear();
 
-	if (_texCoords.size())
+	if (_preparedOptimization)
+	{
+		// reordered and measured on the loading thread
+		_preparedOptimization = false;
+	}
+	else
 	{
-		_buffers.push_back(_texCoordBuffer);
-		_texCoordBuffer.bind();
-		_texCoordBuffer.setUsagePattern(QOpenGLBuffer::StaticDraw);
-		_texCoordBuffer.allocate(_texCoords.data(), static_cast<int>(_texCoords.size() * sizeof(float)));
-		_memorySize += _texCoords.size() * sizeof(float);
+		_geometry->acmrBefore = _geometry->acmrAfter = MeshOptimizer::computeACMR(_geometry->indices, _geometry->points.size() / 3);
+		if (_meshOptimization)
+			optimizeMesh();
 	}
 
-	if (_tangents.size())
+	_geometry->memorySize = 0;
+
+	_geometry->nVerts = (unsigned int)_geometry->indices.size();
+
+	createBuffer(_geometry->indexBuffer);
+	_geometry->indexBuffer.bind();
+	_geometry->indexBuffer.setUsagePattern(QOpenGLBuffer::StaticDraw);
+	if (_geometry->points.size() / 3 < 65536)
+	{
+		// 16 bit indices are enough to address all the vertices
+		std::vector<unsigned short> shortIndices(_geometry->indices.begin(), _geometry->indices.end());
+		_geometry->indexBuffer.allocate(shortIndices.data(), static_cast<int>(shortIndices.size() * sizeof(unsigned short)));
+		_geometry->indexType = GL_UNSIGNED_SHORT;
+		_geometry->memorySize += shortIndices.size() * sizeof(unsigned short);
+	}
+	else
 	{
-		_buffers.push_back(_tangentBuf);
-		_tangentBuf.bind();
-		_tangentBuf.setUsagePattern(QOpenGLBuffer::StaticDraw);
-		_tangentBuf.allocate(_tangents.data(), static_cast<int>(_tangents.size() * sizeof(float)));
-		_memorySize += _tangents.size() * sizeof(float);
+		_geometry->indexBuffer.allocate(_geometry->indices.data(), static_cast<int>(_geometry->indices.size() * sizeof(unsigned int)));
+		_geometry->indexType = GL_UNSIGNED_INT;
+		_geometry->memorySize += _geometry->indices.size() * sizeof(unsigned int);
 	}
 
-	if (_bitangents.size())
+	_geometry->compactVertices = _compactVertexFormat;
+	if (_geometry->compactVertices)
+	{
+		uploadCompactVertices();
+	}
+	else
 	{
-		_buffers.push_back(_bitangentBuf);
-		_bitangentBuf.bind();
-		_bitangentBuf.setUsagePattern(QOpenGLBuffer::StaticDraw);
-		_bitangentBuf.allocate(_bitangents.data(), static_cast<int>(_bitangents.size() * sizeof(float)));
-		_memorySize += _bitangents.size() * sizeof(float);
+		_preparedVertices = CompactVertices();
+		createBuffer(_geometry->positionBuffer);
+		_geometry->positionBuffer.bind();
+		_geometry->positionBuffer.setUsagePattern(QOpenGLBuffer::StaticDraw);
+		_geometry->positionBuffer.allocate(_geometry->points.data(), static_cast<int>(_geometry->points.size() * sizeof(float)));
+		_geometry->memorySize += _geometry->points.size() * sizeof(float);
+
+		createBuffer(_geometry->normalBuffer);
+		_geometry->normalBuffer.bind();
+		_geometry->normalBuffer.setUsagePattern(QOpenGLBuffer::StaticDraw);
+		_geometry->normalBuffer.allocate(_geometry->normals.data(), static_cast<int>(_geometry->normals.size() * sizeof(float)));
+		_geometry->memorySize += _geometry->normals.size() * sizeof(float);
+
+		if (_geometry->texCoords.size())
+		{
+			createBuffer(_geometry->texCoordBuffer);
+			_geometry->texCoordBuffer.bind();
+			_geometry->texCoordBuffer.setUsagePattern(QOpenGLBuffer::StaticDraw);
+			_geometry->texCoordBuffer.allocate(_geometry->texCoords.data(), static_cast<int>(_geometry->texCoords.size() * sizeof(float)));
+			_geometry->memorySize += _geometry->texCoords.size() * sizeof(float);
+		}
+
+		if (_geometry->tangents.size())
+		{
+			createBuffer(_geometry->tangentBuf);
+			_geometry->tangentBuf.bind();
+			_geometry->tangentBuf.setUsagePattern(QOpenGLBuffer::StaticDraw);
+			_geometry->tangentBuf.allocate(_geometry->tangents.data(), static_cast<int>(_geometry->tangents.size() * sizeof(float)));
+			_geometry->memorySize += _geometry->tangents.size() * sizeof(float);
+		}
+
+		if (_geometry->bitangents.size())
+		{
+			createBuffer(_geometry->bitangentBuf);
+			_geometry->bitangentBuf.bind();
+			_geometry->bitangentBuf.setUsagePattern(QOpenGLBuffer::StaticDraw);
+			_geometry->bitangentBuf.allocate(_geometry->bitangents.data(), static_cast<int>(_geometry->bitangents.size() * sizeof(float)));
+			_geometry->memorySize += _geometry->bitangents.size() * sizeof(float);
+		}
 	}
 
+	if (!_vertexArrayObject.isCreated())
+		_vertexArrayObject.create();
 	_vertexArrayObject.bind();
 
-	_indexBuffer.bind();
+	_geometry->indexBuffer.bind();
 
-	// _position
-	_positionBuffer.bind();
-	//glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 0, 0);
-	//glEnableVertexAttribArray(0);  // Vertex position
-	_prog->enableAttributeArray("vertexPosition");
-	_prog->setAttributeBuffer("vertexPosition", GL_FLOAT, 0, 3);
+	setupAttributes();
 
-	// Normal
-	_normalBuffer.bind();
-	//glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, 0, 0);
-	//glEnableVertexAttribArray(1);  // Normal
-	_prog->enableAttributeArray("vertexNormal");
-	_prog->setAttributeBuffer("vertexNormal", GL_FLOAT, 0, 3);
+	_vertexArrayObject.release();
 
-	// Tex coords
-	if (_texCoords.size())
+	startLodGeneration();
+}
+
+void TriangleMesh::detachGeometry()
+{
+	// geometry drawn by other meshes as well is left to them
+	if (_geometry.use_count() > 1)
+		_geometry = std::make_shared<Geometry>();
+	_ownsGeometry = true;
+}
+
+void TriangleMesh::shareGeometry(const std::shared_ptr<Geometry>& geometry)
+{
+	_geometry = geometry;
+	_ownsGeometry = false;
+	_trsfpoints.clear();
+	_worldDataDirty = true;
+	_boundsDirty = true;
+	_boundsVersion++;
+	_lodLevel = 0;
+
+	if (!_vertexArrayObject.isCreated())
+		_vertexArrayObject.create();
+	_vertexArrayObject.bind();
+
+	_geometry->indexBuffer.bind();
+
+	setupAttributes();
+
+	_vertexArrayObject.release();
+}
+
+void TriangleMesh::createBuffer(QOpenGLBuffer& buffer)
+{
+	if (buffer.isCreated())
+		return;
+	buffer.create();
+	_geometry->buffers.push_back(buffer);
+}
+
+void TriangleMesh::optimizeMesh()
+{
+	optimizeGeometry(_geometry->indices, _geometry->points, _geometry->normals, _geometry->texCoords, _geometry->tangents, _geometry->bitangents);
+	_geometry->acmrAfter = MeshOptimizer::computeACMR(_geometry->indices, _geometry->points.size() / 3);
+}
+
+void TriangleMesh::optimizeGeometry(std::vector<unsigned int>& indices, std::vector<float>& points, std::vector<float>& normals,
+	std::vector<float>& texCoords, std::vector<float>& tangents, std::vector<float>& bitangents)
+{
+	const size_t vertexCount = points.size() / 3;
+	if (indices.size() < 3 || vertexCount == 0)
+		return;
+
+	MeshOptimizer::optimizeVertexCache(indices, vertexCount);
+	MeshOptimizer::optimizeOverdraw(indices, points, vertexCount);
+
+	// store the vertices in the order they are first referenced
+	std::vector<unsigned int> remap = MeshOptimizer::optimizeVertexFetch(indices, vertexCount);
+	MeshOptimizer::remapVertexAttribute(points, remap, 3);
+	MeshOptimizer::remapVertexAttribute(normals, remap, 3);
+	MeshOptimizer::remapVertexAttribute(texCoords, remap, 2);
+	MeshOptimizer::remapVertexAttribute(tangents, remap, 3);
+	MeshOptimizer::remapVertexAttribute(bitangents, remap, 3);
+}
+
+void TriangleMesh::startLodGeneration()
+{
+	_geometry->lodLevels.clear();
+	_geometry->lodLevels.push_back({ 0, _geometry->nVerts, 0.0f });
+	_lodLevel = 0;
+	// a chain still running for the previous geometry is discarded when it finishes
+	_geometry->lodPending = false;
+	if (!_lodGeneration || _geometry->indices.size() / 3 < LOD_MIN_TRIANGLES)
+		return;
+
+	_geometry->lodFuture = QtConcurrent::run(&TriangleMesh::buildLodChain, _geometry->indices, _geometry->points);
+	_geometry->lodPending = true;
+}
+
+TriangleMesh::LodChain TriangleMesh::buildLodChain(std::vector<unsigned int> indices, std::vector<float> points)
+{
+	LodChain chain;
+	const size_t vertexCount = points.size() / 3;
+	float error = 0.0f;
+	while (chain.levels.size() < LOD_MAX_LEVELS && indices.size() / 3 >= LOD_MIN_TRIANGLES / 2)
 	{
-		_texCoordBuffer.bind();
-		//glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, 0, 0);
-		//glEnableVertexAttribArray(2);  // Tex coord
-		_prog->enableAttributeArray("texCoord2d");
-		_prog->setAttributeBuffer("texCoord2d", GL_FLOAT, 0, 2);
+		float levelError = 0.0f;
+		std::vector<unsigned int> simplified = MeshOptimizer::simplify(indices, points, vertexCount,
+			indices.size() / 2, LOD_MAX_ERROR, &levelError);
+		// stop once borders and seams or the error bound keep the mesh from getting coarser
+		if (simplified.size() < 3 || simplified.size() > indices.size() * 3 / 4)
+			break;
+
+		// each level is simplified from the previous one, so the errors add up
+		error += levelError;
+		MeshOptimizer::optimizeVertexCache(simplified, vertexCount);
+		chain.levels.push_back({ static_cast<unsigned int>(chain.indices.size()), static_cast<unsigned int>(simplified.size()), error });
+		chain.indices.insert(chain.indices.end(), simplified.begin(), simplified.end());
+		indices.swap(simplified);
 	}
+	return chain;
+}
+
+void TriangleMesh::updateLodChain()
+{
+	if (!_geometry->lodPending || !_geometry->lodFuture.isFinished())
+		return;
+	_geometry->lodPending = false;
+
+	const LodChain chain = _geometry->lodFuture.result();
+	if (chain.levels.empty())
+		return;
 
-	if (_tangents.size())
+	for (LodLevel level : chain.levels)
 	{
-		_tangentBuf.bind();
-		//glVertexAttribPointer(3, 4, GL_FLOAT, GL_FALSE, 0, 0);
-		//glEnableVertexAttribArray(3);  // Tangents
-		_prog->enableAttributeArray("vertexTangent");
-		_prog->setAttributeBuffer("vertexTangent", GL_FLOAT, 0, 3);
+		level.indexOffset += _geometry->nVerts;
+		_geometry->lodLevels.push_back(level);
 	}
 
-	if (_bitangents.size())
+	// the levels go after the full resolution indices in the same buffer
+	std::vector<unsigned int> allIndices(_geometry->indices);
+	allIndices.insert(allIndices.end(), chain.indices.begin(), chain.indices.end());
+	_vertexArrayObject.bind();
+	_geometry->indexBuffer.bind();
+	if (_geometry->indexType == GL_UNSIGNED_SHORT)
 	{
-		_bitangentBuf.bind();
-		_prog->enableAttributeArray("vertexBitangent");
-		_prog->setAttributeBuffer("vertexBitangent", GL_FLOAT, 0, 3);
+		std::vector<unsigned short> shortIndices(allIndices.begin(), allIndices.end());
+		_geometry->indexBuffer.allocate(shortIndices.data(), static_cast<int>(shortIndices.size() * sizeof(unsigned short)));
+		_geometry->memorySize += chain.indices.size() * sizeof(unsigned short);
+	}
+	else
+	{
+		_geometry->indexBuffer.allocate(allIndices.data(), static_cast<int>(allIndices.size() * sizeof(unsigned int)));
+		_geometry->memorySize += chain.indices.size() * sizeof(unsigned int);
 	}
-
 	_vertexArrayObject.release();
 }
 
-void TriangleMesh::buildTriangles()
+unsigned int TriangleMesh::getLodIndexCount(int level) const
+{
+	if (level <= 0 || level >= static_cast<int>(_geometry->lodLevels.size()))
+		return _geometry->nVerts;
+	return _geometry->lodLevels[level].indexCount;
+}
+
+const void* TriangleMesh::getLodIndexPointer(int level) const
+{
+	if (level <= 0 || level >= static_cast<int>(_geometry->lodLevels.size()))
+		return nullptr;
+	size_t indexSize = _geometry->indexType == GL_UNSIGNED_SHORT ? sizeof(unsigned short) : sizeof(unsigned int);
+	return reinterpret_cast<const void*>(_geometry->lodLevels[level].indexOffset * indexSize);
+}
+
+int TriangleMesh::selectLodLevel(float radiusPixels, float maxPixelError) const
 {
-	if (_triangles.size())
+	// the errors grow with the level, take the last one that is still small enough
+	int level = 0;
+	for (int i = 1; i < static_cast<int>(_geometry->lodLevels.size()); i++)
 	{
-		for (Triangle* t : _triangles)
-			delete t;
-		_memorySize -= _triangles.size() * sizeof(Triangle);
-		_triangles.clear();
+		if (_geometry->lodLevels[i].error * radiusPixels <= maxPixelError)
+			level = i;
 	}
-	try {
-		size_t offset = 3; // each index points to 3 floats
-		for (size_t i = 0; i < _indices.size();)
+	return level;
+}
+
+// Signed normalized GL_INT_2_10_10_10_REV packing
+static quint32 packSnorm1010102(float x, float y, float z, float w)
+{
+	auto pack = [](float v, int bits)
+	{
+		int maxValue = (1 << (bits - 1)) - 1;
+		int c = qRound(qBound(-1.0f, v, 1.0f) * maxValue);
+		return static_cast<quint32>(c) & ((1u << bits) - 1);
+	};
+	return pack(x, 10) | (pack(y, 10) << 10) | (pack(z, 10) << 20) | (pack(w, 2) << 30);
+}
+
+void TriangleMesh::uploadCompactVertices()
+{
+	// imported meshes arrive packed from the loading thread
+	CompactVertices vertices;
+	if (!_preparedVertices.data.empty() && _preparedVertices.data.size() == _geometry->points.size() / 3 * _preparedVertices.stride)
+		vertices = std::move(_preparedVertices);
+	else
+		vertices = packCompactVertices(_geometry->points, _geometry->normals, _geometry->texCoords, _geometry->tangents, _geometry->bitangents);
+	_preparedVertices = CompactVertices();
+
+	_geometry->vertexStride = vertices.stride;
+	_geometry->normalOffset = vertices.normalOffset;
+	_geometry->tangentOffset = vertices.tangentOffset;
+	_geometry->texCoordOffset = vertices.texCoordOffset;
+	_geometry->texCoordType = vertices.texCoordType;
+
+	createBuffer(_geometry->interleavedBuffer);
+	_geometry->interleavedBuffer.bind();
+	_geometry->interleavedBuffer.setUsagePattern(QOpenGLBuffer::StaticDraw);
+	_geometry->interleavedBuffer.allocate(vertices.data.data(), static_cast<int>(vertices.data.size()));
+	_geometry->memorySize += vertices.data.size();
+}
+
+TriangleMesh::CompactVertices TriangleMesh::packCompactVertices(const std::vector<float>& points, const std::vector<float>& normals,
+	const std::vector<float>& texCoords, const std::vector<float>& tangents, const std::vector<float>& bitangents)
+{
+	// Interleaved layout: float position, 10_10_10_2 normal, 10_10_10_2 tangent with
+	// the bitangent sign in w, half float texture coordinates
+	const size_t vertexCount = points.size() / 3;
+	const bool hasTangents = tangents.size() >= 3 * vertexCount && vertexCount;
+	const bool hasBitangents = bitangents.size() >= 3 * vertexCount && vertexCount;
+	const bool hasTexCoords = texCoords.size() >= 2 * vertexCount && vertexCount;
+
+	// half floats lose texel precision beyond this range, heavily tiled
+	// texture coordinates are kept as floats
+	bool halfTexCoords = true;
+	for (float t : texCoords)
+	{
+		if (std::fabs(t) > 4.0f)
 		{
-			// Vertex 1
-			QVector3D v1(_trsfpoints.at(offset * _indices.at(i) + 0), // x coordinate
-				_trsfpoints.at(offset * _indices.at(i) + 1),          // y coordinate
-				_trsfpoints.at(offset * _indices.at(i) + 2));         // z coordinate
-			i++;
-
-			// Vertex 2
-			QVector3D v2(_trsfpoints.at(offset * _indices.at(i) + 0), // x coordinate
-				_trsfpoints.at(offset * _indices.at(i) + 1),          // y coordinate
-				_trsfpoints.at(offset * _indices.at(i) + 2));         // z coordinate
-			i++;
-
-			// Vertex 3
-			QVector3D v3(_trsfpoints[offset * _indices.at(i) + 0], // x coordinate
-				_trsfpoints.at(offset * _indices.at(i) + 1),          // y coordinate
-				_trsfpoints.at(offset * _indices.at(i) + 2));         // z coordinate
-			i++;
-
-			_triangles.push_back(new TriangleMollerTrumbore(v1, v2, v3, this));
+			halfTexCoords = false;
+			break;
 		}
-		_memorySize += _triangles.size() * sizeof(Triangle);
 	}
-	catch (const std::exception& ex) {
-		std::cout << "Exception raised in TriangleMesh::buildTriangles\n" << ex.what() << std::endl;
+
+	CompactVertices vertices;
+	vertices.stride = 3 * sizeof(float);
+	vertices.normalOffset = vertices.stride;
+	vertices.stride += sizeof(quint32);
+	if (hasTangents)
+	{
+		vertices.tangentOffset = vertices.stride;
+		vertices.stride += sizeof(quint32);
+	}
+	vertices.texCoordType = halfTexCoords ? GL_HALF_FLOAT : GL_FLOAT;
+	if (hasTexCoords)
+	{
+		vertices.texCoordOffset = vertices.stride;
+		vertices.stride += halfTexCoords ? 2 * sizeof(qfloat16) : 2 * sizeof(float);
+	}
+
+	vertices.data.resize(vertexCount * vertices.stride);
+	for (size_t v = 0; v < vertexCount; v++)
+	{
+		char* dst = vertices.data.data() + v * vertices.stride;
+		memcpy(dst, &points[3 * v], 3 * sizeof(float));
+
+		QVector3D normal(normals[3 * v], normals[3 * v + 1], normals[3 * v + 2]);
+		quint32 packedNormal = packSnorm1010102(normal.x(), normal.y(), normal.z(), 0.0f);
+		memcpy(dst + vertices.normalOffset, &packedNormal, sizeof(quint32));
+
+		if (hasTangents)
+		{
+			QVector3D tangent(tangents[3 * v], tangents[3 * v + 1], tangents[3 * v + 2]);
+			float handedness = 1.0f;
+			if (hasBitangents)
+			{
+				QVector3D bitangent(bitangents[3 * v], bitangents[3 * v + 1], bitangents[3 * v + 2]);
+				if (QVector3D::dotProduct(QVector3D::crossProduct(normal, tangent), bitangent) < 0.0f)
+					handedness = -1.0f;
+			}
+			quint32 packedTangent = packSnorm1010102(tangent.x(), tangent.y(), tangent.z(), handedness);
+			memcpy(dst + vertices.tangentOffset, &packedTangent, sizeof(quint32));
+		}
+
+		if (hasTexCoords)
+		{
+			if (halfTexCoords)
+			{
+				qfloat16 uv[2] = { qfloat16(texCoords[2 * v]), qfloat16(texCoords[2 * v + 1]) };
+				memcpy(dst + vertices.texCoordOffset, uv, sizeof(uv));
+			}
+			else
+			{
+				memcpy(dst + vertices.texCoordOffset, &texCoords[2 * v], 2 * sizeof(float));
+			}
+		}
 	}
+	return vertices;
 }
 
-void TriangleMesh::setProg(QOpenGLShaderProgram* prog)
+void TriangleMesh::setupAttributes()
 {
-	_prog = prog;
+	if (_geometry->compactVertices)
+	{
+		_geometry->interleavedBuffer.bind();
+		_prog->enableAttributeArray("vertexPosition");
+		_prog->setAttributeBuffer("vertexPosition", GL_FLOAT, 0, 3, _geometry->vertexStride);
 
-	_vertexArrayObject.bind();
+		// normalized signed integer attributes are decoded by the vertex fetch
+		_prog->enableAttributeArray("vertexNormal");
+		_prog->setAttributeBuffer("vertexNormal", GL_INT_2_10_10_10_REV, _geometry->normalOffset, 4, _geometry->vertexStride);
 
-	//_indexBuffer.bind();
+		if (_geometry->texCoordOffset)
+		{
+			_prog->enableAttributeArray("texCoord2d");
+			_prog->setAttributeBuffer("texCoord2d", _geometry->texCoordType, _geometry->texCoordOffset, 2, _geometry->vertexStride);
+		}
+
+		if (_geometry->tangentOffset)
+		{
+			_prog->enableAttributeArray("vertexTangent");
+			_prog->setAttributeBuffer("vertexTangent", GL_INT_2_10_10_10_REV, _geometry->tangentOffset, 4, _geometry->vertexStride);
+		}
+
+		// the bitangent is rebuilt in the shader from the normal and the signed tangent
+		_prog->disableAttributeArray("vertexBitangent");
+		return;
+	}
 
 	// _position
-	_positionBuffer.bind();
+	_geometry->positionBuffer.bind();
 	//glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 0, 0);
 	//glEnableVertexAttribArray(0);  // Vertex position
 	_prog->enableAttributeArray("vertexPosition");
 	_prog->setAttributeBuffer("vertexPosition", GL_FLOAT, 0, 3);
 
 	// Normal
-	_normalBuffer.bind();
+	_geometry->normalBuffer.bind();
 	//glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, 0, 0);
 	//glEnableVertexAttribArray(1);  // Normal
 	_prog->enableAttributeArray("vertexNormal");
 	_prog->setAttributeBuffer("vertexNormal", GL_FLOAT, 0, 3);
 
-	if (_texCoords.size())
+	// Tex coords
+	if (_geometry->texCoords.size())
 	{
-		_texCoordBuffer.bind();
+		_geometry->texCoordBuffer.bind();
 		//glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, 0, 0);
 		//glEnableVertexAttribArray(2);  // Tex coord
 		_prog->enableAttributeArray("texCoord2d");
 		_prog->setAttributeBuffer("texCoord2d", GL_FLOAT, 0, 2);
 	}
 
-	if (_tangents.size())
+	if (_geometry->tangents.size())
 	{
-		_tangentBuf.bind();
+		_geometry->tangentBuf.bind();
 		//glVertexAttribPointer(3, 4, GL_FLOAT, GL_FALSE, 0, 0);
 		//glEnableVertexAttribArray(3);  // Tangents
 		_prog->enableAttributeArray("vertexTangent");
 		_prog->setAttributeBuffer("vertexTangent", GL_FLOAT, 0, 3);
 	}
 
-	if (_bitangents.size())
+	if (_geometry->bitangents.size())
 	{
-		_bitangentBuf.bind();
+		_geometry->bitangentBuf.bind();
 		_prog->enableAttributeArray("vertexBitangent");
 		_prog->setAttributeBuffer("vertexBitangent", GL_FLOAT, 0, 3);
 	}
+}
+
+void TriangleMesh::setProg(QOpenGLShaderProgram* prog)
+{
+	if (prog != _prog)
+		_meshBlockProgramId = 0;
+	_prog = prog;
+	if (!_vertexArrayObject.isCreated())
+		return;
+
+	_vertexArrayObject.bind();
+
+	setupAttributes();
 
 	_vertexArrayObject.release();
 }
 
 void TriangleMesh::setupTextures()
 {
-	glActiveTexture(GL_TEXTURE0);
-	glBindTexture(GL_TEXTURE_2D, _texture);
-	glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, _texImage.width(), _texImage.height(), 0, GL_RGBA, GL_UNSIGNED_BYTE, _texImage.bits());
-	glGenerateMipmap(GL_TEXTURE_2D);
-
-	glActiveTexture(GL_TEXTURE10);
-	glBindTexture(GL_TEXTURE_2D, _diffuseADSMap);
-	glActiveTexture(GL_TEXTURE11);
-	glBindTexture(GL_TEXTURE_2D, _specularADSMap);
-	glActiveTexture(GL_TEXTURE12);
-	glBindTexture(GL_TEXTURE_2D, _emissiveADSMap);
-	glActiveTexture(GL_TEXTURE13);
-	glBindTexture(GL_TEXTURE_2D, _normalADSMap);
-	glActiveTexture(GL_TEXTURE14);
-	glBindTexture(GL_TEXTURE_2D, _heightADSMap);
-	glActiveTexture(GL_TEXTURE15);
-	glBindTexture(GL_TEXTURE_2D, _opacityADSMap);
-
-	glActiveTexture(GL_TEXTURE20);
-	glBindTexture(GL_TEXTURE_2D, _albedoPBRMap);
-	glActiveTexture(GL_TEXTURE21);
-	glBindTexture(GL_TEXTURE_2D, _normalPBRMap);
-	glActiveTexture(GL_TEXTURE22);
-	glBindTexture(GL_TEXTURE_2D, _metallicPBRMap);
-	glActiveTexture(GL_TEXTURE23);
-	glBindTexture(GL_TEXTURE_2D, _roughnessPBRMap);
-	glActiveTexture(GL_TEXTURE24);
-	glBindTexture(GL_TEXTURE_2D, _aoPBRMap);
-	glActiveTexture(GL_TEXTURE25);
-	glBindTexture(GL_TEXTURE_2D, _heightPBRMap);
-	glActiveTexture(GL_TEXTURE26);
-	glBindTexture(GL_TEXTURE_2D, _opacityPBRMap);
+	// units that already hold the same texture as for the previous mesh are skipped
+	TextureState& state = TextureState::instance();
+	if (_texture == 0)
+	{
+		_texture = state.acquireDefaultTexture();
+		_usesDefaultTexture = true;
+	}
+	state.bind(0, _texture);
+
+	state.bind(10, _diffuseADSMap);
+	state.bind(11, _specularADSMap);
+	state.bind(12, _emissiveADSMap);
+	state.bind(13, _normalADSMap);
+	state.bind(14, _heightADSMap);
+	state.bind(15, _opacityADSMap);
+
+	state.bind(20, _albedoPBRMap);
+	state.bind(21, _normalPBRMap);
+	state.bind(22, _metallicPBRMap);
+	state.bind(23, _roughnessPBRMap);
+	state.bind(24, _aoPBRMap);
+	state.bind(25, _heightPBRMap);
+	state.bind(26, _opacityPBRMap);
 }
 
 void TriangleMesh::setupUniforms()
 {
 	_prog->bind();
-	_prog->setUniformValue("texEnabled", _hasTexture);
-	_prog->setUniformValue("texUnit", 0);
-	_prog->setUniformValue("material.ambient", _material.ambient());
-	_prog->setUniformValue("material.diffuse", _material.diffuse());
-	_prog->setUniformValue("material.specular", _material.specular());
-	_prog->setUniformValue("material.emission", _material.emissive());
-	_prog->setUniformValue("material.shininess", _material.shininess());
-	_prog->setUniformValue("material.metallic", _material.metallic());
-	_prog->setUniformValue("opacity", _material.opacity());
-	// ADS light texture maps
-	_prog->setUniformValue("hasDiffuseTexture", _hasDiffuseADSMap);
-	_prog->setUniformValue("hasSpecularTexture", _hasSpecularADSMap);
-	_prog->setUniformValue("hasEmissiveTexture", _hasEmissiveADSMap);
-	_prog->setUniformValue("hasNormalTexture", _hasNormalADSMap);
-	_prog->setUniformValue("hasHeightTexture", _hasHeightADSMap);
-	_prog->setUniformValue("hasOpacityTexture", _hasOpacityADSMap);
-	_prog->setUniformValue("opacityTextureInverted", _opacityADSMapInverted);
-
-	_prog->setUniformValue("texture_diffuse", 10);
-	_prog->setUniformValue("texture_specular", 11);
-	_prog->setUniformValue("texture_emissive", 12);
-	_prog->setUniformValue("texture_normal", 13);
-	_prog->setUniformValue("texture_height", 14);
-	_prog->setUniformValue("texture_opacity", 15);
+	if (_meshBlockProgramId != _prog->programId())
+	{
+		_meshBlockProgramId = _prog->programId();
+		_hasMeshBlock = glGetUniformBlockIndex(_meshBlockProgramId, "MeshBlock") != GL_INVALID_INDEX;
+	}
+	if (!_hasMeshBlock)
+	{
+		// the other programs drawing meshes only read the transformation and the selection
+		_prog->setUniformValue("meshMatrix", _transformation);
+		_prog->setUniformValue("selected", _selected);
+		return;
+	}
+
+	updateUniformBlock();
+	glBindBufferBase(GL_UNIFORM_BUFFER, MeshUniformBlock::BINDING, _uniformBuffer);
+}
+
+void TriangleMesh::updateUniformBlock()
+{
+	MeshUniformBlock block;
+	memset(&block, 0, sizeof(block));
+	storeStd140(block.meshMatrix, _transformation);
+	storeStd140(block.meshNormalMatrix, _transformation.normalMatrix());
+	storeStd140(block.emission, _material.emissive());
+	storeStd140(block.ambient, _material.ambient());
+	storeStd140(block.diffuse, _material.diffuse());
+	storeStd140(block.specular, _material.specular());
+	block.shininess = _material.shininess();
+	block.metallic = _material.metallic();
 	// PBR Direct Lighting
-	_prog->setUniformValue("pbrLighting.albedo", _material.albedoColor());
-	_prog->setUniformValue("pbrLighting.metallic", _material.metalness());
-	_prog->setUniformValue("pbrLighting.roughness", _material.roughness());
-	_prog->setUniformValue("pbrLighting.ambientOcclusion", 1.0f);
+	storeStd140(block.albedo, _material.albedoColor());
+	block.metalness = _material.metalness();
+	block.roughness = _material.roughness();
+	block.ambientOcclusion = 1.0f;
+	block.opacity = _material.opacity();
+	block.heightScale = _heightPBRMapScale;
+	block.compactVertexFormat = _geometry->compactVertices;
+	block.texEnabled = _hasTexture;
+	// ADS light texture maps
+	block.hasDiffuseTexture = _hasDiffuseADSMap;
+	block.hasSpecularTexture = _hasSpecularADSMap;
+	block.hasEmissiveTexture = _hasEmissiveADSMap;
+	block.hasNormalTexture = _hasNormalADSMap;
+	block.hasHeightTexture = _hasHeightADSMap;
+	block.hasOpacityTexture = _hasOpacityADSMap;
+	block.opacityTextureInverted = _opacityADSMapInverted;
 	// PBR Texture Maps
-	_prog->setUniformValue("albedoMap", 20);
-	_prog->setUniformValue("normalMap", 21);
-	_prog->setUniformValue("metallicMap", 22);
-	_prog->setUniformValue("roughnessMap", 23);
-	_prog->setUniformValue("aoMap", 24);
-	_prog->setUniformValue("heightMap", 25);
-	_prog->setUniformValue("opacityMap", 26);
-	_prog->setUniformValue("heightScale", _heightPBRMapScale);
-	_prog->setUniformValue("hasAlbedoMap", _hasAlbedoPBRMap);
-	_prog->setUniformValue("hasMetallicMap", _hasMetallicPBRMap);
-	_prog->setUniformValue("hasRoughnessMap", _hasRoughnessPBRMap);
-	_prog->setUniformValue("hasNormalMap", _hasNormalPBRMap);
-	_prog->setUniformValue("hasAOMap", _hasAOPBRMap);
-	_prog->setUniformValue("hasOpacityMap", _hasOpacityPBRMap);
-	_prog->setUniformValue("opacityMapInverted", _opacityPBRMapInverted);
-	_prog->setUniformValue("hasHeightMap", _hasHeightPBRMap);
-
-	_prog->setUniformValue("selected", _selected);
+	block.hasAlbedoMap = _hasAlbedoPBRMap;
+	block.hasMetallicMap = _hasMetallicPBRMap;
+	block.hasRoughnessMap = _hasRoughnessPBRMap;
+	block.hasNormalMap = _hasNormalPBRMap;
+	block.hasAOMap = _hasAOPBRMap;
+	block.hasHeightMap = _hasHeightPBRMap;
+	block.hasOpacityMap = _hasOpacityPBRMap;
+	block.opacityMapInverted = _opacityPBRMapInverted;
+	block.selected = _selected;
+	block.hovered = _hovered;
+
+	if (_uniformBuffer == 0)
+	{
+		glCreateBuffers(1, &_uniformBuffer);
+		glNamedBufferData(_uniformBuffer, sizeof(block), &block, GL_DYNAMIC_DRAW);
+		_uniformBlock = block;
+	}
+	else if (memcmp(&block, &_uniformBlock, sizeof(block)) != 0)
+	{
+		// only after a material, flag or transformation change
+		glNamedBufferSubData(_uniformBuffer, 0, sizeof(block), &block);
+		_uniformBlock = block;
+	}
 }
 
 void TriangleMesh::enableOpacityADSMap(bool enable)
@@ -397,7 +708,7 @@ void TriangleMesh::invertOpacityADSMap(bool invert)
 
 void TriangleMesh::setOpacityADSMap(unsigned int opacityTex)
 {
-	glDeleteTextures(1, &_opacityADSMap);
+	TextureCache::instance().release(_opacityADSMap);
 	_opacityADSMap = opacityTex;
 	_hasOpacityADSMap = true;
 }
@@ -409,7 +720,7 @@ void TriangleMesh::enableHeightADSMap(bool enable)
 
 void TriangleMesh::setHeightADSMap(unsigned int heightTex)
 {
-	glDeleteTextures(1, &_heightADSMap);
+	TextureCache::instance().release(_heightADSMap);
 	_heightADSMap = heightTex;
 	_hasHeightADSMap = true;
 }
@@ -421,7 +732,7 @@ void TriangleMesh::enableNormalADSMap(bool enable)
 
 void TriangleMesh::setNormalADSMap(unsigned int normalTex)
 {
-	glDeleteTextures(1, &_normalADSMap);
+	TextureCache::instance().release(_normalADSMap);
 	_normalADSMap = normalTex;
 	_hasNormalADSMap = true;
 }
@@ -433,7 +744,7 @@ void TriangleMesh::enableSpecularADSMap(bool enable)
 
 void TriangleMesh::setSpecularADSMap(unsigned int specularTex)
 {
-	glDeleteTextures(1, &_specularADSMap);
+	TextureCache::instance().release(_specularADSMap);
 	_specularADSMap = specularTex;
 	_hasSpecularADSMap = true;
 }
@@ -445,7 +756,7 @@ void TriangleMesh::enableEmissiveADSMap(bool enable)
 
 void TriangleMesh::setEmissiveADSMap(unsigned int emissiveTex)
 {
-	glDeleteTextures(1, &_emissiveADSMap);
+	TextureCache::instance().release(_emissiveADSMap);
 	_emissiveADSMap = emissiveTex;
 	_hasEmissiveADSMap = true;
 }
@@ -457,59 +768,48 @@ void TriangleMesh::enableDiffuseADSMap(bool enable)
 
 void TriangleMesh::setDiffuseADSMap(unsigned int diffuseTex)
 {
-	glDeleteTextures(1, &_diffuseADSMap);
+	TextureCache::instance().release(_diffuseADSMap);
 	_diffuseADSMap = diffuseTex;
 	_hasDiffuseADSMap = true;
 }
 
 void TriangleMesh::clearDiffuseADSMap()
 {
-	glDeleteTextures(1, &_diffuseADSMap);
-	_diffuseADSMap = 0;
+	TextureCache::instance().release(_diffuseADSMap);
 }
 
 void TriangleMesh::clearSpecularADSMap()
 {
-	glDeleteTextures(1, &_specularADSMap);
-	_specularADSMap = 0;
+	TextureCache::instance().release(_specularADSMap);
 }
 
 void TriangleMesh::clearEmissiveADSMap()
 {
-	glDeleteTextures(1, &_emissiveADSMap);
-	_emissiveADSMap = 0;
+	TextureCache::instance().release(_emissiveADSMap);
 }
 
 void TriangleMesh::clearNormalADSMap()
 {
-	glDeleteTextures(1, &_normalADSMap);
-	_normalADSMap = 0;
+	TextureCache::instance().release(_normalADSMap);
 }
 
 void TriangleMesh::clearHeightADSMap()
 {
-	glDeleteTextures(1, &_heightADSMap);
-	_heightADSMap = 0;
+	TextureCache::instance().release(_heightADSMap);
 }
 
 void TriangleMesh::clearOpacityADSMap()
 {
-	glDeleteTextures(1, &_opacityADSMap);
-	_opacityADSMap = 0;
+	TextureCache::instance().release(_opacityADSMap);
 }
 
 void TriangleMesh::clearAllADSMaps()
 {
-	glDeleteTextures(1, &_diffuseADSMap);
-	_diffuseADSMap = 0;
-	glDeleteTextures(1, &_specularADSMap);
-	_specularADSMap = 0;
-	glDeleteTextures(1, &_emissiveADSMap);
-	_emissiveADSMap = 0;
-	glDeleteTextures(1, &_normalADSMap);
-	_normalADSMap = 0;
-	glDeleteTextures(1, &_heightADSMap);
-	_heightADSMap = 0;
+	TextureCache::instance().release(_diffuseADSMap);
+	TextureCache::instance().release(_specularADSMap);
+	TextureCache::instance().release(_emissiveADSMap);
+	TextureCache::instance().release(_normalADSMap);
+	TextureCache::instance().release(_heightADSMap);
 }
 
 GLMaterial TriangleMesh::getMaterial() const
@@ -543,11 +843,8 @@ void TriangleMesh::render()
 		glDisable(GL_BLEND);
 	}
 
-	// Handle lighting normal for negative scaling
-	if ((_scaleX < 0 && _scaleY > 0 && _scaleZ > 0) ||
-		(_scaleX > 0 && _scaleY < 0 && _scaleZ > 0) ||
-		(_scaleX > 0 && _scaleY > 0 && _scaleZ < 0) ||
-		(_scaleX < 0 && _scaleY < 0 && _scaleZ < 0))
+	// Handle lighting normal for mirroring transformations
+	if (_transformation.determinant() < 0.0)
 	{
 		glFrontFace(GL_CW);
 	}
@@ -556,11 +853,10 @@ void TriangleMesh::render()
 		glFrontFace(GL_CCW);
 	}
 	_vertexArrayObject.bind();
-	glDrawElements(GL_TRIANGLES, _nVerts, GL_UNSIGNED_INT, 0);
+	glDrawElements(GL_TRIANGLES, getLodIndexCount(_lodLevel), _geometry->indexType, getLodIndexPointer(_lodLevel));
 	_vertexArrayObject.release();
 	_prog->release();
 
-	glBindTexture(GL_TEXTURE_2D, 0);
 	glDisable(GL_BLEND);
 }
 
@@ -568,62 +864,66 @@ void TriangleMesh::deleteTextures()
 {
 	//std::cout << "TriangleMesh::deleteTextures : _texture = " << _texture << std::endl;
 
-	glDeleteTextures(1, &_texture);
-	glDeleteTextures(1, &_diffuseADSMap);
-	glDeleteTextures(1, &_specularADSMap);
-	glDeleteTextures(1, &_emissiveADSMap);
-	glDeleteTextures(1, &_normalADSMap);
-	glDeleteTextures(1, &_heightADSMap);
-	glDeleteTextures(1, &_opacityADSMap);
-	glDeleteTextures(1, &_albedoPBRMap);
-	glDeleteTextures(1, &_metallicPBRMap);
-	glDeleteTextures(1, &_roughnessPBRMap);
-	glDeleteTextures(1, &_normalPBRMap);
-	glDeleteTextures(1, &_aoPBRMap);
-	glDeleteTextures(1, &_heightPBRMap);
-	glDeleteTextures(1, &_opacityPBRMap);
+	if (!_usesDefaultTexture)
+		TextureState::instance().release(_texture);
+	TextureCache::instance().release(_diffuseADSMap);
+	TextureCache::instance().release(_specularADSMap);
+	TextureCache::instance().release(_emissiveADSMap);
+	TextureCache::instance().release(_normalADSMap);
+	TextureCache::instance().release(_heightADSMap);
+	TextureCache::instance().release(_opacityADSMap);
+	TextureCache::instance().release(_albedoPBRMap);
+	TextureCache::instance().release(_metallicPBRMap);
+	TextureCache::instance().release(_roughnessPBRMap);
+	TextureCache::instance().release(_normalPBRMap);
+	TextureCache::instance().release(_aoPBRMap);
+	TextureCache::instance().release(_heightPBRMap);
+	TextureCache::instance().release(_opacityPBRMap);
 }
 
 TriangleMesh::~TriangleMesh()
 {
 	deleteBuffers();
-#ifdef Q_OS_WIN
-	deleteTextures(); // causes wrong texture deletion on Linux
-#endif
-	for (Triangle* t : _triangles)
-		delete t;
+	deleteTextures();
+	if (_usesDefaultTexture)
+		TextureState::instance().releaseDefaultTexture();
 }
 
 void TriangleMesh::deleteBuffers()
 {
-	if (_buffers.size() > 0)
-	{
-		for (QOpenGLBuffer& buff : _buffers)
-		{
-			buff.destroy();
-		}
-		_buffers.clear();
-	}
+	// the vertex buffers go with the last mesh drawing them
+	_geometry.reset();
 
 	if (_vertexArrayObject.isCreated())
 	{
 		_vertexArrayObject.destroy();
 	}
+
+	glDeleteBuffers(1, &_uniformBuffer);
+	_uniformBuffer = 0;
 }
 
-void TriangleMesh::computeBounds()
+void TriangleMesh::computeBounds() const
 {
-	// Ritter's algorithm
-	std::vector<QVector3D> aPoints;
-	for (size_t i = 0; i < _trsfpoints.size(); i += 3)
+	_boundsDirty = false;
+	if (_geometry->points.size() < 3)
+		return;
+
+	// world space points are transformed on the fly instead of keeping a copy of the mesh
+	const bool identity = _transformation.isIdentity();
+	auto worldPoint = [&](size_t i)
 	{
-		aPoints.push_back(QVector3D(_trsfpoints[i], _trsfpoints[i + 1], _trsfpoints[i + 2]));
-	}
+		QVector3D p(_geometry->points[i], _geometry->points[i + 1], _geometry->points[i + 2]);
+		return identity ? p : _transformation.map(p);
+	};
+
+	// Ritter's algorithm
 	QVector3D xmin, xmax, ymin, ymax, zmin, zmax;
 	xmin = ymin = zmin = QVector3D(1, 1, 1) * INFINITY;
 	xmax = ymax = zmax = QVector3D(1, 1, 1) * -INFINITY;
-	for (auto p : aPoints)
+	for (size_t i = 0; i < _geometry->points.size(); i += 3)
 	{
+		QVector3D p = worldPoint(i);
 		if (p.x() < xmin.x())
 			xmin = p;
 		if (p.x() > xmax.x())
@@ -657,8 +957,9 @@ void TriangleMesh::computeBounds()
 	auto center = (dia1 + dia2) * 0.5f;
 	auto sqRad = (dia2 - center).lengthSquared();
 	auto radius = sqrt(sqRad);
-	for (auto p : aPoints)
+	for (size_t i = 0; i < _geometry->points.size(); i += 3)
 	{
+		QVector3D p = worldPoint(i);
 		float d = (p - center).lengthSquared();
 		if (d > sqRad)
 		{
@@ -673,54 +974,82 @@ void TriangleMesh::computeBounds()
 	_boundingSphere.setCenter(center);
 	_boundingSphere.setRadius(radius);
 
-	QList<float> xVals, yVals, zVals;
-	for (size_t i = 0; i < _trsfpoints.size(); i += 3)
+	// the extreme points along each axis give the box limits
+	_boundingBox.setLimits(xmin.x(), xmax.x(),
+		ymin.y(), ymax.y(),
+		zmin.z(), zmax.z());
+}
+
+void TriangleMesh::updateWorldData() const
+{
+	if (!_worldDataDirty)
+		return;
+
+	_trsfpoints.resize(_geometry->points.size());
+	if (_transformation.isIdentity())
 	{
-		xVals.push_back(_trsfpoints.at(i));
-		yVals.push_back(_trsfpoints.at(i + 1));
-		zVals.push_back(_trsfpoints.at(i + 2));
+		std::copy(_geometry->points.begin(), _geometry->points.end(), _trsfpoints.begin());
 	}
-	std::sort(xVals.begin(), xVals.end(), std::less<float>());
-	std::sort(yVals.begin(), yVals.end(), std::less<float>());
-	std::sort(zVals.begin(), zVals.end(), std::less<float>());
-	_boundingBox.setLimits(xVals.first(), xVals.last(),
-		yVals.first(), yVals.last(),
-		zVals.first(), zVals.last());
-	Point cen = _boundingBox.center();
+	else
+	{
+		for (size_t i = 0; i < _geometry->points.size(); i += 3)
+		{
+			QVector3D tp = _transformation.map(QVector3D(_geometry->points[i + 0], _geometry->points[i + 1], _geometry->points[i + 2]));
+			_trsfpoints[i + 0] = tp.x();
+			_trsfpoints[i + 1] = tp.y();
+			_trsfpoints[i + 2] = tp.z();
+		}
+	}
+	_worldDataDirty = false;
+}
+
+BoundingSphere TriangleMesh::getBoundingSphere() const
+{
+	if (_boundsDirty)
+		computeBounds();
+	return _boundingSphere;
+}
+
+BoundingBox TriangleMesh::getBoundingBox() const
+{
+	if (_boundsDirty)
+		computeBounds();
+	return _boundingBox;
 }
 
 float TriangleMesh::getHighestXValue() const
 {
-	return _boundingBox.xMax();
+	return getBoundingBox().xMax();
 }
 
 float TriangleMesh::getLowestXValue() const
 {
-	return _boundingBox.xMin();
+	return getBoundingBox().xMin();
 }
 
 float TriangleMesh::getHighestYValue() const
 {
-	return _boundingBox.yMax();
+	return getBoundingBox().yMax();
 }
 
 float TriangleMesh::getLowestYValue() const
 {
-	return _boundingBox.yMin();
+	return getBoundingBox().yMin();
 }
 
 float TriangleMesh::getHighestZValue() const
 {
-	return _boundingBox.zMax();
+	return getBoundingBox().zMax();
 }
 
 float TriangleMesh::getLowestZValue() const
 {
-	return _boundingBox.zMin();
+	return getBoundingBox().zMin();
 }
 
 QRect TriangleMesh::projectedRect(const QMatrix4x4& modelView, const QMatrix4x4& projection, const QRect& viewport, const QRect& window) const
 {
+	updateWorldData();
 	QList<float> xVals;
 	QList<float> yVals;
 	for (size_t i = 0; i < _trsfpoints.size(); i += 3)
@@ -737,18 +1066,19 @@ QRect TriangleMesh::projectedRect(const QMatrix4x4& modelView, const QMatrix4x4&
 	return rect;
 }
 
-std::vector<float> TriangleMesh::getNormals() const
+const std::vector<float>& TriangleMesh::getNormals() const
 {
-	return _normals;
+	return _geometry->normals;
 }
 
-std::vector<float> TriangleMesh::getTexCoords() const
+const std::vector<float>& TriangleMesh::getTexCoords() const
 {
-	return _texCoords;
+	return _geometry->texCoords;
 }
 
-std::vector<float> TriangleMesh::getTrsfPoints() const
+const std::vector<float>& TriangleMesh::getTrsfPoints() const
 {
+	updateWorldData();
 	return _trsfpoints;
 }
 
@@ -758,36 +1088,20 @@ void TriangleMesh::resetTransformations()
 	_rotateX = _rotateY = _rotateZ = 0.0f;
 	_scaleX = _scaleY = _scaleZ = 1.0f;
 
-	_transformation.setToIdentity();
-
-	_trsfpoints.clear();
-	_trsfnormals.clear();
-
-	_trsfpoints = _points;
-	_trsfnormals = _normals;
-
-	_prog->bind();
-	_positionBuffer.bind();
-	_positionBuffer.allocate(_points.data(), static_cast<int>(_points.size() * sizeof(float)));
-	_prog->enableAttributeArray("vertexPosition");
-	_prog->setAttributeBuffer("vertexPosition", GL_FLOAT, 0, 3);
-
-	_normalBuffer.bind();
-	_normalBuffer.allocate(_normals.data(), static_cast<int>(_normals.size() * sizeof(float)));
-	_prog->enableAttributeArray("vertexNormal");
-	_prog->setAttributeBuffer("vertexNormal", GL_FLOAT, 0, 3);
+	_userTransformation.setToIdentity();
+	_transformation = _baseTransformation;
 
-	computeBounds();
+	setupTransformation();
 }
 
-std::vector<unsigned int> TriangleMesh::getIndices() const
+const std::vector<unsigned int>& TriangleMesh::getIndices() const
 {
-	return _indices;
+	return _geometry->indices;
 }
 
-std::vector<float> TriangleMesh::getPoints() const
+const std::vector<float>& TriangleMesh::getPoints() const
 {
-	return _points;
+	return _geometry->points;
 }
 
 QVector3D TriangleMesh::getTranslation() const
@@ -800,7 +1114,8 @@ void TriangleMesh::setTranslation(const QVector3D& trans)
 	_transX = trans.x() - _transX;
 	_transY = trans.y() - _transY;
 	_transZ = trans.z() - _transZ;
-	_transformation.translate(_transX, _transY, _transZ);
+	_userTransformation.translate(_transX, _transY, _transZ);
+	_transformation = _userTransformation * _baseTransformation;
 	setupTransformation();
 	_transX = trans.x();
 	_transY = trans.y();
@@ -817,9 +1132,10 @@ void TriangleMesh::setRotation(const QVector3D& rota)
 	_rotateX = rota.x() - _rotateX;
 	_rotateY = rota.y() - _rotateY;
 	_rotateZ = rota.z() - _rotateZ;
-	_transformation.rotate(_rotateX, QVector3D(1.0f, 0.0f, 0.0f));
-	_transformation.rotate(_rotateY, QVector3D(0.0f, 1.0f, 0.0f));
-	_transformation.rotate(_rotateZ, QVector3D(0.0f, 0.0f, 1.0f));
+	_userTransformation.rotate(_rotateX, QVector3D(1.0f, 0.0f, 0.0f));
+	_userTransformation.rotate(_rotateY, QVector3D(0.0f, 1.0f, 0.0f));
+	_userTransformation.rotate(_rotateZ, QVector3D(0.0f, 0.0f, 1.0f));
+	_transformation = _userTransformation * _baseTransformation;
 	setupTransformation();
 	_rotateX = rota.x();
 	_rotateY = rota.y();
@@ -836,7 +1152,8 @@ void TriangleMesh::setScaling(const QVector3D& scale)
 	_scaleX = scale.x() / _scaleX;
 	_scaleY = scale.y() / _scaleY;
 	_scaleZ = scale.z() / _scaleZ;
-	_transformation.scale(_scaleX, _scaleY, _scaleZ);
+	_userTransformation.scale(_scaleX, _scaleY, _scaleZ);
+	_transformation = _userTransformation * _baseTransformation;
 	setupTransformation();
 	_scaleX = scale.x();
 	_scaleY = scale.y();
@@ -848,53 +1165,31 @@ QMatrix4x4 TriangleMesh::getTransformation() const
 	return _transformation;
 }
 
-void TriangleMesh::setupTransformation()
+void TriangleMesh::setBaseTransformation(const QMatrix4x4& transformation)
 {
-	_prog->bind();
-	_trsfpoints.clear();
-	_trsfnormals.clear();
-
-	// transform points
-	for (size_t i = 0; i < _points.size(); i += 3)
-	{
-		QVector3D p(_points[i + 0], _points[i + 1], _points[i + 2]);
-		QVector3D tp = _transformation * p;
-		_trsfpoints.push_back(tp.x());
-		_trsfpoints.push_back(tp.y());
-		_trsfpoints.push_back(tp.z());
-	}
-	_positionBuffer.bind();
-	_positionBuffer.allocate(_trsfpoints.data(), static_cast<int>(_trsfpoints.size() * sizeof(float)));
-	_prog->enableAttributeArray("vertexPosition");
-	_prog->setAttributeBuffer("vertexPosition", GL_FLOAT, 0, 3);
-
-	// transform normals
-	for (size_t i = 0; i < _normals.size(); i += 3)
-	{
-		QVector3D n(_normals[i + 0], _normals[i + 1], _normals[i + 2]);
-		QMatrix4x4 rotMat = _transformation;
-		// use only the rotations
-		rotMat.setColumn(3, QVector4D(0, 0, 0, 1));
-		QVector3D tn = rotMat * n;
-		_trsfnormals.push_back(tn.x());
-		_trsfnormals.push_back(tn.y());
-		_trsfnormals.push_back(tn.z());
-	}
-	_normalBuffer.bind();
-	_normalBuffer.allocate(_trsfnormals.data(), static_cast<int>(_trsfnormals.size() * sizeof(float)));
-	_prog->enableAttributeArray("vertexNormal");
-	_prog->setAttributeBuffer("vertexNormal", GL_FLOAT, 0, 3);
+	_baseTransformation = transformation;
+	resetTransformations();
+}
 
-	buildTriangles();
-	computeBounds();
+void TriangleMesh::setupTransformation()
+{
+	// The transformation is applied by the shaders through the meshMatrix uniform,
+	// world space points and bounds are only derived when a query needs them
+	_worldDataDirty = true;
+	_boundsDirty = true;
+	_boundsVersion++;
 }
 
 void TriangleMesh::setTexureImage(const QImage& texImage)
 {
 	_texImage = texImage;
-	glActiveTexture(GL_TEXTURE0);
-	glBindTexture(GL_TEXTURE_2D, _texture);
-	glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, _texImage.width(), _texImage.height(), 0, GL_RGBA, GL_UNSIGNED_BYTE, _texImage.bits());
+	if (_usesDefaultTexture)
+	{
+		TextureState::instance().releaseDefaultTexture();
+		_texture = 0;
+		_usesDefaultTexture = false;
+	}
+	TextureState::instance().upload(_texture, _texImage);
 }
 
 bool TriangleMesh::hasTexture() const
@@ -902,6 +1197,15 @@ bool TriangleMesh::hasTexture() const
 	return _hasTexture;
 }
 
+bool TriangleMesh::hasTextureMaps() const
+{
+	return _hasTexture ||
+		_hasDiffuseADSMap || _hasSpecularADSMap || _hasEmissiveADSMap ||
+		_hasNormalADSMap || _hasHeightADSMap || _hasOpacityADSMap ||
+		_hasAlbedoPBRMap || _hasMetallicPBRMap || _hasRoughnessPBRMap ||
+		_hasNormalPBRMap || _hasAOPBRMap || _hasHeightPBRMap || _hasOpacityPBRMap;
+}
+
 void TriangleMesh::enableTexture(const bool& bHasTexture)
 {
 	_hasTexture = bHasTexture;
@@ -998,22 +1302,75 @@ QOpenGLVertexArrayObject& TriangleMesh::getVAO()
 	return _vertexArrayObject;
 }
 
+void TriangleMesh::setCompactVertexFormat(bool enable)
+{
+	_compactVertexFormat = enable;
+}
+
+bool TriangleMesh::compactVertexFormat()
+{
+	return _compactVertexFormat;
+}
+
+void TriangleMesh::setLodGeneration(bool enable)
+{
+	_lodGeneration = enable;
+}
+
+bool TriangleMesh::lodGeneration()
+{
+	return _lodGeneration;
+}
+
+void TriangleMesh::setMeshOptimization(bool enable)
+{
+	_meshOptimization = enable;
+}
+
+bool TriangleMesh::meshOptimization()
+{
+	return _meshOptimization;
+}
+
 unsigned long long TriangleMesh::memorySize() const
 {
-	return _memorySize + sizeof(TriangleMesh);
+	// a mesh drawing the geometry of another one only counts itself
+	if (!_ownsGeometry)
+		return sizeof(TriangleMesh);
+	return _geometry->memorySize + _geometry->bvh.memorySize() + sizeof(TriangleMesh);
 }
 
 bool TriangleMesh::intersectsWithRay(const QVector3D& rayPos, const QVector3D& rayDir, QVector3D& outIntersectionPoint)
+{
+	MeshBVH::Hit hit;
+	bool intersects = intersectsWithRay(rayPos, rayDir, hit);
+	if (intersects)
+		outIntersectionPoint = hit.point;
+	return intersects;
+}
+
+bool TriangleMesh::intersectsWithRay(const QVector3D& rayPos, const QVector3D& rayDir, MeshBVH::Hit& outHit)
 {
 	bool intersects = false;
-	if (_triangles.size())
+	try
 	{
-		for (Triangle* t : _triangles)
-		{
-			intersects = t->intersectsWithRay(rayPos, rayDir, outIntersectionPoint);
-			if (intersects)
-				break;
-		}
+		// The hierarchy is kept in object space, so the ray is brought into
+		// object space instead of refitting the tree after every transformation.
+		// The ray parameter is the same in both spaces for an affine transformation.
+		bool invertible = false;
+		QMatrix4x4 inverse = _transformation.inverted(&invertible);
+		if (!invertible)
+			return false;
+
+		if (!_geometry->bvh.isBuilt())
+			_geometry->bvh.build(_geometry->points, _geometry->indices);
+		intersects = _geometry->bvh.intersectsWithRay(inverse.map(rayPos), inverse.mapVector(rayDir), outHit);
+		if (intersects)
+			outHit.point = rayPos + rayDir * outHit.distance;
+	}
+	catch (const std::exception& ex)
+	{
+		std::cout << "Exception raised in TriangleMesh::intersectsWithRay\n" << ex.what() << std::endl;
 	}
 	return intersects;
 }
@@ -1090,37 +1447,37 @@ void TriangleMesh::enableOpacityPBRMap(bool hasOpacityMap)
 
 void TriangleMesh::setAlbedoPBRMap(unsigned int albedoMap)
 {
-	glDeleteTextures(1, &_albedoPBRMap);
+	TextureCache::instance().release(_albedoPBRMap);
 	_albedoPBRMap = albedoMap;
 }
 
 void TriangleMesh::setMetallicPBRMap(unsigned int metallicMap)
 {
-	glDeleteTextures(1, &_metallicPBRMap);
+	TextureCache::instance().release(_metallicPBRMap);
 	_metallicPBRMap = metallicMap;
 }
 
 void TriangleMesh::setRoughnessPBRMap(unsigned int roughnessMap)
 {
-	glDeleteTextures(1, &_roughnessPBRMap);
+	TextureCache::instance().release(_roughnessPBRMap);
 	_roughnessPBRMap = roughnessMap;
 }
 
 void TriangleMesh::setNormalPBRMap(unsigned int normalMap)
 {
-	glDeleteTextures(1, &_normalPBRMap);
+	TextureCache::instance().release(_normalPBRMap);
 	_normalPBRMap = normalMap;
 }
 
 void TriangleMesh::setAOPBRMap(unsigned int aoMap)
 {
-	glDeleteTextures(1, &_aoPBRMap);
+	TextureCache::instance().release(_aoPBRMap);
 	_aoPBRMap = aoMap;
 }
 
 void TriangleMesh::setHeightPBRMap(unsigned int heightMap)
 {
-	glDeleteTextures(1, &_heightPBRMap);
+	TextureCache::instance().release(_heightPBRMap);
 	_heightPBRMap = heightMap;
 }
 
@@ -1136,7 +1493,7 @@ void TriangleMesh::setHeightPBRMapScale(float heightScale)
 
 void TriangleMesh::setOpacityPBRMap(unsigned int opacityMap)
 {
-	glDeleteTextures(1, &_opacityPBRMap);
+	TextureCache::instance().release(_opacityPBRMap);
 	_opacityPBRMap = opacityMap;
 }
 
@@ -1147,58 +1504,45 @@ void TriangleMesh::invertOpacityPBRMap(bool invert)
 
 void TriangleMesh::clearAlbedoPBRMap()
 {
-	glDeleteTextures(1, &_albedoPBRMap);
-	_albedoPBRMap = 0;
+	TextureCache::instance().release(_albedoPBRMap);
 }
 
 void TriangleMesh::clearMetallicPBRMap()
 {
-	glDeleteTextures(1, &_metallicPBRMap);
-	_metallicPBRMap = 0;
+	TextureCache::instance().release(_metallicPBRMap);
 }
 
 void TriangleMesh::clearRoughnessPBRMap()
 {
-	glDeleteTextures(1, &_roughnessPBRMap);
-	_roughnessPBRMap = 0;
+	TextureCache::instance().release(_roughnessPBRMap);
 }
 
 void TriangleMesh::clearNormalPBRMap()
 {
-	glDeleteTextures(1, &_normalPBRMap);
-	_normalPBRMap = 0;
+	TextureCache::instance().release(_normalPBRMap);
 }
 
 void TriangleMesh::clearAOPBRMap()
 {
-	glDeleteTextures(1, &_aoPBRMap);
-	_aoPBRMap = 0;
+	TextureCache::instance().release(_aoPBRMap);
 }
 
 void TriangleMesh::clearHeightPBRMap()
 {
-	glDeleteTextures(1, &_heightPBRMap);
-	_heightPBRMap = 0;
+	TextureCache::instance().release(_heightPBRMap);
 }
 
 void TriangleMesh::clearOpacityPBRMap()
 {
-	glDeleteTextures(1, &_opacityPBRMap);
-	_opacityPBRMap = 0;
+	TextureCache::instance().release(_opacityPBRMap);
 }
 
 void TriangleMesh::clearAllPBRMaps()
 {
-	glDeleteTextures(1, &_albedoPBRMap);
-	_albedoPBRMap = 0;
-	glDeleteTextures(1, &_metallicPBRMap);
-	_metallicPBRMap = 0;
-	glDeleteTextures(1, &_roughnessPBRMap);
-	_roughnessPBRMap = 0;
-	glDeleteTextures(1, &_normalPBRMap);
-	_normalPBRMap = 0;
-	glDeleteTextures(1, &_aoPBRMap);
-	_aoPBRMap = 0;
-	glDeleteTextures(1, &_heightPBRMap);
-	_heightPBRMap = 0;
+	TextureCache::instance().release(_albedoPBRMap);
+	TextureCache::instance().release(_metallicPBRMap);
+	TextureCache::instance().release(_roughnessPBRMap);
+	TextureCache::instance().release(_normalPBRMap);
+	TextureCache::instance().release(_aoPBRMap);
+	TextureCache::instance().release(_heightPBRMap);
 }
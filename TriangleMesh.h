@@ -1,12 +1,14 @@
 #pragma once
 
 #include <vector>
+#include <memory>
+#include <QFuture>
 #include "Drawable.h"
 #include "BoundingSphere.h"
 #include "BoundingBox.h"
 #include "GLMaterial.h"
-
-class Triangle;
+#include "MeshBVH.h"
+#include "UniformBlocks.h"
 
 class TriangleMesh : public Drawable
 {
@@ -29,9 +31,14 @@ public:
 	{
 		_selected = false;
 	}
+	// highlighted while under the mouse cursor
+	void setHovered(bool hovered) { _hovered = hovered; }
+	bool isHovered() const { return _hovered; }
 
-	virtual BoundingSphere getBoundingSphere() const { return _boundingSphere; }
-	virtual BoundingBox getBoundingBox() const { return _boundingBox; }
+	virtual BoundingSphere getBoundingSphere() const;
+	virtual BoundingBox getBoundingBox() const;
+	// changes whenever the geometry or the transformation invalidate the bounds
+	unsigned int getBoundsVersion() const { return _boundsVersion; }
 
 	virtual QOpenGLVertexArrayObject& getVAO();
 	virtual QString getName() const
@@ -64,6 +71,8 @@ public:
 
 	bool hasTexture() const;
 	void enableTexture(const bool& bHasTexture);
+	// true when any texture or ADS / PBR map is sampled while rendering
+	bool hasTextureMaps() const;
 
 	void setTexureImage(const QImage& texImage);
 
@@ -89,16 +98,135 @@ public:
 	void setScaling(const QVector3D& scale);
 
 	QMatrix4x4 getTransformation() const;
-
-	std::vector<unsigned int> getIndices() const;
-	std::vector<float> getPoints() const;
-	std::vector<float> getNormals() const;
-	std::vector<float> getTexCoords() const;
-	std::vector<float> getTrsfPoints() const;
+	// Placement in the scene, kept by resetTransformations. The transformation components
+	// are applied after it, in world units
+	void setBaseTransformation(const QMatrix4x4& transformation);
+
+	// read-only views of the mesh data, valid until the mesh buffers are rebuilt
+	const std::vector<unsigned int>& getIndices() const;
+	const std::vector<float>& getPoints() const;
+	const std::vector<float>& getNormals() const;
+	const std::vector<float>& getTexCoords() const;
+	const std::vector<float>& getTrsfPoints() const;
+
+	// number of indices passed to glDrawElements
+	unsigned int getIndexCount() const { return _geometry->nVerts; }
+	// GL_UNSIGNED_SHORT for meshes with less than 65536 vertices
+	GLenum getIndexType() const { return _geometry->indexType; }
+
+	// Pack vertices of meshes built from now on into a single interleaved buffer
+	// with 10_10_10_2 normals and tangents and half float texture coordinates
+	static void setCompactVertexFormat(bool enable);
+	static bool compactVertexFormat();
+	// Vertices packed in the compact format and their layout, offsets are in bytes
+	struct CompactVertices
+	{
+		std::vector<char> data;
+		int stride = 0;
+		int normalOffset = 0;
+		int tangentOffset = 0;
+		int texCoordOffset = 0;
+		GLenum texCoordType = GL_FLOAT;
+	};
+	// Needs no context, so loaders can pack on their own thread
+	static CompactVertices packCompactVertices(const std::vector<float>& points, const std::vector<float>& normals,
+		const std::vector<float>& texCoords, const std::vector<float>& tangents, const std::vector<float>& bitangents);
+
+	// Reorder indices and vertices of meshes built from now on for the
+	// post-transform vertex cache, overdraw and vertex fetch
+	static void setMeshOptimization(bool enable);
+	static bool meshOptimization();
+	// Reorder indices and the per-vertex attributes, needs no context
+	static void optimizeGeometry(std::vector<unsigned int>& indices, std::vector<float>& points, std::vector<float>& normals,
+		std::vector<float>& texCoords, std::vector<float>& tangents, std::vector<float>& bitangents);
+	// Average cache miss ratio of the index list as given and as uploaded
+	float getACMRBefore() const { return _geometry->acmrBefore; }
+	float getACMRAfter() const { return _geometry->acmrAfter; }
+
+	// Build a chain of simplified index lists in the background for meshes built from now on
+	static void setLodGeneration(bool enable);
+	static bool lodGeneration();
+	// Upload the LOD chain once the background simplification has finished, needs a current context
+	void updateLodChain();
+	// Level 0 is the full mesh, coarser levels follow
+	int getLodCount() const { return _geometry->lodLevels.empty() ? 1 : static_cast<int>(_geometry->lodLevels.size()); }
+	unsigned int getLodIndexCount(int level) const;
+	// byte offset of the first index of the level, for glDrawElements
+	const void* getLodIndexPointer(int level) const;
+	// Coarsest level whose error stays below maxPixelError when the bounding sphere radius covers radiusPixels
+	int selectLodLevel(float radiusPixels, float maxPixelError) const;
+	// Level used by render()
+	void setLodLevel(int level) { _lodLevel = level; }
+	int lodLevel() const { return _lodLevel; }
 
 	void resetTransformations();
 
+	// Simplified levels share the vertex buffer, their indices are stored
+	// in the index buffer after the full resolution ones
+	struct LodLevel
+	{
+		unsigned int indexOffset;
+		unsigned int indexCount;
+		float error; // relative to half the bounding box diagonal
+	};
+	struct LodChain
+	{
+		std::vector<unsigned int> indices;
+		std::vector<LodLevel> levels;
+	};
+
+	// Object space geometry of a mesh with its GL buffers, vertex layout and LOD chain.
+	// Meshes placing the same geometry with their own transformation, such as the nodes
+	// of a glTF scene using one mesh, share it and only keep their vertex array object
+	struct Geometry
+	{
+		// the buffers are deleted with the last mesh using them, its context must be current
+		~Geometry();
+
+		std::vector<unsigned int> indices;
+		std::vector<float> points;
+		std::vector<float> normals;
+		std::vector<float> tangents;
+		std::vector<float> bitangents;
+		std::vector<float> texCoords;
+
+		// ray picking structure in object space, built on the first ray query
+		MeshBVH bvh;
+
+		QOpenGLBuffer indexBuffer = QOpenGLBuffer(QOpenGLBuffer::IndexBuffer);
+		QOpenGLBuffer positionBuffer;
+		QOpenGLBuffer normalBuffer;
+		QOpenGLBuffer texCoordBuffer;
+		QOpenGLBuffer tangentBuf;
+		QOpenGLBuffer bitangentBuf;
+		QOpenGLBuffer interleavedBuffer;
+		// Vertex buffers
+		std::vector<QOpenGLBuffer> buffers;
+
+		unsigned int nVerts = 0;     // Number of indices to draw
+		unsigned long long memorySize = 0;
+
+		// Interleaved vertex layout, offsets are in bytes
+		bool compactVertices = false;
+		int vertexStride = 0;
+		int normalOffset = 0;
+		int tangentOffset = 0;
+		int texCoordOffset = 0;
+		GLenum texCoordType = GL_FLOAT;
+		GLenum indexType = GL_UNSIGNED_INT;
+
+		float acmrBefore = 0.0f;
+		float acmrAfter = 0.0f;
+
+		std::vector<LodLevel> lodLevels;
+		QFuture<LodChain> lodFuture;
+		bool lodPending = false;
+	};
+	std::shared_ptr<Geometry> getGeometry() const { return _geometry; }
+
 	virtual bool intersectsWithRay(const QVector3D& rayPos, const QVector3D& rayDir, QVector3D& outIntersectionPoint);
+	// Closest hit along the ray, with triangle index and barycentrics
+	virtual bool intersectsWithRay(const QVector3D& rayPos, const QVector3D& rayDir, MeshBVH::Hit& outHit);
 
 	void setAlbedoPBRMap(unsigned int albedoMap);
 	void setNormalPBRMap(unsigned int normalMap);
@@ -178,10 +306,30 @@ protected: // methods
 		std::vector<float>* tangents = nullptr,
 		std::vector<float>* bitangents = nullptr
 	);
-
-	void buildTriangles();
-    void computeBounds();
+	// Same as above, taking over the vectors instead of copying them
+	void initBuffers(
+		std::vector<unsigned int>&& indices,
+		std::vector<float>&& points,
+		std::vector<float>&& normals,
+		std::vector<float>&& texCoords,
+		std::vector<float>&& tangents,
+		std::vector<float>&& bitangents
+	);
+	void uploadBuffers();
+	// Give up geometry shared with other meshes before it is replaced
+	void detachGeometry();
+	// Draw the geometry of another mesh, only the vertex array object is created
+	void shareGeometry(const std::shared_ptr<Geometry>& geometry);
+
+    void computeBounds() const;
+    void updateWorldData() const;
     void deleteBuffers();
+	void createBuffer(QOpenGLBuffer& buffer);
+	void uploadCompactVertices();
+	void setupAttributes();
+	void updateUniformBlock();
+	void optimizeMesh();
+	void startLodGeneration();
 
     virtual void setupTransformation();
 	virtual void setupTextures();
@@ -189,31 +337,24 @@ protected: // methods
 
 protected:
 
-	QOpenGLBuffer _indexBuffer;
-	QOpenGLBuffer _positionBuffer;
-	QOpenGLBuffer _normalBuffer;
-	QOpenGLBuffer _texCoordBuffer;
-	QOpenGLBuffer _tangentBuf;
-	QOpenGLBuffer _bitangentBuf;
-
 	QOpenGLBuffer _coordBuf;
 
-	unsigned int _nVerts;     // Number of vertices
+	std::shared_ptr<Geometry> _geometry;
+	// false when drawing the geometry of another mesh
+	bool _ownsGeometry;
 	QOpenGLVertexArrayObject _vertexArrayObject;        // The Vertex Array Object
 
-	// Vertex buffers
-	std::vector<QOpenGLBuffer> _buffers;
-
-	BoundingSphere _boundingSphere;
-	BoundingBox    _boundingBox;
-
-	std::vector<Triangle*> _triangles;
+	// world space bounds, computed on demand after a transformation
+	mutable BoundingSphere _boundingSphere;
+	mutable BoundingBox    _boundingBox;
 
 	GLMaterial _material;
 
-	QImage _texImage, _texBuffer;
+	// only set for meshes with an image of their own, the others share the default texture
+	QImage _texImage;
 	// ADS texture light maps
 	unsigned int _texture;
+	bool _usesDefaultTexture;
 	unsigned int _diffuseADSMap;
 	unsigned int _specularADSMap;
 	unsigned int _emissiveADSMap;
@@ -250,14 +391,12 @@ protected:
 	bool _hasOpacityPBRMap;
 	bool _opacityPBRMapInverted;
 
-	std::vector<unsigned int> _indices;
-	std::vector<float> _points;
-	std::vector<float> _normals;
-	std::vector<float> _tangents;
-	std::vector<float> _bitangents;
-	std::vector<float> _texCoords;
-	std::vector<float> _trsfpoints;
-	std::vector<float> _trsfnormals;
+	// world space points, derived from the geometry and _transformation on demand
+	mutable std::vector<float> _trsfpoints;
+	mutable bool _worldDataDirty;
+	mutable bool _boundsDirty;
+	unsigned int _boundsVersion;
+	bool _hovered;
 
 	// Individual transformation components
 	float _transX;
@@ -273,6 +412,27 @@ protected:
 	float _scaleZ;
 
 	QMatrix4x4 _transformation;
+	QMatrix4x4 _baseTransformation;
+	// the components composed, applied after the base placement
+	QMatrix4x4 _userTransformation;
+
+	// Set by subclasses whose geometry was optimized and packed by the loader before
+	// the buffers are built, used once by uploadBuffers
+	bool _preparedOptimization;
+	CompactVertices _preparedVertices;
+
+	static LodChain buildLodChain(std::vector<unsigned int> indices, std::vector<float> points);
+
+	int _lodLevel;
+
+	// per mesh uniform block of the twoside_per_fragment shaders and its last uploaded contents
+	unsigned int _uniformBuffer;
+	MeshUniformBlock _uniformBlock;
+	// whether _prog declares the block, looked up again when the program or its link changes
+	unsigned int _meshBlockProgramId;
+	bool _hasMeshBlock;
 
-	unsigned long long _memorySize;
+	static bool _compactVertexFormat;
+	static bool _meshOptimization;
+	static bool _lodGeneration;
 };
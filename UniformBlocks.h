@@ -0,0 +1,155 @@
+#pragma once
+
+#include <QMatrix4x4>
+#include <QVector3D>
+#include <QVector4D>
+#include <cstddef>
+#include <cstring>
+
+// Host side copies of the std140 uniform blocks declared by the twoside_per_fragment
+// shaders. Member order and padding follow the GLSL declarations, vec3 and every
+// struct start on 16 bytes and a mat3 is stored as three padded columns
+
+// Camera and viewport, updated once per view
+struct FrameUniformBlock
+{
+	static const unsigned int BINDING = 0;
+
+	float viewMatrix[16];
+	float modelViewMatrix[16];
+	float projectionMatrix[16];
+	float viewportMatrix[16];
+	float lightSpaceMatrix[16];
+	float normalMatrix[12];
+	float cameraPos[3];
+	float pad0;
+	float lightPos[3];
+	int displayMode;
+};
+
+// Lights and display flags of the fragment shader, updated once per view
+struct LightingUniformBlock
+{
+	static const unsigned int BINDING = 1;
+
+	float lightAmbient[4];
+	float lightDiffuse[4];
+	float lightSpecular[4];
+	float lightPosition[4];
+	float lightModelAmbient[4];
+	float lineWidth;
+	float pad0[3];
+	float lineColor[4];
+	int shadowsEnabled;
+	int lockLightAndCamera;
+	int hdrToneMapping;
+	int gammaCorrection;
+	float screenGamma;
+	int shIrradiance;
+	float pad1[2];
+	float irradianceSH[9][4];
+};
+
+// Transformation, material and texture map flags of a mesh, uploaded only when they change
+struct MeshUniformBlock
+{
+	static const unsigned int BINDING = 2;
+
+	float meshMatrix[16];
+	float meshNormalMatrix[12];
+	// Material
+	float emission[3];
+	float pad0;
+	float ambient[3];
+	float pad1;
+	float diffuse[3];
+	float pad2;
+	float specular[3];
+	float shininess;
+	int metallic;
+	float pad3[3];
+	// PBRLighting
+	float albedo[3];
+	float metalness;
+	float roughness;
+	float ambientOcclusion;
+	float pad4[2];
+
+	float opacity;
+	float heightScale;
+	int compactVertexFormat;
+	int texEnabled;
+	int hasDiffuseTexture;
+	int hasSpecularTexture;
+	int hasEmissiveTexture;
+	int hasNormalTexture;
+	int hasHeightTexture;
+	int hasOpacityTexture;
+	int opacityTextureInverted;
+	int hasAlbedoMap;
+	int hasMetallicMap;
+	int hasRoughnessMap;
+	int hasNormalMap;
+	int hasAOMap;
+	int hasHeightMap;
+	int hasOpacityMap;
+	int opacityMapInverted;
+	int selected;
+	int hovered;
+	float pad5[3];
+};
+
+// Model matrix, clip planes and shading switches that change between the passes of a view
+struct PassUniformBlock
+{
+	static const unsigned int BINDING = 3;
+
+	float modelMatrix[16];
+	float clipPlaneX[4];
+	float clipPlaneY[4];
+	float clipPlaneZ[4];
+	float clipPlane[4];
+	int renderingMode;
+	int envMapEnabled;
+	int floorRendering;
+	int sectionActive;
+	float shadowSamples;
+	float pad0[3];
+};
+
+static_assert(offsetof(FrameUniformBlock, cameraPos) == 368 && offsetof(FrameUniformBlock, displayMode) == 396, "FrameBlock layout");
+static_assert(offsetof(LightingUniformBlock, lineColor) == 96 && offsetof(LightingUniformBlock, screenGamma) == 128 &&
+	offsetof(LightingUniformBlock, irradianceSH) == 144 && sizeof(LightingUniformBlock) == 288, "LightingBlock layout");
+static_assert(offsetof(MeshUniformBlock, emission) == 112 && offsetof(MeshUniformBlock, albedo) == 192 &&
+	offsetof(MeshUniformBlock, opacity) == 224 && offsetof(MeshUniformBlock, hovered) == 304, "MeshBlock layout");
+static_assert(offsetof(PassUniformBlock, renderingMode) == 128 && offsetof(PassUniformBlock, shadowSamples) == 144, "PassBlock layout");
+
+inline void storeStd140(float* dst, const QMatrix4x4& m)
+{
+	memcpy(dst, m.constData(), 16 * sizeof(float));
+}
+
+inline void storeStd140(float* dst, const QMatrix3x3& m)
+{
+	for (int c = 0; c < 3; c++)
+	{
+		for (int r = 0; r < 3; r++)
+			dst[4 * c + r] = m(r, c);
+		dst[4 * c + 3] = 0.0f;
+	}
+}
+
+inline void storeStd140(float* dst, const QVector4D& v)
+{
+	dst[0] = v.x();
+	dst[1] = v.y();
+	dst[2] = v.z();
+	dst[3] = v.w();
+}
+
+inline void storeStd140(float* dst, const QVector3D& v)
+{
+	dst[0] = v.x();
+	dst[1] = v.y();
+	dst[2] = v.z();
+}
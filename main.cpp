@@ -19,6 +19,8 @@ int main(int argc, char** argv)
 	QCoreApplication::setOrganizationName("Sharjith N");
     QCoreApplication::setApplicationVersion(QT_VERSION_STR);
     QApplication::setAttribute(Qt::AA_DisableHighDpiScaling);
+    // textures of the shared cache are used by every viewer
+    QApplication::setAttribute(Qt::AA_ShareOpenGLContexts);
 
     QApplication app(argc, argv);
 
@@ -3,6 +3,7 @@
 layout(location = 0) in vec3 vertexPosition;
 
 uniform mat4 modelMatrix;
+uniform mat4 meshMatrix;
 uniform mat4 viewMatrix;
 uniform mat4 projectionMatrix;
 
@@ -19,12 +20,13 @@ out float v_clipDist;
 
 void main()
 {
-    gl_Position = projectionMatrix * viewMatrix * modelMatrix * vec4(vertexPosition, 1);
+    vec4 eyePosition = viewMatrix * modelMatrix * meshMatrix * vec4(vertexPosition, 1);
+    gl_Position = projectionMatrix * eyePosition;
 
-    v_clipDistX = dot(clipPlaneX, viewMatrix * modelMatrix * vec4(vertexPosition, 1));
-    v_clipDistY = dot(clipPlaneY, viewMatrix * modelMatrix* vec4(vertexPosition, 1));
-    v_clipDistZ = dot(clipPlaneZ, viewMatrix * modelMatrix* vec4(vertexPosition, 1));
-    v_clipDist =  dot(clipPlane, viewMatrix * modelMatrix* vec4(vertexPosition, 1));
+    v_clipDistX = dot(clipPlaneX, eyePosition);
+    v_clipDistY = dot(clipPlaneY, eyePosition);
+    v_clipDistZ = dot(clipPlaneZ, eyePosition);
+    v_clipDist =  dot(clipPlane, eyePosition);
 
     gl_ClipDistance[0] = v_clipDistX;
     gl_ClipDistance[1] = v_clipDistY;
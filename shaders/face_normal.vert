@@ -8,6 +8,7 @@ out VS_OUT {
 } vs_out;
 
 uniform mat4 modelViewMatrix;
+uniform mat4 meshMatrix;
 uniform mat4 projectionMatrix;
 uniform vec4 clipPlaneX;
 uniform vec4 clipPlaneY;
@@ -22,12 +23,14 @@ out float clipDist;
 
 void main()
 {
-    mat3 normalMatrix = mat3(transpose(inverse(modelViewMatrix)));
+    mat4 meshModelViewMatrix = modelViewMatrix * meshMatrix;
+    mat3 normalMatrix = mat3(transpose(inverse(meshModelViewMatrix)));
     vs_out.normal = normalize(vec3(projectionMatrix * vec4(normalMatrix * vertexNormal, 0.0)));
-    gl_Position = projectionMatrix * modelViewMatrix * vec4(vertexPosition, 1.0);
+    vec4 eyePosition = meshModelViewMatrix * vec4(vertexPosition, 1.0);
+    gl_Position = projectionMatrix * eyePosition;
 
-    clipDistX = dot(clipPlaneX, modelViewMatrix* vec4(vertexPosition, 1));
-    clipDistY = dot(clipPlaneY, modelViewMatrix* vec4(vertexPosition, 1));
-    clipDistZ = dot(clipPlaneZ, modelViewMatrix* vec4(vertexPosition, 1));
-    clipDist = dot(clipPlane, modelViewMatrix* vec4(vertexPosition, 1));
+    clipDistX = dot(clipPlaneX, eyePosition);
+    clipDistY = dot(clipPlaneY, eyePosition);
+    clipDistZ = dot(clipPlaneZ, eyePosition);
+    clipDist = dot(clipPlane, eyePosition);
 }
\ No newline at end of file
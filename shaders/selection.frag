@@ -1,10 +1,11 @@
 #version 450 core
 
-uniform vec4 pickingColor;
+// mesh index + 1 and triangle index + 1, zero where nothing was drawn
+uniform uint objectId;
 
-out vec4 fragColor;
+layout(location = 0) out uvec2 objectID;
 
 void main()
 {
-    fragColor = pickingColor;
+    objectID = uvec2(objectId, uint(gl_PrimitiveID) + 1u);
 } 
@@ -3,9 +3,10 @@
 layout(location = 0) in vec3 vertexPosition;
 
 uniform mat4 modelViewMatrix;
+uniform mat4 meshMatrix;
 uniform mat4 projectionMatrix;
 
 void main()
 {
-    gl_Position = projectionMatrix * modelViewMatrix * vec4(vertexPosition, 1);
+    gl_Position = projectionMatrix * modelViewMatrix * meshMatrix * vec4(vertexPosition, 1);
 }
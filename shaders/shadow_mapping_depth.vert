@@ -3,8 +3,9 @@ layout (location = 0) in vec3 aPos;
 
 uniform mat4 lightSpaceMatrix;
 uniform mat4 model;
+uniform mat4 meshMatrix;
 
 void main()
 {
-    gl_Position = lightSpaceMatrix * model * vec4(aPos, 1.0);
+    gl_Position = lightSpaceMatrix * model * meshMatrix * vec4(aPos, 1.0);
 }
\ No newline at end of file
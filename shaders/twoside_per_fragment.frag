@@ -23,8 +23,6 @@ in GS_OUT_SHADOW {
     vec3 lightPos;
 } fs_in_shadow;
 
-uniform float opacity;
-uniform bool texEnabled;
 uniform sampler2D texUnit;
 
 // ADS light maps
@@ -34,13 +32,6 @@ uniform sampler2D texture_emissive;
 uniform sampler2D texture_normal;
 uniform sampler2D texture_height;
 uniform sampler2D texture_opacity;
-uniform bool hasDiffuseTexture = false;
-uniform bool hasSpecularTexture = false;
-uniform bool hasEmissiveTexture = false;
-uniform bool hasNormalTexture = false;
-uniform bool hasHeightTexture = false;
-uniform bool hasOpacityTexture = false;
-uniform bool opacityTextureInverted = false;
 
 uniform samplerCube envMap;
 uniform sampler2D shadowMap;
@@ -57,31 +48,8 @@ uniform sampler2D roughnessMap;
 uniform sampler2D heightMap;
 uniform sampler2D aoMap;
 uniform sampler2D opacityMap;
-uniform bool hasAlbedoMap;
-uniform bool hasMetallicMap;
-uniform bool hasRoughnessMap;
-uniform bool hasNormalMap;
-uniform bool hasAOMap;
-uniform bool hasHeightMap;
-uniform float heightScale;
-uniform bool hasOpacityMap;
-uniform bool opacityMapInverted = false;
-
-uniform bool envMapEnabled;
-uniform bool shadowsEnabled;
-uniform float shadowSamples;
-uniform vec3 cameraPos;
-uniform mat4 viewMatrix;
-uniform bool sectionActive;
-uniform int displayMode;
-uniform int renderingMode;
-uniform bool selected;
+
 uniform vec4 reflectColor;
-uniform bool floorRendering;
-uniform bool lockLightAndCamera = true;
-uniform bool hdrToneMapping = false;
-uniform bool gammaCorrection = false;
-uniform float screenGamma = 2.2;
 
 struct LineInfo
 {
@@ -89,8 +57,6 @@ struct LineInfo
     vec4 Color;
 };
 
-uniform LineInfo Line;
-
 struct LightSource
 {
     vec3 ambient;
@@ -98,13 +64,11 @@ struct LightSource
     vec3 specular;
     vec3 position;
 };
-uniform LightSource lightSource;
 
 struct LightModel
 {
     vec3 ambient;
 };
-uniform LightModel lightModel;
 
 struct Material {
     vec3  emission;
@@ -114,7 +78,6 @@ struct Material {
     float shininess;
     bool  metallic;
 };
-uniform Material material;
 
 struct PBRLighting {
     vec3 albedo;
@@ -122,7 +85,105 @@ struct PBRLighting {
     float roughness;
     float ambientOcclusion;
 };
-uniform PBRLighting pbrLighting;
+
+// the blocks below are mirrored by UniformBlocks.h
+layout(std140, binding = 0) uniform FrameBlock
+{
+    mat4 viewMatrix;
+    mat4 modelViewMatrix;
+    mat4 projectionMatrix;
+    mat4 viewportMatrix;
+    mat4 lightSpaceMatrix;
+    mat3 normalMatrix;
+    vec3 cameraPos;
+    vec3 lightPos;
+    int displayMode;
+};
+
+layout(std140, binding = 1) uniform LightingBlock
+{
+    LightSource lightSource;
+    LightModel lightModel;
+    LineInfo Line;
+    bool shadowsEnabled;
+    bool lockLightAndCamera;
+    bool hdrToneMapping;
+    bool gammaCorrection;
+    float screenGamma;
+    // diffuse IBL from spherical harmonics instead of irradianceMap
+    bool shIrradiance;
+    vec4 irradianceSH[9];
+};
+
+layout(std140, binding = 2) uniform MeshBlock
+{
+    mat4 meshMatrix;
+    mat3 meshNormalMatrix;
+    Material material;
+    PBRLighting pbrLighting;
+    float opacity;
+    float heightScale;
+    bool compactVertexFormat;
+    bool texEnabled;
+    bool hasDiffuseTexture;
+    bool hasSpecularTexture;
+    bool hasEmissiveTexture;
+    bool hasNormalTexture;
+    bool hasHeightTexture;
+    bool hasOpacityTexture;
+    bool opacityTextureInverted;
+    bool hasAlbedoMap;
+    bool hasMetallicMap;
+    bool hasRoughnessMap;
+    bool hasNormalMap;
+    bool hasAOMap;
+    bool hasHeightMap;
+    bool hasOpacityMap;
+    bool opacityMapInverted;
+    bool selected;
+    bool hovered;
+};
+
+// state that changes between the passes of a view
+layout(std140, binding = 3) uniform PassBlock
+{
+    mat4 modelMatrix;
+    vec4 clipPlaneX;
+    vec4 clipPlaneY;
+    vec4 clipPlaneZ;
+    // user defined clip plane
+    vec4 clipPlane;
+    int renderingMode;
+    bool envMapEnabled;
+    bool floorRendering;
+    bool sectionActive;
+    float shadowSamples;
+};
+
+// Variants are compiled with some of these defined, the switches they replace
+// become constants and the branches on them are removed by the compiler
+#ifdef DISPLAY_MODE
+#define displayMode DISPLAY_MODE
+#endif
+#ifdef RENDERING_MODE
+#define renderingMode RENDERING_MODE
+#endif
+#ifdef NO_TEXTURE_MAPS
+#define texEnabled false
+#define hasDiffuseTexture false
+#define hasSpecularTexture false
+#define hasEmissiveTexture false
+#define hasNormalTexture false
+#define hasHeightTexture false
+#define hasOpacityTexture false
+#define hasAlbedoMap false
+#define hasMetallicMap false
+#define hasRoughnessMap false
+#define hasNormalMap false
+#define hasAOMap false
+#define hasHeightMap false
+#define hasOpacityMap false
+#endif
 
 const float PI = 3.14159265359;
 
@@ -142,6 +203,7 @@ vec3    fresnelSchlick(float cosTheta, vec3 F0);
 vec3    fresnelSchlickRoughness(float cosTheta, vec3 F0, float roughness);
 vec2    parallaxMapping(vec2 texCoords, vec3 viewDir, sampler2D map);
 vec3    calcBumpedNormal(sampler2D map, vec2 texCoord);
+vec3    irradianceFromSH(vec3 n);
 
 void main()
 {
@@ -224,6 +286,9 @@ void main()
     }
     applyEnvironmentMapping(alpha);
 
+    if(hovered && !floorRendering)
+        fragColor.rgb = mix(fragColor.rgb, vec3(1.0f, 0.6392156862745098f, 0.396078431372549f), 0.35f);
+
     if(selected)
     {
         //vec3 objectColor = vec3(1.0f, 0.65f, 0.0f);
@@ -570,7 +635,7 @@ vec4 calculatePBRLighting(int renderMode, float side) // side 1 = front, -1 = ba
     // this ambient lighting with environment lighting).
     vec3 ambient;
     // ambient lighting (we now use IBL as the ambient term)
-    vec3 irradiance = texture(irradianceMap, N).rgb;
+    vec3 irradiance = shIrradiance ? irradianceFromSH(N) : texture(irradianceMap, N).rgb;
     vec3 diffuse      = irradiance * albedo;
 
     if(displayMode == 3)
@@ -746,6 +811,21 @@ vec3 fresnelSchlickRoughness(float cosTheta, vec3 F0, float roughness)
     return F0 + (max(vec3(1.0 - roughness), F0) - F0) * pow(1.0 - cosTheta, 5.0);
 }
 
+// irradiance / PI from the L2 coefficients, already convolved with the cosine lobe
+vec3 irradianceFromSH(vec3 n)
+{
+    vec3 irradiance = irradianceSH[0].rgb * 0.282095
+        + irradianceSH[1].rgb * 0.488603 * n.y
+        + irradianceSH[2].rgb * 0.488603 * n.z
+        + irradianceSH[3].rgb * 0.488603 * n.x
+        + irradianceSH[4].rgb * 1.092548 * n.x * n.y
+        + irradianceSH[5].rgb * 1.092548 * n.y * n.z
+        + irradianceSH[6].rgb * 0.315392 * (3.0 * n.z * n.z - 1.0)
+        + irradianceSH[7].rgb * 1.092548 * n.x * n.z
+        + irradianceSH[8].rgb * 0.546274 * (n.x * n.x - n.y * n.y);
+    return max(irradiance, vec3(0.0));
+}
+
 vec2 parallaxMapping(vec2 texCoords, vec3 viewDir, sampler2D map)
 {
     float height =  texture(map, texCoords).r;
@@ -3,23 +3,84 @@
 layout(location = 0) in vec3 vertexPosition;
 layout(location = 1) in vec3 vertexNormal;
 layout(location = 2) in vec2 texCoord2d;
-layout(location = 3) in vec3 vertexTangent;
+layout(location = 3) in vec4 vertexTangent; // w holds the bitangent sign in the compact format
 layout(location = 4) in vec3 vertexBitangent;
 
-uniform mat4 modelMatrix;
-uniform mat4 viewMatrix;
-uniform mat4 modelViewMatrix;
-uniform mat3 normalMatrix;
-uniform mat4 projectionMatrix;
-uniform vec4 clipPlaneX;
-uniform vec4 clipPlaneY;
-uniform vec4 clipPlaneZ;
-uniform mat4 lightSpaceMatrix;
-uniform vec3 cameraPos;
-uniform vec3 lightPos;
-
-// user defined clip plane
-uniform vec4 clipPlane;
+struct Material {
+    vec3  emission;
+    vec3  ambient;
+    vec3  diffuse;
+    vec3  specular;
+    float shininess;
+    bool  metallic;
+};
+
+struct PBRLighting {
+    vec3 albedo;
+    float metallic;
+    float roughness;
+    float ambientOcclusion;
+};
+
+// the blocks below are mirrored by UniformBlocks.h
+layout(std140, binding = 0) uniform FrameBlock
+{
+    mat4 viewMatrix;
+    mat4 modelViewMatrix;
+    mat4 projectionMatrix;
+    mat4 viewportMatrix;
+    mat4 lightSpaceMatrix;
+    mat3 normalMatrix;
+    vec3 cameraPos;
+    vec3 lightPos;
+    int displayMode;
+};
+
+// per mesh transformation, compactVertexFormat marks the interleaved format without a bitangent attribute
+layout(std140, binding = 2) uniform MeshBlock
+{
+    mat4 meshMatrix;
+    mat3 meshNormalMatrix;
+    Material material;
+    PBRLighting pbrLighting;
+    float opacity;
+    float heightScale;
+    bool compactVertexFormat;
+    bool texEnabled;
+    bool hasDiffuseTexture;
+    bool hasSpecularTexture;
+    bool hasEmissiveTexture;
+    bool hasNormalTexture;
+    bool hasHeightTexture;
+    bool hasOpacityTexture;
+    bool opacityTextureInverted;
+    bool hasAlbedoMap;
+    bool hasMetallicMap;
+    bool hasRoughnessMap;
+    bool hasNormalMap;
+    bool hasAOMap;
+    bool hasHeightMap;
+    bool hasOpacityMap;
+    bool opacityMapInverted;
+    bool selected;
+    bool hovered;
+};
+
+// state that changes between the passes of a view
+layout(std140, binding = 3) uniform PassBlock
+{
+    mat4 modelMatrix;
+    vec4 clipPlaneX;
+    vec4 clipPlaneY;
+    vec4 clipPlaneZ;
+    // user defined clip plane
+    vec4 clipPlane;
+    int renderingMode;
+    bool envMapEnabled;
+    bool floorRendering;
+    bool sectionActive;
+    float shadowSamples;
+};
 
 out float v_clipDistX;
 out float v_clipDistY;
@@ -49,36 +110,41 @@ out VS_OUT_SHADOW {
 
 void main()
 {
-    v_normal     = normalize(normalMatrix * vertexNormal);                       // normal vector
+    mat4 model = modelMatrix * meshMatrix;
+    mat3 normalModel = mat3(transpose(inverse(model)));
+    vec4 eyePosition = modelViewMatrix * meshMatrix * vec4(vertexPosition, 1);
+
+    v_normal     = normalize(normalMatrix * meshNormalMatrix * vertexNormal);    // normal vector
     //v_normal = mat3(transpose(inverse(modelMatrix))) * vertexNormal;
-    v_position   = vec3(modelMatrix * vec4(vertexPosition, 1));              // vertex pos in eye coords
+    v_position   = vec3(model * vec4(vertexPosition, 1));                    // vertex pos in eye coords
     v_texCoord2d = texCoord2d;
-    v_tangent = normalize(normalMatrix * vertexTangent);
-    v_bitangent = normalize(normalMatrix * vertexBitangent);
+    vec3 bitangent = compactVertexFormat ? cross(vertexNormal, vertexTangent.xyz) * vertexTangent.w : vertexBitangent;
+    v_tangent = normalize(normalMatrix * meshNormalMatrix * vertexTangent.xyz);
+    v_bitangent = normalize(normalMatrix * meshNormalMatrix * bitangent);
 
-    gl_Position = projectionMatrix * viewMatrix * modelMatrix * vec4(vertexPosition, 1);
+    gl_Position = projectionMatrix * viewMatrix * model * vec4(vertexPosition, 1);
 
-    v_clipDistX = dot(clipPlaneX, modelViewMatrix* vec4(vertexPosition, 1));
-    v_clipDistY = dot(clipPlaneY, modelViewMatrix* vec4(vertexPosition, 1));
-    v_clipDistZ = dot(clipPlaneZ, modelViewMatrix* vec4(vertexPosition, 1));
-    v_clipDist = dot(clipPlane, modelViewMatrix* vec4(vertexPosition, 1));
+    v_clipDistX = dot(clipPlaneX, eyePosition);
+    v_clipDistY = dot(clipPlaneY, eyePosition);
+    v_clipDistZ = dot(clipPlaneZ, eyePosition);
+    v_clipDist = dot(clipPlane, eyePosition);
 
     // Shadow mapping
-    vs_out_shadow.FragPos = vec3(modelMatrix * vec4(vertexPosition, 1.0));
-    vs_out_shadow.Normal = normalize(mat3(transpose(inverse(modelMatrix))) * vertexNormal);
+    vs_out_shadow.FragPos = vec3(model * vec4(vertexPosition, 1.0));
+    vs_out_shadow.Normal = normalize(normalModel * vertexNormal);
     vs_out_shadow.TexCoords = v_texCoord2d;
     vs_out_shadow.FragPosLightSpace = lightSpaceMatrix * vec4(vs_out_shadow.FragPos, 1.0);
     vs_out_shadow.cameraPos = cameraPos;
     vs_out_shadow.lightPos = lightPos;
 
     // Cube environment mapping
-    v_reflectionPosition = vec3(modelMatrix * vec4(vertexPosition, 1.0));
-    v_reflectionNormal = normalize(mat3(transpose(inverse(modelMatrix))) * vertexNormal);
+    v_reflectionPosition = vec3(model * vec4(vertexPosition, 1.0));
+    v_reflectionNormal = normalize(normalModel * vertexNormal);
 
     // Depth mapping
-    vec3 T = normalize((mat3(modelViewMatrix)) * vertexTangent);
-    //vec3 B = normalize((mat3(modelViewMatrix)) * vertexBitangent);
-    vec3 N = normalize((mat3(modelViewMatrix)) * vertexNormal);
+    vec3 T = normalize((mat3(modelViewMatrix * meshMatrix)) * vertexTangent.xyz);
+    //vec3 B = normalize((mat3(modelViewMatrix * meshMatrix)) * vertexBitangent);
+    vec3 N = normalize((mat3(modelViewMatrix * meshMatrix)) * vertexNormal);
     vec3 B = cross(N, T);
     if (dot(cross(N, T), B) < 0.0f)
     {